@@ -0,0 +1,189 @@
+/**
+ * @file aggregate.h
+ * @brief Streaming aggregation of telegrams into demand windows and tariff periods, with constant memory
+ * @copyright Copyright (c) 2023
+ * 
+ */
+
+// Multiple inclusion protection
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_check.h"
+
+#include "obis.h"
+
+/* ===== AGGREGATION CONFIGURATION ===== */
+#define AGGREGATE_WINDOW_S              900         /* < Demand window, aligned to the clock of the meter */
+#define AGGREGATE_MAX_GAP_S             60          /* < Samples further apart don't define the start energy of a window */
+#define AGGREGATE_MAX_TARIFFS           4           /* < Number of tariffs, tariff 0 applies if no window matches */
+#define AGGREGATE_MAX_TARIFF_WINDOWS    8           /* < Number of configured tariff windows */
+
+/* Flags returned by aggregate_add */
+#define AGGREGATE_WINDOW_CLOSED         0x01        /* < Demand window is complete */
+#define AGGREGATE_PERIOD_CLOSED         0x02        /* < Tariff changed */
+
+/* Local time of the meter in which a tariff applies */
+typedef struct {
+    uint8_t tariff;                     /* < Index of tariff, less than AGGREGATE_MAX_TARIFFS */
+    uint8_t weekdays;                   /* < Bit 0 = Monday ... bit 6 = Sunday */
+    uint16_t start_minute;              /* < Minute of day, included */
+    uint16_t end_minute;                /* < Minute of day, excluded, lower than start_minute if window wraps midnight */
+} aggregate_tariff_window_t;
+
+/* Values of one telegram */
+typedef struct {
+    uint32_t time;                      /* < Meter time in seconds since 1970-01-01 UTC */
+    uint16_t minute_of_day;             /* < Local time of meter */
+    uint8_t weekday;                    /* < Local time of meter, 0 = Monday */
+    uint32_t energy_delivered;          /* < Active energy A+ in Wh */
+    uint32_t energy_received;           /* < Active energy A- in Wh */
+    int32_t active_power;               /* < A+ minus A- in W */
+    uint16_t voltage[3];                /* < Voltage L1-L3 in 0.1 V */
+    uint16_t current[3];                /* < Current L1-L3 in 0.01 A */
+} aggregate_sample_t;
+
+/* Minimum, maximum and sum of one phase value */
+typedef struct {
+    uint16_t min;
+    uint16_t max;
+    uint32_t sum;
+} aggregate_range_t;
+
+/* Closed demand window */
+typedef struct {
+    uint32_t start_time;                /* < Start of window in seconds since 1970-01-01 UTC */
+    uint16_t duration;                  /* < Seconds covered by the energy difference, shorter after gaps */
+    uint16_t sample_count;              /* < Number of telegrams in window */
+    uint8_t tariff;                     /* < Tariff at start of window */
+    uint32_t demand_delivered;          /* < Average power of A+ in W, from energy difference */
+    uint32_t demand_received;           /* < Average power of A- in W, from energy difference */
+    int32_t average_power;              /* < Mean of active power of the telegrams in W */
+    uint16_t voltage_min[3];            /* < Voltage L1-L3 in 0.1 V */
+    uint16_t voltage_mean[3];
+    uint16_t voltage_max[3];
+    uint16_t current_min[3];            /* < Current L1-L3 in 0.01 A */
+    uint16_t current_mean[3];
+    uint16_t current_max[3];
+} aggregate_window_t;
+
+/* Closed tariff period */
+typedef struct {
+    uint8_t tariff;                     /* < Index of tariff */
+    uint32_t start_time;                /* < First telegram of period */
+    uint32_t end_time;                  /* < First telegram of next period */
+    uint32_t energy_delivered;          /* < A+ in Wh during period */
+    uint32_t energy_received;           /* < A- in Wh during period */
+} aggregate_period_t;
+
+/* State of aggregation, size doesn't depend on the number of telegrams */
+typedef struct {
+    aggregate_tariff_window_t tariff_windows[AGGREGATE_MAX_TARIFF_WINDOWS];
+    size_t tariff_window_count;
+
+    /* Last telegram */
+    bool has_last;
+    aggregate_sample_t last;
+
+    /* Current demand window */
+    uint32_t window_index;              /* < Start time divided by AGGREGATE_WINDOW_S */
+    uint32_t window_energy_time;        /* < Time of energy reference, last telegram of previous window if close enough */
+    uint32_t window_energy_delivered;
+    uint32_t window_energy_received;
+    uint8_t window_tariff;
+    uint16_t window_count;
+    int64_t window_power_sum;
+    aggregate_range_t voltage[3];
+    aggregate_range_t current[3];
+
+    /* Current tariff period */
+    uint8_t tariff;
+    uint32_t period_start_time;
+    uint32_t period_energy_delivered;
+    uint32_t period_energy_received;
+
+    /* Energy per tariff since start of counting */
+    uint64_t tier_delivered[AGGREGATE_MAX_TARIFFS];
+    uint64_t tier_received[AGGREGATE_MAX_TARIFFS];
+} aggregate_t;
+
+/**
+ * @brief Initialize aggregation
+ * 
+ * @param aggregate state
+ * @param tariff_windows tariff windows, first matching window defines the tariff
+ * @param tariff_window_count number of tariff windows, at most AGGREGATE_MAX_TARIFF_WINDOWS
+ * @return esp_err_t ESP_ERR_INVALID_ARG on invalid tariff windows
+ */
+esp_err_t aggregate_init(aggregate_t *aggregate, const aggregate_tariff_window_t *tariff_windows, size_t tariff_window_count);
+
+/**
+ * @brief Convert decoded telegram into sample
+ * 
+ * @param data decoded telegram
+ * @param sample sample
+ * @return esp_err_t ESP_FAIL if telegram has no valid time
+ */
+esp_err_t aggregate_sample_from_obis(const obis_data_t *data, aggregate_sample_t *sample);
+
+/**
+ * @brief Tariff which applies at local time of sample
+ * 
+ * @param aggregate state
+ * @param sample sample
+ * @return uint8_t index of tariff
+ */
+uint8_t aggregate_get_tariff(const aggregate_t *aggregate, const aggregate_sample_t *sample);
+
+/**
+ * @brief Add telegram, closes window or tariff period if the telegram belongs to a new one
+ * 
+ * @note Energy between two telegrams is counted for the tariff of the later telegram
+ * 
+ * @param aggregate state
+ * @param sample values of telegram
+ * @param window closed window, valid if AGGREGATE_WINDOW_CLOSED is returned
+ * @param period closed tariff period, valid if AGGREGATE_PERIOD_CLOSED is returned
+ * @return uint32_t AGGREGATE_WINDOW_CLOSED and AGGREGATE_PERIOD_CLOSED flags
+ */
+uint32_t aggregate_add(aggregate_t *aggregate, const aggregate_sample_t *sample, aggregate_window_t *window, aggregate_period_t *period);
+
+/**
+ * @brief Set energy per tariff, e.g. after loading it from NVS
+ * 
+ * @param aggregate state
+ * @param delivered A+ in Wh per tariff
+ * @param received A- in Wh per tariff
+ */
+void aggregate_set_tiers(aggregate_t *aggregate, const uint64_t *delivered, const uint64_t *received);
+
+/* ===== NVS STORAGE ===== */
+#define AGGREGATE_NVS_NAMESPACE         "aggregate"     /* < NVS namespace of energy per tariff */
+#define AGGREGATE_NVS_KEY               "tiers"         /* < NVS key of energy per tariff */
+
+/**
+ * @brief Load energy per tariff from NVS, NVS must be initialized
+ * 
+ * @param aggregate state
+ * @return esp_err_t ESP_ERR_NOT_FOUND if nothing was stored
+ */
+esp_err_t aggregate_load_tiers(aggregate_t *aggregate);
+
+/**
+ * @brief Store energy per tariff to NVS, called at end of each tariff period
+ * 
+ * @param aggregate state
+ * @return esp_err_t 
+ */
+esp_err_t aggregate_store_tiers(const aggregate_t *aggregate);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
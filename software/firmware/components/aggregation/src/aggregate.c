@@ -0,0 +1,212 @@
+/**
+ * @file aggregate.c
+ * 
+ * @copyright Copyright (c) 2023
+ * 
+ */
+
+#include <string.h>
+
+/* Header */
+#include "aggregate.h"
+
+#define MINUTES_PER_DAY                 1440
+#define SECONDS_PER_DAY                 86400
+
+/* ===== HELPER FUNCTIONS ===== */
+/* Counters only increase, a lower value (e.g. other meter) adds nothing */
+static uint32_t energy_difference(uint32_t from, uint32_t to)
+{
+    return to >= from ? to - from : 0;
+}
+
+static void start_window(aggregate_t *aggregate, uint32_t index, const aggregate_sample_t *reference, uint8_t tariff)
+{
+    aggregate->window_index = index;
+    aggregate->window_energy_time = reference->time;
+    aggregate->window_energy_delivered = reference->energy_delivered;
+    aggregate->window_energy_received = reference->energy_received;
+    aggregate->window_tariff = tariff;
+    aggregate->window_count = 0;
+    aggregate->window_power_sum = 0;
+    for(int i = 0; i < 3; i++)
+    {
+        aggregate->voltage[i] = (aggregate_range_t){.min = UINT16_MAX, .max = 0, .sum = 0};
+        aggregate->current[i] = (aggregate_range_t){.min = UINT16_MAX, .max = 0, .sum = 0};
+    }
+}
+
+static void add_range(aggregate_range_t *range, uint16_t value)
+{
+    if(value < range->min){ range->min = value; }
+    if(value > range->max){ range->max = value; }
+    range->sum += value;
+}
+
+static void add_to_window(aggregate_t *aggregate, const aggregate_sample_t *sample)
+{
+    aggregate->window_count++;
+    aggregate->window_power_sum += sample->active_power;
+    for(int i = 0; i < 3; i++)
+    {
+        add_range(&aggregate->voltage[i], sample->voltage[i]);
+        add_range(&aggregate->current[i], sample->current[i]);
+    }
+}
+
+/* Window ends with last telegram */
+static void close_window(const aggregate_t *aggregate, aggregate_window_t *window)
+{
+    const aggregate_sample_t *last = &aggregate->last;
+    uint32_t duration = last->time - aggregate->window_energy_time;
+
+    memset(window, 0, sizeof(aggregate_window_t));
+    window->start_time = aggregate->window_index * AGGREGATE_WINDOW_S;
+    window->duration = (uint16_t)duration;
+    window->sample_count = aggregate->window_count;
+    window->tariff = aggregate->window_tariff;
+    if(duration > 0)
+    {
+        window->demand_delivered = (uint32_t)((uint64_t)energy_difference(aggregate->window_energy_delivered, last->energy_delivered) * 3600 / duration);
+        window->demand_received = (uint32_t)((uint64_t)energy_difference(aggregate->window_energy_received, last->energy_received) * 3600 / duration);
+    }
+    window->average_power = (int32_t)(aggregate->window_power_sum / aggregate->window_count);
+    for(int i = 0; i < 3; i++)
+    {
+        window->voltage_min[i] = aggregate->voltage[i].min;
+        window->voltage_mean[i] = (uint16_t)(aggregate->voltage[i].sum / aggregate->window_count);
+        window->voltage_max[i] = aggregate->voltage[i].max;
+        window->current_min[i] = aggregate->current[i].min;
+        window->current_mean[i] = (uint16_t)(aggregate->current[i].sum / aggregate->window_count);
+        window->current_max[i] = aggregate->current[i].max;
+    }
+}
+
+/* Period starts with energy of the telegram before, energy since then counts for the new tariff */
+static void start_period(aggregate_t *aggregate, const aggregate_sample_t *reference, uint32_t start_time, uint8_t tariff)
+{
+    aggregate->tariff = tariff;
+    aggregate->period_start_time = start_time;
+    aggregate->period_energy_delivered = reference->energy_delivered;
+    aggregate->period_energy_received = reference->energy_received;
+}
+
+/* ===== AGGREGATION FUNCTIONS ===== */
+esp_err_t aggregate_init(aggregate_t *aggregate, const aggregate_tariff_window_t *tariff_windows, size_t tariff_window_count)
+{
+    if(tariff_window_count > AGGREGATE_MAX_TARIFF_WINDOWS){ return ESP_ERR_INVALID_ARG; }
+    for(size_t i = 0; i < tariff_window_count; i++)
+    {
+        const aggregate_tariff_window_t *tariff_window = &tariff_windows[i];
+        if(tariff_window->tariff >= AGGREGATE_MAX_TARIFFS || tariff_window->start_minute >= MINUTES_PER_DAY || tariff_window->end_minute > MINUTES_PER_DAY)
+        {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+
+    memset(aggregate, 0, sizeof(aggregate_t));
+    memcpy(aggregate->tariff_windows, tariff_windows, tariff_window_count * sizeof(aggregate_tariff_window_t));
+    aggregate->tariff_window_count = tariff_window_count;
+    return ESP_OK;
+}
+
+esp_err_t aggregate_sample_from_obis(const obis_data_t *data, aggregate_sample_t *sample)
+{
+    memset(sample, 0, sizeof(aggregate_sample_t));
+    if(obis_timestamp_to_unix(data->timestamp, &sample->time) != ESP_OK)
+    {
+        return ESP_FAIL;
+    }
+
+    /* Local time, deviation is local time minus UTC in minutes with inverted sign */
+    int16_t deviation = (int16_t)((data->timestamp[9] << 8) | data->timestamp[10]);
+    int64_t local_time = (int64_t)sample->time - (deviation != (int16_t)0x8000 ? deviation * 60 : 0);
+    sample->minute_of_day = (uint16_t)(data->timestamp[5] * 60 + data->timestamp[6]);
+    sample->weekday = (uint8_t)((local_time / SECONDS_PER_DAY + 3) % 7);   /* < 1970-01-01 was a thursday */
+
+    sample->energy_delivered = (uint32_t)obis_get_scaled(data, ActiveEnergyPlus, 0, NULL);
+    sample->energy_received = (uint32_t)obis_get_scaled(data, ActiveEnergyMinus, 0, NULL);
+    sample->active_power = (int32_t)(obis_get_scaled(data, ActivePowerPlus, 0, NULL) - obis_get_scaled(data, ActivePowerMinus, 0, NULL));
+    for(int i = 0; i < 3; i++)
+    {
+        sample->voltage[i] = (uint16_t)obis_get_scaled(data, obis_voltage_types[i], -1, NULL);
+        sample->current[i] = (uint16_t)obis_get_scaled(data, obis_current_types[i], -2, NULL);
+    }
+    return ESP_OK;
+}
+
+uint8_t aggregate_get_tariff(const aggregate_t *aggregate, const aggregate_sample_t *sample)
+{
+    for(size_t i = 0; i < aggregate->tariff_window_count; i++)
+    {
+        const aggregate_tariff_window_t *tariff_window = &aggregate->tariff_windows[i];
+        if((tariff_window->weekdays & (1 << sample->weekday)) == 0){ continue; }
+
+        uint16_t minute = sample->minute_of_day;
+        bool inside = tariff_window->start_minute <= tariff_window->end_minute
+            ? minute >= tariff_window->start_minute && minute < tariff_window->end_minute
+            : minute >= tariff_window->start_minute || minute < tariff_window->end_minute;
+        if(inside)
+        {
+            return tariff_window->tariff;
+        }
+    }
+    return 0;
+}
+
+uint32_t aggregate_add(aggregate_t *aggregate, const aggregate_sample_t *sample, aggregate_window_t *window, aggregate_period_t *period)
+{
+    uint32_t flags = 0;
+    uint8_t tariff = aggregate_get_tariff(aggregate, sample);
+    uint32_t index = sample->time / AGGREGATE_WINDOW_S;
+    const aggregate_sample_t *last = &aggregate->last;
+
+    /* First telegram, or clock of meter was set back */
+    if(!aggregate->has_last || sample->time < last->time)
+    {
+        start_period(aggregate, sample, sample->time, tariff);
+        start_window(aggregate, index, sample, tariff);
+        add_to_window(aggregate, sample);
+        aggregate->last = *sample;
+        aggregate->has_last = true;
+        return 0;
+    }
+
+    /* Repeated telegram */
+    if(sample->time == last->time){ return 0; }
+
+    /* Energy since last telegram counts for tariff of this telegram */
+    aggregate->tier_delivered[tariff] += energy_difference(last->energy_delivered, sample->energy_delivered);
+    aggregate->tier_received[tariff] += energy_difference(last->energy_received, sample->energy_received);
+
+    if(tariff != aggregate->tariff)
+    {
+        period->tariff = aggregate->tariff;
+        period->start_time = aggregate->period_start_time;
+        period->end_time = sample->time;
+        period->energy_delivered = energy_difference(aggregate->period_energy_delivered, last->energy_delivered);
+        period->energy_received = energy_difference(aggregate->period_energy_received, last->energy_received);
+        flags |= AGGREGATE_PERIOD_CLOSED;
+
+        start_period(aggregate, last, sample->time, tariff);
+    }
+
+    if(index != aggregate->window_index)
+    {
+        close_window(aggregate, window);
+        flags |= AGGREGATE_WINDOW_CLOSED;
+
+        /* Energy difference starts at last telegram of previous window, if there was no gap */
+        start_window(aggregate, index, sample->time - last->time <= AGGREGATE_MAX_GAP_S ? last : sample, tariff);
+    }
+
+    add_to_window(aggregate, sample);
+    aggregate->last = *sample;
+    return flags;
+}
+
+void aggregate_set_tiers(aggregate_t *aggregate, const uint64_t *delivered, const uint64_t *received)
+{
+    memcpy(aggregate->tier_delivered, delivered, sizeof(aggregate->tier_delivered));
+    memcpy(aggregate->tier_received, received, sizeof(aggregate->tier_received));
+}
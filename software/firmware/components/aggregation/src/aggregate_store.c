@@ -0,0 +1,73 @@
+/**
+ * @file aggregate_store.c
+ * 
+ * @copyright Copyright (c) 2023
+ * 
+ */
+
+#include <string.h>
+
+/* Setup logging */
+#include "esp_log.h"
+static const char* TAG = "aggregate";
+
+/* Header */
+#include "aggregate.h"
+
+/* System libraries */
+#include "nvs.h"
+
+/* Stored energy per tariff */
+typedef struct {
+    uint64_t delivered[AGGREGATE_MAX_TARIFFS];
+    uint64_t received[AGGREGATE_MAX_TARIFFS];
+} stored_tiers_t;
+
+esp_err_t aggregate_load_tiers(aggregate_t *aggregate)
+{
+    nvs_handle_t handle;
+    if(nvs_open(AGGREGATE_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK)
+    {
+        ESP_LOGI(TAG, "No stored energy per tariff");
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    stored_tiers_t stored;
+    size_t size = sizeof(stored_tiers_t);
+    esp_err_t err = nvs_get_blob(handle, AGGREGATE_NVS_KEY, &stored, &size);
+    nvs_close(handle);
+
+    /* Size differs if number of tariffs changed with a firmware update */
+    if(err != ESP_OK || size != sizeof(stored_tiers_t))
+    {
+        ESP_LOGI(TAG, "No valid stored energy per tariff");
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    aggregate_set_tiers(aggregate, stored.delivered, stored.received);
+    return ESP_OK;
+}
+
+esp_err_t aggregate_store_tiers(const aggregate_t *aggregate)
+{
+    stored_tiers_t stored;
+    memcpy(stored.delivered, aggregate->tier_delivered, sizeof(stored.delivered));
+    memcpy(stored.received, aggregate->tier_received, sizeof(stored.received));
+
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(AGGREGATE_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if(err != ESP_OK){ return err; }
+
+    err = nvs_set_blob(handle, AGGREGATE_NVS_KEY, &stored, sizeof(stored_tiers_t));
+    if(err == ESP_OK)
+    {
+        err = nvs_commit(handle);
+    }
+    nvs_close(handle);
+
+    if(err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Storing energy per tariff failed!");
+    }
+    return err;
+}
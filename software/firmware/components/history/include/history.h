@@ -0,0 +1,134 @@
+/**
+ * @file history.h
+ * @brief Append-only ring log of measurements in flash, written in pages and read back in batches
+ * @copyright Copyright (c) 2023
+ * 
+ */
+
+// Multiple inclusion protection
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_check.h"
+
+#include "flash_ops.h"
+#include "obis.h"
+#include "history_codec.h"
+
+/* ===== HISTORY CONFIGURATION ===== */
+#define HISTORY_PAGE_SIZE               FLASH_OPS_PAGE_SIZE     /* < Records are written one page at a time */
+#define HISTORY_PAGE_MAGIC              0x48495332              /* < "HIS2", increment on format changes */
+#define HISTORY_PAGE_DATA_SIZE          (HISTORY_PAGE_SIZE - sizeof(history_page_header_t))
+#define HISTORY_MAX_RECORDS_PER_PAGE    (HISTORY_PAGE_DATA_SIZE / HISTORY_CODEC_FIELD_COUNT)    /* < Every field needs at least one byte */
+#define HISTORY_MIN_SECTORS             2                       /* < One sector is erased while the others keep data */
+
+/* Header of a page, followed by the encoded records */
+typedef struct {
+    uint32_t magic;                     /* < HISTORY_PAGE_MAGIC */
+    uint32_t sequence;                  /* < Incremented for every page, defines order of the ring */
+    uint8_t count;                      /* < Number of records in page */
+    uint8_t uploaded;                   /* < 0xFF until page was uploaded, then cleared to 0x00 without erase */
+    uint16_t size;                      /* < Size of encoded records */
+    uint32_t crc;                       /* < CRC32 of header without uploaded and crc, and of the encoded records */
+} history_page_header_t;
+
+/* One page as written to flash, first record is a keyframe, so every page is decoded on its own */
+typedef struct {
+    history_page_header_t header;
+    uint8_t data[HISTORY_PAGE_SIZE - sizeof(history_page_header_t)];
+} history_page_t;
+
+_Static_assert(sizeof(history_page_t) == HISTORY_PAGE_SIZE, "history page must fill one flash page");
+_Static_assert(HISTORY_CODEC_MAX_RECORD_SIZE <= HISTORY_PAGE_DATA_SIZE, "keyframe must fit into an empty page");
+
+/* State of the ring */
+typedef struct {
+    flash_ops_t flash;
+    uint32_t page_count;                /* < Number of pages in reserved area */
+    uint32_t head;                      /* < Index of next page to write */
+    uint32_t tail;                      /* < Index of oldest page which wasn't uploaded, equal to head if none */
+    uint32_t sequence;                  /* < Sequence of last written page */
+    uint32_t backlog;                   /* < Number of pages from tail to head */
+    history_page_t buffer;              /* < Records which are not written yet */
+    history_codec_t codec;              /* < Encoder of buffer */
+    uint32_t lost_pages;                /* < Pages overwritten before they were uploaded */
+    uint32_t erase_count;               /* < Sectors erased since initialization */
+} history_t;
+
+/**
+ * @brief Convert decoded telegram into history record
+ * 
+ * @param data decoded telegram
+ * @param frame_counter frame counter of DLMS-Layer
+ * @param record record, time is 0 if the meter sent no valid time
+ */
+void history_record_from_obis(const obis_data_t *data, uint32_t frame_counter, history_record_t *record);
+
+/**
+ * @brief Find head and oldest page which wasn't uploaded
+ * 
+ * @param history ring to initialize
+ * @param flash flash operations of reserved area with at least HISTORY_MIN_SECTORS sectors
+ * @return esp_err_t 
+ */
+esp_err_t history_init(history_t *history, const flash_ops_t *flash);
+
+/**
+ * @brief Append record, a page is written when the next record doesn't fit anymore
+ * 
+ * @note Sectors are erased in ring order, so all sectors wear evenly, oldest pages are overwritten if ring is full
+ * 
+ * @param history ring
+ * @param record record to append
+ * @return esp_err_t 
+ */
+esp_err_t history_append(history_t *history, const history_record_t *record);
+
+/**
+ * @brief Write collected records even if page is not full
+ * 
+ * @param history ring
+ * @return esp_err_t 
+ */
+esp_err_t history_flush(history_t *history);
+
+/**
+ * @brief Number of written pages which weren't uploaded yet
+ * 
+ * @param history ring
+ * @return uint32_t 
+ */
+uint32_t history_backlog(const history_t *history);
+
+/**
+ * @brief Read records of oldest pages which weren't uploaded, in order of writing
+ * 
+ * @param history ring
+ * @param records output array
+ * @param max_records size of output array, at least HISTORY_MAX_RECORDS_PER_PAGE
+ * @param record_count number of read records
+ * @param last_sequence sequence of last read page, pass to history_mark_uploaded
+ * @return esp_err_t ESP_ERR_NOT_FOUND if backlog is empty
+ */
+esp_err_t history_read_batch(history_t *history, history_record_t *records, size_t max_records, size_t *record_count, uint32_t *last_sequence);
+
+/**
+ * @brief Mark oldest pages up to the given sequence as uploaded, by clearing the flag in flash
+ * 
+ * @note Pages overwritten since history_read_batch are skipped
+ * 
+ * @param history ring
+ * @param last_sequence sequence returned by history_read_batch
+ * @return esp_err_t 
+ */
+esp_err_t history_mark_uploaded(history_t *history, uint32_t last_sequence);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,76 @@
+/**
+ * @file history_codec.h
+ * @brief Compact encoding of history records as zig-zag varint differences to the previous record
+ * @copyright Copyright (c) 2023
+ * 
+ */
+
+// Multiple inclusion protection
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_check.h"
+
+/* ===== CODEC CONFIGURATION ===== */
+#define HISTORY_CODEC_FIELD_COUNT       11          /* < Fields of history_record_t */
+#define HISTORY_CODEC_MAX_FIELD_SIZE    5           /* < Difference of two 32 bit values needs 33 bits */
+#define HISTORY_CODEC_MAX_RECORD_SIZE   (HISTORY_CODEC_FIELD_COUNT * HISTORY_CODEC_MAX_FIELD_SIZE)
+
+/* Values of one telegram, all values little endian */
+typedef struct {
+    uint32_t time;                      /* < Meter time in seconds since 1970-01-01 UTC */
+    uint32_t frame_counter;             /* < Frame counter of DLMS-Layer */
+    uint32_t energy_delivered;          /* < Active energy A+ in Wh */
+    uint32_t energy_received;           /* < Active energy A- in Wh */
+    int32_t active_power;               /* < A+ minus A- in W */
+    uint16_t voltage[3];                /* < Voltage L1-L3 in 0.1 V */
+    uint16_t current[3];                /* < Current L1-L3 in 0.01 A */
+} history_record_t;
+
+/* State of encoder or decoder, values of previous record */
+typedef struct {
+    int64_t previous[HISTORY_CODEC_FIELD_COUNT];
+} history_codec_t;
+
+/**
+ * @brief Start new sequence, next record is a keyframe which is decoded without previous records
+ * 
+ * @param codec encoder or decoder
+ */
+void history_codec_reset(history_codec_t *codec);
+
+/**
+ * @brief Encode record as difference to previous record
+ * 
+ * Every field is encoded in order of history_record_t as zig-zag varint, 7 bits per byte
+ * and the highest bit set if another byte follows. Consecutive telegrams mostly differ by
+ * less than 64, so most fields need one byte.
+ * 
+ * @param codec encoder
+ * @param record record to encode
+ * @param buffer output buffer
+ * @param buffer_size size of output buffer
+ * @return size_t encoded size, 0 if buffer is too small, encoder is unchanged then
+ */
+size_t history_codec_encode(history_codec_t *codec, const history_record_t *record, uint8_t *buffer, size_t buffer_size);
+
+/**
+ * @brief Decode record
+ * 
+ * @param codec decoder
+ * @param buffer encoded data
+ * @param buffer_size size of encoded data
+ * @param record decoded record
+ * @return size_t decoded size, 0 on truncated data
+ */
+size_t history_codec_decode(history_codec_t *codec, const uint8_t *buffer, size_t buffer_size, history_record_t *record);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,71 @@
+/**
+ * @file history_log.h
+ * @brief History ring in the history partition, written by a low priority task
+ * @copyright Copyright (c) 2023
+ * 
+ */
+
+// Multiple inclusion protection
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "esp_check.h"
+
+#include "history.h"
+
+/* ===== HISTORY LOG CONFIGURATION ===== */
+#define HISTORY_LOG_PARTITION_LABEL     "history"   /* < Partition with at least HISTORY_MIN_SECTORS sectors */
+#define HISTORY_LOG_PARTITION_SUBTYPE   0x41        /* < Custom data subtype */
+#define HISTORY_LOG_QUEUE_LENGTH        16          /* < Records waiting for the task, more are dropped */
+#define HISTORY_LOG_TASK_PRIORITY       1           /* < Erasing a sector blocks flash access, run below all other tasks */
+#define HISTORY_LOG_TASK_STACK_SIZE     3072
+
+/**
+ * @brief Find oldest record which wasn't uploaded and start task
+ * 
+ * @return esp_err_t ESP_ERR_NOT_FOUND if partition is missing
+ */
+esp_err_t history_log_init();
+
+/**
+ * @brief Queue record for writing, never blocks
+ * 
+ * @param record record of one telegram
+ * @return esp_err_t ESP_ERR_TIMEOUT if queue is full
+ */
+esp_err_t history_log_append(const history_record_t *record);
+
+/**
+ * @brief Number of pages which weren't uploaded yet, including the partial page
+ * 
+ * @return uint32_t 
+ */
+uint32_t history_log_backlog();
+
+/**
+ * @brief Read oldest records on flash which weren't uploaded, the task is asked to write the partial page
+ * 
+ * @note Doesn't wait while the task writes to flash, records of the partial page are returned by a later call
+ * 
+ * @param records output array
+ * @param max_records size of output array
+ * @param record_count number of read records
+ * @param last_sequence pass to history_log_mark_uploaded once the batch is confirmed
+ * @return esp_err_t ESP_ERR_TIMEOUT if ring is busy, ESP_ERR_NOT_FOUND if nothing is left
+ */
+esp_err_t history_log_read_batch(history_record_t *records, size_t max_records, size_t *record_count, uint32_t *last_sequence);
+
+/**
+ * @brief Mark records returned by history_log_read_batch as uploaded
+ * 
+ * @param last_sequence sequence returned by history_log_read_batch
+ * @return esp_err_t ESP_ERR_TIMEOUT if ring is busy, records are sent again
+ */
+esp_err_t history_log_mark_uploaded(uint32_t last_sequence);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,309 @@
+/**
+ * @file history.c
+ * 
+ * @copyright Copyright (c) 2023
+ * 
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+/* Logging */
+#include "esp_log.h"
+static const char* TAG = "HISTORY";
+
+/* Header */
+#include "history.h"
+
+#define PAGES_PER_SECTOR                (FLASH_OPS_SECTOR_SIZE / HISTORY_PAGE_SIZE)
+#define PAGE_OFFSET(index)              ((size_t)(index) * HISTORY_PAGE_SIZE)
+
+/* ===== HELPER FUNCTIONS ===== */
+static uint32_t page_crc(const history_page_t *page)
+{
+    /* Uploaded flag is changed after writing and not part of the checksum */
+    history_page_header_t header = page->header;
+    header.uploaded = 0xFF;
+    uint32_t crc = flash_ops_crc32(0, &header, offsetof(history_page_header_t, crc));
+    return flash_ops_crc32(crc, page->data, page->header.size);
+}
+
+static bool is_valid(const history_page_t *page)
+{
+    return page->header.magic == HISTORY_PAGE_MAGIC && page->header.count > 0 && page->header.count <= HISTORY_MAX_RECORDS_PER_PAGE
+        && page->header.size <= HISTORY_PAGE_DATA_SIZE && page->header.crc == page_crc(page);
+}
+
+static bool is_erased(const history_page_t *page)
+{
+    const uint8_t *bytes = (const uint8_t *)page;
+    for(size_t i = 0; i < sizeof(history_page_t); i++)
+    {
+        if(bytes[i] != 0xFF){ return false; }
+    }
+    return true;
+}
+
+static esp_err_t read_page(history_t *history, uint32_t index, history_page_t *page)
+{
+    return history->flash.read(history->flash.ctx, PAGE_OFFSET(index), page, sizeof(history_page_t));
+}
+
+static uint32_t next_index(const history_t *history, uint32_t index)
+{
+    return (index + 1) % history->page_count;
+}
+
+/* Write buffer to head, erases sector if head is at its start */
+static esp_err_t write_page(history_t *history)
+{
+    if(history->head % PAGES_PER_SECTOR == 0)
+    {
+        /* Pages of this sector which weren't uploaded yet are lost */
+        uint32_t sector_end = history->head + PAGES_PER_SECTOR;
+        while(history->backlog > 0 && history->tail >= history->head && history->tail < sector_end)
+        {
+            history->tail = next_index(history, history->tail);
+            history->backlog--;
+            history->lost_pages++;
+        }
+
+        esp_err_t err = history->flash.erase(history->flash.ctx, PAGE_OFFSET(history->head), FLASH_OPS_SECTOR_SIZE);
+        if(err != ESP_OK){ return err; }
+        history->erase_count++;
+    }
+
+    history_page_t *page = &history->buffer;
+    page->header.magic = HISTORY_PAGE_MAGIC;
+    page->header.sequence = history->sequence + 1;
+    page->header.uploaded = 0xFF;
+    page->header.crc = page_crc(page);
+
+    /* Unused bytes stay erased */
+    memset(&page->data[page->header.size], 0xFF, HISTORY_PAGE_DATA_SIZE - page->header.size);
+
+    esp_err_t err = history->flash.write(history->flash.ctx, PAGE_OFFSET(history->head), page, sizeof(history_page_t));
+    if(err != ESP_OK){ return err; }
+
+    if(history->backlog == 0)
+    {
+        history->tail = history->head;
+    }
+    history->backlog++;
+    history->sequence = page->header.sequence;
+    history->head = next_index(history, history->head);
+
+    /* Next page starts with a keyframe */
+    page->header.count = 0;
+    page->header.size = 0;
+    history_codec_reset(&history->codec);
+    return ESP_OK;
+}
+
+/* ===== RING FUNCTIONS ===== */
+void history_record_from_obis(const obis_data_t *data, uint32_t frame_counter, history_record_t *record)
+{
+    memset(record, 0, sizeof(history_record_t));
+    if(obis_timestamp_to_unix(data->timestamp, &record->time) != ESP_OK)
+    {
+        record->time = 0;
+    }
+    record->frame_counter = frame_counter;
+    record->energy_delivered = (uint32_t)obis_get_scaled(data, ActiveEnergyPlus, 0, NULL);
+    record->energy_received = (uint32_t)obis_get_scaled(data, ActiveEnergyMinus, 0, NULL);
+    record->active_power = (int32_t)(obis_get_scaled(data, ActivePowerPlus, 0, NULL) - obis_get_scaled(data, ActivePowerMinus, 0, NULL));
+    for(int i = 0; i < 3; i++)
+    {
+        record->voltage[i] = (uint16_t)obis_get_scaled(data, obis_voltage_types[i], -1, NULL);
+        record->current[i] = (uint16_t)obis_get_scaled(data, obis_current_types[i], -2, NULL);
+    }
+}
+
+esp_err_t history_init(history_t *history, const flash_ops_t *flash)
+{
+    history_page_t page;
+    bool found = false;
+    uint32_t newest = 0;
+
+    memset(history, 0, sizeof(history_t));
+    history->flash = *flash;
+    history_codec_reset(&history->codec);
+    history->page_count = (uint32_t)(flash->size / HISTORY_PAGE_SIZE);
+    if(flash->size < HISTORY_MIN_SECTORS * FLASH_OPS_SECTOR_SIZE)
+    {
+        ESP_LOGE(TAG, "Reserved area too small");
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    /* Newest page defines head */
+    for(uint32_t index = 0; index < history->page_count; index++)
+    {
+        esp_err_t err = read_page(history, index, &page);
+        if(err != ESP_OK){ return err; }
+
+        if(is_valid(&page) && (!found || (int32_t)(page.header.sequence - history->sequence) > 0))
+        {
+            found = true;
+            newest = index;
+            history->sequence = page.header.sequence;
+        }
+    }
+
+    if(!found)
+    {
+        /* Empty, first write erases first sector */
+        ESP_LOGI(TAG, "No history found");
+        return ESP_OK;
+    }
+
+    /* Skip interrupted writes after newest page, until end of sector */
+    history->head = next_index(history, newest);
+    while(history->head % PAGES_PER_SECTOR != 0)
+    {
+        esp_err_t err = read_page(history, history->head, &page);
+        if(err != ESP_OK){ return err; }
+        if(is_erased(&page)){ break; }
+        history->head = next_index(history, history->head);
+    }
+
+    /* Oldest page which wasn't uploaded, pages are uploaded in order of writing */
+    bool pending = false;
+    uint32_t index = history->head;
+    for(uint32_t i = 0; i < history->page_count; i++)
+    {
+        esp_err_t err = read_page(history, index, &page);
+        if(err != ESP_OK){ return err; }
+
+        if(is_valid(&page) && page.header.uploaded == 0xFF && !pending)
+        {
+            pending = true;
+            history->tail = index;
+        }
+        else if(is_valid(&page) && page.header.uploaded != 0xFF)
+        {
+            pending = false;
+        }
+        index = next_index(history, index);
+    }
+
+    /* Interrupted writes within the backlog are skipped when reading */
+    history->backlog = pending ? (history->head + history->page_count - history->tail - 1) % history->page_count + 1 : 0;
+    if(!pending)
+    {
+        history->tail = history->head;
+    }
+
+    ESP_LOGI(TAG, "History with %lu pages, %lu not uploaded", (unsigned long)history->page_count, (unsigned long)history->backlog);
+    return ESP_OK;
+}
+
+esp_err_t history_append(history_t *history, const history_record_t *record)
+{
+    history_page_t *page = &history->buffer;
+
+    /* Page is written when the next record doesn't fit */
+    size_t size = history_codec_encode(&history->codec, record, &page->data[page->header.size], HISTORY_PAGE_DATA_SIZE - page->header.size);
+    if(size == 0 || page->header.count >= HISTORY_MAX_RECORDS_PER_PAGE)
+    {
+        esp_err_t err = write_page(history);
+        if(err != ESP_OK){ return err; }
+
+        size = history_codec_encode(&history->codec, record, &page->data[0], HISTORY_PAGE_DATA_SIZE);
+    }
+
+    page->header.count++;
+    page->header.size += size;
+    return ESP_OK;
+}
+
+esp_err_t history_flush(history_t *history)
+{
+    if(history->buffer.header.count == 0)
+    {
+        return ESP_OK;
+    }
+    return write_page(history);
+}
+
+uint32_t history_backlog(const history_t *history)
+{
+    return history->backlog;
+}
+
+esp_err_t history_read_batch(history_t *history, history_record_t *records, size_t max_records, size_t *record_count, uint32_t *last_sequence)
+{
+    history_page_t page;
+    uint32_t index = history->tail;
+
+    *record_count = 0;
+    if(history->backlog == 0)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    for(uint32_t i = 0; i < history->backlog; i++)
+    {
+        esp_err_t err = read_page(history, index, &page);
+        if(err != ESP_OK){ return err; }
+
+        /* Interrupted writes have no records */
+        if(is_valid(&page))
+        {
+            if(*record_count + page.header.count > max_records){ break; }
+
+            /* Every page starts with a keyframe */
+            history_codec_t codec;
+            history_codec_reset(&codec);
+            size_t offset = 0;
+            for(uint8_t j = 0; j < page.header.count; j++)
+            {
+                size_t size = history_codec_decode(&codec, &page.data[offset], page.header.size - offset, &records[*record_count + j]);
+                if(size == 0){ return ESP_ERR_INVALID_CRC; }
+                offset += size;
+            }
+            *record_count += page.header.count;
+            *last_sequence = page.header.sequence;
+        }
+        index = next_index(history, index);
+    }
+
+    /* Only interrupted writes left */
+    if(*record_count == 0 && index == history->head)
+    {
+        history->tail = history->head;
+        history->backlog = 0;
+    }
+    return *record_count > 0 ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t history_mark_uploaded(history_t *history, uint32_t last_sequence)
+{
+    history_page_t page;
+
+    while(history->backlog > 0)
+    {
+        esp_err_t err = read_page(history, history->tail, &page);
+        if(err != ESP_OK){ return err; }
+
+        if(is_valid(&page))
+        {
+            /* Newer page, not read by history_read_batch */
+            if((int32_t)(page.header.sequence - last_sequence) > 0){ break; }
+
+            /* Clear flag, count and size keep their value */
+            history_page_header_t header = page.header;
+            header.uploaded = 0x00;
+            err = history->flash.write(history->flash.ctx, PAGE_OFFSET(history->tail) + offsetof(history_page_header_t, count), &header.count, 4);
+            if(err != ESP_OK){ return err; }
+        }
+
+        history->tail = next_index(history, history->tail);
+        history->backlog--;
+    }
+
+    if(history->backlog == 0)
+    {
+        history->tail = history->head;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,84 @@
+/**
+ * @file history_codec.c
+ * 
+ * @copyright Copyright (c) 2023
+ * 
+ */
+
+#include <string.h>
+
+/* Header */
+#include "history_codec.h"
+#include "zb_varint.h"
+
+/* ===== HELPER FUNCTIONS ===== */
+static void get_fields(const history_record_t *record, int64_t *fields)
+{
+    fields[0] = record->time;
+    fields[1] = record->frame_counter;
+    fields[2] = record->energy_delivered;
+    fields[3] = record->energy_received;
+    fields[4] = record->active_power;
+    for(int i = 0; i < 3; i++)
+    {
+        fields[5 + i] = record->voltage[i];
+        fields[8 + i] = record->current[i];
+    }
+}
+
+static void set_fields(history_record_t *record, const int64_t *fields)
+{
+    record->time = (uint32_t)fields[0];
+    record->frame_counter = (uint32_t)fields[1];
+    record->energy_delivered = (uint32_t)fields[2];
+    record->energy_received = (uint32_t)fields[3];
+    record->active_power = (int32_t)fields[4];
+    for(int i = 0; i < 3; i++)
+    {
+        record->voltage[i] = (uint16_t)fields[5 + i];
+        record->current[i] = (uint16_t)fields[8 + i];
+    }
+}
+
+/* ===== CODEC FUNCTIONS ===== */
+void history_codec_reset(history_codec_t *codec)
+{
+    memset(codec, 0, sizeof(history_codec_t));
+}
+
+size_t history_codec_encode(history_codec_t *codec, const history_record_t *record, uint8_t *buffer, size_t buffer_size)
+{
+    int64_t fields[HISTORY_CODEC_FIELD_COUNT];
+    size_t offset = 0;
+
+    get_fields(record, fields);
+    for(int i = 0; i < HISTORY_CODEC_FIELD_COUNT; i++)
+    {
+        size_t size = zb_varint_put(fields[i] - codec->previous[i], &buffer[offset], buffer_size - offset);
+        if(size == 0){ return 0; }
+        offset += size;
+    }
+
+    memcpy(codec->previous, fields, sizeof(fields));
+    return offset;
+}
+
+size_t history_codec_decode(history_codec_t *codec, const uint8_t *buffer, size_t buffer_size, history_record_t *record)
+{
+    int64_t fields[HISTORY_CODEC_FIELD_COUNT];
+    size_t offset = 0;
+
+    for(int i = 0; i < HISTORY_CODEC_FIELD_COUNT; i++)
+    {
+        int64_t difference = 0;
+        size_t available = buffer_size - offset;
+        size_t size = zb_varint_get(&buffer[offset], available < HISTORY_CODEC_MAX_FIELD_SIZE ? available : HISTORY_CODEC_MAX_FIELD_SIZE, &difference);
+        if(size == 0){ return 0; }
+        offset += size;
+        fields[i] = codec->previous[i] + difference;
+    }
+
+    memcpy(codec->previous, fields, sizeof(fields));
+    set_fields(record, fields);
+    return offset;
+}
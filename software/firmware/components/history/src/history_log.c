@@ -0,0 +1,156 @@
+/**
+ * @file history_log.c
+ * 
+ * @copyright Copyright (c) 2023
+ * 
+ */
+
+/* Logging */
+#include "esp_log.h"
+static const char* TAG = "HISTORY_LOG";
+
+/* Header */
+#include "history_log.h"
+
+/* FreeRTOS Libraries */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+/* Item of the queue, a flush request writes the partial page */
+typedef struct {
+    bool flush;
+    history_record_t record;
+} history_log_item_t;
+
+static bool enabled = false;
+static history_t history;
+static QueueHandle_t history_queue = NULL;
+static SemaphoreHandle_t history_mutex = NULL;
+
+/* Flush request is queued, changed with mutex taken */
+static bool flush_requested = false;
+
+/* Written with mutex taken, read without lock */
+static volatile uint32_t backlog = 0;
+
+/* ===== HELPER FUNCTIONS ===== */
+/* Called with mutex taken, a partial page counts as one page */
+static void update_backlog()
+{
+    backlog = history_backlog(&history) + (history.buffer.header.count > 0 ? 1 : 0);
+}
+
+/* ===== TASK ===== */
+static void history_log_task(void *pvParameters)
+{
+    history_log_item_t item;
+    for(;;)
+    {
+        if(xQueueReceive(history_queue, &item, portMAX_DELAY) != pdTRUE){ continue; }
+
+        /* Erasing a sector is only done in this task */
+        xSemaphoreTake(history_mutex, portMAX_DELAY);
+        uint32_t lost_before = history.lost_pages;
+        esp_err_t err;
+        if(item.flush)
+        {
+            err = history_flush(&history);
+            flush_requested = false;
+        }
+        else
+        {
+            err = history_append(&history, &item.record);
+        }
+        uint32_t lost_pages = history.lost_pages;
+        update_backlog();
+        xSemaphoreGive(history_mutex);
+
+        if(err != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Writing %s failed (%s)", item.flush ? "partial page" : "record", esp_err_to_name(err));
+        }
+        if(lost_pages != lost_before)
+        {
+            ESP_LOGW(TAG, "History full, %lu pages overwritten before upload", (unsigned long)lost_pages);
+        }
+    }
+}
+
+/* ===== HISTORY LOG FUNCTIONS ===== */
+esp_err_t history_log_init()
+{
+    flash_ops_t flash;
+    esp_err_t err = flash_ops_partition(HISTORY_LOG_PARTITION_LABEL, HISTORY_LOG_PARTITION_SUBTYPE, &flash);
+    if(err != ESP_OK)
+    {
+        ESP_LOGW(TAG, "No history partition, values are lost while the network is down");
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    err = history_init(&history, &flash);
+    if(err != ESP_OK){ return err; }
+    update_backlog();
+
+    history_queue = xQueueCreate(HISTORY_LOG_QUEUE_LENGTH, sizeof(history_log_item_t));
+    history_mutex = xSemaphoreCreateMutex();
+    if(history_queue == NULL || history_mutex == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    if(xTaskCreate(history_log_task, "history_task", HISTORY_LOG_TASK_STACK_SIZE, NULL, HISTORY_LOG_TASK_PRIORITY, NULL) != pdPASS)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    enabled = true;
+    return ESP_OK;
+}
+
+esp_err_t history_log_append(const history_record_t *record)
+{
+    if(!enabled){ return ESP_ERR_INVALID_STATE; }
+
+    history_log_item_t item = {.flush = false, .record = *record};
+    return xQueueSend(history_queue, &item, 0) == pdTRUE ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+uint32_t history_log_backlog()
+{
+    return backlog;
+}
+
+esp_err_t history_log_read_batch(history_record_t *records, size_t max_records, size_t *record_count, uint32_t *last_sequence)
+{
+    if(!enabled){ return ESP_ERR_NOT_FOUND; }
+
+    /* Caller is the zigbee task, don't wait for a sector erase */
+    if(xSemaphoreTake(history_mutex, 0) != pdTRUE){ return ESP_ERR_TIMEOUT; }
+
+    /* Partial page is written by the task, its records are read by a later call */
+    if(history.buffer.header.count > 0 && !flush_requested)
+    {
+        history_log_item_t item = {.flush = true};
+        flush_requested = xQueueSend(history_queue, &item, 0) == pdTRUE;
+    }
+
+    /* Only pages on flash are read */
+    esp_err_t err = history_read_batch(&history, records, max_records, record_count, last_sequence);
+    xSemaphoreGive(history_mutex);
+
+    return err;
+}
+
+esp_err_t history_log_mark_uploaded(uint32_t last_sequence)
+{
+    if(!enabled){ return ESP_ERR_INVALID_STATE; }
+    if(xSemaphoreTake(history_mutex, 0) != pdTRUE){ return ESP_ERR_TIMEOUT; }
+
+    esp_err_t err = history_mark_uploaded(&history, last_sequence);
+    update_backlog();
+    xSemaphoreGive(history_mutex);
+
+    return err;
+}
@@ -0,0 +1,111 @@
+/**
+ * @file power_quality.h
+ * @brief Detection of voltage sags, swells, phase loss and overcurrent per phase, with hysteresis
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+// Multiple inclusion protection
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_check.h"
+
+#include "obis.h"
+
+/* ===== THRESHOLD CONFIGURATION ===== */
+/* Voltage in 0.1 V, nominal 230 V, limits of EN 50160 */
+#define POWER_QUALITY_SAG_ENTER         2070        /* < Sag below 90 % of nominal voltage */
+#define POWER_QUALITY_SAG_EXIT          2110        /* < Sag ends above 92 % */
+#define POWER_QUALITY_SWELL_ENTER       2530        /* < Swell above 110 % of nominal voltage */
+#define POWER_QUALITY_SWELL_EXIT        2490        /* < Swell ends below 108 % */
+#define POWER_QUALITY_LOSS_ENTER        1150        /* < Phase is lost below 50 % of nominal voltage, no sag is raised below */
+#define POWER_QUALITY_LOSS_EXIT         1840        /* < Phase is back above 80 % */
+
+/* Current in 0.01 A */
+#define POWER_QUALITY_OVERCURRENT_ENTER 6300        /* < Rated current of main fuse */
+#define POWER_QUALITY_OVERCURRENT_EXIT  5700        /* < Overcurrent ends below 90 % */
+
+/* An event is raised with the first telegram beyond the enter threshold, */
+/* it is cleared after this number of consecutive telegrams beyond the exit threshold */
+#define POWER_QUALITY_CLEAR_COUNT       3
+
+/* Maximum number of events of one telegram, every condition on every phase */
+#define POWER_QUALITY_MAX_EVENTS        (3 * POWER_QUALITY_CONDITION_COUNT)
+
+/* Monitored conditions */
+typedef enum {
+    POWER_QUALITY_SAG = 0,
+    POWER_QUALITY_SWELL = 1,
+    POWER_QUALITY_PHASE_LOSS = 2,
+    POWER_QUALITY_OVERCURRENT = 3,
+    POWER_QUALITY_CONDITION_COUNT
+} power_quality_condition_t;
+
+/* Bit of a condition in the alarm bitmap, 4 bits per phase starting with L1 */
+#define POWER_QUALITY_ALARM_BIT(phase, condition)   (1 << ((phase) * POWER_QUALITY_CONDITION_COUNT + (condition)))
+
+/* Values of one telegram */
+typedef struct {
+    uint8_t phases;                     /* < Bit 0 = L1 ... bit 2 = L3, set if the registers are in the telegram */
+    uint16_t voltage[3];                /* < Voltage L1-L3 in 0.1 V */
+    uint16_t current[3];                /* < Current L1-L3 in 0.01 A */
+} power_quality_sample_t;
+
+/* Raised or cleared condition */
+typedef struct {
+    uint8_t phase;                      /* < 0 = L1 */
+    power_quality_condition_t condition;
+    bool active;                        /* < True if raised, false if cleared */
+    uint16_t value;                     /* < Voltage or current of the telegram */
+} power_quality_event_t;
+
+/* State of detection */
+typedef struct {
+    uint16_t alarms;                    /* < Active conditions, POWER_QUALITY_ALARM_BIT */
+    uint8_t clear_count[3][POWER_QUALITY_CONDITION_COUNT];     /* < Consecutive telegrams beyond exit threshold */
+} power_quality_t;
+
+/**
+ * @brief Initialize detection, no condition is active
+ *
+ * @param power_quality state
+ */
+void power_quality_init(power_quality_t *power_quality);
+
+/**
+ * @brief Convert decoded telegram into sample
+ *
+ * @param data decoded telegram
+ * @param sample sample, phases without voltage register are not monitored
+ */
+void power_quality_sample_from_obis(const obis_data_t *data, power_quality_sample_t *sample);
+
+/**
+ * @brief Check values of one telegram against thresholds
+ *
+ * @param power_quality state
+ * @param sample values of telegram
+ * @param events raised and cleared conditions, at least POWER_QUALITY_MAX_EVENTS
+ * @return size_t number of events, 0 if alarms didn't change
+ */
+size_t power_quality_update(power_quality_t *power_quality, const power_quality_sample_t *sample, power_quality_event_t *events);
+
+/**
+ * @brief Name of condition for logging
+ *
+ * @param condition condition
+ * @return const char*
+ */
+const char* power_quality_condition_name(power_quality_condition_t condition);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
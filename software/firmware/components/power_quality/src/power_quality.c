@@ -0,0 +1,122 @@
+/**
+ * @file power_quality.c
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <string.h>
+
+/* Header */
+#include "power_quality.h"
+
+/* ===== HELPER FUNCTIONS ===== */
+/* Enter and exit condition of each threshold */
+static void check_thresholds(power_quality_condition_t condition, uint16_t voltage, uint16_t current, bool *enter, bool *recovered)
+{
+    switch(condition)
+    {
+        case POWER_QUALITY_SAG:
+            *enter = voltage < POWER_QUALITY_SAG_ENTER && voltage >= POWER_QUALITY_LOSS_ENTER;
+            *recovered = voltage > POWER_QUALITY_SAG_EXIT;
+            break;
+        case POWER_QUALITY_SWELL:
+            *enter = voltage > POWER_QUALITY_SWELL_ENTER;
+            *recovered = voltage < POWER_QUALITY_SWELL_EXIT;
+            break;
+        case POWER_QUALITY_PHASE_LOSS:
+            *enter = voltage < POWER_QUALITY_LOSS_ENTER;
+            *recovered = voltage > POWER_QUALITY_LOSS_EXIT;
+            break;
+        case POWER_QUALITY_OVERCURRENT:
+            *enter = current > POWER_QUALITY_OVERCURRENT_ENTER;
+            *recovered = current < POWER_QUALITY_OVERCURRENT_EXIT;
+            break;
+        default:
+            *enter = false;
+            *recovered = true;
+            break;
+    }
+}
+
+/* ===== POWER QUALITY FUNCTIONS ===== */
+void power_quality_init(power_quality_t *power_quality)
+{
+    memset(power_quality, 0, sizeof(power_quality_t));
+}
+
+void power_quality_sample_from_obis(const obis_data_t *data, power_quality_sample_t *sample)
+{
+    memset(sample, 0, sizeof(power_quality_sample_t));
+    for(int i = 0; i < 3; i++)
+    {
+        /* Missing voltage register is no phase loss, e.g. single phase meter */
+        bool found = false;
+        sample->voltage[i] = (uint16_t)obis_get_scaled(data, obis_voltage_types[i], -1, &found);
+        if(found){ sample->phases |= (uint8_t)(1 << i); }
+        sample->current[i] = (uint16_t)obis_get_scaled(data, obis_current_types[i], -2, &found);
+    }
+}
+
+size_t power_quality_update(power_quality_t *power_quality, const power_quality_sample_t *sample, power_quality_event_t *events)
+{
+    size_t count = 0;
+
+    for(uint8_t phase = 0; phase < 3; phase++)
+    {
+        if(!(sample->phases & (1 << phase))){ continue; }
+
+        for(int condition = 0; condition < POWER_QUALITY_CONDITION_COUNT; condition++)
+        {
+            uint16_t bit = (uint16_t)POWER_QUALITY_ALARM_BIT(phase, condition);
+            bool active = (power_quality->alarms & bit) != 0;
+            bool enter = false;
+            bool recovered = false;
+            check_thresholds((power_quality_condition_t)condition, sample->voltage[phase], sample->current[phase], &enter, &recovered);
+
+            /* Raised immediately, cleared only after several good telegrams, values between thresholds keep the state */
+            bool changed = false;
+            if(!active && enter)
+            {
+                power_quality->alarms |= bit;
+                changed = true;
+            }
+            else if(active && recovered)
+            {
+                if(++power_quality->clear_count[phase][condition] >= POWER_QUALITY_CLEAR_COUNT)
+                {
+                    power_quality->alarms &= (uint16_t)~bit;
+                    changed = true;
+                }
+            }
+            if(!recovered || changed)
+            {
+                power_quality->clear_count[phase][condition] = 0;
+            }
+
+            if(changed)
+            {
+                events[count++] = (power_quality_event_t){
+                    .phase = phase,
+                    .condition = (power_quality_condition_t)condition,
+                    .active = !active,
+                    .value = condition == POWER_QUALITY_OVERCURRENT ? sample->current[phase] : sample->voltage[phase],
+                };
+            }
+        }
+    }
+
+    return count;
+}
+
+const char* power_quality_condition_name(power_quality_condition_t condition)
+{
+    switch(condition)
+    {
+        case POWER_QUALITY_SAG: return "sag";
+        case POWER_QUALITY_SWELL: return "swell";
+        case POWER_QUALITY_PHASE_LOSS: return "phase loss";
+        case POWER_QUALITY_OVERCURRENT: return "overcurrent";
+        default: return "unknown";
+    }
+}
@@ -0,0 +1,83 @@
+/**
+ * @file sys_monitor.h
+ * @brief Periodic sampling of cpu time and stack high-water mark of every task and of free heap
+ * @copyright Copyright (c) 2023
+ * 
+ */
+
+// Multiple inclusion protection
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_check.h"
+
+/* ===== MONITOR CONFIGURATION ===== */
+/* Requires CONFIG_FREERTOS_USE_TRACE_FACILITY and CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS */
+#define SYS_MONITOR_INTERVAL_MS         10000       /* < Interval of samples, cpu time is the share of this interval */
+#define SYS_MONITOR_LOG_SAMPLES         6           /* < Every n-th sample is written to the log */
+#define SYS_MONITOR_MAX_TASKS           20          /* < Tasks of ESP-IDF, zigbee stack and application */
+#define SYS_MONITOR_NAME_SIZE           8           /* < Characters of task name in encoded status */
+#define SYS_MONITOR_TASK_PRIORITY       1           /* < Sampling only runs if nothing else has to */
+#define SYS_MONITOR_TASK_STACK_SIZE     2560
+#define SYS_MONITOR_FORMAT_VERSION      1           /* < Version of encoded status */
+
+/* Size of encoded status: version, task count, free heap, minimum free heap, then name, priority, stack and cpu per task */
+#define SYS_MONITOR_TASK_ENCODED_SIZE   (SYS_MONITOR_NAME_SIZE + 1 + 2 + 2)
+#define SYS_MONITOR_ENCODED_SIZE        (10 + SYS_MONITOR_MAX_TASKS * SYS_MONITOR_TASK_ENCODED_SIZE)
+
+/* Sample of one task */
+typedef struct {
+    char name[SYS_MONITOR_NAME_SIZE + 1];
+    uint8_t priority;
+    uint32_t stack_free;                /* < Minimum of free stack since start of task in bytes */
+    uint16_t cpu_permille;              /* < Share of cpu time during last interval */
+} sys_monitor_task_t;
+
+/* Sample of system */
+typedef struct {
+    uint32_t sequence;                  /* < Incremented for every sample */
+    uint32_t free_heap;                 /* < Bytes */
+    uint32_t min_free_heap;             /* < Minimum since boot in bytes */
+    size_t task_count;
+    sys_monitor_task_t tasks[SYS_MONITOR_MAX_TASKS];
+} sys_monitor_status_t;
+
+/**
+ * @brief Start sampling task
+ * 
+ * @return esp_err_t 
+ */
+esp_err_t sys_monitor_init();
+
+/**
+ * @brief Copy last sample, called from any task
+ * 
+ * @param status copy
+ * @return esp_err_t ESP_ERR_NOT_FOUND if nothing was sampled yet, ESP_ERR_TIMEOUT if monitor is writing
+ */
+esp_err_t sys_monitor_get(sys_monitor_status_t *status);
+
+/**
+ * @brief Write last sample to the log
+ */
+void sys_monitor_log();
+
+/**
+ * @brief Encode sample as little endian bytes, e.g. for a zigbee attribute
+ * 
+ * @param status sample
+ * @param buffer output
+ * @param size size of buffer, at least SYS_MONITOR_ENCODED_SIZE
+ * @return size_t number of bytes, 0 if buffer is too small
+ */
+size_t sys_monitor_encode(const sys_monitor_status_t *status, uint8_t *buffer, size_t size);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
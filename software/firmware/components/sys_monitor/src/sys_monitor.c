@@ -0,0 +1,192 @@
+/**
+ * @file sys_monitor.c
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Logging */
+#include "esp_log.h"
+static const char* TAG = "SYS_MONITOR";
+
+/* Header */
+#include "sys_monitor.h"
+
+/* System libraries */
+#include "esp_system.h"
+
+/* FreeRTOS Libraries */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#if !configUSE_TRACE_FACILITY || !configGENERATE_RUN_TIME_STATS
+#error Enable CONFIG_FREERTOS_USE_TRACE_FACILITY and CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS for the system monitor
+#endif
+
+/* Last sample, written by monitor task */
+static sys_monitor_status_t status;
+static SemaphoreHandle_t status_mutex = NULL;
+
+/* Run time counter of each task at previous sample */
+static struct {
+    UBaseType_t number;
+    uint32_t run_time;
+} previous[SYS_MONITOR_MAX_TASKS];
+static size_t previous_count = 0;
+static uint32_t previous_total = 0;
+
+/* ===== HELPER FUNCTIONS ===== */
+static uint32_t get_previous_run_time(UBaseType_t number)
+{
+    for(size_t i = 0; i < previous_count; i++)
+    {
+        if(previous[i].number == number){ return previous[i].run_time; }
+    }
+
+    /* New task, counted since its creation */
+    return 0;
+}
+
+static int compare_task_number(const void *a, const void *b)
+{
+    UBaseType_t x = ((const TaskStatus_t *)a)->xTaskNumber;
+    UBaseType_t y = ((const TaskStatus_t *)b)->xTaskNumber;
+    return (x > y) - (x < y);
+}
+
+static void put_le(uint8_t *buffer, uint32_t value, size_t bytes)
+{
+    for(size_t i = 0; i < bytes; i++)
+    {
+        buffer[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static void sample(void)
+{
+    static TaskStatus_t tasks[SYS_MONITOR_MAX_TASKS];
+    static sys_monitor_status_t next;
+    uint32_t total = 0;
+
+    UBaseType_t count = uxTaskGetSystemState(tasks, SYS_MONITOR_MAX_TASKS, &total);
+    if(count == 0)
+    {
+        ESP_LOGW(TAG, "More than %d tasks, increase SYS_MONITOR_MAX_TASKS", SYS_MONITOR_MAX_TASKS);
+        return;
+    }
+    qsort(tasks, count, sizeof(TaskStatus_t), compare_task_number);
+
+    /* Counters wrap, differences are still correct */
+    uint32_t elapsed = total - previous_total;
+    memset(&next, 0, sizeof(next));
+    for(UBaseType_t i = 0; i < count; i++)
+    {
+        sys_monitor_task_t *task = &next.tasks[i];
+        uint32_t run_time = tasks[i].ulRunTimeCounter - get_previous_run_time(tasks[i].xTaskNumber);
+
+        strncpy(task->name, tasks[i].pcTaskName, SYS_MONITOR_NAME_SIZE);
+        task->priority = (uint8_t)tasks[i].uxCurrentPriority;
+        task->stack_free = (uint32_t)tasks[i].usStackHighWaterMark;     /* < Bytes in ESP-IDF */
+        task->cpu_permille = elapsed > 0 ? (uint16_t)((uint64_t)run_time * 1000 / elapsed) : 0;
+
+        previous[i].number = tasks[i].xTaskNumber;
+        previous[i].run_time = tasks[i].ulRunTimeCounter;
+    }
+    previous_count = count;
+    previous_total = total;
+
+    next.task_count = count;
+    next.free_heap = esp_get_free_heap_size();
+    next.min_free_heap = esp_get_minimum_free_heap_size();
+
+    xSemaphoreTake(status_mutex, portMAX_DELAY);
+    next.sequence = status.sequence + 1;
+    memcpy(&status, &next, sizeof(status));
+    xSemaphoreGive(status_mutex);
+}
+
+/* ===== TASK ===== */
+static void sys_monitor_task(void *pvParameters)
+{
+    uint32_t samples = 0;
+    TickType_t last_wake = xTaskGetTickCount();
+    for(;;)
+    {
+        vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(SYS_MONITOR_INTERVAL_MS));
+        sample();
+
+        if(++samples >= SYS_MONITOR_LOG_SAMPLES)
+        {
+            samples = 0;
+            sys_monitor_log();
+        }
+    }
+}
+
+/* ===== MONITOR FUNCTIONS ===== */
+esp_err_t sys_monitor_init()
+{
+    status_mutex = xSemaphoreCreateMutex();
+    if(status_mutex == NULL){ return ESP_ERR_NO_MEM; }
+
+    if(xTaskCreate(sys_monitor_task, "sys_monitor", SYS_MONITOR_TASK_STACK_SIZE, NULL, SYS_MONITOR_TASK_PRIORITY, NULL) != pdPASS)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t sys_monitor_get(sys_monitor_status_t *copy)
+{
+    if(status_mutex == NULL){ return ESP_ERR_NOT_FOUND; }
+
+    /* Caller may be the zigbee task, don't wait */
+    if(xSemaphoreTake(status_mutex, 0) != pdTRUE){ return ESP_ERR_TIMEOUT; }
+    memcpy(copy, &status, sizeof(status));
+    xSemaphoreGive(status_mutex);
+
+    return copy->sequence != 0 ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+void sys_monitor_log()
+{
+    static sys_monitor_status_t copy;
+
+    xSemaphoreTake(status_mutex, portMAX_DELAY);
+    memcpy(&copy, &status, sizeof(status));
+    xSemaphoreGive(status_mutex);
+    if(copy.sequence == 0){ return; }
+
+    ESP_LOGI(TAG, "Heap free %lu bytes, minimum %lu bytes", (unsigned long)copy.free_heap, (unsigned long)copy.min_free_heap);
+    for(size_t i = 0; i < copy.task_count; i++)
+    {
+        const sys_monitor_task_t *task = &copy.tasks[i];
+        ESP_LOGI(TAG, "%-8s prio %2d  stack free %5lu bytes  cpu %3d.%d %%", task->name, task->priority,
+                 (unsigned long)task->stack_free, task->cpu_permille / 10, task->cpu_permille % 10);
+    }
+}
+
+size_t sys_monitor_encode(const sys_monitor_status_t *sample, uint8_t *buffer, size_t size)
+{
+    if(size < SYS_MONITOR_ENCODED_SIZE){ return 0; }
+
+    buffer[0] = SYS_MONITOR_FORMAT_VERSION;
+    buffer[1] = (uint8_t)sample->task_count;
+    put_le(&buffer[2], sample->free_heap, 4);
+    put_le(&buffer[6], sample->min_free_heap, 4);
+    size_t offset = 10;
+    for(size_t i = 0; i < sample->task_count; i++)
+    {
+        const sys_monitor_task_t *task = &sample->tasks[i];
+        memcpy(&buffer[offset], task->name, SYS_MONITOR_NAME_SIZE);
+        buffer[offset + SYS_MONITOR_NAME_SIZE] = task->priority;
+        put_le(&buffer[offset + SYS_MONITOR_NAME_SIZE + 1], task->stack_free > UINT16_MAX ? UINT16_MAX : task->stack_free, 2);
+        put_le(&buffer[offset + SYS_MONITOR_NAME_SIZE + 3], task->cpu_permille, 2);
+        offset += SYS_MONITOR_TASK_ENCODED_SIZE;
+    }
+    return offset;
+}
@@ -0,0 +1,49 @@
+/**
+ * @file latency_budget.h
+ * @brief End-to-end latency budget from stop byte of the last meter frame to radio transmit
+ * @copyright Copyright (c) 2023
+ * 
+ */
+
+// Multiple inclusion protection
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "uart.h"
+
+/* ===== LATENCY BUDGET ===== */
+/* 1. UART: the driver reports the last bytes after its hardware timeout of 10 symbols, */
+/*    the telegram is processed after no further event was received for UART_RX_TIMEOUT */
+/* 2. Decode: M-Bus, DLMS decryption and OBIS decoding in uart event task (priority 4) */
+/* 3. Handoff: decoded values wait for the next poll of the zigbee task (priority 5) */
+/* 4. Radio: writing attributes and sending the reports, including CSMA-CA and retries of the MAC layer */
+#define LATENCY_BUDGET_RX_TOUT_MS       50                              /* < 10 symbols of 11 bit at 2400 baud = 46 ms */
+#define LATENCY_BUDGET_RX_IDLE_MS       (LATENCY_BUDGET_RX_TOUT_MS + UART_RX_TIMEOUT)   /* < Fixed, defined by uart configuration */
+#define LATENCY_BUDGET_DECODE_MS        20                              /* < Decoding of one telegram, checked by host latency simulation */
+#define LATENCY_BUDGET_HANDOFF_MS       METER_BRIDGE_POLL_INTERVAL_MS   /* < Worst case is one full poll interval */
+#define LATENCY_BUDGET_RADIO_MS         150                             /* < 9 attribute reports and one fragmented bulk command */
+
+/* Total from stop byte to radio transmit */
+#define LATENCY_BUDGET_TOTAL_MS         (LATENCY_BUDGET_RX_IDLE_MS + LATENCY_BUDGET_DECODE_MS + LATENCY_BUDGET_HANDOFF_MS + LATENCY_BUDGET_RADIO_MS)
+
+/* Poll interval of the zigbee task for new measurements */
+#define METER_BRIDGE_POLL_INTERVAL_MS   50
+
+/* History log is uploaded in polls without a new telegram, at most one batch per interval */
+#define METER_BRIDGE_BACKFILL_INTERVAL_MS   1000
+
+/* Batch without send status, e.g. after a leave, is sent again after this time */
+#define METER_BRIDGE_HISTORY_CONFIRM_TIMEOUT_MS 10000
+
+/* Counters of the meter link are copied to the diagnostics cluster in this interval */
+#define METER_BRIDGE_DIAGNOSTICS_INTERVAL_MS    1000
+
+/* Measured latency histograms are written to the log and the latency attribute in this interval */
+#define METER_BRIDGE_LATENCY_LOG_INTERVAL_MS    60000
+
+#ifdef __cplusplus
+}
+#endif
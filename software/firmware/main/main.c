@@ -0,0 +1,48 @@
+/**
+ * @file main.c
+ * 
+ * @copyright Copyright (c) 2023
+ * 
+ */
+
+#include <stdio.h>
+
+/* Setup logging */
+#include "esp_log.h"
+static const char *TAG = "app_main";
+
+#include "smartmeter.h"
+#include "powerfail.h"
+#include "zb_main.h"
+#include "meter_bridge.h"
+#include "history_log.h"
+#include "sys_monitor.h"
+
+void app_main(void)
+{
+    /* Record of last power fail is loaded before zigbee restores the attribute values, works without powerfail partition */
+    esp_err_t err = powerfail_init();
+    if(err != ESP_ERR_NOT_FOUND)
+    {
+        ESP_ERROR_CHECK(err);
+    }
+
+    /* Connect meter pipeline to zigbee endpoint */
+    ESP_ERROR_CHECK(meter_bridge_init());
+
+    /* Telegrams are stored while the network is down, works without history partition */
+    err = history_log_init();
+    if(err != ESP_ERR_NOT_FOUND)
+    {
+        ESP_ERROR_CHECK(err);
+    }
+
+    /* Start zigbee first, nvs is initialized there */
+    ESP_ERROR_CHECK(zb_run());
+
+    /* Start reading the meter */
+    ESP_ERROR_CHECK(smartmeter_init());
+
+    /* Cpu time, stack and heap are sampled once all tasks are running */
+    ESP_ERROR_CHECK(sys_monitor_init());
+}
@@ -0,0 +1,364 @@
+/**
+ * @file meter_bridge.c
+ * 
+ * @copyright Copyright (c) 2023
+ * 
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+/* Setup logging */
+#include "esp_log.h"
+static const char* TAG = "meter_bridge";
+
+#include "esp_timer.h"
+
+/* Components */
+#include "meter_snapshot.h"
+#include "meter_diagnostics.h"
+#include "powerfail.h"
+#include "frame_pool.h"
+#include "zb_main.h"
+#include "zb_rejoin.h"
+#include "zb_electricity_meter_reporter.h"
+#include "zb_electricity_meter_endpoint.h"
+#include "zb_electricity_meter_update.h"
+#include "human_interface.h"
+#include "history_log.h"
+#include "aggregate.h"
+#include "power_quality.h"
+#include "latency_trace.h"
+#include "sys_monitor.h"
+#include "esp_zigbee_core.h"
+
+/* Header */
+#include "latency_budget.h"
+#include "meter_convert.h"
+#include "meter_bridge.h"
+
+/* Sequence of last sent telegram */
+static uint32_t sent_sequence = 0;
+
+/* Time of last uploaded history batch */
+static int64_t backfill_time_us = 0;
+
+/* Sent history batch waiting for its send status, records are marked uploaded once it is confirmed */
+static bool history_pending = false;
+static uint32_t history_pending_sequence = 0;
+
+/* Tariff windows in local time of the meter, tariff 0 (Tier1) applies outside of them */
+static const aggregate_tariff_window_t tariff_windows[] = {
+    {.tariff = 1, .weekdays = 0x7F, .start_minute = 22 * 60, .end_minute = 6 * 60},   /* < Night tariff (Tier2) on all days */
+};
+
+_Static_assert(AGGREGATE_MAX_TARIFFS <= ZB_METERING_TIER_COUNT, "every tariff needs a tier of the metering cluster");
+
+/* Demand windows and energy per tariff */
+static aggregate_t aggregate;
+static bool tiers_loaded = false;
+
+/* Time of last copy of diagnostics counters */
+static int64_t diagnostics_time_us = 0;
+
+/* Sags, swells, phase loss and overcurrent per phase */
+static power_quality_t power_quality;
+
+_Static_assert(SYS_MONITOR_ENCODED_SIZE <= ZB_MANUFACTURER_SYSTEM_STATUS_MAX_SIZE, "system status must fit into attribute");
+
+/* Sequence of last published system status */
+static uint32_t system_status_sequence = 0;
+
+#if LATENCY_TRACE_ENABLED
+_Static_assert(LATENCY_TRACE_ENCODED_SIZE <= ZB_MANUFACTURER_LATENCY_MAX_SIZE, "latency histograms must fit into attribute");
+
+/* Time of last latency log */
+static int64_t latency_log_time_us = 0;
+#endif
+
+/* ===== HELPER FUNCTIONS ===== */
+/* Upload oldest records of history log, only called in polls without new telegram */
+static void backfill_history(void)
+{
+    static history_record_t records[ZB_HISTORY_MAX_ENTRIES];
+    static zb_history_entry_t entries[ZB_HISTORY_MAX_ENTRIES];
+    size_t count = 0;
+    uint32_t last_sequence = 0;
+
+    int64_t now_us = esp_timer_get_time();
+
+    /* One batch at a time, without send status the same records are read again */
+    if(history_pending && now_us - backfill_time_us < METER_BRIDGE_HISTORY_CONFIRM_TIMEOUT_MS * 1000LL){ return; }
+    history_pending = false;
+
+    if(history_log_backlog() == 0 || now_us - backfill_time_us < METER_BRIDGE_BACKFILL_INTERVAL_MS * 1000LL){ return; }
+
+    /* Busy while the history task writes or only the partial page is left, try again in next poll */
+    if(history_log_read_batch(records, ZB_HISTORY_MAX_ENTRIES, &count, &last_sequence) != ESP_OK){ return; }
+    backfill_time_us = now_us;
+
+    for(size_t i = 0; i < count; i++)
+    {
+        meter_convert_history(&records[i], &entries[i]);
+    }
+
+    /* Records are marked in send_status_cb once the batch is confirmed */
+    if(zb_send_history_batch(entries, (uint8_t)count) == ESP_OK)
+    {
+        history_pending = true;
+        history_pending_sequence = last_sequence;
+    }
+}
+
+/* Copy counters of uart event task and rejoin time to diagnostics cluster, read by coordinator on demand */
+static void update_diagnostics(void)
+{
+    int64_t now_us = esp_timer_get_time();
+    if(now_us - diagnostics_time_us < METER_BRIDGE_DIAGNOSTICS_INTERVAL_MS * 1000LL){ return; }
+    diagnostics_time_us = now_us;
+
+    frame_pool_stats_t pool;
+    frame_pool_get_stats(&pool);
+
+    zb_diagnostics_t diagnostics = {
+        .telegrams_ok = meter_diag_get(METER_DIAG_TELEGRAMS_OK),
+        .fifo_overflows = meter_diag_get(METER_DIAG_FIFO_OVERFLOW),
+        .buffer_full = meter_diag_get(METER_DIAG_BUFFER_FULL),
+        .parity_errors = meter_diag_get(METER_DIAG_PARITY_ERROR),
+        .frame_errors = meter_diag_get(METER_DIAG_FRAME_ERROR),
+        .parse_failures = meter_diag_get(METER_DIAG_PARSE_FAILURE),
+        .decrypt_failures = meter_diag_get(METER_DIAG_DECRYPT_FAILURE),
+        .frame_pool_peak = pool.peak,
+        .frame_pool_empty = pool.empty,
+        .rejoin_time_ms = zb_rejoin_get_time_ms(),
+    };
+    zb_update_diagnostics(&diagnostics);
+}
+
+/* Copy new sample of system monitor to attribute, coordinator reads the attribute on demand */
+static void publish_system_status(void)
+{
+    static sys_monitor_status_t status;
+    static uint8_t encoded[SYS_MONITOR_ENCODED_SIZE];
+
+    /* Monitor may be writing, try again in next poll */
+    if(sys_monitor_get(&status) != ESP_OK || status.sequence == system_status_sequence){ return; }
+    system_status_sequence = status.sequence;
+
+    size_t size = sys_monitor_encode(&status, encoded, sizeof(encoded));
+    zb_update_system_status(encoded, size);
+}
+
+/* Add telegram to aggregation, closed windows and tariff periods are sent if joined */
+static void aggregate_telegram(const obis_data_t *data, bool joined)
+{
+    static aggregate_window_t window;
+    static aggregate_period_t period;
+    static zb_aggregate_window_t zb_window;
+    aggregate_sample_t sample;
+
+    /* NVS is initialized by zigbee */
+    if(!tiers_loaded)
+    {
+        aggregate_load_tiers(&aggregate);
+        tiers_loaded = true;
+    }
+
+    if(aggregate_sample_from_obis(data, &sample) != ESP_OK){ return; }
+    uint32_t flags = aggregate_add(&aggregate, &sample, &window, &period);
+
+    /* Energy per tariff is written a few times per day */
+    if(flags & AGGREGATE_PERIOD_CLOSED)
+    {
+        ESP_LOGI(TAG, "Tariff %d ended, %lu Wh delivered", period.tariff, (unsigned long)period.energy_delivered);
+        aggregate_store_tiers(&aggregate);
+        if(joined)
+        {
+            zb_update_tier_summation(period.tariff, aggregate.tier_delivered[period.tariff], aggregate.tier_received[period.tariff]);
+        }
+    }
+
+    if((flags & AGGREGATE_WINDOW_CLOSED) && joined)
+    {
+        meter_convert_aggregate(&window, &zb_window);
+        zb_send_aggregate_window(&zb_window);
+        zb_update_tier_summation(aggregate.tariff, aggregate.tier_delivered[aggregate.tariff], aggregate.tier_received[aggregate.tariff]);
+    }
+}
+
+/* Fast lane, changed alarms are reported before the throttled measurements of the same telegram */
+static void check_power_quality(const obis_data_t *data, int64_t received_time_us, bool joined)
+{
+    power_quality_event_t events[POWER_QUALITY_MAX_EVENTS];
+    power_quality_sample_t sample;
+
+    power_quality_sample_from_obis(data, &sample);
+    size_t count = power_quality_update(&power_quality, &sample, events);
+    if(count == 0){ return; }
+
+    for(size_t i = 0; i < count; i++)
+    {
+        ESP_LOGW(TAG, "L%d %s %s, value %u", events[i].phase + 1, power_quality_condition_name(events[i].condition),
+                 events[i].active ? "raised" : "cleared", events[i].value);
+    }
+    zb_update_power_quality(power_quality.alarms, joined);
+    if(!joined){ return; }
+
+    /* Values of the affected phases as measured, not averaged by the reporter in reduced mode */
+    for(size_t i = 0; i < count; i++)
+    {
+        phase_t phase = (phase_t)events[i].phase;
+        if(events[i].condition == POWER_QUALITY_OVERCURRENT)
+        {
+            zb_update_current(phase, (int16_t)sample.current[phase]);
+        }
+        else
+        {
+            zb_update_voltage(phase, (int16_t)sample.voltage[phase]);
+        }
+    }
+    ESP_LOGI(TAG, "Power quality reported %d ms after decoding", (int)((esp_timer_get_time() - received_time_us) / 1000));
+}
+
+#if LATENCY_TRACE_ENABLED
+/* Write histograms to log and attribute, coordinator reads the attribute on demand */
+static void publish_latency(void)
+{
+    static uint8_t encoded[LATENCY_TRACE_ENCODED_SIZE];
+
+    int64_t now_us = esp_timer_get_time();
+    if(now_us - latency_log_time_us < METER_BRIDGE_LATENCY_LOG_INTERVAL_MS * 1000LL){ return; }
+    latency_log_time_us = now_us;
+
+    latency_trace_log();
+    size_t size = latency_trace_encode(encoded, sizeof(encoded));
+    zb_update_latency_histograms(encoded, size);
+}
+#endif
+
+/* Called from zigbee task for every sent command, APS confirms drive the reporting rate */
+static void send_status_cb(esp_zb_zcl_command_send_status_message_t message)
+{
+    zb_reporter_send_status(message.status);
+
+    /* Kind is taken for every status to stay in order with the requests */
+    zb_sent_request_t kind = zb_pop_sent_request();
+
+    /* Unmarked records are read and sent again by the next backfill */
+    if(kind == ZB_SENT_HISTORY && history_pending)
+    {
+        history_pending = false;
+        if(message.status != ESP_OK)
+        {
+            ESP_LOGW(TAG, "History batch not delivered, sent again");
+        }
+        else if(history_log_mark_uploaded(history_pending_sequence) != ESP_OK)
+        {
+            ESP_LOGW(TAG, "History batch confirmed, but ring was busy, sent again");
+        }
+    }
+#if LATENCY_TRACE_ENABLED
+    /* The first confirmed measurement report ends the trace of a telegram */
+    if(message.status == ESP_OK && kind == ZB_SENT_MEASUREMENT)
+    {
+        latency_trace_mark(LATENCY_STAGE_REPORT_CONFIRMED);
+    }
+#else
+    (void)kind;
+#endif
+}
+
+/* ===== CALLBACK FUNCTIONS ===== */
+/* Called from zigbee task, sends data of last telegram */
+static void zb_app_poll_cb(void)
+{
+    static meter_snapshot_t meter_snapshot;
+    static zb_electricity_meter_snapshot_t snapshot;
+    static zb_bulk_snapshot_t bulk;
+    static history_record_t record;
+
+    /* Stack is running once the poll callback is called */
+    static bool send_status_registered = false;
+    if(!send_status_registered)
+    {
+        esp_zb_zcl_command_send_status_handler_register(send_status_cb);
+        send_status_registered = true;
+    }
+
+    /* Nothing new since last poll, time to upload stored telegrams */
+    if(!meter_snapshot_changed_since(sent_sequence))
+    {
+        if(esp_zb_bdb_dev_joined()){ backfill_history(); }
+        update_diagnostics();
+        publish_system_status();
+#if LATENCY_TRACE_ENABLED
+        publish_latency();
+#endif
+        return;
+    }
+
+    /* Snapshot store is written by uart event task without locking */
+    if(meter_snapshot_read(&meter_snapshot) != ESP_OK){ return; }
+    if(sent_sequence != 0 && meter_snapshot.sequence != sent_sequence + 1)
+    {
+        ESP_LOGW(TAG, "Skipped %d telegrams", (int)(meter_snapshot.sequence - sent_sequence - 1));
+    }
+    sent_sequence = meter_snapshot.sequence;
+
+    /* Power quality is checked first, also while not joined to keep the alarms current */
+    bool joined = esp_zb_bdb_dev_joined();
+    check_power_quality(&meter_snapshot.data, meter_snapshot.received_time_us, joined);
+
+    /* Network is down, store telegram until rejoin */
+    if(!joined)
+    {
+        history_record_from_obis(&meter_snapshot.data, meter_snapshot.frame_counter, &record);
+        if(history_log_append(&record) == ESP_ERR_TIMEOUT)
+        {
+            ESP_LOGW(TAG, "History queue full, telegram dropped");
+        }
+        aggregate_telegram(&meter_snapshot.data, false);
+        return;
+    }
+
+    meter_convert_snapshot(&meter_snapshot.data, &snapshot);
+    meter_convert_bulk(&meter_snapshot.data, &bulk);
+    zb_reporter_submit(&snapshot);
+    LATENCY_TRACE_MARK(LATENCY_STAGE_REPORT_QUEUED);
+    zb_reporter_submit_bulk(&bulk);
+    human_interface_post(HI_EVENT_DATA_SENT);
+
+    /* Handoff and sending must stay within their part of the latency budget */
+    int64_t elapsed_ms = (esp_timer_get_time() - meter_snapshot.received_time_us) / 1000;
+    if(elapsed_ms > LATENCY_BUDGET_HANDOFF_MS + LATENCY_BUDGET_RADIO_MS)
+    {
+        ESP_LOGW(TAG, "Latency budget exceeded: %d ms from decoding to sending", (int)elapsed_ms);
+    }
+    else
+    {
+        ESP_LOGD(TAG, "%d ms from decoding to sending", (int)elapsed_ms);
+    }
+
+    /* After live values, not part of the latency budget */
+    aggregate_telegram(&meter_snapshot.data, true);
+}
+
+/* ===== BRIDGE FUNCTIONS ===== */
+esp_err_t meter_bridge_init()
+{
+    /* Values of last power fail replace older stored attribute values, flagged as stale until measured */
+    powerfail_record_t record;
+    if(powerfail_get_restored(&record) == ESP_OK)
+    {
+        zb_electricity_meter_snapshot_t restored;
+        meter_convert_powerfail(&record, &restored);
+        zb_snapshot_restore(&restored);
+    }
+
+    power_quality_init(&power_quality);
+
+    esp_err_t err = aggregate_init(&aggregate, tariff_windows, sizeof(tariff_windows) / sizeof(tariff_windows[0]));
+    if(err != ESP_OK){ return err; }
+
+    return zb_register_app_poll_cb(zb_app_poll_cb, METER_BRIDGE_POLL_INTERVAL_MS);
+}
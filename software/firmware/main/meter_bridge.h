@@ -0,0 +1,26 @@
+/**
+ * @file meter_bridge.h
+ * @brief Sends telegrams published by the uart event task from the zigbee task
+ * @copyright Copyright (c) 2023
+ * 
+ */
+
+// Multiple inclusion protection
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "esp_check.h"
+
+/**
+ * @brief Register poll callback at zigbee and provide values of last power fail, call after powerfail_init and before zb_run
+ * 
+ * @return esp_err_t 
+ */
+esp_err_t meter_bridge_init();
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,101 @@
+/**
+ * @file meter_convert.c
+ * 
+ * @copyright Copyright (c) 2023
+ * 
+ */
+
+#include <string.h>
+
+/* Header */
+#include "meter_convert.h"
+
+/* ===== HELPER FUNCTIONS ===== */
+static bool get_value(const obis_data_t *data, enum CodeType type, int8_t target_scaler, int64_t *value)
+{
+    bool found = false;
+    int64_t scaled = obis_get_scaled(data, type, target_scaler, &found);
+    if(found){ *value = scaled; }
+    return found;
+}
+
+/* ===== CONVERSION ===== */
+void meter_convert_snapshot(const obis_data_t *data, zb_electricity_meter_snapshot_t *snapshot)
+{
+    int64_t value = 0;
+    int64_t value_minus = 0;
+
+    /* TotalActivePower in W, negative if energy is fed into the grid */
+    if(get_value(data, ActivePowerPlus, 0, &value) && get_value(data, ActivePowerMinus, 0, &value_minus))
+    {
+        snapshot->total_active_power = (int32_t)(value - value_minus);
+    }
+
+    /* RMSVoltage in 0.1 V, RMSCurrent in 0.01 A */
+    for(int i = 0; i < 3; i++)
+    {
+        if(get_value(data, obis_voltage_types[i], -1, &value)){ snapshot->rms_voltage[i] = (uint16_t)value; }
+        if(get_value(data, obis_current_types[i], -2, &value)){ snapshot->rms_current[i] = (uint16_t)value; }
+    }
+
+    /* Summation in Wh */
+    if(get_value(data, ActiveEnergyPlus, 0, &value)){ snapshot->summation_delivered = (uint64_t)value; }
+    if(get_value(data, ActiveEnergyMinus, 0, &value)){ snapshot->summation_received = (uint64_t)value; }
+}
+
+void meter_convert_powerfail(const powerfail_record_t *record, zb_electricity_meter_snapshot_t *snapshot)
+{
+    /* Record has the units of the attributes */
+    snapshot->total_active_power = record->active_power;
+    for(int i = 0; i < 3; i++)
+    {
+        snapshot->rms_voltage[i] = record->voltage[i];
+        snapshot->rms_current[i] = record->current[i];
+    }
+    snapshot->summation_delivered = record->energy_delivered;
+    snapshot->summation_received = record->energy_received;
+}
+
+void meter_convert_bulk(const obis_data_t *data, zb_bulk_snapshot_t *bulk)
+{
+    memcpy(bulk->timestamp, data->timestamp, ZB_BULK_TIMESTAMP_LENGTH);
+    memcpy(bulk->serial_number, data->serial_number, data->serial_number_length);
+    bulk->serial_number_length = data->serial_number_length;
+
+    bulk->register_count = 0;
+    for(uint8_t i = 0; i < data->record_count && i < ZB_BULK_MAX_REGISTERS; i++)
+    {
+        zb_bulk_register_t *reg = &bulk->registers[bulk->register_count++];
+        memcpy(reg->obis_code, data->records[i].code, OBIS_CODE_LENGTH);
+        reg->scaler = data->records[i].scaler;
+        reg->unit = data->records[i].unit;
+        reg->value = data->records[i].value;
+    }
+}
+
+void meter_convert_history(const history_record_t *record, zb_history_entry_t *entry)
+{
+    entry->time = record->time;
+    entry->summation_delivered = record->energy_delivered;
+    entry->summation_received = record->energy_received;
+    entry->total_active_power = record->active_power;
+    memcpy(entry->rms_voltage, record->voltage, sizeof(entry->rms_voltage));
+    memcpy(entry->rms_current, record->current, sizeof(entry->rms_current));
+}
+
+void meter_convert_aggregate(const aggregate_window_t *window, zb_aggregate_window_t *zb_window)
+{
+    zb_window->start_time = window->start_time;
+    zb_window->duration = window->duration;
+    zb_window->sample_count = window->sample_count;
+    zb_window->tariff = window->tariff;
+    zb_window->demand_delivered = window->demand_delivered;
+    zb_window->demand_received = window->demand_received;
+    zb_window->average_power = window->average_power;
+    memcpy(zb_window->voltage_min, window->voltage_min, sizeof(zb_window->voltage_min));
+    memcpy(zb_window->voltage_mean, window->voltage_mean, sizeof(zb_window->voltage_mean));
+    memcpy(zb_window->voltage_max, window->voltage_max, sizeof(zb_window->voltage_max));
+    memcpy(zb_window->current_min, window->current_min, sizeof(zb_window->current_min));
+    memcpy(zb_window->current_mean, window->current_mean, sizeof(zb_window->current_mean));
+    memcpy(zb_window->current_max, window->current_max, sizeof(zb_window->current_max));
+}
@@ -0,0 +1,66 @@
+/**
+ * @file meter_convert.h
+ * @brief Converts decoded registers of the meter into values of the zigbee endpoint, also used by host tools
+ * @copyright Copyright (c) 2023
+ * 
+ */
+
+// Multiple inclusion protection
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "obis.h"
+#include "zb_electricity_meter_snapshot.h"
+#include "zb_electricity_meter_bulk.h"
+#include "history.h"
+#include "aggregate.h"
+#include "powerfail_store.h"
+
+/**
+ * @brief Convert decoded registers into attribute values of the electricity meter endpoint
+ * 
+ * Units: power in W (A+ minus A-), voltage in 0.1 V, current in 0.01 A, energy in Wh
+ * 
+ * @param data decoded telegram
+ * @param snapshot attribute values, registers missing in the telegram are left unchanged
+ */
+void meter_convert_snapshot(const obis_data_t *data, zb_electricity_meter_snapshot_t *snapshot);
+
+/**
+ * @brief Convert record written at power fail into attribute values of the electricity meter endpoint
+ * 
+ * @param record record of last power fail
+ * @param snapshot attribute values
+ */
+void meter_convert_powerfail(const powerfail_record_t *record, zb_electricity_meter_snapshot_t *snapshot);
+
+/**
+ * @brief Copy all registers of decoded telegram into bulk snapshot
+ * 
+ * @param data decoded telegram
+ * @param bulk bulk snapshot
+ */
+void meter_convert_bulk(const obis_data_t *data, zb_bulk_snapshot_t *bulk);
+
+/**
+ * @brief Convert record of history log into entry of history batch command
+ * 
+ * @param record record read from history log
+ * @param entry entry of history batch
+ */
+void meter_convert_history(const history_record_t *record, zb_history_entry_t *entry);
+
+/**
+ * @brief Convert closed demand window into payload of aggregate window command
+ * 
+ * @param window closed window
+ * @param zb_window window of aggregate window command
+ */
+void meter_convert_aggregate(const aggregate_window_t *window, zb_aggregate_window_t *zb_window);
+
+#ifdef __cplusplus
+}
+#endif
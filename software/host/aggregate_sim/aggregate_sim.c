@@ -0,0 +1,212 @@
+/**
+ * @file aggregate_sim.c
+ * @brief Runs the aggregation of the combined firmware over generated days of telegrams
+ *
+ * The first telegram of the corpus is decoded to check time conversion, following telegrams are
+ * generated every 5 s with random gaps. Demand of all windows, energy of all tariff periods and
+ * energy per tariff must add up to the difference of the energy registers.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "telegram.h"
+#include "obis.h"
+#include "aggregate.h"
+#include "meter_convert.h"
+
+/* ===== SIMULATION CONFIGURATION ===== */
+#define SIM_DEFAULT_DAYS                7           /* < Number of simulated days */
+#define SIM_TELEGRAM_INTERVAL_S         5           /* < Interval of telegrams of the meter */
+#define SIM_GAP_PROBABILITY             0.0005      /* < Probability that telegrams are missing, e.g. restart */
+#define SIM_MAX_GAP_S                   1800        /* < Longest gap */
+
+/* Same tariff windows as the firmware */
+static const aggregate_tariff_window_t tariff_windows[] = {
+    {.tariff = 1, .weekdays = 0x7F, .start_minute = 22 * 60, .end_minute = 6 * 60},
+};
+
+static double random_uniform()
+{
+    return (double)rand() / ((double)RAND_MAX + 1.0);
+}
+
+static void print_usage(const char *name)
+{
+    printf("Usage: %s [-d days] [-f plaintext file] [-v]\n", name);
+}
+
+/* ===== MAIN ===== */
+int main(int argc, char **argv)
+{
+    size_t days = SIM_DEFAULT_DAYS;
+    const char *path = HOST_DATA_DIR "/sample_plaintext.hex";
+    bool verbose = false;
+
+    int opt;
+    while((opt = getopt(argc, argv, "d:f:vh")) != -1)
+    {
+        switch(opt)
+        {
+            case 'd': days = (size_t)strtoul(optarg, NULL, 10); break;
+            case 'f': path = optarg; break;
+            case 'v': verbose = true; break;
+            default: print_usage(argv[0]); return 2;
+        }
+    }
+
+    /* First telegram of corpus defines start values */
+    static telegram_plaintext_t plaintext;
+    static obis_data_t data;
+    aggregate_sample_t sample;
+    if(telegram_load_hex_file(path, &plaintext, 1) != 1 || parse_obis(plaintext.data, plaintext.size, &data) != ESP_OK
+        || aggregate_sample_from_obis(&data, &sample) != ESP_OK)
+    {
+        fprintf(stderr, "No telegram loaded from %s\n", path);
+        return 2;
+    }
+    printf("Corpus telegram: time %lu, weekday %d, minute of day %d\n", (unsigned long)sample.time, sample.weekday, sample.minute_of_day);
+
+    static aggregate_t aggregate;
+    if(aggregate_init(&aggregate, tariff_windows, sizeof(tariff_windows) / sizeof(tariff_windows[0])) != ESP_OK)
+    {
+        fprintf(stderr, "Invalid tariff windows\n");
+        return 2;
+    }
+
+    srand(1);
+    size_t failures = 0;
+    size_t telegrams = 0;
+    size_t windows = 0;
+    size_t periods = 0;
+    uint64_t window_energy_wh = 0;              /* < Sum of demand times duration */
+    uint64_t period_energy = 0;
+    uint64_t tier_energy_expected[AGGREGATE_MAX_TARIFFS] = {0};
+    uint32_t first_energy = sample.energy_delivered;
+    uint32_t first_time = sample.time;
+    uint32_t end_time = first_time + (uint32_t)(days * 86400);
+
+    /* Local time of meter minus UTC */
+    int64_t local_offset = (int64_t)(sample.minute_of_day * 60 + first_time % 60) - first_time % 86400;
+    double energy_fraction = 0;
+    int64_t power = sample.active_power;
+    aggregate_window_t window;
+    aggregate_period_t period;
+    zb_aggregate_window_t zb_window;
+    zb_aggregate_window_t decoded;
+    uint8_t payload[ZB_AGGREGATE_PAYLOAD_SIZE];
+
+    uint32_t previous_energy = sample.energy_delivered;
+    while(sample.time < end_time)
+    {
+        uint32_t flags = aggregate_add(&aggregate, &sample, &window, &period);
+        telegrams++;
+
+        /* Energy since previous telegram counts for the tariff of this telegram */
+        tier_energy_expected[aggregate_get_tariff(&aggregate, &sample)] += sample.energy_delivered - previous_energy;
+        previous_energy = sample.energy_delivered;
+
+        if(flags & AGGREGATE_WINDOW_CLOSED)
+        {
+            windows++;
+            window_energy_wh += (uint64_t)window.demand_delivered * window.duration;
+
+            /* Payload of the zigbee command */
+            meter_convert_aggregate(&window, &zb_window);
+            if(zb_aggregate_encode(&zb_window, payload, sizeof(payload)) != ZB_AGGREGATE_PAYLOAD_SIZE
+                || zb_aggregate_decode(payload, sizeof(payload), &decoded) != ESP_OK || memcmp(&decoded, &zb_window, sizeof(decoded)) != 0)
+            {
+                fprintf(stderr, "Encoding of window %lu failed\n", (unsigned long)window.start_time);
+                failures++;
+            }
+            if(window.voltage_min[0] > window.voltage_mean[0] || window.voltage_mean[0] > window.voltage_max[0] || window.start_time % AGGREGATE_WINDOW_S != 0)
+            {
+                fprintf(stderr, "Window %lu is inconsistent\n", (unsigned long)window.start_time);
+                failures++;
+            }
+            if(verbose)
+            {
+                printf("Window %lu: %d telegrams, %lu s, demand %lu W, mean power %ld W, voltage L1 %u/%u/%u, tariff %d\n",
+                       (unsigned long)window.start_time, window.sample_count, (unsigned long)window.duration, (unsigned long)window.demand_delivered,
+                       (long)window.average_power, window.voltage_min[0], window.voltage_mean[0], window.voltage_max[0], window.tariff);
+            }
+        }
+        if(flags & AGGREGATE_PERIOD_CLOSED)
+        {
+            periods++;
+            period_energy += period.energy_delivered;
+            if(verbose)
+            {
+                printf("Tariff %d from %lu to %lu: %lu Wh\n", period.tariff, (unsigned long)period.start_time, (unsigned long)period.end_time, (unsigned long)period.energy_delivered);
+            }
+        }
+
+        /* Next telegram, sometimes after a gap */
+        uint32_t interval = SIM_TELEGRAM_INTERVAL_S;
+        if(random_uniform() < SIM_GAP_PROBABILITY)
+        {
+            interval += (uint32_t)(random_uniform() * SIM_MAX_GAP_S);
+        }
+        power = random_uniform() < 0.02 ? (int64_t)(random_uniform() * 8000) : power;
+        energy_fraction += (double)power * interval / 3600.0;
+        sample.energy_delivered += (uint32_t)energy_fraction;
+        energy_fraction -= (uint32_t)energy_fraction;
+        sample.active_power = (int32_t)power;
+        sample.time += interval;
+        int64_t local_time = (int64_t)sample.time + local_offset;
+        sample.minute_of_day = (uint16_t)(local_time % 86400 / 60);
+        sample.weekday = (uint8_t)((local_time / 86400 + 3) % 7);
+        for(int i = 0; i < 3; i++)
+        {
+            sample.voltage[i] = (uint16_t)(2250 + rand() % 150);
+            sample.current[i] = (uint16_t)(power / 7 + rand() % 50);
+        }
+    }
+
+    uint32_t total_energy = aggregate.last.energy_delivered - first_energy;
+
+    /* Energy per tariff is exact */
+    uint64_t tier_energy = 0;
+    for(int i = 0; i < AGGREGATE_MAX_TARIFFS; i++)
+    {
+        tier_energy += aggregate.tier_delivered[i];
+        if(aggregate.tier_delivered[i] != tier_energy_expected[i])
+        {
+            fprintf(stderr, "Tariff %d: %llu Wh, expected %llu Wh\n", i, (unsigned long long)aggregate.tier_delivered[i], (unsigned long long)tier_energy_expected[i]);
+            failures++;
+        }
+    }
+    if(tier_energy != total_energy)
+    {
+        fprintf(stderr, "Energy per tariff %llu Wh, meter %lu Wh\n", (unsigned long long)tier_energy, (unsigned long)total_energy);
+        failures++;
+    }
+
+    /* Closed periods and open period add up to meter energy */
+    uint64_t open_period = aggregate.last.energy_delivered - aggregate.period_energy_delivered;
+    if(period_energy + open_period != total_energy)
+    {
+        fprintf(stderr, "Energy of tariff periods %llu Wh, meter %lu Wh\n", (unsigned long long)(period_energy + open_period), (unsigned long)total_energy);
+        failures++;
+    }
+
+    /* Demand is rounded down to 1 W, windows after gaps don't cover the gap */
+    double demand_energy = (double)window_energy_wh / 3600.0;
+    printf("Simulated %zu days, %zu telegrams, %zu windows, %zu tariff periods\n", days, telegrams, windows, periods);
+    printf("Meter %lu Wh, tariffs %llu / %llu Wh, demand windows %.0f Wh\n", (unsigned long)total_energy,
+           (unsigned long long)aggregate.tier_delivered[0], (unsigned long long)aggregate.tier_delivered[1], demand_energy);
+    printf("Reports: %zu aggregates instead of %zu telegrams (%.1f %%)\n", windows + periods, telegrams, 100.0 * (double)(windows + periods) / (double)telegrams);
+    if(demand_energy > total_energy || demand_energy < 0.9 * total_energy)
+    {
+        fprintf(stderr, "Demand of windows doesn't match energy\n");
+        failures++;
+    }
+
+    printf("%s\n", failures == 0 ? "All checks passed" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
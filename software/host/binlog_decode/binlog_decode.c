@@ -0,0 +1,226 @@
+/**
+ * @file binlog_decode.c
+ * @brief Renders records of the binary log in a console capture, or checks the log against direct formatting
+ *
+ * Firmware built with BINARY_LOG_RAW_OUTPUT prints each record as a hex line, all other lines of the
+ * capture are passed through. With -b the telegrams of the corpus are written to the ring of the
+ * firmware like the uart event task does, read back, sent through the raw line encoding and compared
+ * with the output of the former printf hex dump. The cost of a write and of direct formatting is printed.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "telegram.h"
+#include "binary_log.h"
+
+/* ===== DECODER CONFIGURATION ===== */
+#define DECODE_MAX_TELEGRAMS            16          /* < Maximum number of telegrams loaded from file */
+#define DECODE_DEFAULT_ITERATIONS       100000      /* < Records written in check */
+#define DECODE_INPUT_LINE_SIZE          (BINARY_LOG_LINE_SIZE + 64)
+
+static double now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec / 1e3;
+}
+
+static void print_usage(const char *name)
+{
+    printf("Usage: %s [-f capture] [-q]      render capture, default stdin\n", name);
+    printf("       %s -b [-n records] [-t plaintext file]\n", name);
+}
+
+static char level_letter(binary_log_level_t level)
+{
+    switch(level)
+    {
+        case BINARY_LOG_LEVEL_ERROR: return 'E';
+        case BINARY_LOG_LEVEL_WARN: return 'W';
+        default: return 'I';
+    }
+}
+
+/* Former output of uart event task, without the console */
+static size_t format_direct(const uint8_t *data, size_t size, char *line, size_t line_size)
+{
+    size_t length = (size_t)snprintf(line, line_size, "Decrypted data size: %u, data: ", (unsigned int)size);
+    for(size_t i = 0; i < size && length + 2 < line_size; i++)
+    {
+        length += (size_t)snprintf(&line[length], line_size - length, "%02X", data[i]);
+    }
+    return length;
+}
+
+/* ===== RENDER ===== */
+static int render(FILE *input, bool quiet)
+{
+    static char input_line[DECODE_INPUT_LINE_SIZE];
+    static char message[BINARY_LOG_LINE_SIZE];
+    static binary_log_record_t record;
+    size_t prefix_length = strlen(BINARY_LOG_RAW_PREFIX);
+    size_t records = 0;
+    size_t invalid = 0;
+
+    while(fgets(input_line, sizeof(input_line), input) != NULL)
+    {
+        /* Prefix may follow other output on the same line, e.g. of the bootloader */
+        const char *raw = strstr(input_line, BINARY_LOG_RAW_PREFIX);
+        if(raw == NULL)
+        {
+            if(!quiet){ fputs(input_line, stdout); }
+            continue;
+        }
+
+        if(binary_log_decode_hex(raw + prefix_length, &record) != ESP_OK)
+        {
+            fprintf(stderr, "Invalid record: %s", input_line);
+            invalid++;
+            continue;
+        }
+
+        const char *tag = NULL;
+        binary_log_level_t level = binary_log_get_level(record.header.id, &tag);
+        binary_log_format(&record, message, sizeof(message));
+        printf("%c [%lu.%03lu] (%s) %s\n", level_letter(level), (unsigned long)(record.header.timestamp_us / 1000000),
+               (unsigned long)(record.header.timestamp_us / 1000 % 1000), tag, message);
+        records++;
+    }
+
+    fprintf(stderr, "%zu records, %zu invalid\n", records, invalid);
+    return invalid == 0 ? 0 : 1;
+}
+
+/* ===== CHECK ===== */
+static int check(const char *path, size_t iterations)
+{
+    static telegram_plaintext_t plaintexts[DECODE_MAX_TELEGRAMS];
+    static binary_log_record_t record;
+    static binary_log_record_t decoded;
+    static char expected[BINARY_LOG_LINE_SIZE];
+    static char message[BINARY_LOG_LINE_SIZE];
+    static char raw[BINARY_LOG_LINE_SIZE];
+    size_t failures = 0;
+
+    size_t count = telegram_load_hex_file(path, plaintexts, DECODE_MAX_TELEGRAMS);
+    if(count == 0)
+    {
+        fprintf(stderr, "No telegrams loaded from %s\n", path);
+        return 2;
+    }
+
+    /* Round trip of every telegram and of a record without arguments */
+    for(size_t i = 0; i < count; i++)
+    {
+        const telegram_plaintext_t *plaintext = &plaintexts[i];
+        BINARY_LOG_DATA(BINARY_LOG_UART_DECRYPTED_DATA, plaintext->data, plaintext->size, (uint32_t)plaintext->size);
+        BINARY_LOG(BINARY_LOG_UART_PARITY_ERROR);
+        BINARY_LOG(BINARY_LOG_UART_EVENT, 7);
+
+        format_direct(plaintext->data, plaintext->size, expected, sizeof(expected));
+        const char *expected_messages[] = {expected, "Parity Error", "Event Type: 7"};
+        for(size_t m = 0; m < 3; m++)
+        {
+            bool valid = binary_log_read(&record) && binary_log_encode_hex(&record, raw, sizeof(raw)) > 0 &&
+                         binary_log_decode_hex(raw, &decoded) == ESP_OK && binary_log_format(&decoded, message, sizeof(message)) == ESP_OK;
+            if(!valid || strcmp(message, expected_messages[m]) != 0)
+            {
+                fprintf(stderr, "Telegram %zu, record %zu: got \"%s\", expected \"%s\"\n", i, m, valid ? message : "", expected_messages[m]);
+                failures++;
+            }
+        }
+    }
+
+    /* Full ring drops records instead of blocking */
+    size_t written = 0;
+    while(BINARY_LOG_DATA(BINARY_LOG_UART_DECRYPTED_DATA, plaintexts[0].data, plaintexts[0].size, (uint32_t)plaintexts[0].size)){ written++; }
+    size_t read = 0;
+    while(binary_log_read(&record)){ read++; }
+    if(read != written || binary_log_dropped() != 1)
+    {
+        fprintf(stderr, "Full ring: %zu written, %zu read, %lu dropped\n", written, read, (unsigned long)binary_log_dropped());
+        failures++;
+    }
+    printf("Ring of %d bytes holds %zu telegram dumps of %zu bytes\n", BINARY_LOG_RING_SIZE, written, plaintexts[0].size);
+
+    /* Cost on the meter path, ring is drained between telegrams like by the formatter task */
+    double write_us = 0;
+    double direct_us = 0;
+    double format_us = 0;
+    size_t checksum = 0;
+    for(size_t n = 0; n < iterations; n++)
+    {
+        const telegram_plaintext_t *plaintext = &plaintexts[n % count];
+
+        double start = now_us();
+        BINARY_LOG_DATA(BINARY_LOG_UART_DECRYPTED_DATA, plaintext->data, plaintext->size, (uint32_t)plaintext->size);
+        write_us += now_us() - start;
+
+        start = now_us();
+        checksum += format_direct(plaintext->data, plaintext->size, expected, sizeof(expected));
+        direct_us += now_us() - start;
+
+        start = now_us();
+        binary_log_read(&record);
+        binary_log_format(&record, message, sizeof(message));
+        format_us += now_us() - start;
+    }
+    printf("Telegram dump of %zu records: write %.3f us, deferred formatting %.3f us, direct formatting %.3f us (checksum %zu)\n",
+           iterations, write_us / iterations, format_us / iterations, direct_us / iterations, checksum);
+    printf("Console output of the direct dump is not included, at 115200 baud it takes about %.1f ms per telegram\n",
+           (2.0 * plaintexts[0].size + 32) * 10 / 115.2);
+
+    printf("%s\n", failures == 0 ? "All checks passed" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
+
+/* ===== MAIN ===== */
+int main(int argc, char **argv)
+{
+    const char *capture = NULL;
+    const char *path = HOST_DATA_DIR "/sample_plaintext.hex";
+    size_t iterations = DECODE_DEFAULT_ITERATIONS;
+    bool bench = false;
+    bool quiet = false;
+
+    int opt;
+    while((opt = getopt(argc, argv, "f:bn:t:qh")) != -1)
+    {
+        switch(opt)
+        {
+            case 'f': capture = optarg; break;
+            case 'b': bench = true; break;
+            case 'n': iterations = (size_t)strtoul(optarg, NULL, 10); break;
+            case 't': path = optarg; break;
+            case 'q': quiet = true; break;
+            default: print_usage(argv[0]); return 2;
+        }
+    }
+
+    if(bench)
+    {
+        if(iterations == 0)
+        {
+            print_usage(argv[0]);
+            return 2;
+        }
+        return check(path, iterations);
+    }
+
+    FILE *input = capture != NULL ? fopen(capture, "r") : stdin;
+    if(input == NULL)
+    {
+        fprintf(stderr, "Cannot open %s\n", capture);
+        return 2;
+    }
+    int result = render(input, quiet);
+    if(input != stdin){ fclose(input); }
+    return result;
+}
@@ -0,0 +1,503 @@
+/**
+ * @file capture_archive_tool.c
+ * @brief Converts raw telegram captures into an indexed archive, lists and queries archives
+ *
+ * Captures of the firmware are appended to an archive with the system title and frame counter of every
+ * telegram. Queries for a meter or a time range only search the index of the mapped archive.
+ * With -B a fleet is written by a streaming writer while reader threads open the growing archive and
+ * check their queries, then queries are timed against a sequential scan of all telegrams.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#define _GNU_SOURCE
+#include <getopt.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "telegram.h"
+#include "capture_archive.h"
+#include "meter_capture.h"
+
+/* ===== TOOL CONFIGURATION ===== */
+#define TOOL_MAX_DUMP_SIZE              (16 * 1024 * 1024)
+#define TOOL_MAX_METERS                 4096
+
+/* Benchmark */
+#define BENCH_DEFAULT_METERS            32
+#define BENCH_DEFAULT_TELEGRAMS         8640        /* < Per meter, 12 hours */
+#define BENCH_DEFAULT_READERS           2
+#define BENCH_TELEGRAM_INTERVAL_MS      5000        /* < Sagemcom T210-D sends every 5 seconds */
+#define BENCH_START_MS                  1672531200000LL /* < 2023-01-01 00:00 UTC */
+#define BENCH_RANGE_MS                  (3600 * 1000LL) /* < Time range of timed queries */
+#define BENCH_QUERIES                   200         /* < Timed queries of each kind */
+#define BENCH_FIRST_FRAME_COUNTER       0x00010001
+
+/* Telegrams of a meter in an archive */
+typedef struct {
+    uint64_t meter_id;
+    size_t count;
+    int64_t first_ms;
+    int64_t last_ms;
+    uint32_t first_frame_counter;
+    uint32_t last_frame_counter;
+} meter_summary_t;
+
+/* State shared with readers of the benchmark */
+static struct {
+    const char *path;
+    size_t meter_count;
+    volatile bool writing;
+    pthread_mutex_t mutex;
+    size_t opens;
+    size_t queries;
+    size_t records;
+    size_t errors;
+} bench = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/* ===== HELPER FUNCTIONS ===== */
+static void print_usage(const char *name)
+{
+    printf("Usage: %s -c archive capture...                       convert captures\n", name);
+    printf("       %s -l archive                                  list meters\n", name);
+    printf("       %s -q archive [-m meter] [-a from ms] [-b to ms] [-v]   query\n", name);
+    printf("       %s -B archive [-M meters] [-n telegrams] [-r readers]  benchmark\n", name);
+}
+
+static double now_s()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t bench_meter_id(size_t meter)
+{
+    telegram_params_t params;
+    telegram_default_params(&params);
+    uint64_t meter_id = 0;
+    for(size_t i = 0; i < TELEGRAM_SYSTEM_TITLE_LENGTH; i++){ meter_id = (meter_id << 8) | params.system_title[i]; }
+    return (meter_id & ~0xFFFFULL) | (0x100 + meter);
+}
+
+/* ===== CONVERT ===== */
+static int convert(const char *archive, char **captures, size_t capture_count)
+{
+    capture_archive_writer_t writer;
+    if(capture_archive_create(&writer, archive) != ESP_OK)
+    {
+        fprintf(stderr, "Cannot create %s\n", archive);
+        return 2;
+    }
+    uint8_t *dump = malloc(TOOL_MAX_DUMP_SIZE);
+    if(dump == NULL)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 2;
+    }
+
+    size_t appended = 0, skipped = 0;
+    for(size_t i = 0; i < capture_count; i++)
+    {
+        FILE *file = fopen(captures[i], "rb");
+        size_t size = file != NULL ? fread(dump, 1, TOOL_MAX_DUMP_SIZE, file) : 0;
+        if(file != NULL){ fclose(file); }
+
+        meter_capture_file_header_t header;
+        esp_err_t err = meter_capture_parse_header(dump, size, &header);
+        if(err != ESP_OK && err != ESP_ERR_INVALID_CRC)
+        {
+            fprintf(stderr, "%s: no valid capture (0x%x)\n", captures[i], err);
+            continue;
+        }
+
+        /* Telegrams without M-Bus and DLMS header can't be assigned to a meter */
+        size_t offset = 0;
+        meter_capture_record_t record;
+        while(meter_capture_next_record(&dump[sizeof(header)], header.records_size, &offset, &record) == ESP_OK)
+        {
+            uint64_t meter_id = 0;
+            uint32_t frame_counter = 0;
+            if(capture_archive_identify(record.data, record.header.size, &meter_id, &frame_counter) != ESP_OK)
+            {
+                skipped++;
+                continue;
+            }
+            if(capture_archive_append(&writer, meter_id, record.header.timestamp_ms, frame_counter, record.data, record.header.size) != ESP_OK)
+            {
+                fprintf(stderr, "Writing %s failed\n", archive);
+                free(dump);
+                return 2;
+            }
+            appended++;
+        }
+    }
+    free(dump);
+
+    if(capture_archive_close(&writer) != ESP_OK)
+    {
+        fprintf(stderr, "Writing %s failed\n", archive);
+        return 2;
+    }
+    printf("%zu telegrams appended, %zu without meter skipped\n", appended, skipped);
+    return 0;
+}
+
+/* ===== LIST ===== */
+static int compare_summaries(const void *a, const void *b)
+{
+    uint64_t meter_a = ((const meter_summary_t *)a)->meter_id;
+    uint64_t meter_b = ((const meter_summary_t *)b)->meter_id;
+    return meter_a < meter_b ? -1 : meter_a > meter_b;
+}
+
+/* Meters of all index blocks, entries of a block are sorted by meter and time */
+static size_t summarize(const capture_archive_reader_t *reader, meter_summary_t *meters)
+{
+    size_t count = 0;
+    for(size_t s = 0; s < reader->segment_count; s++)
+    {
+        const capture_archive_segment_t *segment = &reader->segments[s];
+        for(size_t i = 0; i < segment->index->entry_count; i++)
+        {
+            const capture_archive_entry_t *entry = &segment->entries[i];
+            meter_summary_t search = {.meter_id = entry->meter_id};
+            meter_summary_t *meter = bsearch(&search, meters, count, sizeof(meter_summary_t), compare_summaries);
+            if(meter == NULL)
+            {
+                if(count == TOOL_MAX_METERS){ continue; }
+                meter = &meters[count++];
+                *meter = (meter_summary_t){entry->meter_id, 0, entry->timestamp_ms, entry->timestamp_ms, entry->frame_counter, entry->frame_counter};
+                qsort(meters, count, sizeof(meter_summary_t), compare_summaries);
+                meter = bsearch(&search, meters, count, sizeof(meter_summary_t), compare_summaries);
+            }
+            meter->count++;
+            if(entry->timestamp_ms < meter->first_ms){ meter->first_ms = entry->timestamp_ms; }
+            if(entry->timestamp_ms > meter->last_ms){ meter->last_ms = entry->timestamp_ms; }
+            if(entry->frame_counter < meter->first_frame_counter){ meter->first_frame_counter = entry->frame_counter; }
+            if(entry->frame_counter > meter->last_frame_counter){ meter->last_frame_counter = entry->frame_counter; }
+        }
+    }
+    return count;
+}
+
+static int list(const char *archive)
+{
+    capture_archive_reader_t reader;
+    esp_err_t err = capture_archive_open(&reader, archive);
+    if(err != ESP_OK)
+    {
+        fprintf(stderr, "Cannot open %s (0x%x)\n", archive, err);
+        return 2;
+    }
+
+    static meter_summary_t meters[TOOL_MAX_METERS];
+    size_t count = summarize(&reader, meters);
+    printf("%-16s %10s %16s %16s %12s %12s\n", "meter", "telegrams", "first ms", "last ms", "first fc", "last fc");
+    for(size_t i = 0; i < count; i++)
+    {
+        printf("%016llx %10zu %16lld %16lld %12lu %12lu\n", (unsigned long long)meters[i].meter_id, meters[i].count,
+               (long long)meters[i].first_ms, (long long)meters[i].last_ms, (unsigned long)meters[i].first_frame_counter,
+               (unsigned long)meters[i].last_frame_counter);
+    }
+    printf("%zu telegrams, %zu meters, %zu index blocks, %.1f MB\n", reader.entry_count, count, reader.segment_count, reader.size / 1e6);
+    capture_archive_close_reader(&reader);
+    return 0;
+}
+
+/* ===== QUERY ===== */
+static int query(const char *archive, uint64_t meter_id, int64_t from_ms, int64_t to_ms, bool verbose)
+{
+    capture_archive_reader_t reader;
+    esp_err_t err = capture_archive_open(&reader, archive);
+    if(err != ESP_OK)
+    {
+        fprintf(stderr, "Cannot open %s (0x%x)\n", archive, err);
+        return 2;
+    }
+
+    capture_archive_query_t q;
+    capture_archive_record_t record;
+    size_t found = 0, damaged = 0;
+    capture_archive_query_init(&q, meter_id, from_ms, to_ms);
+    while((err = capture_archive_next(&reader, &q, &record)) != ESP_ERR_NOT_FOUND)
+    {
+        found++;
+        if(err == ESP_OK){ err = capture_archive_check(&reader, &record); }
+        if(err != ESP_OK){ damaged++; }
+        printf("%016llx %16lld fc %10lu, %4lu bytes%s", (unsigned long long)record.entry->meter_id, (long long)record.entry->timestamp_ms,
+               (unsigned long)record.entry->frame_counter, (unsigned long)record.entry->size, err == ESP_OK ? "" : ", damaged");
+        if(verbose && err == ESP_OK)
+        {
+            for(size_t i = 0; i < record.entry->size; i++){ printf("%s%02X", i == 0 ? "\n    " : "", record.data[i]); }
+        }
+        printf("\n");
+    }
+    printf("%zu telegrams, %zu damaged\n", found, damaged);
+    capture_archive_close_reader(&reader);
+    return damaged > 0 ? 1 : 0;
+}
+
+/* ===== BENCHMARK ===== */
+/* Telegrams of a meter must be complete up to the newest published index, with consecutive frame counters */
+static void *bench_reader(void *arg)
+{
+    unsigned int seed = (unsigned int)(uintptr_t)arg;
+    while(bench.writing)
+    {
+        capture_archive_reader_t reader;
+        if(capture_archive_open(&reader, bench.path) != ESP_OK){ continue; }
+
+        size_t queries = 0, records = 0, errors = 0;
+        for(int i = 0; i < 16; i++)
+        {
+            uint64_t meter_id = bench_meter_id((size_t)rand_r(&seed) % bench.meter_count);
+            capture_archive_query_t q;
+            capture_archive_record_t record;
+            capture_archive_query_init(&q, meter_id, INT64_MIN, INT64_MAX);
+            uint32_t expected = BENCH_FIRST_FRAME_COUNTER;
+            esp_err_t err;
+            while((err = capture_archive_next(&reader, &q, &record)) != ESP_ERR_NOT_FOUND)
+            {
+                if(err == ESP_OK){ err = capture_archive_check(&reader, &record); }
+                if(err != ESP_OK || record.entry->meter_id != meter_id || record.entry->frame_counter != expected){ errors++; }
+                expected = record.entry->frame_counter + 1;
+                records++;
+            }
+            queries++;
+        }
+        capture_archive_close_reader(&reader);
+
+        pthread_mutex_lock(&bench.mutex);
+        bench.opens++;
+        bench.queries += queries;
+        bench.records += records;
+        bench.errors += errors;
+        pthread_mutex_unlock(&bench.mutex);
+    }
+    return NULL;
+}
+
+static int bench_write(const char *archive, size_t meter_count, size_t telegrams)
+{
+    static telegram_plaintext_t plaintexts[16];
+    size_t plaintext_count = telegram_load_hex_file(HOST_DATA_DIR "/sample_plaintext.hex", plaintexts, 16);
+    if(plaintext_count == 0)
+    {
+        fprintf(stderr, "No telegrams loaded\n");
+        return -1;
+    }
+
+    capture_archive_writer_t writer;
+    if(capture_archive_create(&writer, archive) != ESP_OK)
+    {
+        fprintf(stderr, "Cannot create %s\n", archive);
+        return -1;
+    }
+
+    /* All meters send every 5 seconds, in arrival order like a gateway */
+    telegram_params_t *params = calloc(meter_count, sizeof(telegram_params_t));
+    if(params == NULL){ return -1; }
+    for(size_t m = 0; m < meter_count; m++)
+    {
+        telegram_default_params(&params[m]);
+        uint64_t meter_id = bench_meter_id(m);
+        for(size_t i = 0; i < TELEGRAM_SYSTEM_TITLE_LENGTH; i++){ params[m].system_title[i] = (uint8_t)(meter_id >> (8 * (7 - i))); }
+        params[m].frame_counter = BENCH_FIRST_FRAME_COUNTER - 1;
+    }
+
+    double start = now_s();
+    for(size_t t = 0; t < telegrams; t++)
+    {
+        for(size_t m = 0; m < meter_count; m++)
+        {
+            uint8_t telegram[TELEGRAM_MAX_SIZE];
+            telegram_plaintext_t plaintext = plaintexts[t % plaintext_count];
+            telegram_set_register(&plaintext, 1, 7, (uint64_t)((t * 37 + m * 100) % 10000));
+            params[m].frame_counter++;
+            size_t size = telegram_build(&params[m], plaintext.data, plaintext.size, telegram, sizeof(telegram));
+
+            uint64_t meter_id = 0;
+            uint32_t frame_counter = 0;
+            int64_t timestamp_ms = BENCH_START_MS + (int64_t)t * BENCH_TELEGRAM_INTERVAL_MS + (int64_t)m;
+            if(size == 0 || capture_archive_identify(telegram, size, &meter_id, &frame_counter) != ESP_OK ||
+               capture_archive_append(&writer, meter_id, timestamp_ms, frame_counter, telegram, size) != ESP_OK)
+            {
+                fprintf(stderr, "Appending telegram %zu of meter %zu failed\n", t, m);
+                free(params);
+                return -1;
+            }
+        }
+    }
+    free(params);
+    esp_err_t err = capture_archive_close(&writer);
+    double elapsed = now_s() - start;
+    printf("Wrote %zu telegrams in %.2f s, %.0f telegrams/s, index block every %d telegrams\n", meter_count * telegrams, elapsed,
+           meter_count * telegrams / elapsed, CAPTURE_ARCHIVE_CHECKPOINT_RECORDS);
+    return err == ESP_OK ? 0 : -1;
+}
+
+/* Telegrams in range found by reading every block from the start, like a capture without index */
+static size_t scan(const capture_archive_reader_t *reader, uint64_t meter_id, int64_t from_ms, int64_t to_ms)
+{
+    size_t found = 0;
+    size_t offset = sizeof(capture_archive_header_t);
+    while(offset + sizeof(capture_archive_block_t) <= reader->size)
+    {
+        capture_archive_block_t block;
+        memcpy(&block, &reader->data[offset], sizeof(block));
+        if(block.magic != CAPTURE_ARCHIVE_BLOCK_MAGIC){ break; }
+        if(block.type == CaptureArchiveTelegram)
+        {
+            capture_archive_telegram_t telegram;
+            memcpy(&telegram, &reader->data[offset + sizeof(block)], sizeof(telegram));
+            if((meter_id == CAPTURE_ARCHIVE_ANY_METER || telegram.meter_id == meter_id) && telegram.timestamp_ms >= from_ms &&
+               telegram.timestamp_ms <= to_ms){ found++; }
+        }
+        offset += sizeof(block) + ((block.size + 7) & ~(size_t)7);
+    }
+    return found;
+}
+
+static size_t count_query(const capture_archive_reader_t *reader, uint64_t meter_id, int64_t from_ms, int64_t to_ms, size_t *errors)
+{
+    capture_archive_query_t q;
+    capture_archive_record_t record;
+    size_t found = 0;
+    esp_err_t err;
+    capture_archive_query_init(&q, meter_id, from_ms, to_ms);
+    while((err = capture_archive_next(reader, &q, &record)) != ESP_ERR_NOT_FOUND)
+    {
+        if(err != ESP_OK){ (*errors)++; }
+        found++;
+    }
+    return found;
+}
+
+static int benchmark(const char *archive, size_t meter_count, size_t telegrams, size_t reader_count)
+{
+    bench.path = archive;
+    bench.meter_count = meter_count;
+    bench.writing = true;
+
+    /* Readers start before the first index block and open the growing archive again and again */
+    pthread_t *readers = calloc(reader_count, sizeof(pthread_t));
+    for(size_t i = 0; i < reader_count; i++){ pthread_create(&readers[i], NULL, bench_reader, (void *)(uintptr_t)(i + 1)); }
+    int result = bench_write(archive, meter_count, telegrams);
+    bench.writing = false;
+    for(size_t i = 0; i < reader_count; i++){ pthread_join(readers[i], NULL); }
+    free(readers);
+    if(result != 0){ return 2; }
+    printf("%zu readers during write: %zu opens, %zu queries, %zu telegrams, %zu errors\n", reader_count, bench.opens, bench.queries,
+           bench.records, bench.errors);
+
+    capture_archive_reader_t reader;
+    double start = now_s();
+    esp_err_t err = capture_archive_open(&reader, archive);
+    double open_ms = (now_s() - start) * 1000.0;
+    if(err != ESP_OK)
+    {
+        fprintf(stderr, "Cannot open %s (0x%x)\n", archive, err);
+        return 2;
+    }
+    printf("Opened %.1f MB, %zu telegrams in %zu index block in %.1f ms\n", reader.size / 1e6, reader.entry_count, reader.segment_count, open_ms);
+
+    /* Every meter complete, random ranges by index and by scan */
+    size_t errors = 0;
+    for(size_t m = 0; m < meter_count; m++)
+    {
+        if(count_query(&reader, bench_meter_id(m), INT64_MIN, INT64_MAX, &errors) != telegrams){ errors++; }
+    }
+
+    unsigned int seed = 1;
+    int64_t span_ms = (int64_t)telegrams * BENCH_TELEGRAM_INTERVAL_MS;
+    size_t meter_found = 0, range_found = 0;
+    start = now_s();
+    for(int i = 0; i < BENCH_QUERIES; i++)
+    {
+        int64_t from_ms = BENCH_START_MS + (span_ms > BENCH_RANGE_MS ? rand_r(&seed) % (span_ms - BENCH_RANGE_MS) : 0);
+        meter_found += count_query(&reader, bench_meter_id((size_t)rand_r(&seed) % meter_count), from_ms, from_ms + BENCH_RANGE_MS - 1, &errors);
+    }
+    double meter_us = (now_s() - start) * 1e6 / BENCH_QUERIES;
+    start = now_s();
+    for(int i = 0; i < BENCH_QUERIES; i++)
+    {
+        int64_t from_ms = BENCH_START_MS + (span_ms > BENCH_RANGE_MS ? rand_r(&seed) % (span_ms - BENCH_RANGE_MS) : 0);
+        range_found += count_query(&reader, CAPTURE_ARCHIVE_ANY_METER, from_ms, from_ms + BENCH_RANGE_MS - 1, &errors);
+    }
+    double range_us = (now_s() - start) * 1e6 / BENCH_QUERIES;
+
+    start = now_s();
+    size_t scanned = scan(&reader, bench_meter_id(0), BENCH_START_MS, BENCH_START_MS + BENCH_RANGE_MS - 1);
+    double scan_us = (now_s() - start) * 1e6;
+    size_t indexed = count_query(&reader, bench_meter_id(0), BENCH_START_MS, BENCH_START_MS + BENCH_RANGE_MS - 1, &errors);
+    capture_archive_close_reader(&reader);
+
+    /* One hour of 5 second telegrams */
+    size_t per_hour = (size_t)(BENCH_RANGE_MS / BENCH_TELEGRAM_INTERVAL_MS);
+    if(span_ms >= BENCH_RANGE_MS && (meter_found != BENCH_QUERIES * per_hour || range_found != BENCH_QUERIES * per_hour * meter_count)){ errors++; }
+    if(scanned != indexed){ errors++; }
+
+    printf("meter, 1 h:  %8.1f us per query with index\n", meter_us);
+    printf("all, 1 h:    %8.1f us per query with index\n", range_us);
+    printf("meter, 1 h:  %8.1f us by sequential scan\n", scan_us);
+    if(errors > 0 || bench.errors > 0)
+    {
+        fprintf(stderr, "%zu queries differ\n", errors + bench.errors);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *converted = NULL;
+    const char *listed = NULL;
+    const char *queried = NULL;
+    const char *benchmarked = NULL;
+    uint64_t meter_id = CAPTURE_ARCHIVE_ANY_METER;
+    int64_t from_ms = INT64_MIN;
+    int64_t to_ms = INT64_MAX;
+    size_t meter_count = BENCH_DEFAULT_METERS;
+    size_t telegrams = BENCH_DEFAULT_TELEGRAMS;
+    size_t reader_count = BENCH_DEFAULT_READERS;
+    bool verbose = false;
+
+    int opt;
+    while((opt = getopt(argc, argv, "c:l:q:B:m:a:b:M:n:r:vh")) != -1)
+    {
+        switch(opt)
+        {
+            case 'c': converted = optarg; break;
+            case 'l': listed = optarg; break;
+            case 'q': queried = optarg; break;
+            case 'B': benchmarked = optarg; break;
+            case 'm': meter_id = strtoull(optarg, NULL, 16); break;
+            case 'a': from_ms = strtoll(optarg, NULL, 10); break;
+            case 'b': to_ms = strtoll(optarg, NULL, 10); break;
+            case 'M': meter_count = (size_t)strtoul(optarg, NULL, 10); break;
+            case 'n': telegrams = (size_t)strtoul(optarg, NULL, 10); break;
+            case 'r': reader_count = (size_t)strtoul(optarg, NULL, 10); break;
+            case 'v': verbose = true; break;
+            default: print_usage(argv[0]); return 2;
+        }
+    }
+    int modes = (converted != NULL) + (listed != NULL) + (queried != NULL) + (benchmarked != NULL);
+    if(modes != 1 || (converted != NULL) != (optind < argc) || meter_count == 0 || meter_count > 0xFF00 || telegrams == 0)
+    {
+        print_usage(argv[0]);
+        return 2;
+    }
+
+    if(converted != NULL){ return convert(converted, &argv[optind], (size_t)(argc - optind)); }
+    if(listed != NULL){ return list(listed); }
+    if(queried != NULL){ return query(queried, meter_id, from_ms, to_ms, verbose); }
+    return benchmark(benchmarked, meter_count, telegrams, reader_count);
+}
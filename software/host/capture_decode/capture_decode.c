@@ -0,0 +1,845 @@
+/**
+ * @file capture_decode.c
+ * @brief Decodes archived raw telegram captures of many meters with a pool of worker threads
+ *
+ * Captures are dumps of the capture ring as written by the firmware, e.g. collected from a fleet.
+ * Files are mapped and indexed in parallel, then the records are decoded in batches by the workers with
+ * the M-Bus, DLMS and OBIS layer of the firmware. A meter is identified by the system title of its
+ * telegrams, its key is looked up in a key file. Every worker has its own frame and decryption context,
+ * the expanded key is reused while the telegrams of a batch are from the same meter.
+ * With -g a fleet of meters with their own keys is generated and decoded as a check. With -o the decoded
+ * registers are exported to a columnar file in the order of the captures.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "telegram.h"
+#include "obis.h"
+#include "meter_capture.h"
+#include "flash_ops.h"
+#include "obis_columns.h"
+
+/* ===== DECODER CONFIGURATION ===== */
+#define DECODE_BATCH_RECORDS            1024        /* < Records decoded by a worker at once */
+#define DECODE_MAX_METERS               4096        /* < Distinct system titles */
+#define DECODE_METER_TABLE_SIZE         8192        /* < Slots of meter table of a worker, power of two */
+#define DECODE_LINE_LENGTH              256
+#define DECODE_PATH_LENGTH              512
+
+/* Generated fleet */
+#define DECODE_DEFAULT_METERS           16
+#define DECODE_DEFAULT_FILES            2           /* < Capture files per meter */
+#define DECODE_DEFAULT_RECORDS          8192        /* < Records per capture file */
+#define DECODE_TELEGRAM_INTERVAL_MS     5000        /* < Sagemcom T210-D sends every 5 seconds */
+
+/* Layer in which decoding failed */
+enum DecodeLayer
+{
+    LayerMbus,
+    LayerDlms,
+    LayerObis,
+    LayerCount
+};
+
+static const char *layer_names[LayerCount] = {"mbus", "dlms", "obis"};
+
+/* Mapped capture file with offsets of its records */
+typedef struct {
+    const char *path;
+    const uint8_t *dump;
+    size_t size;
+    esp_err_t err;                      /* < Result of header check */
+    const uint8_t *records;
+    size_t records_size;
+    uint32_t *offsets;
+    size_t record_count;
+} capture_file_t;
+
+/* Records of one file decoded by a worker at once */
+typedef struct {
+    capture_file_t *file;
+    size_t first;
+    size_t count;
+} decode_batch_t;
+
+/* Decoded telegram for export */
+typedef struct {
+    uint64_t title;
+    int64_t timestamp_ms;
+    uint32_t frame_counter;
+    obis_data_t obis;
+} export_row_t;
+
+/* Key of a meter from key file */
+typedef struct {
+    uint64_t title;
+    uint8_t key[GUE_KEY_LENGTH];
+} meter_key_t;
+
+/* Counters of one meter, title 0 collects telegrams without valid M-Bus layer */
+typedef struct {
+    uint64_t title;
+    bool used;
+    uint64_t records;
+    uint64_t decoded;
+    uint32_t min_frame_counter;
+    uint32_t max_frame_counter;
+} meter_stats_t;
+
+/* State of one worker */
+typedef struct {
+    pthread_t thread;
+    dlms_decryptor_t decryptor;
+    frame_t frame;
+    obis_data_t obis;
+    meter_stats_t *meters;              /* < Open addressing by title */
+    uint64_t records;
+    uint64_t bytes;
+    uint64_t failed[LayerCount];
+    uint64_t key_changes;               /* < Expansions of a key */
+    bool full;                          /* < More meters than DECODE_MAX_METERS */
+    export_row_t *rows;                 /* < Decoded telegrams of current batch, with -o */
+    size_t row_count;
+} decode_worker_t;
+
+static capture_file_t *files = NULL;
+static size_t file_count = 0;
+static decode_batch_t *batches = NULL;
+static size_t batch_count = 0;
+static meter_key_t *keys = NULL;
+static size_t key_count = 0;
+static uint8_t default_key[GUE_KEY_LENGTH];
+
+/* Next file or batch of workers */
+static size_t next_item = 0;
+
+static bool verbose = false;
+static bool context_per_telegram = false;
+
+/* Export with -o, batches are written in order */
+static obis_columns_writer_t *exporter = NULL;
+static esp_err_t export_err = ESP_OK;
+static size_t next_export = 0;
+static pthread_mutex_t export_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t export_cond = PTHREAD_COND_INITIALIZER;
+
+/* ===== HELPER FUNCTIONS ===== */
+static void print_usage(const char *name)
+{
+    printf("Usage: %s [-k key file] [-K key hex] [-w workers] [-o columns file] [-p] [-m] [-q] [-v] capture...\n", name);
+    printf("       %s -g directory [-M meters] [-F files per meter] [-n records per file] [-t plaintext file] [-w workers] [-o columns file] [-p] [-m]\n", name);
+    printf("  key file: one line per meter with system title hex and key hex, other meters use -K or the key of general.h\n");
+    printf("  -p new decryption context per telegram like parse_dlms_layer, -m counters per meter, -v values per telegram\n");
+    printf("  -o decoded registers as columnar file, time of meter or else time of capture record\n");
+    printf("  exit code 2 if a capture can't be opened or has no valid header, 1 if no telegram was decoded\n");
+}
+
+static double now_s()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int parse_hex(const char *hex, uint8_t *data, size_t size)
+{
+    if(strlen(hex) != size * 2){ return -1; }
+    for(size_t i = 0; i < size; i++)
+    {
+        unsigned int byte;
+        if(sscanf(&hex[i * 2], "%2x", &byte) != 1){ return -1; }
+        data[i] = (uint8_t)byte;
+    }
+    return 0;
+}
+
+/* System title as number, big endian so it prints like the bytes */
+static uint64_t title_value(const uint8_t *title, size_t length)
+{
+    uint64_t value = 0;
+    for(size_t i = 0; i < length; i++){ value = (value << 8) | title[i]; }
+    return value;
+}
+
+/* Runs function on count threads and waits for them */
+static int run_workers(decode_worker_t *workers, size_t count, void *(*function)(void *))
+{
+    next_item = 0;
+    for(size_t i = 0; i < count; i++)
+    {
+        if(pthread_create(&workers[i].thread, NULL, function, &workers[i]) != 0){ return -1; }
+    }
+    for(size_t i = 0; i < count; i++){ pthread_join(workers[i].thread, NULL); }
+    return 0;
+}
+
+static size_t take_item()
+{
+    return __atomic_fetch_add(&next_item, 1, __ATOMIC_RELAXED);
+}
+
+/* ===== KEYS ===== */
+static int compare_keys(const void *a, const void *b)
+{
+    uint64_t title_a = ((const meter_key_t *)a)->title;
+    uint64_t title_b = ((const meter_key_t *)b)->title;
+    return title_a < title_b ? -1 : title_a > title_b;
+}
+
+static int load_keys(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if(file == NULL)
+    {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return -1;
+    }
+
+    keys = calloc(DECODE_MAX_METERS, sizeof(meter_key_t));
+    if(keys == NULL)
+    {
+        fclose(file);
+        return -1;
+    }
+
+    char line[DECODE_LINE_LENGTH];
+    unsigned int line_number = 0;
+    while(fgets(line, sizeof(line), file) != NULL)
+    {
+        line_number++;
+        if(line[0] == '#' || line[0] == '\n'){ continue; }
+
+        char title_hex[2 * TELEGRAM_SYSTEM_TITLE_LENGTH + 2];
+        char key_hex[2 * GUE_KEY_LENGTH + 2];
+        uint8_t title[TELEGRAM_SYSTEM_TITLE_LENGTH];
+        if(sscanf(line, "%17s %33s", title_hex, key_hex) != 2 || key_count == DECODE_MAX_METERS ||
+           parse_hex(title_hex, title, sizeof(title)) != 0 || parse_hex(key_hex, keys[key_count].key, GUE_KEY_LENGTH) != 0)
+        {
+            fprintf(stderr, "%s:%u: invalid key\n", path, line_number);
+            fclose(file);
+            return -1;
+        }
+        keys[key_count].title = title_value(title, sizeof(title));
+        key_count++;
+    }
+    fclose(file);
+
+    qsort(keys, key_count, sizeof(meter_key_t), compare_keys);
+    return 0;
+}
+
+static const uint8_t *find_key(uint64_t title)
+{
+    meter_key_t search = {.title = title};
+    const meter_key_t *key = key_count > 0 ? bsearch(&search, keys, key_count, sizeof(meter_key_t), compare_keys) : NULL;
+    return key != NULL ? key->key : default_key;
+}
+
+/* ===== INDEX ===== */
+static int map_file(capture_file_t *file)
+{
+    int fd = open(file->path, O_RDONLY);
+    if(fd < 0){ return -1; }
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return -1;
+    }
+    void *dump = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(dump == MAP_FAILED){ return -1; }
+
+    madvise(dump, (size_t)st.st_size, MADV_SEQUENTIAL);
+    file->dump = dump;
+    file->size = (size_t)st.st_size;
+    return 0;
+}
+
+/* Check header and collect record offsets, damaged records are decoded anyway */
+static void index_file(capture_file_t *file)
+{
+    meter_capture_file_header_t header;
+    file->err = map_file(file) == 0 ? meter_capture_parse_header(file->dump, file->size, &header) : ESP_FAIL;
+    if(file->err != ESP_OK && file->err != ESP_ERR_INVALID_CRC){ return; }
+
+    file->records = &file->dump[sizeof(header)];
+    file->records_size = header.records_size;
+    file->offsets = malloc(header.record_count * sizeof(uint32_t));
+    if(file->offsets == NULL)
+    {
+        file->err = ESP_ERR_NO_MEM;
+        return;
+    }
+
+    size_t offset = 0;
+    meter_capture_record_t record;
+    while(file->record_count < header.record_count)
+    {
+        size_t record_offset = offset;
+        if(meter_capture_next_record(file->records, file->records_size, &offset, &record) != ESP_OK){ break; }
+        file->offsets[file->record_count++] = (uint32_t)record_offset;
+    }
+}
+
+static void *index_thread(void *arg)
+{
+    for(size_t i = take_item(); i < file_count; i = take_item()){ index_file(&files[i]); }
+    return NULL;
+}
+
+/* Batches never span files, so a batch is mostly of one meter */
+static int build_batches()
+{
+    size_t count = 0;
+    for(size_t i = 0; i < file_count; i++){ count += (files[i].record_count + DECODE_BATCH_RECORDS - 1) / DECODE_BATCH_RECORDS; }
+
+    batches = calloc(count > 0 ? count : 1, sizeof(decode_batch_t));
+    if(batches == NULL){ return -1; }
+    for(size_t i = 0; i < file_count; i++)
+    {
+        for(size_t first = 0; first < files[i].record_count; first += DECODE_BATCH_RECORDS)
+        {
+            size_t rest = files[i].record_count - first;
+            batches[batch_count++] = (decode_batch_t){&files[i], first, rest < DECODE_BATCH_RECORDS ? rest : DECODE_BATCH_RECORDS};
+        }
+    }
+    return 0;
+}
+
+/* ===== DECODE ===== */
+static meter_stats_t *find_meter(decode_worker_t *worker, uint64_t title)
+{
+    /* Fibonacci hashing, titles of a fleet differ in the last bytes */
+    size_t slot = (size_t)((title * 0x9E3779B97F4A7C15ULL) >> 51) & (DECODE_METER_TABLE_SIZE - 1);
+    for(size_t i = 0; i < DECODE_MAX_METERS; i++)
+    {
+        meter_stats_t *meter = &worker->meters[(slot + i) & (DECODE_METER_TABLE_SIZE - 1)];
+        if(!meter->used)
+        {
+            meter->used = true;
+            meter->title = title;
+            meter->min_frame_counter = UINT32_MAX;
+            return meter;
+        }
+        if(meter->title == title){ return meter; }
+    }
+    worker->full = true;
+    return NULL;
+}
+
+static void print_values(const capture_file_t *file, size_t index, uint64_t title, uint32_t frame_counter, const obis_data_t *obis)
+{
+    const obis_record_t *power = obis_find_record(obis, ActivePowerPlus);
+    const obis_record_t *energy = obis_find_record(obis, ActiveEnergyPlus);
+
+    /* One line at a time from all workers */
+    flockfile(stdout);
+    printf("%s:%zu: title %016llx, frame counter %lu, serial %.*s, power %lld, energy %lld\n", file->path, index, (unsigned long long)title,
+           (unsigned long)frame_counter, obis->serial_number_length, (const char *)obis->serial_number,
+           power != NULL ? (long long)power->value : -1LL, energy != NULL ? (long long)energy->value : -1LL);
+    funlockfile(stdout);
+}
+
+static void decode_record(decode_worker_t *worker, const capture_file_t *file, size_t index)
+{
+    frame_t *frame = &worker->frame;
+    size_t offset = file->offsets[index];
+    meter_capture_record_t record;
+    meter_capture_next_record(file->records, file->records_size, &offset, &record);
+
+    worker->records++;
+    worker->bytes += record.header.size;
+
+    /* Same decoding chain as uart event task, in place in the frame of the worker */
+    size_t user_data_size = 0;
+    esp_err_t err = record.header.size <= FRAME_POOL_FRAME_SIZE ? ESP_OK : ESP_ERR_INVALID_SIZE;
+    if(err == ESP_OK)
+    {
+        memcpy(frame->data, record.data, record.header.size);
+        frame->size = record.header.size;
+        frame->offset = 0;
+        err = parse_mbus_long_frame_layer(frame->data, frame->size, frame->data, &user_data_size);
+    }
+
+    /* System title selects the key */
+    uint8_t title_length = user_data_size > DLMS_SYSTEM_TITLE_LENGTH_OFFSET ? frame->data[DLMS_SYSTEM_TITLE_LENGTH_OFFSET] : 0;
+    if(err == ESP_OK && (title_length > TELEGRAM_SYSTEM_TITLE_LENGTH || (size_t)DLMS_SYSTEM_TITLE_OFFSET + title_length > user_data_size)){ err = ESP_FAIL; }
+    if(err != ESP_OK)
+    {
+        worker->failed[LayerMbus]++;
+        meter_stats_t *unknown = find_meter(worker, 0);
+        if(unknown != NULL){ unknown->records++; }
+        return;
+    }
+    uint64_t title = title_value(&frame->data[DLMS_SYSTEM_TITLE_OFFSET], title_length);
+    meter_stats_t *meter = find_meter(worker, title);
+    if(meter != NULL){ meter->records++; }
+
+    const uint8_t *key = find_key(title);
+    if(context_per_telegram)
+    {
+        err = parse_dlms_layer(frame->data, user_data_size, &frame->offset, &frame->size, key);
+        worker->key_changes++;
+    }
+    else
+    {
+        if(!worker->decryptor.has_key || memcmp(worker->decryptor.key, key, GUE_KEY_LENGTH) != 0){ worker->key_changes++; }
+        err = parse_dlms_layer_with(&worker->decryptor, frame->data, user_data_size, &frame->offset, &frame->size, key);
+    }
+    if(err != ESP_OK)
+    {
+        worker->failed[LayerDlms]++;
+        return;
+    }
+
+    /* A wrong key only shows in the OBIS layer, there is no authentication tag */
+    err = parse_obis(&frame->data[frame->offset], frame->size, &worker->obis);
+    if(err != ESP_OK)
+    {
+        worker->failed[LayerObis]++;
+        return;
+    }
+
+    uint32_t frame_counter = 0;
+    get_dlms_frame_counter(frame->data, user_data_size, &frame_counter);
+    if(meter != NULL)
+    {
+        meter->decoded++;
+        if(frame_counter < meter->min_frame_counter){ meter->min_frame_counter = frame_counter; }
+        if(frame_counter > meter->max_frame_counter){ meter->max_frame_counter = frame_counter; }
+    }
+    if(verbose){ print_values(file, index, title, frame_counter, &worker->obis); }
+    if(worker->rows != NULL)
+    {
+        export_row_t *row = &worker->rows[worker->row_count++];
+        uint32_t meter_time = 0;
+        row->title = title;
+        row->timestamp_ms = obis_timestamp_to_unix(worker->obis.timestamp, &meter_time) == ESP_OK ? meter_time * 1000LL : record.header.timestamp_ms;
+        row->frame_counter = frame_counter;
+        row->obis = worker->obis;
+    }
+}
+
+/* Rows of a batch after those of all batches before, batches are taken in order so the oldest one never waits */
+static void export_batch(decode_worker_t *worker, size_t batch)
+{
+    pthread_mutex_lock(&export_mutex);
+    while(next_export != batch){ pthread_cond_wait(&export_cond, &export_mutex); }
+    for(size_t i = 0; i < worker->row_count && export_err == ESP_OK; i++)
+    {
+        const export_row_t *row = &worker->rows[i];
+        export_err = obis_columns_append(exporter, row->title, row->timestamp_ms, row->frame_counter, &row->obis);
+    }
+    next_export++;
+    pthread_cond_broadcast(&export_cond);
+    pthread_mutex_unlock(&export_mutex);
+    worker->row_count = 0;
+}
+
+static void *decode_thread(void *arg)
+{
+    decode_worker_t *worker = arg;
+    for(size_t i = take_item(); i < batch_count; i = take_item())
+    {
+        const decode_batch_t *batch = &batches[i];
+        for(size_t j = 0; j < batch->count; j++){ decode_record(worker, batch->file, batch->first + j); }
+        if(worker->rows != NULL){ export_batch(worker, i); }
+    }
+    return NULL;
+}
+
+/* ===== RESULTS ===== */
+static int compare_meters(const void *a, const void *b)
+{
+    uint64_t title_a = ((const meter_stats_t *)a)->title;
+    uint64_t title_b = ((const meter_stats_t *)b)->title;
+    return title_a < title_b ? -1 : title_a > title_b;
+}
+
+/* Counters of all workers by meter, sorted by title */
+static size_t merge_meters(decode_worker_t *workers, size_t worker_count, meter_stats_t *merged)
+{
+    size_t count = 0;
+    decode_worker_t *total = &workers[0];
+    for(size_t w = 1; w < worker_count; w++)
+    {
+        for(size_t i = 0; i < DECODE_METER_TABLE_SIZE; i++)
+        {
+            const meter_stats_t *meter = &workers[w].meters[i];
+            if(!meter->used){ continue; }
+            meter_stats_t *target = find_meter(total, meter->title);
+            if(target == NULL){ continue; }
+            target->records += meter->records;
+            target->decoded += meter->decoded;
+            if(meter->min_frame_counter < target->min_frame_counter){ target->min_frame_counter = meter->min_frame_counter; }
+            if(meter->max_frame_counter > target->max_frame_counter){ target->max_frame_counter = meter->max_frame_counter; }
+        }
+    }
+    for(size_t i = 0; i < DECODE_METER_TABLE_SIZE; i++)
+    {
+        if(total->meters[i].used){ merged[count++] = total->meters[i]; }
+    }
+    qsort(merged, count, sizeof(meter_stats_t), compare_meters);
+    return count;
+}
+
+/* Frame counters between first and last one which were not decoded */
+static uint64_t missing_frames(const meter_stats_t *meter)
+{
+    if(meter->decoded == 0){ return 0; }
+    uint64_t span = (uint64_t)meter->max_frame_counter - meter->min_frame_counter + 1;
+    return span > meter->decoded ? span - meter->decoded : 0;
+}
+
+static void print_meters(const meter_stats_t *meters, size_t count)
+{
+    printf("%-16s %10s %10s %10s %12s %12s %10s\n", "title", "records", "decoded", "failed", "first fc", "last fc", "missing");
+    for(size_t i = 0; i < count; i++)
+    {
+        const meter_stats_t *m = &meters[i];
+        if(m->title == 0)
+        {
+            printf("%-16s %10llu %10s %10llu\n", "no mbus layer", (unsigned long long)m->records, "", (unsigned long long)m->records);
+            continue;
+        }
+        printf("%016llx %10llu %10llu %10llu %12lu %12lu %10llu\n", (unsigned long long)m->title, (unsigned long long)m->records,
+               (unsigned long long)m->decoded, (unsigned long long)(m->records - m->decoded),
+               m->decoded > 0 ? (unsigned long)m->min_frame_counter : 0UL, (unsigned long)m->max_frame_counter,
+               (unsigned long long)missing_frames(m));
+    }
+}
+
+/* ===== GENERATION ===== */
+static void meter_params(size_t meter, telegram_params_t *params)
+{
+    /* Titles above the default one of telegram.h */
+    telegram_default_params(params);
+    params->system_title[TELEGRAM_SYSTEM_TITLE_LENGTH - 2] = (uint8_t)((meter + 0x100) >> 8);
+    params->system_title[TELEGRAM_SYSTEM_TITLE_LENGTH - 1] = (uint8_t)meter;
+    for(size_t i = 0; i < GUE_KEY_LENGTH; i++){ params->key[i] ^= (uint8_t)((meter + 1) * (i + 7)); }
+}
+
+static int write_capture(const char *path, const uint8_t *dump, size_t size)
+{
+    FILE *file = fopen(path, "wb");
+    if(file == NULL || fwrite(dump, 1, size, file) != size)
+    {
+        fprintf(stderr, "Cannot write %s\n", path);
+        if(file != NULL){ fclose(file); }
+        return -1;
+    }
+    fclose(file);
+    return 0;
+}
+
+/* Capture files of a fleet, frame counters of a meter continue across its files, keys in keys.txt */
+static int generate(const char *directory, const char *plaintext_path, size_t meter_count, size_t files_per_meter, size_t records,
+                    char ***paths)
+{
+    static telegram_plaintext_t plaintexts[16];
+    size_t plaintext_count = telegram_load_hex_file(plaintext_path, plaintexts, 16);
+    if(plaintext_count == 0)
+    {
+        fprintf(stderr, "No telegrams loaded from %s\n", plaintext_path);
+        return -1;
+    }
+    if(mkdir(directory, 0755) != 0 && errno != EEXIST)
+    {
+        fprintf(stderr, "Cannot create %s\n", directory);
+        return -1;
+    }
+
+    char path[DECODE_PATH_LENGTH];
+    snprintf(path, sizeof(path), "%s/keys.txt", directory);
+    FILE *key_file = fopen(path, "w");
+    size_t dump_capacity = sizeof(meter_capture_file_header_t) + records * (sizeof(meter_capture_record_header_t) + sizeof(meter_capture_chunk_t) + TELEGRAM_MAX_SIZE);
+    uint8_t *dump = malloc(dump_capacity);
+    *paths = calloc(meter_count * files_per_meter, sizeof(char *));
+    if(key_file == NULL || dump == NULL || *paths == NULL)
+    {
+        fprintf(stderr, "Cannot generate fleet in %s\n", directory);
+        if(key_file != NULL){ fclose(key_file); }
+        free(dump);
+        return -1;
+    }
+
+    size_t bytes = 0;
+    for(size_t m = 0; m < meter_count; m++)
+    {
+        telegram_params_t params;
+        meter_params(m, &params);
+        fprintf(key_file, "%016llx ", (unsigned long long)title_value(params.system_title, TELEGRAM_SYSTEM_TITLE_LENGTH));
+        for(size_t i = 0; i < GUE_KEY_LENGTH; i++){ fprintf(key_file, "%02x", params.key[i]); }
+        fprintf(key_file, "\n");
+
+        for(size_t f = 0; f < files_per_meter; f++)
+        {
+            meter_capture_file_header_t header = {
+                .magic = METER_CAPTURE_MAGIC,
+                .version = METER_CAPTURE_FORMAT_VERSION,
+            };
+            size_t offset = sizeof(header);
+            for(size_t r = 0; r < records; r++)
+            {
+                uint8_t telegram[TELEGRAM_MAX_SIZE];
+                size_t index = f * records + r;
+                telegram_plaintext_t plaintext = plaintexts[index % plaintext_count];
+                telegram_set_register(&plaintext, 1, 7, (uint64_t)((index * 37 + m * 100) % 10000));
+                params.frame_counter++;
+                size_t size = telegram_build(&params, plaintext.data, plaintext.size, telegram, sizeof(telegram));
+
+                meter_capture_chunk_t chunk = {.offset_ms = 0, .size = (uint16_t)size};
+                size_t record_size = size > 0 ? meter_capture_encode_record((uint32_t)(index * DECODE_TELEGRAM_INTERVAL_MS), &chunk, 1, telegram,
+                                                                            size, &dump[offset], dump_capacity - offset) : 0;
+                if(record_size == 0)
+                {
+                    fprintf(stderr, "Encoding telegram %zu of meter %zu failed\n", index, m);
+                    fclose(key_file);
+                    free(dump);
+                    return -1;
+                }
+                offset += record_size;
+                header.record_count++;
+            }
+            header.records_size = (uint32_t)(offset - sizeof(header));
+            header.crc = flash_ops_crc32(0, &dump[sizeof(header)], header.records_size);
+            memcpy(dump, &header, sizeof(header));
+
+            snprintf(path, sizeof(path), "%s/meter%04zu_%02zu.bin", directory, m, f);
+            if(write_capture(path, dump, offset) != 0)
+            {
+                fclose(key_file);
+                free(dump);
+                return -1;
+            }
+            (*paths)[m * files_per_meter + f] = strdup(path);
+            bytes += offset;
+        }
+    }
+    fclose(key_file);
+    free(dump);
+
+    printf("Wrote %zu meters, %zu files, %zu records, %.1f MB to %s\n", meter_count, meter_count * files_per_meter,
+           meter_count * files_per_meter * records, bytes / 1e6, directory);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *key_path = NULL;
+    const char *generated = NULL;
+    const char *export_path = NULL;
+    const char *plaintext_path = HOST_DATA_DIR "/sample_plaintext.hex";
+    size_t worker_count = (size_t)sysconf(_SC_NPROCESSORS_ONLN);
+    size_t meter_count = DECODE_DEFAULT_METERS;
+    size_t files_per_meter = DECODE_DEFAULT_FILES;
+    size_t records = DECODE_DEFAULT_RECORDS;
+    bool per_meter = false;
+    memcpy(default_key, decryption_key, GUE_KEY_LENGTH);
+
+    int opt;
+    while((opt = getopt(argc, argv, "k:K:w:g:M:F:n:t:o:pmqvh")) != -1)
+    {
+        switch(opt)
+        {
+            case 'k': key_path = optarg; break;
+            case 'K':
+                if(parse_hex(optarg, default_key, GUE_KEY_LENGTH) != 0)
+                {
+                    fprintf(stderr, "Key must be %d hex digits\n", 2 * GUE_KEY_LENGTH);
+                    return 2;
+                }
+                break;
+            case 'w': worker_count = (size_t)strtoul(optarg, NULL, 10); break;
+            case 'g': generated = optarg; break;
+            case 'M': meter_count = (size_t)strtoul(optarg, NULL, 10); break;
+            case 'F': files_per_meter = (size_t)strtoul(optarg, NULL, 10); break;
+            case 'n': records = (size_t)strtoul(optarg, NULL, 10); break;
+            case 't': plaintext_path = optarg; break;
+            case 'o': export_path = optarg; break;
+            case 'p': context_per_telegram = true; break;
+            case 'm': per_meter = true; break;
+            case 'q': host_log_level = 0; break;
+            case 'v': verbose = true; break;
+            default: print_usage(argv[0]); return 2;
+        }
+    }
+    if(worker_count == 0 || ((generated == NULL) == (optind == argc)) || meter_count == 0 || meter_count > DECODE_MAX_METERS ||
+       files_per_meter == 0 || records == 0 || records > UINT16_MAX)
+    {
+        print_usage(argv[0]);
+        return 2;
+    }
+
+    char **paths = &argv[optind];
+    file_count = (size_t)(argc - optind);
+    char generated_keys[DECODE_PATH_LENGTH];
+    if(generated != NULL)
+    {
+        if(generate(generated, plaintext_path, meter_count, files_per_meter, records, &paths) != 0){ return 2; }
+        file_count = meter_count * files_per_meter;
+        snprintf(generated_keys, sizeof(generated_keys), "%s/keys.txt", generated);
+        key_path = generated_keys;
+    }
+    if(key_path != NULL && load_keys(key_path) != 0){ return 2; }
+
+    files = calloc(file_count, sizeof(capture_file_t));
+    decode_worker_t *workers = calloc(worker_count, sizeof(decode_worker_t));
+    if(files == NULL || workers == NULL)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 2;
+    }
+    for(size_t i = 0; i < file_count; i++){ files[i].path = paths[i]; }
+    for(size_t i = 0; i < worker_count; i++)
+    {
+        workers[i].meters = calloc(DECODE_METER_TABLE_SIZE, sizeof(meter_stats_t));
+        if(workers[i].meters == NULL)
+        {
+            fprintf(stderr, "Out of memory\n");
+            return 2;
+        }
+        dlms_decryptor_init(&workers[i].decryptor);
+        if(export_path != NULL && (workers[i].rows = malloc(DECODE_BATCH_RECORDS * sizeof(export_row_t))) == NULL)
+        {
+            fprintf(stderr, "Out of memory\n");
+            return 2;
+        }
+    }
+    static obis_columns_writer_t export_writer;
+    if(export_path != NULL)
+    {
+        if(obis_columns_create(&export_writer, export_path) != ESP_OK)
+        {
+            fprintf(stderr, "Cannot create %s\n", export_path);
+            return 2;
+        }
+        exporter = &export_writer;
+    }
+
+    /* Map and index files in parallel, headers are checked with their CRC */
+    double start = now_s();
+    if(run_workers(workers, worker_count, index_thread) != 0 || build_batches() != 0)
+    {
+        fprintf(stderr, "Indexing failed\n");
+        return 2;
+    }
+    double indexed = now_s();
+
+    size_t total_records = 0;
+    size_t damaged = 0, unreadable = 0;
+    for(size_t i = 0; i < file_count; i++)
+    {
+        total_records += files[i].record_count;
+        if(files[i].err == ESP_FAIL)
+        {
+            fprintf(stderr, "%s: cannot open\n", files[i].path);
+        }
+        else if(files[i].err != ESP_OK)
+        {
+            fprintf(stderr, "%s: %s (0x%x)\n", files[i].path, files[i].err == ESP_ERR_INVALID_CRC ? "damaged records" : "no valid capture", files[i].err);
+        }
+        if(files[i].err != ESP_OK){ damaged++; }
+
+        /* Records of damaged files are decoded anyway */
+        if(files[i].err != ESP_OK && files[i].err != ESP_ERR_INVALID_CRC){ unreadable++; }
+    }
+
+    if(run_workers(workers, worker_count, decode_thread) != 0)
+    {
+        fprintf(stderr, "Decoding failed\n");
+        return 2;
+    }
+    double decoded_time = now_s();
+    if(exporter != NULL)
+    {
+        uint64_t rows = exporter->row_count;
+        uint32_t columns = exporter->column_count;
+        if(exporter->overflow){ fprintf(stderr, "More than %d columns, some registers are not exported\n", OBIS_COLUMNS_MAX_COLUMNS); }
+        esp_err_t err = obis_columns_close(exporter);
+        if(export_err != ESP_OK || err != ESP_OK)
+        {
+            fprintf(stderr, "Export to %s failed (0x%x)\n", export_path, export_err != ESP_OK ? export_err : err);
+            return 2;
+        }
+        printf("Exported %llu rows, %u columns to %s in %.0f ms\n", (unsigned long long)rows, (unsigned)columns, export_path,
+               (now_s() - decoded_time) * 1000.0);
+    }
+
+    /* Totals over workers */
+    uint64_t bytes = 0, key_changes = 0;
+    uint64_t failed[LayerCount] = {0};
+    bool full = false;
+    for(size_t i = 0; i < worker_count; i++)
+    {
+        bytes += workers[i].bytes;
+        key_changes += workers[i].key_changes;
+        full |= workers[i].full;
+        for(size_t l = 0; l < LayerCount; l++){ failed[l] += workers[i].failed[l]; }
+        dlms_decryptor_free(&workers[i].decryptor);
+    }
+    meter_stats_t *meters = calloc(DECODE_METER_TABLE_SIZE, sizeof(meter_stats_t));
+    if(meters == NULL)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 2;
+    }
+    size_t meters_found = merge_meters(workers, worker_count, meters);
+    uint64_t decoded = 0, missing = 0;
+    for(size_t i = 0; i < meters_found; i++)
+    {
+        decoded += meters[i].decoded;
+        missing += missing_frames(&meters[i]);
+    }
+
+    if(per_meter){ print_meters(meters, meters_found); }
+    double decode_s = decoded_time - indexed;
+    printf("%zu files (%zu damaged), %zu records, %.1f MB, indexed in %.0f ms\n", file_count, damaged, total_records, bytes / 1e6,
+           (indexed - start) * 1000.0);
+    printf("%llu decoded, failed in layer %s %llu, %s %llu, %s %llu, %zu meters, %llu frames missing\n", (unsigned long long)decoded,
+           layer_names[LayerMbus], (unsigned long long)failed[LayerMbus], layer_names[LayerDlms], (unsigned long long)failed[LayerDlms],
+           layer_names[LayerObis], (unsigned long long)failed[LayerObis], meters_found, (unsigned long long)missing);
+    printf("%zu workers, %s: %.3f s, %.0f frames/s, %.1f MB/s, %llu key expansions\n", worker_count,
+           context_per_telegram ? "context per telegram" : "context per worker", decode_s, total_records / decode_s, bytes / 1e6 / decode_s,
+           (unsigned long long)key_changes);
+    if(full){ fprintf(stderr, "More than %d meters, some are not counted\n", DECODE_MAX_METERS); }
+
+    /* Generated fleet decodes completely with the keys of its meters */
+    if(generated != NULL && (decoded != total_records || total_records != meter_count * files_per_meter * records || missing != 0 ||
+                             meters_found != meter_count))
+    {
+        fprintf(stderr, "Decoding of generated fleet differs, %llu of %zu decoded, %zu meters, %llu missing\n", (unsigned long long)decoded,
+                total_records, meters_found, (unsigned long long)missing);
+        return 1;
+    }
+
+    /* Scripts collecting captures must notice missing or useless inputs */
+    if(unreadable > 0)
+    {
+        fprintf(stderr, "%zu of %zu files not decoded\n", unreadable, file_count);
+        return 2;
+    }
+    if(decoded == 0)
+    {
+        fprintf(stderr, "No telegram decoded\n");
+        return 1;
+    }
+    return 0;
+}
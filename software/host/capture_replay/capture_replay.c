@@ -0,0 +1,473 @@
+/**
+ * @file capture_replay.c
+ * @brief Replays a raw telegram capture of the firmware through the M-Bus, DLMS and OBIS layer
+ *
+ * The capture is a dump of the capture ring, e.g. read from the capture partition with parttool.py.
+ * Every record is copied into a frame of the pool and decoded in place like the uart event task does.
+ * With -g a capture is generated from the corpus, with uart data events as the driver reports them at
+ * 2400 baud, a telegram encrypted with another key and a truncated last telegram, as in a spill after a
+ * decode failure, and replayed as a check. The authentication tag and the M-Bus layer with invalid frames
+ * are checked with a corpus telegram first.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "telegram.h"
+#include "obis.h"
+#include "meter_capture.h"
+#include "flash_ops.h"
+
+/* ===== REPLAY CONFIGURATION ===== */
+#define REPLAY_MAX_TELEGRAMS            16          /* < Maximum number of telegrams loaded from file */
+#define REPLAY_MAX_DUMP_SIZE            (1024 * 1024)
+#define REPLAY_DEFAULT_TELEGRAMS        10          /* < Telegrams of a generated capture */
+#define REPLAY_TELEGRAM_INTERVAL_MS     5000        /* < Sagemcom T210-D sends every 5 seconds */
+#define REPLAY_LOST_BYTES               16          /* < Missing bytes of the damaged telegram */
+#define REPLAY_WRONG_KEY_XOR            0x5A        /* < Changes key of the telegram before the damaged one */
+
+/* Uart of the firmware, 8E1 */
+#define UART_BITS_PER_BYTE              11
+#define UART_RX_FULL_THRESHOLD          120         /* < Default rx fifo threshold of the driver */
+
+/* Result of a replay */
+typedef struct {
+    size_t records;
+    size_t decoded;
+    size_t failed;
+} replay_result_t;
+
+static void print_usage(const char *name)
+{
+    printf("Usage: %s -f capture [-v]                    replay capture\n", name);
+    printf("       %s -g capture [-n telegrams] [-t plaintext file] [-v]\n", name);
+}
+
+static double byte_ms()
+{
+    return UART_BITS_PER_BYTE * 1000.0 / UART_BAUD_RATE;
+}
+
+/* ===== REPLAY ===== */
+/* Longest time between two uart data events beyond receiving the bytes of the later one, includes the rx timeout of 10 symbols */
+static double max_gap_ms(const meter_capture_record_t *record)
+{
+    double gap = 0.0;
+    for(size_t i = 1; i < record->header.chunk_count; i++)
+    {
+        double idle = record->chunks[i].offset_ms - record->chunks[i - 1].offset_ms - record->chunks[i].size * byte_ms();
+        if(idle > gap){ gap = idle; }
+    }
+    return gap;
+}
+
+static void print_obis(const obis_data_t *obis)
+{
+    printf("    serial %.*s, %u registers\n", obis->serial_number_length, (const char *)obis->serial_number, obis->record_count);
+    for(size_t i = 0; i < obis->record_count; i++)
+    {
+        const obis_record_t *r = &obis->records[i];
+        printf("    %u-%u:%u.%u.%u*%u = %lld e%d unit 0x%02X\n", r->code[0], r->code[1], r->code[2], r->code[3], r->code[4], r->code[5],
+               (long long)r->value, r->scaler, r->unit);
+    }
+}
+
+static int replay(const uint8_t *dump, size_t size, bool verbose, replay_result_t *result)
+{
+    memset(result, 0, sizeof(*result));
+
+    meter_capture_file_header_t header;
+    esp_err_t err = meter_capture_parse_header(dump, size, &header);
+    if(err != ESP_OK)
+    {
+        fprintf(stderr, "No valid capture (0x%x)\n", err);
+        return 2;
+    }
+
+    const uint8_t *records = &dump[sizeof(header)];
+    size_t offset = 0;
+    meter_capture_record_t record;
+    while((err = meter_capture_next_record(records, header.records_size, &offset, &record)) == ESP_OK)
+    {
+        static obis_data_t obis;
+        result->records++;
+
+        /* Same decoding chain as uart event task, in place in a frame of the pool */
+        frame_t *frame = frame_pool_take();
+        size_t user_data_size = 0;
+        err = record.header.size <= FRAME_POOL_FRAME_SIZE ? ESP_OK : ESP_ERR_INVALID_SIZE;
+        if(err == ESP_OK)
+        {
+            memcpy(frame->data, record.data, record.header.size);
+            frame->size = record.header.size;
+            err = parse_mbus_long_frame_layer(frame->data, frame->size, frame->data, &user_data_size);
+        }
+        const char *layer = "mbus";
+        if(err == ESP_OK)
+        {
+            layer = "dlms";
+            err = parse_dlms_layer(frame->data, user_data_size, &frame->offset, &frame->size, decryption_key);
+        }
+        if(err == ESP_OK)
+        {
+            layer = "obis";
+            err = parse_obis(&frame->data[frame->offset], frame->size, &obis);
+        }
+        frame_pool_give(frame);
+
+        if(err == ESP_OK){ result->decoded++; } else { result->failed++; }
+
+        printf("%zu: %u.%03u s, %u bytes, %u events, max gap %.1f ms, %s", result->records,
+               (unsigned int)(record.header.timestamp_ms / 1000), (unsigned int)(record.header.timestamp_ms % 1000),
+               record.header.size, record.header.chunk_count, max_gap_ms(&record),
+               err == ESP_OK ? "ok" : "failed in ");
+        if(err != ESP_OK){ printf("%s layer (0x%x)", layer, err); }
+        if(record.header.flags & METER_CAPTURE_FLAG_TRUNCATED){ printf(", truncated to a frame"); }
+        if(record.header.flags & METER_CAPTURE_FLAG_POOL_EMPTY){ printf(", dropped as frame pool was empty"); }
+        printf("\n");
+
+        if(verbose)
+        {
+            for(size_t i = 0; i < record.header.chunk_count; i++)
+            {
+                printf("    event +%u ms, %u bytes\n", record.chunks[i].offset_ms, record.chunks[i].size);
+            }
+            if(err == ESP_OK){ print_obis(&obis); }
+        }
+    }
+
+    printf("%zu records, %zu decoded, %zu failed\n", result->records, result->decoded, result->failed);
+    if(err != ESP_ERR_NOT_FOUND || result->records != header.record_count)
+    {
+        fprintf(stderr, "Capture truncated after %zu of %u records\n", result->records, header.record_count);
+        return 1;
+    }
+    return 0;
+}
+
+/* ===== AUTHENTICATION ===== */
+/* Decrypt a telegram with tag, shortened to fit the tag, and again with a modified byte */
+static int check_authentication(const telegram_plaintext_t *plaintext)
+{
+    telegram_params_t params;
+    telegram_default_params(&params);
+    params.authenticated = true;
+
+    static uint8_t telegram[TELEGRAM_MAX_SIZE];
+    size_t plaintext_size = plaintext->size < TELEGRAM_MAX_AUTH_PLAINTEXT_SIZE ? plaintext->size : TELEGRAM_MAX_AUTH_PLAINTEXT_SIZE;
+    size_t size = telegram_build(&params, plaintext->data, plaintext_size, telegram, sizeof(telegram));
+
+    for(int modified = 0; modified < 2; modified++)
+    {
+        frame_t *frame = frame_pool_take();
+        size_t user_data_size = 0;
+        memcpy(frame->data, telegram, size);
+        esp_err_t err = size > 0 ? parse_mbus_long_frame_layer(frame->data, size, frame->data, &user_data_size) : ESP_FAIL;
+        if(err == ESP_OK)
+        {
+            /* Last byte of the cipher text, the tag is behind it */
+            if(modified){ frame->data[user_data_size - DLMS_AUTH_TAG_SIZE - 1] ^= 0x01; }
+            err = parse_dlms_layer(frame->data, user_data_size, &frame->offset, &frame->size, decryption_key);
+        }
+        bool valid = err == ESP_OK && frame->size == plaintext_size && memcmp(&frame->data[frame->offset], plaintext->data, plaintext_size) == 0;
+        frame_pool_give(frame);
+
+        if(valid == (bool)modified)
+        {
+            fprintf(stderr, "Authentication check failed, %s telegram %s\n", modified ? "modified" : "valid", modified ? "accepted" : "rejected");
+            return 1;
+        }
+    }
+    printf("Authentication check ok, %zu bytes with tag\n", plaintext_size);
+    return 0;
+}
+
+/* ===== INVALID FRAMES ===== */
+/* Frames of the damaged telegram, all must be rejected without reading beyond the payload */
+typedef enum {
+    FrameTruncated,                 /* < Tail of second frame missing */
+    FrameOversized,                 /* < Maximum frame followed by the header of a frame of 258 bytes */
+    FrameShortLength,               /* < L-Field shorter than C-, A- and CI-Field */
+    FrameChecksum,                  /* < One bit of user data flipped */
+    FrameCaseCount
+} frame_case_t;
+
+static const char *frame_case_names[FrameCaseCount] = {"truncated", "oversized", "short length", "checksum"};
+
+/* Payload in an exactly sized buffer, so a sanitizer catches reads beyond it */
+static size_t build_frame_case(frame_case_t frame_case, const uint8_t *telegram, size_t size, uint8_t *payload)
+{
+    static const uint8_t oversized_header[] = {MBUS_START_VALUE, 0xFF, 0xFF, MBUS_START_VALUE};
+    memcpy(payload, telegram, size);
+    switch(frame_case)
+    {
+        case FrameTruncated:
+            return size - REPLAY_LOST_BYTES;
+        case FrameOversized:
+        {
+            /* Frame of MBUS_MAX_SIZE bytes */
+            size_t l_field = MBUS_MAX_SIZE - MBUS_HEADER_LENGTH - MBUS_FOOTER_LENGTH;
+            uint8_t checksum = 0;
+            payload[MBUS_LENGTH1_OFFSET] = payload[MBUS_LENGTH2_OFFSET] = (uint8_t)(l_field + MBUS_USER_DATA_SIZE_OFFSET);
+            for(size_t i = MBUS_CHECKSUM_START_OFFSET; i < MBUS_HEADER_LENGTH + l_field; i++){ checksum += payload[i]; }
+            payload[MBUS_HEADER_LENGTH + l_field] = checksum;
+            payload[MBUS_HEADER_LENGTH + l_field + 1] = MBUS_STOP_VALUE;
+            memcpy(&payload[MBUS_MAX_SIZE], oversized_header, sizeof(oversized_header));
+            memset(&payload[MBUS_MAX_SIZE + sizeof(oversized_header)], 0, MBUS_HEADER_LENGTH + MBUS_FOOTER_LENGTH + 7);
+            return MBUS_MAX_SIZE + sizeof(oversized_header) + MBUS_HEADER_LENGTH + MBUS_FOOTER_LENGTH + 7;
+        }
+        case FrameShortLength:
+            payload[MBUS_LENGTH1_OFFSET] = payload[MBUS_LENGTH2_OFFSET] = MBUS_USER_DATA_SIZE_OFFSET - 1;
+            return size;
+        case FrameChecksum:
+            payload[MBUS_USER_DATA_OFFSET] ^= 0x01;
+            return size;
+        default:
+            return 0;
+    }
+}
+
+static int check_invalid_frames(const telegram_plaintext_t *plaintext)
+{
+    telegram_params_t params;
+    telegram_default_params(&params);
+
+    static uint8_t telegram[TELEGRAM_MAX_SIZE];
+    size_t size = telegram_build(&params, plaintext->data, plaintext->size, telegram, sizeof(telegram));
+    if(size <= REPLAY_LOST_BYTES)
+    {
+        fprintf(stderr, "Corpus telegram doesn't fit the frame check\n");
+        return 1;
+    }
+
+    for(frame_case_t frame_case = 0; frame_case < FrameCaseCount; frame_case++)
+    {
+        uint8_t buffer[TELEGRAM_MAX_SIZE];
+        size_t payload_size = build_frame_case(frame_case, telegram, size, buffer);
+
+        /* Copy of exact size, like the stack copy of capture_archive */
+        uint8_t *payload = malloc(payload_size);
+        uint8_t *user_data = malloc(payload_size);
+        if(payload == NULL || user_data == NULL)
+        {
+            free(payload);
+            free(user_data);
+            fprintf(stderr, "Out of memory\n");
+            return 2;
+        }
+        memcpy(payload, buffer, payload_size);
+        size_t user_data_size = 0;
+        esp_err_t err = parse_mbus_long_frame_layer(payload, payload_size, user_data, &user_data_size);
+        free(payload);
+        free(user_data);
+
+        if(err == ESP_OK)
+        {
+            fprintf(stderr, "M-Bus check failed, %s frame of %zu bytes accepted\n", frame_case_names[frame_case], payload_size);
+            return 1;
+        }
+    }
+
+    /* Last M-Bus frame with one user data byte, e.g. 245 + 3 bytes, leaves half a DLMS start value */
+    size_t user_data_size = 0;
+    uint8_t *user_data = malloc(DLMS_MAX_SIZE + 1);
+    if(user_data == NULL || parse_mbus_long_frame_layer(telegram, size, telegram, &user_data_size) != ESP_OK || user_data_size <= DLMS_MAX_SIZE)
+    {
+        free(user_data);
+        fprintf(stderr, "Corpus telegram doesn't fit the frame check\n");
+        return 1;
+    }
+    memcpy(user_data, telegram, DLMS_MAX_SIZE + 1);
+    size_t decrypted_offset = 0, decrypted_size = 0;
+    esp_err_t err = parse_dlms_layer(user_data, DLMS_MAX_SIZE + 1, &decrypted_offset, &decrypted_size, decryption_key);
+    free(user_data);
+    if(err == ESP_OK)
+    {
+        fprintf(stderr, "DLMS check failed, last frame of one byte accepted\n");
+        return 1;
+    }
+    printf("M-Bus check ok, %d invalid frames and a short DLMS frame rejected\n", FrameCaseCount);
+    return 0;
+}
+
+/* ===== GENERATION ===== */
+/* Uart data events of a telegram, one per full rx fifo and the rest after the line is idle */
+static size_t simulate_chunks(size_t size, meter_capture_chunk_t *chunks)
+{
+    size_t count = 0;
+    size_t received = 0;
+    double first_ms = 0.0;
+    while(received < size && count < METER_CAPTURE_MAX_CHUNKS)
+    {
+        size_t chunk = size - received > UART_RX_FULL_THRESHOLD ? UART_RX_FULL_THRESHOLD : size - received;
+        received += chunk;
+
+        /* Events are reported when the fifo is full or 10 symbols after the last byte */
+        double time_ms = received * byte_ms();
+        if(received == size){ time_ms += 10 * byte_ms(); }
+        if(count == 0){ first_ms = time_ms; }
+
+        chunks[count].offset_ms = (uint16_t)(time_ms - first_ms);
+        chunks[count].size = (uint16_t)chunk;
+        count++;
+    }
+    chunks[count - 1].size += (uint16_t)(size - received);
+    return count;
+}
+
+static int generate(const char *path, const char *capture, size_t count)
+{
+    static telegram_plaintext_t plaintexts[REPLAY_MAX_TELEGRAMS];
+    size_t plaintext_count = telegram_load_hex_file(path, plaintexts, REPLAY_MAX_TELEGRAMS);
+    if(plaintext_count == 0)
+    {
+        fprintf(stderr, "No telegrams loaded from %s\n", path);
+        return 2;
+    }
+    if(check_authentication(&plaintexts[0]) != 0 || check_invalid_frames(&plaintexts[0]) != 0)
+    {
+        return 1;
+    }
+
+    telegram_params_t params;
+    telegram_default_params(&params);
+
+    uint8_t *dump = calloc(1, REPLAY_MAX_DUMP_SIZE);
+    if(dump == NULL)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 2;
+    }
+
+    meter_capture_file_header_t header = {
+        .magic = METER_CAPTURE_MAGIC,
+        .version = METER_CAPTURE_FORMAT_VERSION,
+    };
+    size_t offset = sizeof(header);
+    for(size_t i = 0; i < count; i++)
+    {
+        static uint8_t telegram[TELEGRAM_MAX_SIZE];
+        meter_capture_chunk_t chunks[METER_CAPTURE_MAX_CHUNKS];
+
+        telegram_plaintext_t plaintext = plaintexts[i % plaintext_count];
+        telegram_set_register(&plaintext, 1, 7, (uint64_t)(i * 100));
+        params.frame_counter++;
+
+        /* Telegram of another meter, e.g. after the key was changed */
+        telegram_params_t wrong_key = params;
+        for(size_t k = 0; k < GUE_KEY_LENGTH; k++){ wrong_key.key[k] ^= REPLAY_WRONG_KEY_XOR; }
+        size_t size = telegram_build(i + 2 == count ? &wrong_key : &params, plaintext.data, plaintext.size, telegram, sizeof(telegram));
+
+        /* Last telegram lost its tail, e.g. by an overflow of the rx fifo */
+        if(i + 1 == count && size > REPLAY_LOST_BYTES){ size -= REPLAY_LOST_BYTES; }
+
+        size_t chunk_count = simulate_chunks(size, chunks);
+        size_t record_size = meter_capture_encode_record((uint32_t)(i * REPLAY_TELEGRAM_INTERVAL_MS), chunks, chunk_count, telegram, size,
+                                                         &dump[offset], REPLAY_MAX_DUMP_SIZE - offset);
+        if(size == 0 || record_size == 0)
+        {
+            fprintf(stderr, "Encoding telegram %zu failed\n", i);
+            free(dump);
+            return 2;
+        }
+        offset += record_size;
+        header.record_count++;
+    }
+    header.records_size = (uint32_t)(offset - sizeof(header));
+    header.crc = flash_ops_crc32(0, &dump[sizeof(header)], header.records_size);
+    memcpy(dump, &header, sizeof(header));
+
+    FILE *file = fopen(capture, "wb");
+    if(file == NULL || fwrite(dump, 1, offset, file) != offset)
+    {
+        fprintf(stderr, "Cannot write %s\n", capture);
+        if(file != NULL){ fclose(file); }
+        free(dump);
+        return 2;
+    }
+    fclose(file);
+    free(dump);
+    printf("Wrote %u records, %zu bytes to %s\n", header.record_count, offset, capture);
+    return 0;
+}
+
+static int load(const char *capture, uint8_t **dump, size_t *size)
+{
+    FILE *file = fopen(capture, "rb");
+    if(file == NULL)
+    {
+        fprintf(stderr, "Cannot open %s\n", capture);
+        return 2;
+    }
+
+    /* Partition images are larger than the capture, the header holds the size */
+    *dump = malloc(REPLAY_MAX_DUMP_SIZE);
+    if(*dump == NULL)
+    {
+        fclose(file);
+        fprintf(stderr, "Out of memory\n");
+        return 2;
+    }
+    *size = fread(*dump, 1, REPLAY_MAX_DUMP_SIZE, file);
+    fclose(file);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *capture = NULL;
+    const char *generated = NULL;
+    const char *path = HOST_DATA_DIR "/sample_plaintext.hex";
+    size_t count = REPLAY_DEFAULT_TELEGRAMS;
+    bool verbose = false;
+
+    int opt;
+    while((opt = getopt(argc, argv, "f:g:n:t:vh")) != -1)
+    {
+        switch(opt)
+        {
+            case 'f': capture = optarg; break;
+            case 'g': generated = optarg; break;
+            case 'n': count = (size_t)strtoul(optarg, NULL, 10); break;
+            case 't': path = optarg; break;
+            case 'v': verbose = true; break;
+            default: print_usage(argv[0]); return 2;
+        }
+    }
+    if((capture == NULL) == (generated == NULL) || count == 0)
+    {
+        print_usage(argv[0]);
+        return 2;
+    }
+
+    if(generated != NULL)
+    {
+        int result = generate(path, generated, count);
+        if(result != 0){ return result; }
+        capture = generated;
+    }
+
+    uint8_t *dump = NULL;
+    size_t size = 0;
+    int result = load(capture, &dump, &size);
+    if(result != 0){ return result; }
+
+    replay_result_t replayed;
+    result = replay(dump, size, verbose, &replayed);
+    free(dump);
+
+    /* Generated capture has a telegram with a wrong key and a damaged one */
+    size_t failed = count > 1 ? 2 : 1;
+    if(result == 0 && generated != NULL && (replayed.decoded != count - failed || replayed.failed != failed))
+    {
+        fprintf(stderr, "Replay of generated capture differs, %zu decoded, %zu failed\n", replayed.decoded, replayed.failed);
+        return 1;
+    }
+    return result;
+}
@@ -0,0 +1,249 @@
+/**
+ * @file codec_bench.c
+ * @brief Measures compression ratio and throughput of the history record codec
+ *
+ * The telegrams of the corpus are decoded with the real parser. A long series is generated from them
+ * by changing the registers like a real household would, every telegram is decoded again and
+ * converted into a history record. The series is packed into pages like the history log does,
+ * every page starts with a keyframe.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "telegram.h"
+#include "obis.h"
+#include "history.h"
+
+/* ===== BENCHMARK CONFIGURATION ===== */
+#define BENCH_DEFAULT_RECORDS           100000      /* < Number of generated telegrams */
+#define BENCH_DEFAULT_ROUNDS            20          /* < Repetitions of throughput measurement */
+#define BENCH_MAX_TELEGRAMS             16          /* < Maximum number of telegrams loaded from file */
+#define BENCH_TELEGRAM_INTERVAL_S       5           /* < Interval of telegrams of the meter */
+
+/* Encoded series, pages like in the history log */
+typedef struct {
+    uint8_t (*pages)[HISTORY_PAGE_DATA_SIZE];
+    uint16_t *page_sizes;
+    uint8_t *page_counts;
+    size_t page_count;
+    size_t bytes;
+} bench_series_t;
+
+static double now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec / 1e3;
+}
+
+static double random_uniform()
+{
+    return (double)rand() / ((double)RAND_MAX + 1.0);
+}
+
+static int64_t random_step(int64_t value, int64_t step, int64_t min, int64_t max)
+{
+    value += (int64_t)(random_uniform() * (double)(2 * step + 1)) - step;
+    return value < min ? min : (value > max ? max : value);
+}
+
+/* Same packing as history_append, new page with keyframe if the record doesn't fit */
+static void encode_series(const history_record_t *records, size_t count, bench_series_t *series)
+{
+    history_codec_t codec;
+    history_codec_reset(&codec);
+    series->page_count = 0;
+    series->bytes = 0;
+    series->page_sizes[0] = 0;
+    series->page_counts[0] = 0;
+
+    for(size_t i = 0; i < count; i++)
+    {
+        size_t page = series->page_count;
+        size_t used = series->page_sizes[page];
+        size_t size = history_codec_encode(&codec, &records[i], &series->pages[page][used], HISTORY_PAGE_DATA_SIZE - used);
+        if(size == 0 || series->page_counts[page] >= HISTORY_MAX_RECORDS_PER_PAGE)
+        {
+            series->bytes += sizeof(history_page_header_t) + used;
+            page = ++series->page_count;
+            series->page_sizes[page] = 0;
+            series->page_counts[page] = 0;
+            history_codec_reset(&codec);
+            size = history_codec_encode(&codec, &records[i], &series->pages[page][0], HISTORY_PAGE_DATA_SIZE);
+        }
+        series->page_sizes[page] += (uint16_t)size;
+        series->page_counts[page]++;
+    }
+    series->bytes += sizeof(history_page_header_t) + series->page_sizes[series->page_count];
+    series->page_count++;
+}
+
+static size_t decode_series(const bench_series_t *series, history_record_t *records)
+{
+    size_t count = 0;
+    for(size_t page = 0; page < series->page_count; page++)
+    {
+        history_codec_t codec;
+        history_codec_reset(&codec);
+        size_t offset = 0;
+        for(uint8_t i = 0; i < series->page_counts[page]; i++)
+        {
+            size_t size = history_codec_decode(&codec, &series->pages[page][offset], series->page_sizes[page] - offset, &records[count++]);
+            if(size == 0){ return 0; }
+            offset += size;
+        }
+    }
+    return count;
+}
+
+static void print_usage(const char *name)
+{
+    printf("Usage: %s [-n records] [-r rounds] [-f plaintext file]\n", name);
+}
+
+/* ===== MAIN ===== */
+int main(int argc, char **argv)
+{
+    size_t count = BENCH_DEFAULT_RECORDS;
+    size_t rounds = BENCH_DEFAULT_ROUNDS;
+    const char *path = HOST_DATA_DIR "/sample_plaintext.hex";
+
+    int opt;
+    while((opt = getopt(argc, argv, "n:r:f:h")) != -1)
+    {
+        switch(opt)
+        {
+            case 'n': count = (size_t)strtoul(optarg, NULL, 10); break;
+            case 'r': rounds = (size_t)strtoul(optarg, NULL, 10); break;
+            case 'f': path = optarg; break;
+            default: print_usage(argv[0]); return 2;
+        }
+    }
+    if(count == 0 || rounds == 0)
+    {
+        print_usage(argv[0]);
+        return 2;
+    }
+
+    static telegram_plaintext_t plaintexts[BENCH_MAX_TELEGRAMS];
+    size_t plaintext_count = telegram_load_hex_file(path, plaintexts, BENCH_MAX_TELEGRAMS);
+    if(plaintext_count == 0)
+    {
+        fprintf(stderr, "No telegrams loaded from %s\n", path);
+        return 2;
+    }
+
+    history_record_t *records = calloc(count, sizeof(history_record_t));
+    history_record_t *decoded = calloc(count, sizeof(history_record_t));
+    bench_series_t series = {
+        .pages = calloc(count, HISTORY_PAGE_DATA_SIZE),
+        .page_sizes = calloc(count, sizeof(uint16_t)),
+        .page_counts = calloc(count, sizeof(uint8_t)),
+    };
+    if(records == NULL || decoded == NULL || series.pages == NULL || series.page_sizes == NULL || series.page_counts == NULL)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 2;
+    }
+
+    /* Corpus as sent by the meter */
+    static obis_data_t data;
+    size_t corpus_count = plaintext_count < count ? plaintext_count : count;
+    for(size_t i = 0; i < corpus_count; i++)
+    {
+        if(parse_obis(plaintexts[i].data, plaintexts[i].size, &data) != ESP_OK)
+        {
+            fprintf(stderr, "Decoding telegram %zu failed\n", i);
+            return 2;
+        }
+        history_record_from_obis(&data, (uint32_t)i, &records[i]);
+    }
+    encode_series(records, corpus_count, &series);
+    printf("Corpus: %zu telegrams, %zu bytes raw, %zu bytes encoded\n", corpus_count, corpus_count * sizeof(history_record_t), series.bytes);
+
+    /* Long series, registers change like in a household, start with values of the corpus */
+    srand(1);
+    int64_t power = records[0].active_power;
+    int64_t energy = records[0].energy_delivered;
+    int64_t voltage[3] = {records[0].voltage[0], records[0].voltage[1], records[0].voltage[2]};
+    int64_t current[3] = {records[0].current[0], records[0].current[1], records[0].current[2]};
+    uint32_t start_time = records[0].time;
+    double energy_fraction = 0;
+    for(size_t i = 0; i < count; i++)
+    {
+        telegram_plaintext_t plaintext = plaintexts[i % plaintext_count];
+
+        /* Sometimes a large consumer is switched */
+        power = random_uniform() < 0.02 ? random_step(power, 2000, 0, 11000) : random_step(power, 30, 0, 11000);
+        energy_fraction += (double)power * BENCH_TELEGRAM_INTERVAL_S / 3600.0;
+        energy += (int64_t)energy_fraction;
+        energy_fraction -= (int64_t)energy_fraction;
+
+        telegram_set_register(&plaintext, 1, 7, (uint64_t)power);
+        telegram_set_register(&plaintext, 1, 8, (uint64_t)energy);
+        for(int phase = 0; phase < 3; phase++)
+        {
+            voltage[phase] = random_step(voltage[phase], 3, 2200, 2450);
+            current[phase] = random_step(current[phase], 5 + power / 200, 0, 6300);
+            telegram_set_register(&plaintext, (uint8_t)(32 + 20 * phase), 7, (uint64_t)voltage[phase]);
+            telegram_set_register(&plaintext, (uint8_t)(31 + 20 * phase), 7, (uint64_t)current[phase]);
+        }
+
+        if(parse_obis(plaintext.data, plaintext.size, &data) != ESP_OK)
+        {
+            fprintf(stderr, "Decoding generated telegram %zu failed\n", i);
+            return 2;
+        }
+        history_record_from_obis(&data, (uint32_t)i, &records[i]);
+
+        /* Timestamp register is a date time and not changed in the telegram */
+        records[i].time = start_time + (uint32_t)(i * BENCH_TELEGRAM_INTERVAL_S);
+    }
+
+    /* Compression ratio */
+    encode_series(records, count, &series);
+    size_t raw_bytes = count * sizeof(history_record_t);
+    size_t fixed_pages = (count + 6) / 7;
+    printf("Series: %zu telegrams, %zu bytes raw, %zu bytes encoded in %zu pages\n", count, raw_bytes, series.bytes, series.page_count);
+    printf("Ratio %.2f, %.1f bytes per record, %.1f records per page (7 with raw records)\n",
+           (double)raw_bytes / (double)series.bytes, (double)series.bytes / (double)count, (double)count / (double)series.page_count);
+    printf("Flash pages %.1f %% of raw records\n", 100.0 * (double)series.page_count / (double)fixed_pages);
+
+    /* Throughput */
+    double encode_us = 0;
+    double decode_us = 0;
+    for(size_t round = 0; round < rounds; round++)
+    {
+        double start_us = now_us();
+        encode_series(records, count, &series);
+        encode_us += now_us() - start_us;
+
+        start_us = now_us();
+        size_t decoded_count = decode_series(&series, decoded);
+        decode_us += now_us() - start_us;
+
+        if(decoded_count != count || memcmp(records, decoded, count * sizeof(history_record_t)) != 0)
+        {
+            fprintf(stderr, "Decoded records differ\n");
+            return 1;
+        }
+    }
+    double total = (double)(count * rounds);
+    printf("Encode: %.1f ns per record, %.1f MB/s raw\n", 1000.0 * encode_us / total, total * sizeof(history_record_t) / encode_us);
+    printf("Decode: %.1f ns per record, %.1f MB/s raw\n", 1000.0 * decode_us / total, total * sizeof(history_record_t) / decode_us);
+    printf("Round trip of %zu records correct\n", count);
+
+    free(records);
+    free(decoded);
+    free(series.pages);
+    free(series.page_sizes);
+    free(series.page_counts);
+    return 0;
+}
@@ -0,0 +1,565 @@
+/**
+ * @file column_bench.c
+ * @brief Compares the columnar export of decoded readings with CSV for typical analytics queries
+ *
+ * The telegrams of the corpus are decoded with the real parser, a fleet of meters sending every
+ * 5 seconds for some days is generated from them with registers changing like in a household.
+ * The readings are written to a columnar file like capture_decode -o does and to CSV with the same
+ * fixed point values. Each query runs on both, results must be equal. The columnar queries skip blocks
+ * by the min and max of the meter and time columns and answer from block statistics where possible,
+ * CSV has to be parsed completely.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "telegram.h"
+#include "obis.h"
+#include "obis_columns.h"
+
+/* ===== BENCHMARK CONFIGURATION ===== */
+#define BENCH_DEFAULT_METERS            16
+#define BENCH_DEFAULT_DAYS              7
+#define BENCH_TELEGRAM_INTERVAL_S       5           /* < Sagemcom T210-D sends every 5 seconds */
+#define BENCH_DAY_MS                    (24LL * 3600 * 1000)
+#define BENCH_START_MS                  1672531200000LL     /* < 2023-01-01 00:00 UTC */
+#define BENCH_PATH_LENGTH               512
+#define BENCH_CSV_BUFFER_SIZE           (1024 * 1024)
+
+/* Registers used by the queries */
+enum BenchRegister
+{
+    RegisterPower,
+    RegisterEnergy,
+    RegisterVoltage,
+    RegisterCount
+};
+
+static const enum CodeType register_types[RegisterCount] = {ActivePowerPlus, ActiveEnergyPlus, VoltageL1};
+
+/* Columns of a file, index of each register */
+typedef struct {
+    size_t column_count;
+    obis_columns_key_t keys[OBIS_COLUMNS_MAX_COLUMNS];
+    int registers[RegisterCount];
+} bench_layout_t;
+
+/* Energy of one meter */
+typedef struct {
+    uint64_t meter_id;
+    int64_t min;
+    int64_t max;
+} meter_energy_t;
+
+/* Results of the queries, equal for both formats */
+typedef struct {
+    int64_t power_sum;                  /* < Power of one meter on one day */
+    uint64_t power_count;
+    meter_energy_t *energy;             /* < Energy delivered per meter */
+    size_t energy_count;
+    int64_t voltage_max;                /* < Highest voltage of fleet on one day */
+    double ms[3];
+    size_t bytes[3];                    /* < Bytes read by each query */
+} bench_results_t;
+
+static double now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
+static double random_uniform()
+{
+    return (double)rand() / ((double)RAND_MAX + 1.0);
+}
+
+static int64_t random_step(int64_t value, int64_t step, int64_t min, int64_t max)
+{
+    value += (int64_t)(random_uniform() * (double)(2 * step + 1)) - step;
+    return value < min ? min : (value > max ? max : value);
+}
+
+static void print_usage(const char *name)
+{
+    printf("Usage: %s [-M meters] [-d days] [-o output prefix] [-f plaintext file] [-k]\n", name);
+    printf("  writes <prefix>.mcol and <prefix>.csv, -k keeps them\n");
+}
+
+static size_t file_size(const char *path)
+{
+    struct stat st;
+    return stat(path, &st) == 0 ? (size_t)st.st_size : 0;
+}
+
+/* ===== ENERGY PER METER ===== */
+static meter_energy_t *find_energy(bench_results_t *results, uint64_t meter_id)
+{
+    /* Rows of a meter are adjacent, so mostly the last one */
+    if(results->energy_count > 0 && results->energy[results->energy_count - 1].meter_id == meter_id)
+    {
+        return &results->energy[results->energy_count - 1];
+    }
+    for(size_t i = 0; i < results->energy_count; i++)
+    {
+        if(results->energy[i].meter_id == meter_id){ return &results->energy[i]; }
+    }
+    meter_energy_t *energy = &results->energy[results->energy_count++];
+    *energy = (meter_energy_t){meter_id, INT64_MAX, INT64_MIN};
+    return energy;
+}
+
+static void add_energy(bench_results_t *results, uint64_t meter_id, int64_t min, int64_t max)
+{
+    meter_energy_t *energy = find_energy(results, meter_id);
+    if(min < energy->min){ energy->min = min; }
+    if(max > energy->max){ energy->max = max; }
+}
+
+/* ===== GENERATION ===== */
+static void format_code(const uint8_t *code, char *text, size_t size)
+{
+    snprintf(text, size, "%u-%u:%u.%u.%u", code[0], code[1], code[2], code[3], code[4]);
+}
+
+/* Same columns as obis_columns_append creates for the template */
+static void layout_from_obis(const obis_data_t *obis, bench_layout_t *layout)
+{
+    memset(layout, 0, sizeof(*layout));
+    layout->column_count = ObisColumnFixedCount;
+    for(size_t r = 0; r < RegisterCount; r++){ layout->registers[r] = -1; }
+    for(size_t i = 0; i < obis->record_count; i++)
+    {
+        const obis_record_t *record = &obis->records[i];
+        if(record->type == Timestamp || record->type == SerialNumber || record->type == DeviceName){ continue; }
+        obis_columns_key_t *key = &layout->keys[layout->column_count];
+        memcpy(key->code, record->code, OBIS_CODE_LENGTH);
+        key->scaler = record->scaler;
+        key->unit = record->unit;
+        for(size_t r = 0; r < RegisterCount; r++)
+        {
+            if(record->type == register_types[r]){ layout->registers[r] = (int)layout->column_count; }
+        }
+        layout->column_count++;
+    }
+}
+
+static void write_csv_row(FILE *csv, const bench_layout_t *layout, uint64_t meter_id, int64_t timestamp_ms, uint32_t frame_counter,
+                          const obis_data_t *obis)
+{
+    fprintf(csv, "%llu,%lld,%lu", (unsigned long long)meter_id, (long long)timestamp_ms, (unsigned long)frame_counter);
+    size_t column = ObisColumnFixedCount;
+    for(size_t i = 0; i < obis->record_count; i++)
+    {
+        const obis_record_t *record = &obis->records[i];
+        if(record->type == Timestamp || record->type == SerialNumber || record->type == DeviceName){ continue; }
+        fprintf(csv, ",%lld", (long long)obis_scale_value(record, layout->keys[column++].scaler));
+    }
+    fputc('\n', csv);
+}
+
+/* Readings of every meter in turn, like the export of one capture file per meter */
+static int generate(const obis_data_t *template, const bench_layout_t *layout, size_t meter_count, size_t days, const char *columns_path,
+                    const char *csv_path, double *columns_ms, double *csv_ms)
+{
+    obis_columns_writer_t writer;
+    if(obis_columns_create(&writer, columns_path) != ESP_OK)
+    {
+        fprintf(stderr, "Cannot create %s\n", columns_path);
+        return -1;
+    }
+    FILE *csv = fopen(csv_path, "w");
+    if(csv == NULL)
+    {
+        fprintf(stderr, "Cannot create %s\n", csv_path);
+        obis_columns_close(&writer);
+        return -1;
+    }
+    static char csv_buffer[BENCH_CSV_BUFFER_SIZE];
+    setvbuf(csv, csv_buffer, _IOFBF, sizeof(csv_buffer));
+
+    fprintf(csv, "meter,time_ms,frame_counter");
+    for(size_t c = ObisColumnFixedCount; c < layout->column_count; c++)
+    {
+        char code[32];
+        format_code(layout->keys[c].code, code, sizeof(code));
+        fprintf(csv, ",%s", code);
+    }
+    fputc('\n', csv);
+
+    /* Registers of the template changed in every reading */
+    static obis_data_t obis;
+    obis = *template;
+    obis_record_t *power = NULL, *energy = NULL, *voltage[3] = {NULL}, *current[3] = {NULL};
+    for(size_t i = 0; i < obis.record_count; i++)
+    {
+        obis_record_t *record = &obis.records[i];
+        switch(record->type)
+        {
+            case ActivePowerPlus: power = record; break;
+            case ActiveEnergyPlus: energy = record; break;
+            case VoltageL1: case VoltageL2: case VoltageL3: voltage[record->type - VoltageL1] = record; break;
+            case CurrentL1: case CurrentL2: case CurrentL3: current[record->type - CurrentL1] = record; break;
+            default: break;
+        }
+    }
+    if(power == NULL || energy == NULL || voltage[0] == NULL)
+    {
+        fprintf(stderr, "Corpus telegram has no power, energy or voltage\n");
+        fclose(csv);
+        obis_columns_close(&writer);
+        return -1;
+    }
+
+    srand(1);
+    size_t readings = days * (size_t)(BENCH_DAY_MS / 1000 / BENCH_TELEGRAM_INTERVAL_S);
+    esp_err_t err = ESP_OK;
+    for(size_t m = 0; m < meter_count && err == ESP_OK; m++)
+    {
+        uint64_t meter_id = 0x5341476770050100ULL + m;
+        double energy_fraction = 0;
+        power->value = template->records[power - obis.records].value;
+        energy->value = template->records[energy - obis.records].value + (int64_t)m * 100000;
+        for(size_t r = 0; r < readings; r++)
+        {
+            /* Sometimes a large consumer is switched */
+            power->value = random_uniform() < 0.02 ? random_step(power->value, 2000, 0, 11000) : random_step(power->value, 30, 0, 11000);
+            energy_fraction += (double)power->value * BENCH_TELEGRAM_INTERVAL_S / 3600.0;
+            energy->value += (int64_t)energy_fraction;
+            energy_fraction -= (int64_t)energy_fraction;
+            for(int phase = 0; phase < 3; phase++)
+            {
+                if(voltage[phase] != NULL){ voltage[phase]->value = random_step(voltage[phase]->value, 3, 2200, 2450); }
+                if(current[phase] != NULL){ current[phase]->value = random_step(current[phase]->value, 5 + power->value / 200, 0, 6300); }
+            }
+
+            int64_t timestamp_ms = BENCH_START_MS + (int64_t)r * BENCH_TELEGRAM_INTERVAL_S * 1000;
+            uint32_t frame_counter = (uint32_t)(0x10000 + r);
+            double start = now_ms();
+            err = obis_columns_append(&writer, meter_id, timestamp_ms, frame_counter, &obis);
+            double middle = now_ms();
+            write_csv_row(csv, layout, meter_id, timestamp_ms, frame_counter, &obis);
+            *columns_ms += middle - start;
+            *csv_ms += now_ms() - middle;
+        }
+    }
+
+    double start = now_ms();
+    esp_err_t close_err = obis_columns_close(&writer);
+    double middle = now_ms();
+    int csv_err = fclose(csv);
+    *columns_ms += middle - start;
+    *csv_ms += now_ms() - middle;
+    if(err != ESP_OK || close_err != ESP_OK || csv_err != 0)
+    {
+        fprintf(stderr, "Writing readings failed\n");
+        return -1;
+    }
+    return 0;
+}
+
+/* ===== COLUMNAR QUERIES ===== */
+static size_t read_column(const obis_columns_reader_t *reader, size_t block, size_t column, int64_t *values, size_t *bytes)
+{
+    size_t rows = obis_columns_read(reader, block, column, values);
+    *bytes += rows * obis_columns_chunk(reader, block, column)->width;
+    return rows;
+}
+
+static void query_columns(const obis_columns_reader_t *reader, const bench_layout_t *layout, uint64_t meter_id, int64_t from_ms,
+                          int64_t to_ms, bench_results_t *results)
+{
+    static int64_t meters[OBIS_COLUMNS_BLOCK_ROWS], times[OBIS_COLUMNS_BLOCK_ROWS], values[OBIS_COLUMNS_BLOCK_ROWS];
+    size_t footer = reader->block_count * reader->column_count * sizeof(obis_columns_chunk_t);
+    int power = obis_columns_find(reader, layout->keys[layout->registers[RegisterPower]].code);
+    int energy = obis_columns_find(reader, layout->keys[layout->registers[RegisterEnergy]].code);
+    int voltage = obis_columns_find(reader, layout->keys[layout->registers[RegisterVoltage]].code);
+
+    /* Power of one meter on one day, blocks of other meters and times are skipped */
+    double start = now_ms();
+    results->bytes[0] = footer;
+    for(size_t b = 0; b < reader->block_count && power >= 0; b++)
+    {
+        const obis_columns_chunk_t *meter = obis_columns_chunk(reader, b, ObisColumnMeter);
+        const obis_columns_chunk_t *time = obis_columns_chunk(reader, b, ObisColumnTime);
+        if((int64_t)meter_id < meter->min || (int64_t)meter_id > meter->max || time->max < from_ms || time->min > to_ms){ continue; }
+
+        size_t rows = read_column(reader, b, ObisColumnMeter, meters, &results->bytes[0]);
+        read_column(reader, b, ObisColumnTime, times, &results->bytes[0]);
+        read_column(reader, b, (size_t)power, values, &results->bytes[0]);
+        for(size_t i = 0; i < rows; i++)
+        {
+            if(meters[i] != (int64_t)meter_id || times[i] < from_ms || times[i] > to_ms || values[i] == OBIS_COLUMNS_NULL){ continue; }
+            results->power_sum += values[i];
+            results->power_count++;
+        }
+    }
+    results->ms[0] = now_ms() - start;
+
+    /* Energy per meter, blocks of one meter from statistics only */
+    start = now_ms();
+    results->bytes[1] = footer;
+    for(size_t b = 0; b < reader->block_count && energy >= 0; b++)
+    {
+        const obis_columns_chunk_t *meter = obis_columns_chunk(reader, b, ObisColumnMeter);
+        const obis_columns_chunk_t *chunk = obis_columns_chunk(reader, b, (size_t)energy);
+        if(chunk->count == 0){ continue; }
+        if(meter->min == meter->max)
+        {
+            add_energy(results, (uint64_t)meter->min, chunk->min, chunk->max);
+            continue;
+        }
+
+        size_t rows = read_column(reader, b, ObisColumnMeter, meters, &results->bytes[1]);
+        read_column(reader, b, (size_t)energy, values, &results->bytes[1]);
+        for(size_t i = 0; i < rows; i++)
+        {
+            if(values[i] != OBIS_COLUMNS_NULL){ add_energy(results, (uint64_t)meters[i], values[i], values[i]); }
+        }
+    }
+    results->ms[1] = now_ms() - start;
+
+    /* Highest voltage of fleet on one day, blocks within the day from statistics only */
+    start = now_ms();
+    results->bytes[2] = footer;
+    results->voltage_max = INT64_MIN;
+    for(size_t b = 0; b < reader->block_count && voltage >= 0; b++)
+    {
+        const obis_columns_chunk_t *time = obis_columns_chunk(reader, b, ObisColumnTime);
+        const obis_columns_chunk_t *chunk = obis_columns_chunk(reader, b, (size_t)voltage);
+        if(time->max < from_ms || time->min > to_ms || chunk->count == 0){ continue; }
+        if(time->min >= from_ms && time->max <= to_ms)
+        {
+            if(chunk->max > results->voltage_max){ results->voltage_max = chunk->max; }
+            continue;
+        }
+
+        size_t rows = read_column(reader, b, ObisColumnTime, times, &results->bytes[2]);
+        read_column(reader, b, (size_t)voltage, values, &results->bytes[2]);
+        for(size_t i = 0; i < rows; i++)
+        {
+            if(times[i] >= from_ms && times[i] <= to_ms && values[i] != OBIS_COLUMNS_NULL && values[i] > results->voltage_max){ results->voltage_max = values[i]; }
+        }
+    }
+    results->ms[2] = now_ms() - start;
+}
+
+/* ===== CSV QUERIES ===== */
+/* Fields of a line up to the last wanted one, empty fields are missing */
+static const char *parse_line(const char *line, const char *end, int64_t *fields, size_t field_count)
+{
+    const char *p = line;
+    for(size_t f = 0; f < field_count; f++)
+    {
+        bool negative = p < end && *p == '-';
+        if(negative){ p++; }
+        bool present = false;
+        int64_t value = 0;
+        while(p < end && *p >= '0' && *p <= '9')
+        {
+            value = value * 10 + (*p++ - '0');
+            present = true;
+        }
+        fields[f] = present ? (negative ? -value : value) : OBIS_COLUMNS_NULL;
+        if(p < end && *p == ','){ p++; }
+    }
+    const char *newline = memchr(p, '\n', (size_t)(end - p));
+    return newline != NULL ? newline + 1 : end;
+}
+
+static int query_csv(const char *path, const bench_layout_t *layout, uint64_t meter_id, int64_t from_ms, int64_t to_ms,
+                     bench_results_t *results)
+{
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if(fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        if(fd >= 0){ close(fd); }
+        return -1;
+    }
+    const char *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED){ return -1; }
+    madvise((void *)data, (size_t)st.st_size, MADV_SEQUENTIAL);
+    const char *end = data + st.st_size;
+    const char *rows = memchr(data, '\n', (size_t)st.st_size);
+    rows = rows != NULL ? rows + 1 : end;
+
+    int64_t fields[OBIS_COLUMNS_MAX_COLUMNS];
+    size_t power = (size_t)layout->registers[RegisterPower];
+    size_t energy = (size_t)layout->registers[RegisterEnergy];
+    size_t voltage = (size_t)layout->registers[RegisterVoltage];
+
+    /* Every query parses all rows */
+    double start = now_ms();
+    for(const char *line = rows; line < end;)
+    {
+        line = parse_line(line, end, fields, power + 1);
+        if(fields[ObisColumnMeter] != (int64_t)meter_id || fields[ObisColumnTime] < from_ms || fields[ObisColumnTime] > to_ms ||
+           fields[power] == OBIS_COLUMNS_NULL){ continue; }
+        results->power_sum += fields[power];
+        results->power_count++;
+    }
+    results->ms[0] = now_ms() - start;
+
+    start = now_ms();
+    for(const char *line = rows; line < end;)
+    {
+        line = parse_line(line, end, fields, energy + 1);
+        if(fields[energy] != OBIS_COLUMNS_NULL){ add_energy(results, (uint64_t)fields[ObisColumnMeter], fields[energy], fields[energy]); }
+    }
+    results->ms[1] = now_ms() - start;
+
+    start = now_ms();
+    results->voltage_max = INT64_MIN;
+    for(const char *line = rows; line < end;)
+    {
+        line = parse_line(line, end, fields, voltage + 1);
+        if(fields[ObisColumnTime] >= from_ms && fields[ObisColumnTime] <= to_ms && fields[voltage] != OBIS_COLUMNS_NULL &&
+           fields[voltage] > results->voltage_max){ results->voltage_max = fields[voltage]; }
+    }
+    results->ms[2] = now_ms() - start;
+
+    for(size_t q = 0; q < 3; q++){ results->bytes[q] = (size_t)st.st_size; }
+    munmap((void *)data, (size_t)st.st_size);
+    return 0;
+}
+
+static bool results_equal(const bench_results_t *a, const bench_results_t *b)
+{
+    if(a->power_sum != b->power_sum || a->power_count != b->power_count || a->voltage_max != b->voltage_max ||
+       a->energy_count != b->energy_count){ return false; }
+    for(size_t i = 0; i < a->energy_count; i++)
+    {
+        if(memcmp(&a->energy[i], &b->energy[i], sizeof(meter_energy_t)) != 0){ return false; }
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    size_t meter_count = BENCH_DEFAULT_METERS;
+    size_t days = BENCH_DEFAULT_DAYS;
+    const char *prefix = "column_bench";
+    const char *plaintext_path = HOST_DATA_DIR "/sample_plaintext.hex";
+    bool keep = false;
+
+    int opt;
+    while((opt = getopt(argc, argv, "M:d:o:f:kh")) != -1)
+    {
+        switch(opt)
+        {
+            case 'M': meter_count = (size_t)strtoul(optarg, NULL, 10); break;
+            case 'd': days = (size_t)strtoul(optarg, NULL, 10); break;
+            case 'o': prefix = optarg; break;
+            case 'f': plaintext_path = optarg; break;
+            case 'k': keep = true; break;
+            default: print_usage(argv[0]); return 2;
+        }
+    }
+    if(meter_count == 0 || days == 0)
+    {
+        print_usage(argv[0]);
+        return 2;
+    }
+
+    /* Corpus as sent by the meter */
+    static telegram_plaintext_t plaintext;
+    static obis_data_t template;
+    bench_layout_t layout;
+    if(telegram_load_hex_file(plaintext_path, &plaintext, 1) != 1 || parse_obis(plaintext.data, plaintext.size, &template) != ESP_OK)
+    {
+        fprintf(stderr, "No telegram decoded from %s\n", plaintext_path);
+        return 2;
+    }
+    layout_from_obis(&template, &layout);
+    for(size_t r = 0; r < RegisterCount; r++)
+    {
+        if(layout.registers[r] < 0)
+        {
+            fprintf(stderr, "Corpus telegram has no power, energy or voltage\n");
+            return 2;
+        }
+    }
+
+    char columns_path[BENCH_PATH_LENGTH], csv_path[BENCH_PATH_LENGTH];
+    snprintf(columns_path, sizeof(columns_path), "%s.mcol", prefix);
+    snprintf(csv_path, sizeof(csv_path), "%s.csv", prefix);
+    double columns_write_ms = 0, csv_write_ms = 0;
+    if(generate(&template, &layout, meter_count, days, columns_path, csv_path, &columns_write_ms, &csv_write_ms) != 0){ return 2; }
+
+    obis_columns_reader_t reader;
+    esp_err_t err = obis_columns_open(&reader, columns_path);
+    if(err != ESP_OK)
+    {
+        fprintf(stderr, "Cannot open %s (0x%x)\n", columns_path, err);
+        return 2;
+    }
+    size_t rows = (size_t)reader.row_count;
+    size_t columns_size = file_size(columns_path);
+    size_t csv_size = file_size(csv_path);
+    printf("%zu meters, %zu days, %zu rows, %u columns, %u blocks of %d rows\n", meter_count, days, rows, (unsigned)reader.column_count,
+           (unsigned)reader.block_count, OBIS_COLUMNS_BLOCK_ROWS);
+    printf("%-8s %10s %12s %12s\n", "format", "MB", "bytes/row", "write ms");
+    printf("%-8s %10.1f %12.1f %12.0f\n", "columns", columns_size / 1e6, (double)columns_size / (double)rows, columns_write_ms);
+    printf("%-8s %10.1f %12.1f %12.0f\n", "csv", csv_size / 1e6, (double)csv_size / (double)rows, csv_write_ms);
+
+    /* Second day, or the only one */
+    uint64_t meter_id = 0x5341476770050100ULL + meter_count / 2;
+    int64_t from_ms = BENCH_START_MS + (days > 1 ? BENCH_DAY_MS : 0);
+    int64_t to_ms = from_ms + BENCH_DAY_MS - 1;
+    bench_results_t columns = {.energy = calloc(meter_count, sizeof(meter_energy_t))};
+    bench_results_t csv = {.energy = calloc(meter_count, sizeof(meter_energy_t))};
+    if(columns.energy == NULL || csv.energy == NULL)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 2;
+    }
+    query_columns(&reader, &layout, meter_id, from_ms, to_ms, &columns);
+    if(query_csv(csv_path, &layout, meter_id, from_ms, to_ms, &csv) != 0)
+    {
+        fprintf(stderr, "Cannot read %s\n", csv_path);
+        return 2;
+    }
+    obis_columns_close_reader(&reader);
+
+    static const char *query_names[3] = {"mean power of meter on day", "energy per meter", "max voltage L1 on day"};
+    printf("%-28s %12s %12s %12s %12s %8s\n", "query", "columns ms", "columns MB", "csv ms", "csv MB", "speedup");
+    for(size_t q = 0; q < 3; q++)
+    {
+        printf("%-28s %12.2f %12.3f %12.1f %12.1f %8.0f\n", query_names[q], columns.ms[q], columns.bytes[q] / 1e6, csv.ms[q],
+               csv.bytes[q] / 1e6, csv.ms[q] / (columns.ms[q] > 0 ? columns.ms[q] : 1e-3));
+    }
+    const obis_columns_key_t *power_key = &layout.keys[layout.registers[RegisterPower]];
+    const obis_columns_key_t *voltage_key = &layout.keys[layout.registers[RegisterVoltage]];
+    printf("Mean power %.1f x 10^%d over %llu readings, energy of %zu meters, max voltage %lld x 10^%d\n",
+           columns.power_count > 0 ? (double)columns.power_sum / (double)columns.power_count : 0.0, power_key->scaler,
+           (unsigned long long)columns.power_count, columns.energy_count, (long long)columns.voltage_max, voltage_key->scaler);
+
+    if(!keep)
+    {
+        unlink(columns_path);
+        unlink(csv_path);
+    }
+    if(!results_equal(&columns, &csv))
+    {
+        fprintf(stderr, "Results of columnar file and CSV differ\n");
+        return 1;
+    }
+    printf("Results of columnar file and CSV equal\n");
+    free(columns.energy);
+    free(csv.energy);
+    return 0;
+}
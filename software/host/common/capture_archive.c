@@ -0,0 +1,430 @@
+/**
+ * @file capture_archive.c
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Header */
+#include "capture_archive.h"
+#include "flash_ops.h"
+#include "mbus.h"
+#include "dlms.h"
+#include "frame_pool.h"
+
+_Static_assert(sizeof(capture_archive_header_t) == 16, "header is part of the archive format");
+_Static_assert(sizeof(capture_archive_block_t) == 16, "block header is part of the archive format");
+_Static_assert(sizeof(capture_archive_entry_t) == 32, "entry is part of the archive format");
+_Static_assert(sizeof(capture_archive_index_t) == 32, "index header is part of the archive format");
+_Static_assert(sizeof(capture_archive_telegram_t) == 24, "telegram header is part of the archive format");
+
+#define ARCHIVE_ALIGNMENT               8
+#define ARCHIVE_MAX_TELEGRAM_SIZE       UINT16_MAX
+
+static size_t padded(size_t size)
+{
+    return (size + ARCHIVE_ALIGNMENT - 1) & ~(size_t)(ARCHIVE_ALIGNMENT - 1);
+}
+
+/* ===== WRITER ===== */
+static esp_err_t write_all(int fd, const uint8_t *data, size_t size)
+{
+    while(size > 0)
+    {
+        ssize_t written = write(fd, data, size);
+        if(written <= 0){ return ESP_FAIL; }
+        data += written;
+        size -= (size_t)written;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t flush_buffer(capture_archive_writer_t *writer)
+{
+    esp_err_t err = write_all(writer->fd, writer->buffer, writer->buffered);
+    writer->buffered = 0;
+    return err;
+}
+
+/* Append block of up to two parts, returns its offset */
+static esp_err_t append_block(capture_archive_writer_t *writer, uint8_t type, const void *head, size_t head_size, const void *data, size_t data_size,
+                              uint64_t *offset)
+{
+    capture_archive_block_t block = {
+        .magic = CAPTURE_ARCHIVE_BLOCK_MAGIC,
+        .type = type,
+        .size = (uint32_t)(head_size + data_size),
+        .crc = flash_ops_crc32(flash_ops_crc32(0, head, head_size), data, data_size),
+    };
+    static const uint8_t zeros[ARCHIVE_ALIGNMENT] = {0};
+    size_t padding = padded(block.size) - block.size;
+    const void *parts[] = {&block, head, data, zeros};
+    const size_t sizes[] = {sizeof(block), head_size, data_size, padding};
+
+    *offset = writer->offset;
+    for(size_t i = 0; i < sizeof(parts) / sizeof(parts[0]); i++)
+    {
+        /* Large parts like an index bypass the buffer */
+        if(writer->buffered + sizes[i] > CAPTURE_ARCHIVE_WRITE_BUFFER_SIZE)
+        {
+            if(flush_buffer(writer) != ESP_OK){ return ESP_FAIL; }
+            if(sizes[i] > CAPTURE_ARCHIVE_WRITE_BUFFER_SIZE)
+            {
+                if(write_all(writer->fd, parts[i], sizes[i]) != ESP_OK){ return ESP_FAIL; }
+                writer->offset += sizes[i];
+                continue;
+            }
+        }
+        if(sizes[i] > 0){ memcpy(&writer->buffer[writer->buffered], parts[i], sizes[i]); }
+        writer->buffered += sizes[i];
+        writer->offset += sizes[i];
+    }
+    return ESP_OK;
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+    const capture_archive_entry_t *entry_a = a;
+    const capture_archive_entry_t *entry_b = b;
+    if(entry_a->meter_id != entry_b->meter_id){ return entry_a->meter_id < entry_b->meter_id ? -1 : 1; }
+    if(entry_a->timestamp_ms != entry_b->timestamp_ms){ return entry_a->timestamp_ms < entry_b->timestamp_ms ? -1 : 1; }
+    return entry_a->offset < entry_b->offset ? -1 : entry_a->offset > entry_b->offset;
+}
+
+static int compare_by_time(const void *a, const void *b, void *ctx)
+{
+    const capture_archive_entry_t *entries = ctx;
+    const capture_archive_entry_t *entry_a = &entries[*(const uint32_t *)a];
+    const capture_archive_entry_t *entry_b = &entries[*(const uint32_t *)b];
+    if(entry_a->timestamp_ms != entry_b->timestamp_ms){ return entry_a->timestamp_ms < entry_b->timestamp_ms ? -1 : 1; }
+    return entry_a->offset < entry_b->offset ? -1 : entry_a->offset > entry_b->offset;
+}
+
+/* Index block of entries, published by pointing the file header to it after it is written */
+static esp_err_t write_index(capture_archive_writer_t *writer, const capture_archive_entry_t *entries, size_t count, uint8_t type)
+{
+    size_t entries_size = count * sizeof(capture_archive_entry_t);
+    uint8_t *data = malloc(entries_size + count * sizeof(uint32_t));
+    if(data == NULL){ return ESP_ERR_NO_MEM; }
+
+    capture_archive_entry_t *sorted = (capture_archive_entry_t *)data;
+    uint32_t *by_time = (uint32_t *)&data[entries_size];
+    memcpy(sorted, entries, entries_size);
+    qsort(sorted, count, sizeof(capture_archive_entry_t), compare_entries);
+    for(size_t i = 0; i < count; i++){ by_time[i] = (uint32_t)i; }
+    qsort_r(by_time, count, sizeof(uint32_t), compare_by_time, sorted);
+
+    capture_archive_index_t index = {
+        .previous_offset = type == CaptureArchiveIndex ? writer->index_offset : 0,
+        .entry_count = (uint32_t)count,
+        .first_timestamp_ms = count > 0 ? sorted[by_time[0]].timestamp_ms : 0,
+        .last_timestamp_ms = count > 0 ? sorted[by_time[count - 1]].timestamp_ms : 0,
+    };
+    for(size_t i = 0; i < count; i++)
+    {
+        if(i == 0 || sorted[i].meter_id != sorted[i - 1].meter_id){ index.meter_count++; }
+    }
+
+    uint64_t offset = 0;
+    esp_err_t err = append_block(writer, type, &index, sizeof(index), data, entries_size + count * sizeof(uint32_t), &offset);
+    free(data);
+    if(err == ESP_OK){ err = flush_buffer(writer); }
+    if(err == ESP_OK && writer->sync && fdatasync(writer->fd) != 0){ err = ESP_FAIL; }
+
+    /* Readers follow the header, the block must be complete before */
+    if(err == ESP_OK && pwrite(writer->fd, &offset, sizeof(offset), offsetof(capture_archive_header_t, index_offset)) != sizeof(offset))
+    {
+        err = ESP_FAIL;
+    }
+    if(err == ESP_OK){ writer->index_offset = offset; }
+    return err;
+}
+
+esp_err_t capture_archive_create(capture_archive_writer_t *writer, const char *path)
+{
+    /* Readers of a replaced archive keep their mapping, truncating it would fault them */
+    memset(writer, 0, sizeof(*writer));
+    unlink(path);
+    writer->fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0644);
+    writer->buffer = malloc(CAPTURE_ARCHIVE_WRITE_BUFFER_SIZE);
+    if(writer->fd < 0 || writer->buffer == NULL)
+    {
+        if(writer->fd >= 0){ close(writer->fd); }
+        free(writer->buffer);
+        return ESP_FAIL;
+    }
+
+    capture_archive_header_t header = {
+        .magic = CAPTURE_ARCHIVE_MAGIC,
+        .version = CAPTURE_ARCHIVE_FORMAT_VERSION,
+    };
+    memcpy(writer->buffer, &header, sizeof(header));
+    writer->buffered = sizeof(header);
+    writer->offset = sizeof(header);
+    return ESP_OK;
+}
+
+esp_err_t capture_archive_append(capture_archive_writer_t *writer, uint64_t meter_id, int64_t timestamp_ms, uint32_t frame_counter,
+                                 const uint8_t *data, size_t size)
+{
+    if(size > ARCHIVE_MAX_TELEGRAM_SIZE){ return ESP_ERR_INVALID_SIZE; }
+    if(writer->entry_count == writer->entry_capacity)
+    {
+        size_t capacity = writer->entry_capacity > 0 ? writer->entry_capacity * 2 : CAPTURE_ARCHIVE_CHECKPOINT_RECORDS;
+        capture_archive_entry_t *entries = realloc(writer->entries, capacity * sizeof(capture_archive_entry_t));
+        if(entries == NULL){ return ESP_ERR_NO_MEM; }
+        writer->entries = entries;
+        writer->entry_capacity = capacity;
+    }
+
+    capture_archive_telegram_t telegram = {
+        .meter_id = meter_id,
+        .timestamp_ms = timestamp_ms,
+        .frame_counter = frame_counter,
+    };
+    capture_archive_entry_t *entry = &writer->entries[writer->entry_count];
+    esp_err_t err = append_block(writer, CaptureArchiveTelegram, &telegram, sizeof(telegram), data, size, &entry->offset);
+    if(err != ESP_OK){ return err; }
+
+    entry->meter_id = meter_id;
+    entry->timestamp_ms = timestamp_ms;
+    entry->frame_counter = frame_counter;
+    entry->size = (uint32_t)size;
+    writer->entry_count++;
+
+    if(writer->entry_count - writer->published >= CAPTURE_ARCHIVE_CHECKPOINT_RECORDS){ return capture_archive_checkpoint(writer); }
+    return ESP_OK;
+}
+
+esp_err_t capture_archive_checkpoint(capture_archive_writer_t *writer)
+{
+    if(writer->published == writer->entry_count){ return flush_buffer(writer); }
+
+    esp_err_t err = write_index(writer, &writer->entries[writer->published], writer->entry_count - writer->published, CaptureArchiveIndex);
+    if(err == ESP_OK){ writer->published = writer->entry_count; }
+    return err;
+}
+
+esp_err_t capture_archive_close(capture_archive_writer_t *writer)
+{
+    /* One index of all telegrams at the end, index blocks before are skipped by readers */
+    esp_err_t err = write_index(writer, writer->entries, writer->entry_count, CaptureArchiveFinalIndex);
+    if(close(writer->fd) != 0 && err == ESP_OK){ err = ESP_FAIL; }
+    free(writer->buffer);
+    free(writer->entries);
+    memset(writer, 0, sizeof(*writer));
+    writer->fd = -1;
+    return err;
+}
+
+/* ===== READER ===== */
+/* Block at offset within the mapping, returns data after block header */
+static const uint8_t *find_block(const capture_archive_reader_t *reader, uint64_t offset, uint8_t type, size_t *size)
+{
+    if(offset < sizeof(capture_archive_header_t) || offset > reader->size || reader->size - offset < sizeof(capture_archive_block_t)){ return NULL; }
+
+    capture_archive_block_t block;
+    memcpy(&block, &reader->data[offset], sizeof(block));
+    if(block.magic != CAPTURE_ARCHIVE_BLOCK_MAGIC || (type != 0 && block.type != type)){ return NULL; }
+    if(block.size > reader->size - offset - sizeof(block)){ return NULL; }
+
+    *size = block.size;
+    return &reader->data[offset + sizeof(block)];
+}
+
+static bool check_crc(const capture_archive_reader_t *reader, uint64_t offset, const uint8_t *data, size_t size)
+{
+    capture_archive_block_t block;
+    memcpy(&block, &reader->data[offset], sizeof(block));
+    return flash_ops_crc32(0, data, size) == block.crc;
+}
+
+static esp_err_t check_index(const capture_archive_reader_t *reader, uint64_t offset, capture_archive_segment_t *segment, uint8_t *type)
+{
+    size_t size = 0;
+    const uint8_t *data = find_block(reader, offset, 0, &size);
+    if(data == NULL){ return ESP_ERR_INVALID_SIZE; }
+    if(!check_crc(reader, offset, data, size)){ return ESP_ERR_INVALID_CRC; }
+
+    *type = reader->data[offset + offsetof(capture_archive_block_t, type)];
+    if(*type != CaptureArchiveIndex && *type != CaptureArchiveFinalIndex){ return ESP_ERR_INVALID_SIZE; }
+    if(size < sizeof(capture_archive_index_t)){ return ESP_ERR_INVALID_SIZE; }
+
+    segment->index = (const capture_archive_index_t *)data;
+    size_t count = segment->index->entry_count;
+    if(size != sizeof(capture_archive_index_t) + count * (sizeof(capture_archive_entry_t) + sizeof(uint32_t))){ return ESP_ERR_INVALID_SIZE; }
+    segment->entries = (const capture_archive_entry_t *)&data[sizeof(capture_archive_index_t)];
+    segment->by_time = (const uint32_t *)&data[sizeof(capture_archive_index_t) + count * sizeof(capture_archive_entry_t)];
+    return ESP_OK;
+}
+
+esp_err_t capture_archive_open(capture_archive_reader_t *reader, const char *path)
+{
+    memset(reader, 0, sizeof(*reader));
+    int fd = open(path, O_RDONLY);
+    if(fd < 0){ return ESP_ERR_NOT_FOUND; }
+
+    /* Header first, the file already has the index it points to */
+    capture_archive_header_t header;
+    struct stat st;
+    if(pread(fd, &header, sizeof(header), 0) != sizeof(header) || header.magic != CAPTURE_ARCHIVE_MAGIC ||
+       header.version != CAPTURE_ARCHIVE_FORMAT_VERSION || fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return ESP_ERR_NOT_FOUND;
+    }
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED){ return ESP_FAIL; }
+    reader->data = data;
+    reader->size = (size_t)st.st_size;
+
+    /* Chain of index blocks, newest first */
+    size_t capacity = 0;
+    esp_err_t err = ESP_OK;
+    for(uint64_t offset = header.index_offset; offset != 0 && err == ESP_OK;)
+    {
+        if(reader->segment_count == capacity)
+        {
+            capacity = capacity > 0 ? capacity * 2 : 16;
+            capture_archive_segment_t *segments = realloc(reader->segments, capacity * sizeof(capture_archive_segment_t));
+            if(segments == NULL)
+            {
+                err = ESP_ERR_NO_MEM;
+                break;
+            }
+            reader->segments = segments;
+        }
+
+        uint8_t type = 0;
+        capture_archive_segment_t *segment = &reader->segments[reader->segment_count];
+        err = check_index(reader, offset, segment, &type);
+        if(err != ESP_OK){ break; }
+        reader->segment_count++;
+        reader->entry_count += segment->index->entry_count;
+
+        /* Previous blocks are always before, which also ends a damaged chain */
+        uint64_t previous = segment->index->previous_offset;
+        if(type == CaptureArchiveFinalIndex || previous >= offset){ break; }
+        offset = previous;
+    }
+    if(err != ESP_OK)
+    {
+        capture_archive_close_reader(reader);
+        return err;
+    }
+
+    /* Oldest first */
+    for(size_t i = 0; i < reader->segment_count / 2; i++)
+    {
+        capture_archive_segment_t segment = reader->segments[i];
+        reader->segments[i] = reader->segments[reader->segment_count - 1 - i];
+        reader->segments[reader->segment_count - 1 - i] = segment;
+    }
+    return ESP_OK;
+}
+
+void capture_archive_close_reader(capture_archive_reader_t *reader)
+{
+    if(reader->data != NULL){ munmap((void *)reader->data, reader->size); }
+    free(reader->segments);
+    memset(reader, 0, sizeof(*reader));
+}
+
+/* ===== QUERIES ===== */
+void capture_archive_query_init(capture_archive_query_t *query, uint64_t meter_id, int64_t from_ms, int64_t to_ms)
+{
+    memset(query, 0, sizeof(*query));
+    query->meter_id = meter_id;
+    query->from_ms = from_ms;
+    query->to_ms = to_ms;
+}
+
+/* First entry of meter at or after time */
+static size_t lower_bound_meter(const capture_archive_segment_t *segment, uint64_t meter_id, int64_t from_ms)
+{
+    size_t low = 0, high = segment->index->entry_count;
+    while(low < high)
+    {
+        size_t mid = low + (high - low) / 2;
+        const capture_archive_entry_t *entry = &segment->entries[mid];
+        if(entry->meter_id < meter_id || (entry->meter_id == meter_id && entry->timestamp_ms < from_ms)){ low = mid + 1; } else { high = mid; }
+    }
+    return low;
+}
+
+/* First position in time order at or after time */
+static size_t lower_bound_time(const capture_archive_segment_t *segment, int64_t from_ms)
+{
+    size_t low = 0, high = segment->index->entry_count;
+    while(low < high)
+    {
+        size_t mid = low + (high - low) / 2;
+        if(segment->entries[segment->by_time[mid]].timestamp_ms < from_ms){ low = mid + 1; } else { high = mid; }
+    }
+    return low;
+}
+
+esp_err_t capture_archive_next(const capture_archive_reader_t *reader, capture_archive_query_t *query, capture_archive_record_t *record)
+{
+    bool any = query->meter_id == CAPTURE_ARCHIVE_ANY_METER;
+    for(; query->segment < reader->segment_count; query->segment++, query->started = false)
+    {
+        const capture_archive_segment_t *segment = &reader->segments[query->segment];
+        if(!query->started)
+        {
+            /* Blocks outside of the range are skipped without searching */
+            if(segment->index->entry_count == 0 || segment->index->last_timestamp_ms < query->from_ms ||
+               segment->index->first_timestamp_ms > query->to_ms){ continue; }
+            query->position = any ? lower_bound_time(segment, query->from_ms) : lower_bound_meter(segment, query->meter_id, query->from_ms);
+            query->started = true;
+        }
+        if(query->position >= segment->index->entry_count){ continue; }
+
+        const capture_archive_entry_t *entry = &segment->entries[any ? segment->by_time[query->position] : query->position];
+        if(entry->timestamp_ms > query->to_ms || (!any && entry->meter_id != query->meter_id)){ continue; }
+        query->position++;
+
+        /* Index blocks are checked on open, telegrams only with capture_archive_check */
+        size_t size = 0;
+        const uint8_t *data = find_block(reader, entry->offset, CaptureArchiveTelegram, &size);
+        record->entry = entry;
+        record->data = data != NULL && size == sizeof(capture_archive_telegram_t) + entry->size ? &data[sizeof(capture_archive_telegram_t)] : NULL;
+        return record->data != NULL ? ESP_OK : ESP_ERR_INVALID_SIZE;
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t capture_archive_check(const capture_archive_reader_t *reader, const capture_archive_record_t *record)
+{
+    if(record->data == NULL){ return ESP_ERR_INVALID_SIZE; }
+    const uint8_t *data = record->data - sizeof(capture_archive_telegram_t);
+    return check_crc(reader, record->entry->offset, data, sizeof(capture_archive_telegram_t) + record->entry->size) ? ESP_OK : ESP_ERR_INVALID_CRC;
+}
+
+/* ===== TELEGRAMS ===== */
+esp_err_t capture_archive_identify(const uint8_t *data, size_t size, uint64_t *meter_id, uint32_t *frame_counter)
+{
+    /* Layers work in place */
+    uint8_t frame[FRAME_POOL_FRAME_SIZE];
+    size_t user_data_size = 0;
+    if(size > sizeof(frame)){ return ESP_ERR_INVALID_SIZE; }
+    memcpy(frame, data, size);
+    esp_err_t err = parse_mbus_long_frame_layer(frame, size, frame, &user_data_size);
+    if(err != ESP_OK){ return err; }
+
+    uint8_t title_length = user_data_size > DLMS_SYSTEM_TITLE_LENGTH_OFFSET ? frame[DLMS_SYSTEM_TITLE_LENGTH_OFFSET] : 0;
+    if(title_length == 0 || title_length > sizeof(uint64_t) || (size_t)DLMS_SYSTEM_TITLE_OFFSET + title_length > user_data_size){ return ESP_FAIL; }
+
+    *meter_id = 0;
+    for(size_t i = 0; i < title_length; i++){ *meter_id = (*meter_id << 8) | frame[DLMS_SYSTEM_TITLE_OFFSET + i]; }
+    return get_dlms_frame_counter(frame, user_data_size, frame_counter);
+}
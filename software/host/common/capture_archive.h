@@ -0,0 +1,233 @@
+/**
+ * @file capture_archive.h
+ * @brief Append-only archive of raw telegrams with an index by meter, frame counter and time, for host tools
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+// Multiple inclusion protection
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+/* ===== ARCHIVE CONFIGURATION ===== */
+#define CAPTURE_ARCHIVE_CHECKPOINT_RECORDS  4096        /* < Telegrams after which the writer publishes an index block */
+#define CAPTURE_ARCHIVE_WRITE_BUFFER_SIZE   (256 * 1024)
+#define CAPTURE_ARCHIVE_ANY_METER           UINT64_MAX  /* < Query all meters */
+
+/*
+ * File format, little endian, all blocks aligned to 8 bytes:
+ * file header, then blocks with a block header each. Telegram blocks hold the raw bytes, index blocks
+ * the entries of all telegrams since the previous index block, or of all telegrams in the final index
+ * written on close. The file header points to the newest index block, it is updated after the block is
+ * written, so readers always find a complete index. Nothing written before is changed.
+ */
+#define CAPTURE_ARCHIVE_MAGIC               0x4352414D  /* < "MARC" */
+#define CAPTURE_ARCHIVE_FORMAT_VERSION      1
+#define CAPTURE_ARCHIVE_BLOCK_MAGIC         0x4B4C424D  /* < "MBLK" */
+
+/* Type of block */
+enum CaptureArchiveBlock
+{
+    CaptureArchiveTelegram = 1,
+    CaptureArchiveIndex = 2,                /* < Entries since previous index block */
+    CaptureArchiveFinalIndex = 3,           /* < Entries of all telegrams, written on close */
+};
+
+/* Header of archive */
+typedef struct {
+    uint32_t magic;                         /* < CAPTURE_ARCHIVE_MAGIC */
+    uint8_t version;                        /* < CAPTURE_ARCHIVE_FORMAT_VERSION */
+    uint8_t reserved[3];
+    uint64_t index_offset;                  /* < Newest index block, 0 before first one, updated in place */
+} capture_archive_header_t;
+
+/* Header of every block */
+typedef struct {
+    uint32_t magic;                         /* < CAPTURE_ARCHIVE_BLOCK_MAGIC */
+    uint8_t type;                           /* < CaptureArchiveBlock */
+    uint8_t reserved[3];
+    uint32_t size;                          /* < Bytes after block header, without padding */
+    uint32_t crc;                           /* < CRC-32 of bytes after block header */
+} capture_archive_block_t;
+
+/* Index of one telegram */
+typedef struct {
+    uint64_t meter_id;                      /* < System title of meter as big endian number */
+    int64_t timestamp_ms;                   /* < Reception time, e.g. ms since epoch */
+    uint64_t offset;                        /* < Telegram block in file */
+    uint32_t frame_counter;                 /* < DLMS frame counter */
+    uint32_t size;                          /* < Raw bytes of telegram */
+} capture_archive_entry_t;
+
+/* Header of index block, followed by entries sorted by meter and time, then positions of entries sorted by time */
+typedef struct {
+    uint64_t previous_offset;               /* < Previous index block, 0 for first and final index */
+    uint32_t entry_count;
+    uint32_t meter_count;
+    int64_t first_timestamp_ms;
+    int64_t last_timestamp_ms;
+} capture_archive_index_t;
+
+/* Telegram block after block header */
+typedef struct {
+    uint64_t meter_id;
+    int64_t timestamp_ms;
+    uint32_t frame_counter;
+    uint32_t reserved;
+} capture_archive_telegram_t;
+
+/* Writer, appends telegrams and publishes index blocks */
+typedef struct {
+    int fd;
+    uint64_t offset;                        /* < End of file including buffer */
+    uint8_t *buffer;
+    size_t buffered;
+    capture_archive_entry_t *entries;       /* < All entries, for final index */
+    size_t entry_count;
+    size_t entry_capacity;
+    size_t published;                       /* < Entries in index blocks */
+    uint64_t index_offset;                  /* < Newest index block */
+    bool sync;                              /* < fdatasync before publishing, for readers after a crash */
+} capture_archive_writer_t;
+
+/* Index block of a mapped archive */
+typedef struct {
+    const capture_archive_index_t *index;
+    const capture_archive_entry_t *entries; /* < Sorted by meter and time */
+    const uint32_t *by_time;                /* < Positions of entries sorted by time */
+} capture_archive_segment_t;
+
+/* Reader of a mapped archive, shared by threads with their own queries */
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+    capture_archive_segment_t *segments;    /* < Oldest first */
+    size_t segment_count;
+    size_t entry_count;
+} capture_archive_reader_t;
+
+/* Query for one or all meters in a time range, inclusive */
+typedef struct {
+    uint64_t meter_id;                      /* < CAPTURE_ARCHIVE_ANY_METER for all */
+    int64_t from_ms;
+    int64_t to_ms;
+    size_t segment;                         /* < Position, start with capture_archive_query_init */
+    size_t position;
+    bool started;
+} capture_archive_query_t;
+
+/* Telegram returned by a query, points into the mapping */
+typedef struct {
+    const capture_archive_entry_t *entry;
+    const uint8_t *data;
+} capture_archive_record_t;
+
+/**
+ * @brief Create archive, an existing file is unlinked, so its readers keep their mapping
+ *
+ * @param writer writer to initialize
+ * @param path file to create
+ * @return esp_err_t
+ */
+esp_err_t capture_archive_create(capture_archive_writer_t *writer, const char *path);
+
+/**
+ * @brief Append raw telegram, an index block is published every CAPTURE_ARCHIVE_CHECKPOINT_RECORDS telegrams
+ *
+ * @param writer writer of capture_archive_create
+ * @param meter_id system title of meter
+ * @param timestamp_ms reception time
+ * @param frame_counter DLMS frame counter
+ * @param data raw bytes
+ * @param size number of bytes
+ * @return esp_err_t
+ */
+esp_err_t capture_archive_append(capture_archive_writer_t *writer, uint64_t meter_id, int64_t timestamp_ms, uint32_t frame_counter,
+                                 const uint8_t *data, size_t size);
+
+/**
+ * @brief Write index block of telegrams since the previous one and point the header to it, readers see them when they open the archive again
+ *
+ * @param writer writer of capture_archive_create
+ * @return esp_err_t
+ */
+esp_err_t capture_archive_checkpoint(capture_archive_writer_t *writer);
+
+/**
+ * @brief Write final index of all telegrams and close file
+ *
+ * @param writer writer of capture_archive_create
+ * @return esp_err_t
+ */
+esp_err_t capture_archive_close(capture_archive_writer_t *writer);
+
+/**
+ * @brief Map archive and its newest index, also while it is written
+ *
+ * @param reader reader to initialize
+ * @param path archive
+ * @return esp_err_t ESP_ERR_NOT_FOUND if no archive, ESP_ERR_INVALID_CRC if an index block is damaged
+ */
+esp_err_t capture_archive_open(capture_archive_reader_t *reader, const char *path);
+
+/**
+ * @brief Unmap archive
+ *
+ * @param reader reader of capture_archive_open
+ */
+void capture_archive_close_reader(capture_archive_reader_t *reader);
+
+/**
+ * @brief Start query for one or all meters in a time range
+ *
+ * @param query query to initialize
+ * @param meter_id system title of meter, CAPTURE_ARCHIVE_ANY_METER for all
+ * @param from_ms first time
+ * @param to_ms last time
+ */
+void capture_archive_query_init(capture_archive_query_t *query, uint64_t meter_id, int64_t from_ms, int64_t to_ms);
+
+/**
+ * @brief Next telegram of query, by time for each meter or for all meters within an index block
+ *
+ * @note Only the index is searched, telegrams before the range are not read
+ *
+ * @param reader reader of capture_archive_open
+ * @param query query of capture_archive_query_init
+ * @param record telegram, points into the mapping
+ * @return esp_err_t ESP_ERR_NOT_FOUND after last telegram, ESP_ERR_INVALID_SIZE if the telegram block is damaged
+ */
+esp_err_t capture_archive_next(const capture_archive_reader_t *reader, capture_archive_query_t *query, capture_archive_record_t *record);
+
+/**
+ * @brief Check CRC of telegram, costs a pass over its bytes
+ *
+ * @param reader reader of capture_archive_open
+ * @param record telegram of capture_archive_next
+ * @return esp_err_t ESP_ERR_INVALID_CRC if telegram is damaged
+ */
+esp_err_t capture_archive_check(const capture_archive_reader_t *reader, const capture_archive_record_t *record);
+
+/**
+ * @brief Get system title and frame counter of a raw telegram from its M-Bus and DLMS header
+ *
+ * @param data raw bytes
+ * @param size number of bytes
+ * @param meter_id system title as big endian number
+ * @param frame_counter DLMS frame counter
+ * @return esp_err_t
+ */
+esp_err_t capture_archive_identify(const uint8_t *data, size_t size, uint64_t *meter_id, uint32_t *frame_counter);
+
+#ifdef __cplusplus
+}
+#endif
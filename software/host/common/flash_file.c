@@ -0,0 +1,132 @@
+/**
+ * @file flash_file.c
+ * 
+ * @copyright Copyright (c) 2023
+ * 
+ */
+
+#include <string.h>
+
+/* Header */
+#include "flash_file.h"
+
+/* ===== FLASH OPERATIONS ===== */
+static esp_err_t file_read(void *ctx, size_t offset, void *data, size_t size)
+{
+    flash_file_t *flash = ctx;
+    if(offset + size > flash->size){ return ESP_ERR_INVALID_SIZE; }
+
+    if(fseek(flash->file, (long)offset, SEEK_SET) != 0 || fread(data, 1, size, flash->file) != size)
+    {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t file_write(void *ctx, size_t offset, const void *data, size_t size)
+{
+    flash_file_t *flash = ctx;
+    uint8_t buffer[FLASH_OPS_PAGE_SIZE];
+    const uint8_t *bytes = data;
+
+    if(offset + size > flash->size){ return ESP_ERR_INVALID_SIZE; }
+
+    /* Supply may die during write */
+    size_t remaining = flash->torn_bytes != 0 && flash->torn_bytes < size ? flash->torn_bytes : size;
+    flash->writes++;
+
+    /* NOR flash can only clear bits */
+    while(remaining > 0)
+    {
+        size_t chunk = remaining < sizeof(buffer) ? remaining : sizeof(buffer);
+        esp_err_t err = file_read(ctx, offset, buffer, chunk);
+        if(err != ESP_OK){ return err; }
+
+        for(size_t i = 0; i < chunk; i++)
+        {
+            buffer[i] &= bytes[i];
+        }
+        if(fseek(flash->file, (long)offset, SEEK_SET) != 0 || fwrite(buffer, 1, chunk, flash->file) != chunk)
+        {
+            return ESP_FAIL;
+        }
+
+        offset += chunk;
+        bytes += chunk;
+        remaining -= chunk;
+    }
+    return fflush(flash->file) == 0 ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t file_erase(void *ctx, size_t offset, size_t size)
+{
+    flash_file_t *flash = ctx;
+    uint8_t erased[FLASH_OPS_SECTOR_SIZE];
+
+    if(offset % FLASH_OPS_SECTOR_SIZE != 0 || size % FLASH_OPS_SECTOR_SIZE != 0 || offset + size > flash->size)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(erased, 0xFF, sizeof(erased));
+    for(size_t sector = offset / FLASH_OPS_SECTOR_SIZE; sector < (offset + size) / FLASH_OPS_SECTOR_SIZE; sector++)
+    {
+        if(fseek(flash->file, (long)(sector * FLASH_OPS_SECTOR_SIZE), SEEK_SET) != 0 || fwrite(erased, 1, sizeof(erased), flash->file) != sizeof(erased))
+        {
+            return ESP_FAIL;
+        }
+        flash->sector_erases[sector]++;
+    }
+    flash->erases++;
+    return fflush(flash->file) == 0 ? ESP_OK : ESP_FAIL;
+}
+
+/* ===== FLASH FILE FUNCTIONS ===== */
+esp_err_t flash_file_open(flash_file_t *flash, const char *path, size_t size, flash_ops_t *ops)
+{
+    if(size % FLASH_OPS_SECTOR_SIZE != 0 || size / FLASH_OPS_SECTOR_SIZE > FLASH_FILE_MAX_SECTORS)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    memset(flash, 0, sizeof(flash_file_t));
+    flash->file = fopen(path, "r+b");
+    if(flash->file == NULL)
+    {
+        flash->file = fopen(path, "w+b");
+    }
+    if(flash->file == NULL)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    flash->size = size;
+
+    /* Missing part is erased */
+    if(fseek(flash->file, 0, SEEK_END) != 0)
+    {
+        flash_file_close(flash);
+        return ESP_FAIL;
+    }
+    long length = ftell(flash->file);
+    for(long i = length; i < (long)size; i++)
+    {
+        fputc(0xFF, flash->file);
+    }
+    fflush(flash->file);
+
+    ops->read = file_read;
+    ops->write = file_write;
+    ops->erase = file_erase;
+    ops->ctx = flash;
+    ops->size = size;
+    return ESP_OK;
+}
+
+void flash_file_close(flash_file_t *flash)
+{
+    if(flash->file != NULL)
+    {
+        fclose(flash->file);
+        flash->file = NULL;
+    }
+}
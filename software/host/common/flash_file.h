@@ -0,0 +1,53 @@
+/**
+ * @file flash_file.h
+ * @brief Flash operations on a file with the behavior of NOR flash, for host tools
+ * @copyright Copyright (c) 2023
+ * 
+ */
+
+// Multiple inclusion protection
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "flash_ops.h"
+
+/* ===== FLASH FILE CONFIGURATION ===== */
+#define FLASH_FILE_MAX_SECTORS          256         /* < Size limit of simulated area */
+
+/* Simulated flash in a file */
+typedef struct {
+    FILE *file;
+    size_t size;
+    uint32_t writes;
+    uint32_t erases;
+    uint32_t sector_erases[FLASH_FILE_MAX_SECTORS]; /* < Erase count of each sector, to check wear levelling */
+    size_t torn_bytes;                              /* < If not 0, next write stops after this number of bytes */
+} flash_file_t;
+
+/**
+ * @brief Open file as flash, a new or shorter file is filled with erased sectors
+ * 
+ * @param flash simulated flash
+ * @param path file to open
+ * @param size size of area, multiple of FLASH_OPS_SECTOR_SIZE
+ * @param ops flash operations on the file
+ * @return esp_err_t 
+ */
+esp_err_t flash_file_open(flash_file_t *flash, const char *path, size_t size, flash_ops_t *ops);
+
+/**
+ * @brief Close file
+ * 
+ * @param flash simulated flash
+ */
+void flash_file_close(flash_file_t *flash);
+
+#ifdef __cplusplus
+}
+#endif
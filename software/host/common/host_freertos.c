@@ -0,0 +1,181 @@
+/**
+ * @file host_freertos.c
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Header */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+/* Items are copied in and out like in FreeRTOS */
+struct host_queue {
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+    uint8_t *items;
+    size_t item_size;
+    size_t length;
+    size_t head;
+    size_t count;
+};
+
+/* Arguments of a new thread */
+typedef struct {
+    TaskFunction_t function;
+    void *parameters;
+} task_start_t;
+
+/* ===== HELPER FUNCTIONS ===== */
+/* Absolute deadline on the clock of the condition variables */
+static struct timespec deadline(TickType_t ticks)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t ns = (uint64_t)ts.tv_nsec + (uint64_t)ticks * portTICK_PERIOD_MS * 1000000ULL;
+    ts.tv_sec += (time_t)(ns / 1000000000ULL);
+    ts.tv_nsec = (long)(ns % 1000000000ULL);
+    return ts;
+}
+
+/* Wait until condition holds, false on timeout */
+static bool wait(struct host_queue *queue, bool (* condition)(const struct host_queue *queue), TickType_t ticks)
+{
+    struct timespec until = deadline(ticks);
+    while(!condition(queue))
+    {
+        if(ticks == 0){ return false; }
+        if(ticks == portMAX_DELAY)
+        {
+            pthread_cond_wait(&queue->changed, &queue->mutex);
+        }
+        else if(pthread_cond_timedwait(&queue->changed, &queue->mutex, &until) == ETIMEDOUT)
+        {
+            return condition(queue);
+        }
+    }
+    return true;
+}
+
+static bool not_full(const struct host_queue *queue)
+{
+    return queue->count < queue->length;
+}
+
+static bool not_empty(const struct host_queue *queue)
+{
+    return queue->count > 0;
+}
+
+static void *task_start(void *arg)
+{
+    task_start_t start = *(task_start_t *)arg;
+    free(arg);
+    start.function(start.parameters);
+    return NULL;
+}
+
+/* ===== TASK FUNCTIONS ===== */
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stack_size, void *parameters, UBaseType_t priority, TaskHandle_t *handle)
+{
+    task_start_t *start = malloc(sizeof(task_start_t));
+    if(start == NULL){ return pdFAIL; }
+    start->function = function;
+    start->parameters = parameters;
+
+    pthread_t thread;
+    if(pthread_create(&thread, NULL, task_start, start) != 0)
+    {
+        free(start);
+        return pdFAIL;
+    }
+    pthread_detach(thread);
+    if(handle != NULL){ *handle = NULL; }
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    pthread_exit(NULL);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    struct timespec ts = {
+        .tv_sec = (time_t)(ticks * portTICK_PERIOD_MS / 1000),
+        .tv_nsec = (long)(ticks * portTICK_PERIOD_MS % 1000) * 1000000L,
+    };
+    while(nanosleep(&ts, &ts) != 0 && errno == EINTR){ }
+}
+
+/* ===== QUEUE FUNCTIONS ===== */
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    struct host_queue *queue = calloc(1, sizeof(struct host_queue));
+    if(queue == NULL){ return NULL; }
+
+    queue->items = calloc(length, item_size);
+    if(queue->items == NULL)
+    {
+        free(queue);
+        return NULL;
+    }
+    queue->item_size = item_size;
+    queue->length = length;
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&queue->changed, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&queue->mutex, NULL);
+    return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+    pthread_mutex_lock(&queue->mutex);
+    bool space = wait(queue, not_full, ticks);
+    if(space)
+    {
+        size_t tail = (queue->head + queue->count) % queue->length;
+        memcpy(&queue->items[tail * queue->item_size], item, queue->item_size);
+        queue->count++;
+        pthread_cond_broadcast(&queue->changed);
+    }
+    pthread_mutex_unlock(&queue->mutex);
+    return space ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks)
+{
+    pthread_mutex_lock(&queue->mutex);
+    bool available = wait(queue, not_empty, ticks);
+    if(available)
+    {
+        memcpy(item, &queue->items[queue->head * queue->item_size], queue->item_size);
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+        pthread_cond_broadcast(&queue->changed);
+    }
+    pthread_mutex_unlock(&queue->mutex);
+    return available ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue)
+{
+    pthread_mutex_lock(&queue->mutex);
+    queue->head = 0;
+    queue->count = 0;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->mutex);
+    return pdPASS;
+}
@@ -0,0 +1,10 @@
+/**
+ * @file host_log.c
+ * @brief Log level of the host replacement of the ESP-IDF logging macros
+ * @copyright Copyright (c) 2023
+ * 
+ */
+
+#include "esp_log.h"
+
+int host_log_level = HOST_LOG_ERROR;
@@ -0,0 +1,107 @@
+/**
+ * @file host_nvs.c
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <string.h>
+
+/* Header */
+#include "nvs.h"
+
+/* Namespaces are stored like keys, handle is the index of the namespace plus one */
+#define HOST_NVS_MAX_NAMESPACES         4
+
+static char namespaces[HOST_NVS_MAX_NAMESPACES][HOST_NVS_KEY_LENGTH];
+static size_t namespace_count = 0;
+
+static struct {
+    nvs_handle_t handle;
+    char key[HOST_NVS_KEY_LENGTH];
+    uint8_t value[HOST_NVS_MAX_BLOB_SIZE];
+    size_t length;
+} entries[HOST_NVS_MAX_ENTRIES];
+static size_t entry_count = 0;
+
+/* ===== HELPER FUNCTIONS ===== */
+static int find_entry(nvs_handle_t handle, const char *key)
+{
+    for(size_t i = 0; i < entry_count; i++)
+    {
+        if(entries[i].handle == handle && strcmp(entries[i].key, key) == 0){ return (int)i; }
+    }
+    return -1;
+}
+
+static bool namespace_used(nvs_handle_t handle)
+{
+    for(size_t i = 0; i < entry_count; i++)
+    {
+        if(entries[i].handle == handle){ return true; }
+    }
+    return false;
+}
+
+/* ===== NVS FUNCTIONS ===== */
+esp_err_t nvs_open(const char *namespace_name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle)
+{
+    if(strlen(namespace_name) >= HOST_NVS_KEY_LENGTH){ return ESP_ERR_INVALID_ARG; }
+
+    for(size_t i = 0; i < namespace_count; i++)
+    {
+        if(strcmp(namespaces[i], namespace_name) == 0)
+        {
+            *out_handle = (nvs_handle_t)(i + 1);
+            return open_mode == NVS_READONLY && !namespace_used(*out_handle) ? ESP_ERR_NVS_NOT_FOUND : ESP_OK;
+        }
+    }
+
+    if(open_mode == NVS_READONLY){ return ESP_ERR_NVS_NOT_FOUND; }
+    if(namespace_count == HOST_NVS_MAX_NAMESPACES){ return ESP_ERR_NO_MEM; }
+
+    strcpy(namespaces[namespace_count], namespace_name);
+    *out_handle = (nvs_handle_t)++namespace_count;
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length)
+{
+    int i = find_entry(handle, key);
+    if(i < 0){ return ESP_ERR_NVS_NOT_FOUND; }
+
+    /* Only length is requested without buffer */
+    if(out_value != NULL)
+    {
+        if(*length < entries[i].length){ return ESP_ERR_INVALID_SIZE; }
+        memcpy(out_value, entries[i].value, entries[i].length);
+    }
+    *length = entries[i].length;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    if(strlen(key) >= HOST_NVS_KEY_LENGTH || length > HOST_NVS_MAX_BLOB_SIZE){ return ESP_ERR_INVALID_ARG; }
+
+    int i = find_entry(handle, key);
+    if(i < 0)
+    {
+        if(entry_count == HOST_NVS_MAX_ENTRIES){ return ESP_ERR_NO_MEM; }
+        i = (int)entry_count++;
+        entries[i].handle = handle;
+        strcpy(entries[i].key, key);
+    }
+    memcpy(entries[i].value, value, length);
+    entries[i].length = length;
+    return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+}
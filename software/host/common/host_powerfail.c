@@ -0,0 +1,24 @@
+/**
+ * @file host_powerfail.c
+ * @brief Host replacement of the power fail handling, behaves like a board without powerfail partition
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+/* Header */
+#include "powerfail.h"
+
+esp_err_t powerfail_init()
+{
+    return ESP_ERR_NOT_FOUND;
+}
+
+void powerfail_prepare(const obis_data_t *data, uint32_t frame_counter)
+{
+}
+
+esp_err_t powerfail_get_restored(powerfail_record_t *record)
+{
+    return ESP_ERR_NOT_FOUND;
+}
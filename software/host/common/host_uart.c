@@ -0,0 +1,212 @@
+/**
+ * @file host_uart.c
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Header */
+#include "driver/uart.h"
+
+/* One uart, the components only use one port */
+static int fd = -1;
+static int baud_rate = 0;
+static QueueHandle_t event_queue = NULL;
+
+/* Ring buffer of the driver, filled by the reader thread */
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t received = PTHREAD_COND_INITIALIZER;
+static uint8_t *ring = NULL;
+static size_t ring_size = 0;
+static size_t ring_head = 0;
+static size_t ring_used = 0;
+static size_t pending = 0;          /* < Bytes not yet reported by a data event, like the rx fifo */
+static bool full = false;           /* < Buffer full was reported, cleared by flush */
+
+/* ===== HELPER FUNCTIONS ===== */
+static void send_event(uart_event_type_t type, size_t size, bool timeout)
+{
+    /* Driver drops events while the queue is full */
+    uart_event_t event = {.type = type, .size = size, .timeout_flag = timeout};
+    xQueueSend(event_queue, &event, 0);
+}
+
+/* Copy received bytes into ring, report data events, called by reader thread */
+static void receive(const uint8_t *data, size_t size)
+{
+    pthread_mutex_lock(&mutex);
+    size_t space = ring_size - ring_used;
+    size_t stored = size < space ? size : space;
+    for(size_t i = 0; i < stored; i++)
+    {
+        ring[(ring_head + ring_used + i) % ring_size] = data[i];
+    }
+    ring_used += stored;
+    pending += stored;
+
+    bool overflow = stored < size && !full;
+    if(stored < size){ full = true; }
+
+    size_t events = pending / HOST_UART_RX_FULL_THRESHOLD;
+    pending %= HOST_UART_RX_FULL_THRESHOLD;
+    pthread_cond_broadcast(&received);
+    pthread_mutex_unlock(&mutex);
+
+    for(size_t i = 0; i < events; i++){ send_event(UART_DATA, HOST_UART_RX_FULL_THRESHOLD, false); }
+    if(overflow){ send_event(UART_BUFFER_FULL, 0, false); }
+}
+
+/* Rest of the bytes after the line is idle */
+static void receive_timeout()
+{
+    pthread_mutex_lock(&mutex);
+    size_t size = pending;
+    pending = 0;
+    pthread_mutex_unlock(&mutex);
+
+    if(size > 0){ send_event(UART_DATA, size, true); }
+}
+
+static void *reader_thread(void *arg)
+{
+    /* Idle time of the rx timeout, at least one microsecond */
+    long idle_ns = (long)(1000000000LL * HOST_UART_RX_TIMEOUT_SYMBOLS * HOST_UART_BITS_PER_SYMBOL / baud_rate) + 1000;
+    struct timespec idle = {.tv_sec = idle_ns / 1000000000L, .tv_nsec = idle_ns % 1000000000L};
+
+    for(;;)
+    {
+        struct pollfd pfd = {.fd = fd, .events = POLLIN};
+        pthread_mutex_lock(&mutex);
+        bool waiting = pending > 0;
+        pthread_mutex_unlock(&mutex);
+
+        int ready = ppoll(&pfd, 1, waiting ? &idle : NULL, NULL);
+        if(ready == 0)
+        {
+            receive_timeout();
+            continue;
+        }
+        if(ready < 0 && errno == EINTR){ continue; }
+
+        uint8_t buffer[256];
+        ssize_t size = ready > 0 && (pfd.revents & POLLIN) ? read(fd, buffer, sizeof(buffer)) : -1;
+        if(size > 0)
+        {
+            receive(buffer, (size_t)size);
+        }
+        else
+        {
+            /* Other end of the pseudo terminal is closed, wait for it to come back */
+            receive_timeout();
+            struct timespec retry = {.tv_sec = 0, .tv_nsec = 100000000L};
+            nanosleep(&retry, NULL);
+        }
+    }
+    return NULL;
+}
+
+/* ===== DRIVER FUNCTIONS ===== */
+esp_err_t host_uart_open(const char *path, int baud)
+{
+    fd = open(path, O_RDWR | O_NOCTTY);
+    if(fd < 0){ return ESP_ERR_NOT_FOUND; }
+
+    /* Raw bytes, no line discipline */
+    struct termios tio;
+    if(tcgetattr(fd, &tio) == 0)
+    {
+        cfmakeraw(&tio);
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    baud_rate = baud;
+    return ESP_OK;
+}
+
+esp_err_t uart_param_config(uart_port_t port, const uart_config_t *config)
+{
+    if(config->baud_rate <= 0){ return ESP_ERR_INVALID_ARG; }
+    if(baud_rate == 0){ baud_rate = config->baud_rate; }
+    return ESP_OK;
+}
+
+esp_err_t uart_set_pin(uart_port_t port, int tx, int rx, int rts, int cts)
+{
+    return ESP_OK;
+}
+
+esp_err_t uart_driver_install(uart_port_t port, int rx_buffer_size, int tx_buffer_size, int queue_size, QueueHandle_t *queue, int intr_flags)
+{
+    if(fd < 0 || baud_rate == 0){ return ESP_ERR_INVALID_STATE; }
+    if(rx_buffer_size <= 0 || queue_size <= 0){ return ESP_ERR_INVALID_ARG; }
+
+    ring = malloc((size_t)rx_buffer_size);
+    event_queue = xQueueCreate((UBaseType_t)queue_size, sizeof(uart_event_t));
+    if(ring == NULL || event_queue == NULL){ return ESP_ERR_NO_MEM; }
+    ring_size = (size_t)rx_buffer_size;
+    *queue = event_queue;
+
+    pthread_t thread;
+    if(pthread_create(&thread, NULL, reader_thread, NULL) != 0){ return ESP_FAIL; }
+    pthread_detach(thread);
+    return ESP_OK;
+}
+
+int uart_read_bytes(uart_port_t port, void *buffer, uint32_t length, TickType_t ticks)
+{
+    pthread_mutex_lock(&mutex);
+
+    /* Wait for all bytes or until timeout */
+    struct timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+    uint64_t ns = (uint64_t)until.tv_nsec + (uint64_t)(ticks == portMAX_DELAY ? 0 : ticks) * portTICK_PERIOD_MS * 1000000ULL;
+    until.tv_sec += (time_t)(ns / 1000000000ULL);
+    until.tv_nsec = (long)(ns % 1000000000ULL);
+    while(ring_used < length && ticks != 0)
+    {
+        int err = ticks == portMAX_DELAY ? pthread_cond_wait(&received, &mutex) : pthread_cond_timedwait(&received, &mutex, &until);
+        if(err == ETIMEDOUT){ break; }
+    }
+
+    size_t size = ring_used < length ? ring_used : length;
+    for(size_t i = 0; i < size; i++)
+    {
+        ((uint8_t *)buffer)[i] = ring[(ring_head + i) % ring_size];
+    }
+    ring_head = (ring_head + size) % ring_size;
+    ring_used -= size;
+    if(pending > ring_used){ pending = ring_used; }
+
+    pthread_mutex_unlock(&mutex);
+    return (int)size;
+}
+
+esp_err_t uart_get_buffered_data_len(uart_port_t port, size_t *size)
+{
+    pthread_mutex_lock(&mutex);
+    *size = ring_used;
+    pthread_mutex_unlock(&mutex);
+    return ESP_OK;
+}
+
+esp_err_t uart_flush_input(uart_port_t port)
+{
+    pthread_mutex_lock(&mutex);
+    ring_head = 0;
+    ring_used = 0;
+    pending = 0;
+    full = false;
+    pthread_mutex_unlock(&mutex);
+    return ESP_OK;
+}
@@ -0,0 +1,454 @@
+/**
+ * @file host_zigbee.c
+ * @brief Host replacement of the data model, ZCL requests and scheduler of esp-zigbee-lib
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Header */
+#include "esp_zigbee_core.h"
+
+/* Manufacturer specific clusters start here, their frames carry the manufacturer code */
+#define HOST_ZIGBEE_MANUF_CLUSTER_MIN   0xFC00
+
+/* One attribute with its value */
+typedef struct {
+    uint16_t id;
+    uint8_t type;
+    uint8_t access;
+    uint8_t value[HOST_ZIGBEE_MAX_VALUE_SIZE];
+} host_attribute_t;
+
+struct esp_zb_attribute_list_s {
+    uint16_t cluster_id;
+    size_t count;
+    host_attribute_t attributes[HOST_ZIGBEE_MAX_ATTRIBUTES];
+};
+
+struct esp_zb_cluster_list_s {
+    size_t count;
+    struct {
+        esp_zb_attribute_list_t *attributes;
+        uint8_t role;
+    } clusters[HOST_ZIGBEE_MAX_CLUSTERS];
+};
+
+struct esp_zb_ep_list_s {
+    size_t count;
+    struct {
+        esp_zb_cluster_list_t *clusters;
+        uint8_t endpoint;
+    } endpoints[HOST_ZIGBEE_MAX_ENDPOINTS];
+};
+
+/* Types of the attributes of the standard clusters, added without type */
+static const struct {
+    uint16_t cluster_id;
+    uint16_t attr_id;
+    uint8_t type;
+} standard_types[] = {
+    {ESP_ZB_ZCL_CLUSTER_ID_BASIC, ESP_ZB_ZCL_ATTR_BASIC_ZCL_VERSION_ID, ESP_ZB_ZCL_ATTR_TYPE_U8},
+    {ESP_ZB_ZCL_CLUSTER_ID_BASIC, ESP_ZB_ZCL_ATTR_BASIC_APPLICATION_VERSION_ID, ESP_ZB_ZCL_ATTR_TYPE_U8},
+    {ESP_ZB_ZCL_CLUSTER_ID_BASIC, ESP_ZB_ZCL_ATTR_BASIC_STACK_VERSION_ID, ESP_ZB_ZCL_ATTR_TYPE_U8},
+    {ESP_ZB_ZCL_CLUSTER_ID_BASIC, ESP_ZB_ZCL_ATTR_BASIC_HW_VERSION_ID, ESP_ZB_ZCL_ATTR_TYPE_U8},
+    {ESP_ZB_ZCL_CLUSTER_ID_BASIC, ESP_ZB_ZCL_ATTR_BASIC_MANUFACTURER_NAME_ID, ESP_ZB_ZCL_ATTR_TYPE_CHAR_STRING},
+    {ESP_ZB_ZCL_CLUSTER_ID_BASIC, ESP_ZB_ZCL_ATTR_BASIC_MODEL_IDENTIFIER_ID, ESP_ZB_ZCL_ATTR_TYPE_CHAR_STRING},
+    {ESP_ZB_ZCL_CLUSTER_ID_BASIC, ESP_ZB_ZCL_ATTR_BASIC_POWER_SOURCE_ID, ESP_ZB_ZCL_ATTR_TYPE_8BIT_ENUM},
+    {ESP_ZB_ZCL_CLUSTER_ID_IDENTIFY, ESP_ZB_ZCL_ATTR_IDENTIFY_IDENTIFY_TIME_ID, ESP_ZB_ZCL_ATTR_TYPE_U16},
+    {ESP_ZB_ZCL_CLUSTER_ID_ELECTRICAL_MEASUREMENT, ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_MEASUREMENT_TYPE_ID, ESP_ZB_ZCL_ATTR_TYPE_32BITMAP},
+    {ESP_ZB_ZCL_CLUSTER_ID_ELECTRICAL_MEASUREMENT, ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_TOTAL_ACTIVE_POWER_ID, ESP_ZB_ZCL_ATTR_TYPE_S32},
+    {ESP_ZB_ZCL_CLUSTER_ID_ELECTRICAL_MEASUREMENT, ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_RMSVOLTAGE_ID, ESP_ZB_ZCL_ATTR_TYPE_U16},
+    {ESP_ZB_ZCL_CLUSTER_ID_ELECTRICAL_MEASUREMENT, ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_RMSCURRENT_ID, ESP_ZB_ZCL_ATTR_TYPE_U16},
+    {ESP_ZB_ZCL_CLUSTER_ID_ELECTRICAL_MEASUREMENT, ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_RMSVOLTAGE_PHB_ID, ESP_ZB_ZCL_ATTR_TYPE_U16},
+    {ESP_ZB_ZCL_CLUSTER_ID_ELECTRICAL_MEASUREMENT, ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_RMSCURRENT_PHB_ID, ESP_ZB_ZCL_ATTR_TYPE_U16},
+    {ESP_ZB_ZCL_CLUSTER_ID_ELECTRICAL_MEASUREMENT, ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_RMSVOLTAGE_PHC_ID, ESP_ZB_ZCL_ATTR_TYPE_U16},
+    {ESP_ZB_ZCL_CLUSTER_ID_ELECTRICAL_MEASUREMENT, ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_RMSCURRENT_PHC_ID, ESP_ZB_ZCL_ATTR_TYPE_U16},
+    {ESP_ZB_ZCL_CLUSTER_ID_ELECTRICAL_MEASUREMENT, ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_ACVOLTAGE_MULTIPLIER_ID, ESP_ZB_ZCL_ATTR_TYPE_U16},
+    {ESP_ZB_ZCL_CLUSTER_ID_ELECTRICAL_MEASUREMENT, ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_ACVOLTAGE_DIVISOR_ID, ESP_ZB_ZCL_ATTR_TYPE_U16},
+    {ESP_ZB_ZCL_CLUSTER_ID_ELECTRICAL_MEASUREMENT, ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_ACCURRENT_MULTIPLIER_ID, ESP_ZB_ZCL_ATTR_TYPE_U16},
+    {ESP_ZB_ZCL_CLUSTER_ID_ELECTRICAL_MEASUREMENT, ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_ACCURRENT_DIVISOR_ID, ESP_ZB_ZCL_ATTR_TYPE_U16},
+    {ESP_ZB_ZCL_CLUSTER_ID_ELECTRICAL_MEASUREMENT, ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_ACPOWER_MULTIPLIER_ID, ESP_ZB_ZCL_ATTR_TYPE_U16},
+    {ESP_ZB_ZCL_CLUSTER_ID_ELECTRICAL_MEASUREMENT, ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_ACPOWER_DIVISOR_ID, ESP_ZB_ZCL_ATTR_TYPE_U16},
+};
+
+/* Registered device */
+static esp_zb_ep_list_t *device = NULL;
+
+/* Recorded frames */
+static host_zigbee_frame_cb_t frame_cb = NULL;
+static host_zigbee_stats_t stats;
+
+/* Send status of requests */
+static esp_zb_zcl_command_send_status_callback_t send_status_cb = NULL;
+static uint8_t send_failure_percent = 0;
+static uint32_t send_failure_seed = 1;
+static uint8_t tsn = 0;
+
+/* Virtual time and pending alarms */
+static uint32_t now_ms = 0;
+static struct {
+    esp_zb_callback_t cb;
+    uint8_t param;
+    uint32_t due_ms;
+} alarms[HOST_ZIGBEE_MAX_ALARMS];
+static size_t alarm_count = 0;
+
+/* Neighbor table */
+static esp_zb_nwk_neighbor_info_t neighbors[HOST_ZIGBEE_MAX_NEIGHBORS];
+static size_t neighbor_count = 0;
+static bool joined = false;
+
+/* ===== HELPER FUNCTIONS ===== */
+/* Size of value of a type, strings include their length prefix */
+static size_t value_size(uint8_t type, const uint8_t *value)
+{
+    switch(type)
+    {
+        case ESP_ZB_ZCL_ATTR_TYPE_BOOL:
+        case ESP_ZB_ZCL_ATTR_TYPE_8BITMAP:
+        case ESP_ZB_ZCL_ATTR_TYPE_U8:
+        case ESP_ZB_ZCL_ATTR_TYPE_8BIT_ENUM:
+            return 1;
+        case ESP_ZB_ZCL_ATTR_TYPE_16BITMAP:
+        case ESP_ZB_ZCL_ATTR_TYPE_U16:
+        case ESP_ZB_ZCL_ATTR_TYPE_S16:
+            return 2;
+        case ESP_ZB_ZCL_ATTR_TYPE_U24:
+            return 3;
+        case ESP_ZB_ZCL_ATTR_TYPE_32BITMAP:
+        case ESP_ZB_ZCL_ATTR_TYPE_U32:
+        case ESP_ZB_ZCL_ATTR_TYPE_S32:
+            return 4;
+        case ESP_ZB_ZCL_ATTR_TYPE_U48:
+            return 6;
+        case ESP_ZB_ZCL_ATTR_TYPE_OCTET_STRING:
+        case ESP_ZB_ZCL_ATTR_TYPE_CHAR_STRING:
+            return 1 + (size_t)value[0];
+        case ESP_ZB_ZCL_ATTR_TYPE_LONG_OCTET_STRING:
+            return 2 + ((size_t)value[0] | ((size_t)value[1] << 8));
+        default:
+            return 0;
+    }
+}
+
+static esp_err_t add_attr(esp_zb_attribute_list_t *attr_list, uint16_t attr_id, uint8_t type, uint8_t access, const void *value_p)
+{
+    if(attr_list == NULL || value_p == NULL){ return ESP_ERR_INVALID_ARG; }
+    if(attr_list->count == HOST_ZIGBEE_MAX_ATTRIBUTES){ return ESP_ERR_NO_MEM; }
+
+    size_t size = value_size(type, value_p);
+    if(size == 0 || size > HOST_ZIGBEE_MAX_VALUE_SIZE){ return ESP_ERR_INVALID_ARG; }
+
+    host_attribute_t *attribute = &attr_list->attributes[attr_list->count++];
+    attribute->id = attr_id;
+    attribute->type = type;
+    attribute->access = access;
+    memcpy(attribute->value, value_p, size);
+    return ESP_OK;
+}
+
+/* Attribute of a standard cluster, type from table */
+static esp_err_t add_standard_attr(esp_zb_attribute_list_t *attr_list, uint16_t cluster_id, uint16_t attr_id, void *value_p)
+{
+    if(attr_list == NULL || attr_list->cluster_id != cluster_id){ return ESP_ERR_INVALID_ARG; }
+
+    for(size_t i = 0; i < sizeof(standard_types) / sizeof(standard_types[0]); i++)
+    {
+        if(standard_types[i].cluster_id == cluster_id && standard_types[i].attr_id == attr_id)
+        {
+            return add_attr(attr_list, attr_id, standard_types[i].type, ESP_ZB_ZCL_ATTR_ACCESS_READ_ONLY | ESP_ZB_ZCL_ATTR_ACCESS_REPORTING, value_p);
+        }
+    }
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+static esp_err_t add_cluster(esp_zb_cluster_list_t *cluster_list, esp_zb_attribute_list_t *attr_list, uint8_t role_mask)
+{
+    if(cluster_list == NULL || attr_list == NULL){ return ESP_ERR_INVALID_ARG; }
+    if(cluster_list->count == HOST_ZIGBEE_MAX_CLUSTERS){ return ESP_ERR_NO_MEM; }
+
+    cluster_list->clusters[cluster_list->count].attributes = attr_list;
+    cluster_list->clusters[cluster_list->count].role = role_mask;
+    cluster_list->count++;
+    return ESP_OK;
+}
+
+static host_attribute_t *find_attr(uint8_t endpoint, uint16_t cluster_id, uint8_t cluster_role, uint16_t attr_id)
+{
+    if(device == NULL){ return NULL; }
+
+    for(size_t e = 0; e < device->count; e++)
+    {
+        if(device->endpoints[e].endpoint != endpoint){ continue; }
+
+        esp_zb_cluster_list_t *clusters = device->endpoints[e].clusters;
+        for(size_t c = 0; c < clusters->count; c++)
+        {
+            esp_zb_attribute_list_t *list = clusters->clusters[c].attributes;
+            if(list->cluster_id != cluster_id || clusters->clusters[c].role != cluster_role){ continue; }
+
+            for(size_t a = 0; a < list->count; a++)
+            {
+                if(list->attributes[a].id == attr_id){ return &list->attributes[a]; }
+            }
+        }
+    }
+    return NULL;
+}
+
+/* Record one request, split into fragments by the APS layer */
+static void record(host_zigbee_frame_type_t type, uint16_t cluster_id, uint16_t id, size_t payload_size)
+{
+    uint8_t fragment_count = (uint8_t)((payload_size + HOST_ZIGBEE_APS_MAX_PAYLOAD - 1) / HOST_ZIGBEE_APS_MAX_PAYLOAD);
+    size_t remaining = payload_size;
+
+    stats.requests++;
+    for(uint8_t i = 0; i < fragment_count; i++)
+    {
+        size_t fragment = remaining > HOST_ZIGBEE_APS_MAX_PAYLOAD ? HOST_ZIGBEE_APS_MAX_PAYLOAD : remaining;
+        remaining -= fragment;
+
+        host_zigbee_frame_t frame = {
+            .time_ms = now_ms,
+            .type = type,
+            .cluster_id = cluster_id,
+            .id = id,
+            .fragment = i,
+            .fragment_count = fragment_count,
+            .payload_size = (uint16_t)fragment,
+            .size = (uint16_t)(fragment + HOST_ZIGBEE_FRAME_OVERHEAD_BYTES),
+        };
+        stats.frames++;
+        stats.payload_bytes += frame.payload_size;
+        stats.bytes += frame.size;
+        if(frame_cb != NULL){ frame_cb(&frame); }
+    }
+
+    /* Confirm of the request, drawn from a linear congruential generator */
+    send_failure_seed = send_failure_seed * 1103515245u + 12345u;
+    esp_zb_zcl_command_send_status_message_t message = {
+        .tsn = tsn++,
+        .status = (send_failure_seed >> 16) % 100 < send_failure_percent ? ESP_FAIL : ESP_OK,
+    };
+    if(message.status != ESP_OK){ stats.send_failures++; }
+    if(send_status_cb != NULL){ send_status_cb(message); }
+}
+
+/* ===== DATA MODEL FUNCTIONS ===== */
+esp_zb_attribute_list_t *esp_zb_zcl_attr_list_create(uint16_t cluster_id)
+{
+    esp_zb_attribute_list_t *attr_list = calloc(1, sizeof(esp_zb_attribute_list_t));
+    if(attr_list != NULL){ attr_list->cluster_id = cluster_id; }
+    return attr_list;
+}
+
+esp_err_t esp_zb_basic_cluster_add_attr(esp_zb_attribute_list_t *attr_list, uint16_t attr_id, void *value_p)
+{
+    return add_standard_attr(attr_list, ESP_ZB_ZCL_CLUSTER_ID_BASIC, attr_id, value_p);
+}
+
+esp_err_t esp_zb_identify_cluster_add_attr(esp_zb_attribute_list_t *attr_list, uint16_t attr_id, void *value_p)
+{
+    return add_standard_attr(attr_list, ESP_ZB_ZCL_CLUSTER_ID_IDENTIFY, attr_id, value_p);
+}
+
+esp_err_t esp_zb_electrical_meas_cluster_add_attr(esp_zb_attribute_list_t *attr_list, uint16_t attr_id, void *value_p)
+{
+    return add_standard_attr(attr_list, ESP_ZB_ZCL_CLUSTER_ID_ELECTRICAL_MEASUREMENT, attr_id, value_p);
+}
+
+esp_err_t esp_zb_custom_cluster_add_custom_attr(esp_zb_attribute_list_t *attr_list, uint16_t attr_id, uint8_t attr_type, uint8_t attr_access, void *value_p)
+{
+    return add_attr(attr_list, attr_id, attr_type, attr_access, value_p);
+}
+
+esp_zb_cluster_list_t *esp_zb_zcl_cluster_list_create(void)
+{
+    return calloc(1, sizeof(esp_zb_cluster_list_t));
+}
+
+esp_err_t esp_zb_cluster_list_add_basic_cluster(esp_zb_cluster_list_t *cluster_list, esp_zb_attribute_list_t *attr_list, uint8_t role_mask)
+{
+    return add_cluster(cluster_list, attr_list, role_mask);
+}
+
+esp_err_t esp_zb_cluster_list_add_identify_cluster(esp_zb_cluster_list_t *cluster_list, esp_zb_attribute_list_t *attr_list, uint8_t role_mask)
+{
+    return add_cluster(cluster_list, attr_list, role_mask);
+}
+
+esp_err_t esp_zb_cluster_list_add_electrical_meas_cluster(esp_zb_cluster_list_t *cluster_list, esp_zb_attribute_list_t *attr_list, uint8_t role_mask)
+{
+    return add_cluster(cluster_list, attr_list, role_mask);
+}
+
+esp_err_t esp_zb_cluster_list_add_custom_cluster(esp_zb_cluster_list_t *cluster_list, esp_zb_attribute_list_t *attr_list, uint8_t role_mask)
+{
+    return add_cluster(cluster_list, attr_list, role_mask);
+}
+
+esp_zb_ep_list_t *esp_zb_ep_list_create(void)
+{
+    return calloc(1, sizeof(esp_zb_ep_list_t));
+}
+
+esp_err_t esp_zb_ep_list_add_ep(esp_zb_ep_list_t *ep_list, esp_zb_cluster_list_t *cluster_list, uint8_t endpoint, uint16_t profile_id, uint16_t device_id)
+{
+    if(ep_list == NULL || cluster_list == NULL){ return ESP_ERR_INVALID_ARG; }
+    if(ep_list->count == HOST_ZIGBEE_MAX_ENDPOINTS){ return ESP_ERR_NO_MEM; }
+
+    ep_list->endpoints[ep_list->count].clusters = cluster_list;
+    ep_list->endpoints[ep_list->count].endpoint = endpoint;
+    ep_list->count++;
+    return ESP_OK;
+}
+
+esp_err_t esp_zb_device_register(esp_zb_ep_list_t *ep_list)
+{
+    if(ep_list == NULL){ return ESP_ERR_INVALID_ARG; }
+    device = ep_list;
+    return ESP_OK;
+}
+
+/* ===== ZCL FUNCTIONS ===== */
+esp_zb_zcl_status_t esp_zb_zcl_set_attribute_val(uint8_t endpoint, uint16_t cluster_id, uint8_t cluster_role, uint16_t attr_id, void *value_p, bool check)
+{
+    host_attribute_t *attribute = find_attr(endpoint, cluster_id, cluster_role, attr_id);
+    if(attribute == NULL){ return ESP_ZB_ZCL_STATUS_UNSUP_ATTRIB; }
+
+    size_t size = value_size(attribute->type, value_p);
+    if(size == 0 || size > HOST_ZIGBEE_MAX_VALUE_SIZE){ return ESP_ZB_ZCL_STATUS_FAIL; }
+
+    memcpy(attribute->value, value_p, size);
+    return ESP_ZB_ZCL_STATUS_SUCCESS;
+}
+
+esp_zb_zcl_status_t esp_zb_zcl_report_attr_cmd_req(esp_zb_zcl_report_attr_cmd_t *cmd_req)
+{
+    host_attribute_t *attribute = find_attr(cmd_req->zcl_basic_cmd.src_endpoint, cmd_req->clusterID, cmd_req->cluster_role, cmd_req->attributeID);
+    if(attribute == NULL)
+    {
+        stats.rejected++;
+        return ESP_ZB_ZCL_STATUS_UNSUP_ATTRIB;
+    }
+
+    /* Header, attribute identifier, type and value */
+    size_t payload_size = HOST_ZIGBEE_ZCL_HEADER_BYTES + 2 + 1 + value_size(attribute->type, attribute->value);
+    if(cmd_req->clusterID >= HOST_ZIGBEE_MANUF_CLUSTER_MIN){ payload_size += HOST_ZIGBEE_ZCL_MANUF_CODE_BYTES; }
+
+    record(HOST_ZIGBEE_FRAME_REPORT, cmd_req->clusterID, cmd_req->attributeID, payload_size);
+    return ESP_ZB_ZCL_STATUS_SUCCESS;
+}
+
+esp_err_t esp_zb_zcl_custom_cluster_cmd_req(esp_zb_zcl_custom_cluster_cmd_req_t *cmd_req)
+{
+    if(cmd_req->data.value == NULL && cmd_req->data.size > 0){ return ESP_ERR_INVALID_ARG; }
+
+    size_t payload_size = HOST_ZIGBEE_ZCL_HEADER_BYTES + cmd_req->data.size;
+    if(cmd_req->manuf_specific){ payload_size += HOST_ZIGBEE_ZCL_MANUF_CODE_BYTES; }
+
+    record(HOST_ZIGBEE_FRAME_COMMAND, cmd_req->cluster_id, cmd_req->custom_cmd_id, payload_size);
+    return ESP_OK;
+}
+
+void esp_zb_zcl_command_send_status_handler_register(esp_zb_zcl_command_send_status_callback_t cb)
+{
+    send_status_cb = cb;
+}
+
+/* ===== NWK AND SCHEDULER FUNCTIONS ===== */
+esp_err_t esp_zb_nwk_get_next_neighbor(esp_zb_nwk_info_iterator_t *iterator, esp_zb_nwk_neighbor_info_t *nbr_info)
+{
+    if(*iterator >= neighbor_count){ return ESP_ERR_NOT_FOUND; }
+    *nbr_info = neighbors[(*iterator)++];
+    return ESP_OK;
+}
+
+bool esp_zb_bdb_dev_joined(void)
+{
+    return joined;
+}
+
+void esp_zb_scheduler_alarm(esp_zb_callback_t cb, uint8_t param, uint32_t time_ms)
+{
+    /* Stack asserts if no timer is left, the tool has to be fixed */
+    if(alarm_count == HOST_ZIGBEE_MAX_ALARMS)
+    {
+        fprintf(stderr, "Too many scheduler alarms\n");
+        abort();
+    }
+    alarms[alarm_count].cb = cb;
+    alarms[alarm_count].param = param;
+    alarms[alarm_count].due_ms = now_ms + time_ms;
+    alarm_count++;
+}
+
+/* ===== HOST FUNCTIONS ===== */
+void host_zigbee_set_frame_cb(host_zigbee_frame_cb_t cb)
+{
+    frame_cb = cb;
+}
+
+void host_zigbee_advance(uint32_t time_ms)
+{
+    for(;;)
+    {
+        /* Earliest due alarm, first scheduled on equal time */
+        size_t next = alarm_count;
+        for(size_t i = 0; i < alarm_count; i++)
+        {
+            if(alarms[i].due_ms <= time_ms && (next == alarm_count || alarms[i].due_ms < alarms[next].due_ms)){ next = i; }
+        }
+        if(next == alarm_count){ break; }
+
+        /* Remove before calling, callback may schedule again */
+        esp_zb_callback_t cb = alarms[next].cb;
+        uint8_t param = alarms[next].param;
+        if(alarms[next].due_ms > now_ms){ now_ms = alarms[next].due_ms; }
+        memmove(&alarms[next], &alarms[next + 1], (alarm_count - next - 1) * sizeof(alarms[0]));
+        alarm_count--;
+        cb(param);
+    }
+    if(time_ms > now_ms){ now_ms = time_ms; }
+}
+
+void host_zigbee_set_parent(uint8_t lqi, int8_t rssi)
+{
+    memset(neighbors, 0, sizeof(neighbors));
+    neighbors[0].short_addr = 0x0000;
+    neighbors[0].relationship = ESP_ZB_NWK_RELATIONSHIP_PARENT;
+    neighbors[0].lqi = lqi;
+    neighbors[0].rssi = rssi;
+    neighbor_count = 1;
+    joined = true;
+}
+
+void host_zigbee_set_send_failure_percent(uint8_t percent)
+{
+    send_failure_percent = percent;
+    send_failure_seed = 1;
+}
+
+size_t host_zigbee_get_attribute(uint8_t endpoint, uint16_t cluster_id, uint8_t cluster_role, uint16_t attr_id, void *value)
+{
+    host_attribute_t *attribute = find_attr(endpoint, cluster_id, cluster_role, attr_id);
+    if(attribute == NULL){ return 0; }
+
+    size_t size = value_size(attribute->type, attribute->value);
+    memcpy(value, attribute->value, size);
+    return size;
+}
+
+void host_zigbee_get_stats(host_zigbee_stats_t *out)
+{
+    *out = stats;
+}
+
+void host_zigbee_reset_stats(void)
+{
+    memset(&stats, 0, sizeof(stats));
+}
@@ -0,0 +1,318 @@
+/**
+ * @file obis_columns.c
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Header */
+#include "obis_columns.h"
+
+_Static_assert(sizeof(obis_columns_header_t) == 8, "header is part of the columns format");
+_Static_assert(sizeof(obis_columns_key_t) == 8, "key is part of the columns format");
+_Static_assert(sizeof(obis_columns_chunk_t) == 32, "chunk is part of the columns format");
+_Static_assert(sizeof(obis_columns_footer_t) == 16, "footer is part of the columns format");
+_Static_assert(sizeof(obis_columns_trailer_t) == 16, "trailer is part of the columns format");
+
+#define COLUMNS_ALIGNMENT               8
+
+static size_t padded(size_t size)
+{
+    return (size + COLUMNS_ALIGNMENT - 1) & ~(size_t)(COLUMNS_ALIGNMENT - 1);
+}
+
+/* Largest stored value of a width marks a missing register */
+static uint64_t null_code(uint8_t width)
+{
+    return width >= 8 ? UINT64_MAX : (1ULL << (8 * width)) - 1;
+}
+
+/* ===== WRITER ===== */
+static esp_err_t write_all(obis_columns_writer_t *writer, const void *data, size_t size)
+{
+    const uint8_t *bytes = data;
+    while(size > 0)
+    {
+        ssize_t written = write(writer->fd, bytes, size);
+        if(written <= 0){ return ESP_FAIL; }
+        bytes += written;
+        size -= (size_t)written;
+        writer->offset += (size_t)written;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t add_column(obis_columns_writer_t *writer, const obis_record_t *record, uint32_t *column)
+{
+    if(writer->column_count == OBIS_COLUMNS_MAX_COLUMNS)
+    {
+        writer->overflow = true;
+        return ESP_ERR_NO_MEM;
+    }
+    int64_t *values = malloc(OBIS_COLUMNS_BLOCK_ROWS * sizeof(int64_t));
+    if(values == NULL){ return ESP_ERR_NO_MEM; }
+
+    /* Missing in rows before */
+    for(size_t i = 0; i < OBIS_COLUMNS_BLOCK_ROWS; i++){ values[i] = OBIS_COLUMNS_NULL; }
+    *column = writer->column_count++;
+    writer->values[*column] = values;
+    obis_columns_key_t *key = &writer->keys[*column];
+    memcpy(key->code, record->code, OBIS_CODE_LENGTH);
+    key->scaler = record->scaler;
+    key->unit = record->unit;
+    return ESP_OK;
+}
+
+/* Column chunks of current block, each with the smallest width for its range */
+static esp_err_t write_block(obis_columns_writer_t *writer)
+{
+    if(writer->block_count == writer->block_capacity)
+    {
+        size_t capacity = writer->block_capacity > 0 ? writer->block_capacity * 2 : 64;
+        uint32_t *block_rows = realloc(writer->block_rows, capacity * sizeof(uint32_t));
+        if(block_rows != NULL){ writer->block_rows = block_rows; }
+        obis_columns_chunk_t *chunks = realloc(writer->chunks, capacity * OBIS_COLUMNS_MAX_COLUMNS * sizeof(obis_columns_chunk_t));
+        if(chunks != NULL){ writer->chunks = chunks; }
+        if(block_rows == NULL || chunks == NULL){ return ESP_ERR_NO_MEM; }
+        writer->block_capacity = capacity;
+    }
+
+    static uint8_t encoded[OBIS_COLUMNS_BLOCK_ROWS * sizeof(uint64_t)];
+    for(uint32_t c = 0; c < writer->column_count; c++)
+    {
+        const int64_t *values = writer->values[c];
+        obis_columns_chunk_t *chunk = &writer->chunks[writer->block_count * OBIS_COLUMNS_MAX_COLUMNS + c];
+        memset(chunk, 0, sizeof(*chunk));
+        chunk->min = INT64_MAX;
+        chunk->max = INT64_MIN;
+        for(size_t i = 0; i < writer->rows; i++)
+        {
+            if(values[i] == OBIS_COLUMNS_NULL){ continue; }
+            if(values[i] < chunk->min){ chunk->min = values[i]; }
+            if(values[i] > chunk->max){ chunk->max = values[i]; }
+            chunk->count++;
+        }
+        if(chunk->count == 0)
+        {
+            chunk->min = 0;
+            chunk->max = 0;
+            continue;
+        }
+
+        /* Range plus the code for missing registers must fit */
+        uint64_t range = (uint64_t)chunk->max - (uint64_t)chunk->min;
+        chunk->width = range < null_code(1) ? 1 : range < null_code(2) ? 2 : range < null_code(4) ? 4 : 8;
+        for(size_t i = 0; i < writer->rows; i++)
+        {
+            uint64_t value = values[i] == OBIS_COLUMNS_NULL ? null_code(chunk->width) : (uint64_t)values[i] - (uint64_t)chunk->min;
+            memcpy(&encoded[i * chunk->width], &value, chunk->width);
+        }
+        chunk->offset = writer->offset;
+        if(write_all(writer, encoded, writer->rows * chunk->width) != ESP_OK){ return ESP_FAIL; }
+    }
+
+    writer->block_rows[writer->block_count++] = (uint32_t)writer->rows;
+    for(uint32_t c = 0; c < writer->column_count; c++)
+    {
+        for(size_t i = 0; i < writer->rows; i++){ writer->values[c][i] = OBIS_COLUMNS_NULL; }
+    }
+    writer->rows = 0;
+    return ESP_OK;
+}
+
+esp_err_t obis_columns_create(obis_columns_writer_t *writer, const char *path)
+{
+    memset(writer, 0, sizeof(*writer));
+    writer->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(writer->fd < 0){ return ESP_FAIL; }
+
+    for(uint32_t c = 0; c < ObisColumnFixedCount; c++)
+    {
+        writer->values[c] = malloc(OBIS_COLUMNS_BLOCK_ROWS * sizeof(int64_t));
+        if(writer->values[c] == NULL){ return ESP_ERR_NO_MEM; }
+        for(size_t i = 0; i < OBIS_COLUMNS_BLOCK_ROWS; i++){ writer->values[c][i] = OBIS_COLUMNS_NULL; }
+    }
+    writer->column_count = ObisColumnFixedCount;
+
+    obis_columns_header_t header = {
+        .magic = OBIS_COLUMNS_MAGIC,
+        .version = OBIS_COLUMNS_FORMAT_VERSION,
+    };
+    return write_all(writer, &header, sizeof(header));
+}
+
+esp_err_t obis_columns_append(obis_columns_writer_t *writer, uint64_t meter_id, int64_t timestamp_ms, uint32_t frame_counter,
+                              const obis_data_t *obis)
+{
+    size_t row = writer->rows;
+    writer->values[ObisColumnMeter][row] = (int64_t)meter_id;
+    writer->values[ObisColumnTime][row] = timestamp_ms;
+    writer->values[ObisColumnFrameCounter][row] = frame_counter;
+
+    for(size_t i = 0; i < obis->record_count; i++)
+    {
+        const obis_record_t *record = &obis->records[i];
+        if(record->type == Timestamp || record->type == SerialNumber || record->type == DeviceName){ continue; }
+
+        /* Telegrams of a meter have the same registers, so the column is mostly at the position of the record */
+        uint32_t column = ObisColumnFixedCount + (uint32_t)i;
+        if(column >= writer->column_count || memcmp(writer->keys[column].code, record->code, OBIS_CODE_LENGTH) != 0)
+        {
+            for(column = ObisColumnFixedCount; column < writer->column_count; column++)
+            {
+                if(memcmp(writer->keys[column].code, record->code, OBIS_CODE_LENGTH) == 0){ break; }
+            }
+            if(column == writer->column_count && add_column(writer, record, &column) != ESP_OK){ continue; }
+        }
+        writer->values[column][row] = obis_scale_value(record, writer->keys[column].scaler);
+    }
+
+    writer->rows++;
+    writer->row_count++;
+    return writer->rows == OBIS_COLUMNS_BLOCK_ROWS ? write_block(writer) : ESP_OK;
+}
+
+esp_err_t obis_columns_close(obis_columns_writer_t *writer)
+{
+    esp_err_t err = writer->rows > 0 ? write_block(writer) : ESP_OK;
+
+    /* Footer aligned, so a mapped reader can use it in place */
+    static const uint8_t zeros[COLUMNS_ALIGNMENT] = {0};
+    if(err == ESP_OK){ err = write_all(writer, zeros, padded(writer->offset) - writer->offset); }
+    uint64_t footer_offset = writer->offset;
+    obis_columns_footer_t footer = {
+        .column_count = writer->column_count,
+        .block_count = (uint32_t)writer->block_count,
+        .row_count = writer->row_count,
+    };
+    if(err == ESP_OK){ err = write_all(writer, &footer, sizeof(footer)); }
+    if(err == ESP_OK){ err = write_all(writer, writer->keys, writer->column_count * sizeof(obis_columns_key_t)); }
+    if(err == ESP_OK){ err = write_all(writer, writer->block_rows, writer->block_count * sizeof(uint32_t)); }
+    if(err == ESP_OK){ err = write_all(writer, zeros, padded(writer->offset) - writer->offset); }
+    for(size_t b = 0; b < writer->block_count && err == ESP_OK; b++)
+    {
+        err = write_all(writer, &writer->chunks[b * OBIS_COLUMNS_MAX_COLUMNS], writer->column_count * sizeof(obis_columns_chunk_t));
+    }
+    obis_columns_trailer_t trailer = {
+        .footer_offset = footer_offset,
+        .footer_size = (uint32_t)(writer->offset - footer_offset),
+        .magic = OBIS_COLUMNS_MAGIC,
+    };
+    if(err == ESP_OK){ err = write_all(writer, &trailer, sizeof(trailer)); }
+
+    if(close(writer->fd) != 0 && err == ESP_OK){ err = ESP_FAIL; }
+    for(uint32_t c = 0; c < writer->column_count; c++){ free(writer->values[c]); }
+    free(writer->block_rows);
+    free(writer->chunks);
+    memset(writer, 0, sizeof(*writer));
+    writer->fd = -1;
+    return err;
+}
+
+/* ===== READER ===== */
+esp_err_t obis_columns_open(obis_columns_reader_t *reader, const char *path)
+{
+    memset(reader, 0, sizeof(*reader));
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if(fd < 0){ return ESP_ERR_NOT_FOUND; }
+    if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(obis_columns_header_t) + sizeof(obis_columns_trailer_t))
+    {
+        close(fd);
+        return ESP_ERR_NOT_FOUND;
+    }
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED){ return ESP_FAIL; }
+    reader->data = data;
+    reader->size = (size_t)st.st_size;
+
+    obis_columns_header_t header;
+    obis_columns_trailer_t trailer;
+    obis_columns_footer_t footer;
+    memcpy(&header, reader->data, sizeof(header));
+    memcpy(&trailer, &reader->data[reader->size - sizeof(trailer)], sizeof(trailer));
+    size_t footer_end = reader->size - sizeof(trailer);
+    if(header.magic != OBIS_COLUMNS_MAGIC || header.version != OBIS_COLUMNS_FORMAT_VERSION || trailer.magic != OBIS_COLUMNS_MAGIC ||
+       trailer.footer_offset % COLUMNS_ALIGNMENT != 0 || trailer.footer_offset > footer_end || footer_end - trailer.footer_offset != trailer.footer_size ||
+       trailer.footer_size < sizeof(footer))
+    {
+        obis_columns_close_reader(reader);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    /* Footer must hold exactly the keys, rows and chunks it announces */
+    memcpy(&footer, &reader->data[trailer.footer_offset], sizeof(footer));
+    size_t rows_offset = trailer.footer_offset + sizeof(footer) + (size_t)footer.column_count * sizeof(obis_columns_key_t);
+    size_t chunks_offset = padded(rows_offset + (size_t)footer.block_count * sizeof(uint32_t));
+    if(footer.column_count < ObisColumnFixedCount || footer.column_count > OBIS_COLUMNS_MAX_COLUMNS ||
+       chunks_offset + (size_t)footer.block_count * footer.column_count * sizeof(obis_columns_chunk_t) != footer_end)
+    {
+        obis_columns_close_reader(reader);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    reader->column_count = footer.column_count;
+    reader->block_count = footer.block_count;
+    reader->row_count = footer.row_count;
+    reader->keys = (const obis_columns_key_t *)&reader->data[trailer.footer_offset + sizeof(footer)];
+    reader->block_rows = (const uint32_t *)&reader->data[rows_offset];
+    reader->chunks = (const obis_columns_chunk_t *)&reader->data[chunks_offset];
+    return ESP_OK;
+}
+
+void obis_columns_close_reader(obis_columns_reader_t *reader)
+{
+    if(reader->data != NULL){ munmap((void *)reader->data, reader->size); }
+    memset(reader, 0, sizeof(*reader));
+}
+
+int obis_columns_find(const obis_columns_reader_t *reader, const uint8_t *code)
+{
+    for(uint32_t c = ObisColumnFixedCount; c < reader->column_count; c++)
+    {
+        if(memcmp(reader->keys[c].code, code, OBIS_CODE_LENGTH) == 0){ return (int)c; }
+    }
+    return -1;
+}
+
+const obis_columns_chunk_t *obis_columns_chunk(const obis_columns_reader_t *reader, size_t block, size_t column)
+{
+    return &reader->chunks[block * reader->column_count + column];
+}
+
+size_t obis_columns_read(const obis_columns_reader_t *reader, size_t block, size_t column, int64_t *values)
+{
+    const obis_columns_chunk_t *chunk = obis_columns_chunk(reader, block, column);
+    size_t rows = reader->block_rows[block];
+    if(rows > OBIS_COLUMNS_BLOCK_ROWS){ rows = OBIS_COLUMNS_BLOCK_ROWS; }
+
+    /* Damaged chunks read as missing */
+    if(chunk->width == 0 || chunk->offset > reader->size || rows * chunk->width > reader->size - chunk->offset)
+    {
+        for(size_t i = 0; i < rows; i++){ values[i] = OBIS_COLUMNS_NULL; }
+        return rows;
+    }
+
+    const uint8_t *data = &reader->data[chunk->offset];
+    uint64_t null = null_code(chunk->width);
+    for(size_t i = 0; i < rows; i++)
+    {
+        uint64_t value = 0;
+        switch(chunk->width)
+        {
+            case 1: value = data[i]; break;
+            case 2: { uint16_t v; memcpy(&v, &data[i * 2], 2); value = v; break; }
+            case 4: { uint32_t v; memcpy(&v, &data[i * 4], 4); value = v; break; }
+            default: memcpy(&value, &data[i * 8], 8); break;
+        }
+        values[i] = value == null ? OBIS_COLUMNS_NULL : (int64_t)((uint64_t)chunk->min + value);
+    }
+    return rows;
+}
@@ -0,0 +1,190 @@
+/**
+ * @file obis_columns.h
+ * @brief Columnar file of decoded readings, one fixed point column per OBIS code with min and max per block, for host tools
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+// Multiple inclusion protection
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "obis.h"
+
+/* ===== COLUMNS CONFIGURATION ===== */
+#define OBIS_COLUMNS_BLOCK_ROWS         4096        /* < Rows of a block, min and max are kept per block */
+#define OBIS_COLUMNS_MAX_COLUMNS        64          /* < Fixed columns and OBIS codes */
+#define OBIS_COLUMNS_NULL               INT64_MIN   /* < Register missing in telegram */
+
+/* Columns of every file, OBIS codes follow in order of appearance */
+enum ObisColumn
+{
+    ObisColumnMeter,                    /* < System title as big endian number */
+    ObisColumnTime,                     /* < ms since epoch, time of meter or reception time */
+    ObisColumnFrameCounter,             /* < DLMS frame counter */
+    ObisColumnFixedCount
+};
+
+/*
+ * File format, little endian: file header, then the column chunks of each block, then the footer with
+ * the dictionary of OBIS codes and the chunk of every column of every block, then the trailer.
+ * A chunk stores value - min with the smallest width of 1, 2, 4 or 8 bytes, the largest value of a
+ * width marks a missing register. Columns of OBIS codes which appear later are missing in earlier blocks.
+ */
+#define OBIS_COLUMNS_MAGIC              0x4C4F434D  /* < "MCOL" */
+#define OBIS_COLUMNS_FORMAT_VERSION     1
+
+/* Header of file */
+typedef struct {
+    uint32_t magic;                     /* < OBIS_COLUMNS_MAGIC */
+    uint8_t version;                    /* < OBIS_COLUMNS_FORMAT_VERSION */
+    uint8_t reserved[3];
+} obis_columns_header_t;
+
+/* Dictionary entry of an OBIS code column */
+typedef struct {
+    uint8_t code[OBIS_CODE_LENGTH];     /* < OBIS code A-F */
+    int8_t scaler;                      /* < Decimal exponent of all values, of the first telegram with this code */
+    uint8_t unit;                       /* < DLMS unit */
+} obis_columns_key_t;
+
+/* Column of one block */
+typedef struct {
+    uint64_t offset;                    /* < Values in file, 0 if all are missing */
+    int64_t min;                        /* < Smallest value, values are stored as value - min */
+    int64_t max;
+    uint32_t count;                     /* < Present values */
+    uint8_t width;                      /* < Bytes per value, 0 if all are missing */
+    uint8_t reserved[3];
+} obis_columns_chunk_t;
+
+/* Footer, followed by keys, rows of each block as uint32 and chunks of block 0 column 0, block 0 column 1, ... */
+typedef struct {
+    uint32_t column_count;
+    uint32_t block_count;
+    uint64_t row_count;
+} obis_columns_footer_t;
+
+/* End of file */
+typedef struct {
+    uint64_t footer_offset;
+    uint32_t footer_size;
+    uint32_t magic;                     /* < OBIS_COLUMNS_MAGIC */
+} obis_columns_trailer_t;
+
+/* Writer, keeps one block in memory */
+typedef struct {
+    int fd;
+    uint64_t offset;
+    uint32_t column_count;
+    obis_columns_key_t keys[OBIS_COLUMNS_MAX_COLUMNS];      /* < From ObisColumnFixedCount on */
+    int64_t *values[OBIS_COLUMNS_MAX_COLUMNS];              /* < Rows of current block */
+    size_t rows;                                            /* < Rows of current block */
+    uint32_t *block_rows;
+    obis_columns_chunk_t *chunks;                           /* < OBIS_COLUMNS_MAX_COLUMNS per block */
+    size_t block_count;
+    size_t block_capacity;
+    uint64_t row_count;
+    bool overflow;                                          /* < More OBIS codes than columns */
+} obis_columns_writer_t;
+
+/* Reader of a mapped file */
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+    uint32_t column_count;
+    uint32_t block_count;
+    uint64_t row_count;
+    const obis_columns_key_t *keys;
+    const uint32_t *block_rows;
+    const obis_columns_chunk_t *chunks;
+} obis_columns_reader_t;
+
+/**
+ * @brief Create file
+ *
+ * @param writer writer to initialize
+ * @param path file to create
+ * @return esp_err_t
+ */
+esp_err_t obis_columns_create(obis_columns_writer_t *writer, const char *path);
+
+/**
+ * @brief Append decoded telegram as row, values are converted to the scaler of their column, registers beyond
+ *        OBIS_COLUMNS_MAX_COLUMNS codes are dropped and flagged in overflow
+ *
+ * @param writer writer of obis_columns_create
+ * @param meter_id system title of meter
+ * @param timestamp_ms time of reading
+ * @param frame_counter DLMS frame counter
+ * @param obis decoded registers
+ * @return esp_err_t
+ */
+esp_err_t obis_columns_append(obis_columns_writer_t *writer, uint64_t meter_id, int64_t timestamp_ms, uint32_t frame_counter,
+                              const obis_data_t *obis);
+
+/**
+ * @brief Write last block and footer, close file
+ *
+ * @param writer writer of obis_columns_create
+ * @return esp_err_t
+ */
+esp_err_t obis_columns_close(obis_columns_writer_t *writer);
+
+/**
+ * @brief Map file and check footer
+ *
+ * @param reader reader to initialize
+ * @param path file
+ * @return esp_err_t ESP_ERR_NOT_FOUND if no columnar file
+ */
+esp_err_t obis_columns_open(obis_columns_reader_t *reader, const char *path);
+
+/**
+ * @brief Unmap file
+ *
+ * @param reader reader of obis_columns_open
+ */
+void obis_columns_close_reader(obis_columns_reader_t *reader);
+
+/**
+ * @brief Find column of OBIS code
+ *
+ * @param reader reader of obis_columns_open
+ * @param code OBIS code A-F
+ * @return int column, -1 if not found
+ */
+int obis_columns_find(const obis_columns_reader_t *reader, const uint8_t *code);
+
+/**
+ * @brief Get chunk of a column in a block, with min and max of its values
+ *
+ * @param reader reader of obis_columns_open
+ * @param block block
+ * @param column column
+ * @return const obis_columns_chunk_t*
+ */
+const obis_columns_chunk_t *obis_columns_chunk(const obis_columns_reader_t *reader, size_t block, size_t column);
+
+/**
+ * @brief Decode values of a column in a block, only this chunk is read
+ *
+ * @param reader reader of obis_columns_open
+ * @param block block
+ * @param column column
+ * @param values output for OBIS_COLUMNS_BLOCK_ROWS values, OBIS_COLUMNS_NULL for missing registers
+ * @return size_t rows of block
+ */
+size_t obis_columns_read(const obis_columns_reader_t *reader, size_t block, size_t column, int64_t *values);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,212 @@
+/**
+ * @file telegram.c
+ * @brief Builds M-Bus telegrams with encrypted DLMS data like a Sagemcom T210-D, for host tools
+ * @copyright Copyright (c) 2023
+ * 
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Header */
+#include "telegram.h"
+
+/* Encryption Library */
+#include "mbedtls/gcm.h"
+
+/* Default system title, "SAG" followed by serial */
+static const uint8_t default_system_title[TELEGRAM_SYSTEM_TITLE_LENGTH] = {0x53, 0x41, 0x47, 0x67, 0x70, 0x05, 0x00, 0x01};
+
+void telegram_default_params(telegram_params_t *params)
+{
+    memcpy(params->key, decryption_key, GUE_KEY_LENGTH);
+    memcpy(params->system_title, default_system_title, TELEGRAM_SYSTEM_TITLE_LENGTH);
+    params->frame_counter = 0x00010000;
+    params->authenticated = false;
+}
+
+/* Append one M-Bus long frame */
+static size_t append_mbus_frame(uint8_t ci, const uint8_t *user_data, size_t user_data_size, uint8_t *out)
+{
+    size_t offset = 0;
+    uint8_t checksum = TELEGRAM_MBUS_CONTROL + TELEGRAM_MBUS_ADDRESS + ci;
+
+    out[offset++] = MBUS_START_VALUE;
+    out[offset++] = (uint8_t)(user_data_size + MBUS_USER_DATA_SIZE_OFFSET);
+    out[offset++] = (uint8_t)(user_data_size + MBUS_USER_DATA_SIZE_OFFSET);
+    out[offset++] = MBUS_START_VALUE;
+    out[offset++] = TELEGRAM_MBUS_CONTROL;
+    out[offset++] = TELEGRAM_MBUS_ADDRESS;
+    out[offset++] = ci;
+    for(size_t i = 0; i < user_data_size; i++)
+    {
+        out[offset++] = user_data[i];
+        checksum += user_data[i];
+    }
+    out[offset++] = checksum;
+    out[offset++] = MBUS_STOP_VALUE;
+    return offset;
+}
+
+size_t telegram_build(const telegram_params_t *params, const uint8_t *plaintext, size_t plaintext_size, uint8_t *telegram, size_t telegram_size)
+{
+    /* DLMS layer: start, General-Glo-Ciphering, system title, length, security control, frame counter, cipher text */
+    uint8_t dlms[TELEGRAM_MAX_SIZE];
+    size_t dlms_size = 0;
+
+    size_t tag_size = params->authenticated ? DLMS_AUTH_TAG_SIZE : 0;
+    if(plaintext_size + tag_size > TELEGRAM_MAX_PLAINTEXT_SIZE)
+    {
+        return 0;
+    }
+
+    dlms[dlms_size++] = DLMS_START_VAL1;
+    dlms[dlms_size++] = DLMS_START_VAL2;
+    dlms[dlms_size++] = DLMS_ENCRYPTION_TYPE_VALUE;
+    dlms[dlms_size++] = TELEGRAM_SYSTEM_TITLE_LENGTH;
+    memcpy(&dlms[dlms_size], params->system_title, TELEGRAM_SYSTEM_TITLE_LENGTH);
+    dlms_size += TELEGRAM_SYSTEM_TITLE_LENGTH;
+
+    /* Length is always encoded with 0x81, parser expects DLMS_UNKNOWN_SIZE bytes */
+    dlms[dlms_size++] = 0x81;
+    dlms[dlms_size++] = (uint8_t)(1 + DLMS_FRAME_COUNTER_SIZE + plaintext_size + tag_size);
+    dlms[dlms_size++] = TELEGRAM_SECURITY_CONTROL | (params->authenticated ? DLMS_SECURITY_AUTHENTICATED : 0);
+
+    /* Frame counter, big endian */
+    uint8_t frame_counter[DLMS_FRAME_COUNTER_SIZE] = {
+        (uint8_t)(params->frame_counter >> 24), (uint8_t)(params->frame_counter >> 16),
+        (uint8_t)(params->frame_counter >> 8), (uint8_t)(params->frame_counter)
+    };
+    memcpy(&dlms[dlms_size], frame_counter, DLMS_FRAME_COUNTER_SIZE);
+    dlms_size += DLMS_FRAME_COUNTER_SIZE;
+
+    /* Initialization vector: system title and frame counter */
+    uint8_t iv[AES_IV_SIZE];
+    memcpy(&iv[0], params->system_title, TELEGRAM_SYSTEM_TITLE_LENGTH);
+    memcpy(&iv[AES_IV_SIZE - DLMS_FRAME_COUNTER_SIZE], frame_counter, DLMS_FRAME_COUNTER_SIZE);
+
+    /* Encrypt, tag is only transmitted if authenticated */
+    uint8_t tag[DLMS_AUTH_TAG_SIZE];
+    mbedtls_gcm_context aes;
+    mbedtls_gcm_init(&aes);
+    mbedtls_gcm_setkey(&aes, MBEDTLS_CIPHER_ID_AES, params->key, GUE_KEY_LENGTH * 8);
+    int ret = mbedtls_gcm_crypt_and_tag(&aes, MBEDTLS_GCM_ENCRYPT, plaintext_size, iv, AES_IV_SIZE, NULL, 0, plaintext, &dlms[dlms_size], sizeof(tag), tag);
+    mbedtls_gcm_free(&aes);
+    if(ret != 0)
+    {
+        return 0;
+    }
+    dlms_size += plaintext_size;
+    memcpy(&dlms[dlms_size], tag, tag_size);
+    dlms_size += tag_size;
+
+    /* Split into M-Bus frames, following frames repeat the DLMS start values */
+    size_t offset = 0;
+    size_t dlms_offset = 0;
+    while(dlms_offset < dlms_size)
+    {
+        uint8_t user_data[DLMS_MAX_SIZE];
+        size_t user_data_size = 0;
+        uint8_t ci = TELEGRAM_MBUS_CI_FIRST;
+
+        if(dlms_offset > 0)
+        {
+            user_data[user_data_size++] = DLMS_START_VAL1;
+            user_data[user_data_size++] = DLMS_START_VAL2;
+            ci = TELEGRAM_MBUS_CI_NEXT;
+        }
+
+        size_t chunk = dlms_size - dlms_offset;
+        if(chunk > DLMS_MAX_SIZE - user_data_size)
+        {
+            chunk = DLMS_MAX_SIZE - user_data_size;
+        }
+        memcpy(&user_data[user_data_size], &dlms[dlms_offset], chunk);
+        user_data_size += chunk;
+        dlms_offset += chunk;
+
+        if(offset + MBUS_HEADER_LENGTH + user_data_size + MBUS_FOOTER_LENGTH > telegram_size)
+        {
+            return 0;
+        }
+        offset += append_mbus_frame(ci, user_data, user_data_size, &telegram[offset]);
+    }
+
+    return offset;
+}
+
+size_t telegram_load_hex_file(const char *path, telegram_plaintext_t *plaintexts, size_t max_count)
+{
+    FILE *file = fopen(path, "r");
+    if(file == NULL)
+    {
+        return 0;
+    }
+
+    size_t count = 0;
+    char line[2 * TELEGRAM_MAX_SIZE + 16];
+    while(count < max_count && fgets(line, sizeof(line), file) != NULL)
+    {
+        if(line[0] == '#')
+        {
+            continue;
+        }
+
+        /* Decode pairs of hex digits, stop at first other character */
+        telegram_plaintext_t *plaintext = &plaintexts[count];
+        plaintext->size = 0;
+        for(size_t i = 0; isxdigit((unsigned char)line[i]) && isxdigit((unsigned char)line[i + 1]); i += 2)
+        {
+            if(plaintext->size >= TELEGRAM_MAX_PLAINTEXT_SIZE)
+            {
+                break;
+            }
+            unsigned int byte;
+            sscanf(&line[i], "%2x", &byte);
+            plaintext->data[plaintext->size++] = (uint8_t)byte;
+        }
+
+        if(plaintext->size > 0)
+        {
+            count++;
+        }
+    }
+
+    fclose(file);
+    return count;
+}
+
+int telegram_set_register(telegram_plaintext_t *plaintext, uint8_t c, uint8_t d, uint64_t value)
+{
+    /* Search for <OctetString 6> with obis code, value type and value follow */
+    for(size_t i = 0; i + 9 < plaintext->size; i++)
+    {
+        if(plaintext->data[i] != 0x09 || plaintext->data[i + 1] != 0x06 || plaintext->data[i + 4] != c || plaintext->data[i + 5] != d)
+        {
+            continue;
+        }
+
+        size_t offset = i + 8;
+        size_t size = 0;
+        switch(plaintext->data[offset])
+        {
+            case 0x12: size = 2; break;     /* LongUnsigned */
+            case 0x06: size = 4; break;     /* DoubleLongUnsigned */
+            case 0x15: size = 8; break;     /* Long64Unsigned */
+            default: return -1;
+        }
+        if(offset + 1 + size > plaintext->size)
+        {
+            return -1;
+        }
+
+        /* Big endian */
+        for(size_t b = 0; b < size; b++)
+        {
+            plaintext->data[offset + size - b] = (uint8_t)(value >> (8 * b));
+        }
+        return 0;
+    }
+    return -1;
+}
@@ -0,0 +1,91 @@
+/**
+ * @file telegram.h
+ * @brief Builds M-Bus telegrams with encrypted DLMS data like a Sagemcom T210-D, for host tools
+ * @copyright Copyright (c) 2023
+ * 
+ */
+
+// Multiple inclusion protection
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "general.h"
+#include "dlms.h"
+#include "mbus.h"
+#include "frame_pool.h"
+
+/* ===== TELEGRAM CONFIGURATION ===== */
+#define TELEGRAM_SYSTEM_TITLE_LENGTH    8           /* < Length of system title */
+#define TELEGRAM_MAX_PLAINTEXT_SIZE     250         /* < Limit of one byte length field after 0x81 */
+#define TELEGRAM_MAX_SIZE               FRAME_POOL_FRAME_SIZE
+#define TELEGRAM_MBUS_CONTROL           0x53        /* < C-Field */
+#define TELEGRAM_MBUS_ADDRESS           0xFF        /* < A-Field */
+#define TELEGRAM_MBUS_CI_FIRST          0x00        /* < CI-Field of first frame */
+#define TELEGRAM_MBUS_CI_NEXT           0x11        /* < CI-Field of following frames */
+#define TELEGRAM_SECURITY_CONTROL       0x20        /* < Encryption only, no authentication tag */
+#define TELEGRAM_MAX_AUTH_PLAINTEXT_SIZE (TELEGRAM_MAX_PLAINTEXT_SIZE - DLMS_AUTH_TAG_SIZE)
+
+/* Parameters of generated telegrams */
+typedef struct {
+    uint8_t key[GUE_KEY_LENGTH];                            /* < Decryption key of meter */
+    uint8_t system_title[TELEGRAM_SYSTEM_TITLE_LENGTH];     /* < System title of meter */
+    uint32_t frame_counter;                                 /* < Frame counter, part of initialization vector */
+    bool authenticated;                                     /* < Append authentication tag, Sagemcom T210-D sends none */
+} telegram_params_t;
+
+/* Plain DLMS data, e.g. loaded from file */
+typedef struct {
+    uint8_t data[TELEGRAM_MAX_PLAINTEXT_SIZE];
+    size_t size;
+} telegram_plaintext_t;
+
+/**
+ * @brief Default parameters, key of general.h and a Sagemcom system title
+ * 
+ * @param params parameters to initialize
+ */
+void telegram_default_params(telegram_params_t *params);
+
+/**
+ * @brief Encrypt DataNotification and wrap it into M-Bus long frames
+ * 
+ * @param params key, system title, frame counter and if a tag is appended
+ * @param plaintext decrypted DataNotification, at most TELEGRAM_MAX_AUTH_PLAINTEXT_SIZE with tag
+ * @param plaintext_size size of DataNotification
+ * @param telegram output buffer
+ * @param telegram_size size of output buffer
+ * @return size_t size of telegram, 0 on error
+ */
+size_t telegram_build(const telegram_params_t *params, const uint8_t *plaintext, size_t plaintext_size, uint8_t *telegram, size_t telegram_size);
+
+/**
+ * @brief Load hex encoded telegrams, one per line, lines starting with # are skipped
+ * 
+ * @param path file to load
+ * @param plaintexts output array
+ * @param max_count size of output array
+ * @return size_t number of loaded telegrams
+ */
+size_t telegram_load_hex_file(const char *path, telegram_plaintext_t *plaintexts, size_t max_count);
+
+/**
+ * @brief Set value of a register in a DataNotification, to generate changing measurements
+ * 
+ * @param plaintext DataNotification to modify
+ * @param c value group C of obis code, e.g. 32 for voltage L1
+ * @param d value group D of obis code, e.g. 7 for instantaneous value
+ * @param value new value, truncated to the size of the register
+ * @return int 0 on success, -1 if register was not found
+ */
+int telegram_set_register(telegram_plaintext_t *plaintext, uint8_t c, uint8_t d, uint64_t value);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,600 @@
+/**
+ * @file gateway.c
+ * @brief Linux gateway, decodes the telegrams of many meters on serial ports with a pool of worker threads
+ *
+ * Every meter is a serial device, e.g. a USB M-Bus adapter, or a pseudo terminal of meter_sim, with its
+ * own key. One thread waits with epoll on all devices and frames telegrams like the uart event task: all
+ * bytes until the line is idle for UART_RX_TIMEOUT. Complete telegrams are queued to the workers, which
+ * run the M-Bus, DLMS and OBIS layer of the firmware in place in the frame of the job, with the decryption
+ * context of the meter.
+ * For each meter the latency from the first byte to the decoded telegram is measured, and the part from
+ * the end of the telegram, which is queueing and decoding.
+ *
+ * Meters are listed in a file, one per line: device, key as 32 hex digits and an optional name.
+ * Lines starting with # are skipped. The gateway stops when all devices are closed by the other end.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "general.h"
+#include "uart.h"
+#include "mbus.h"
+#include "dlms.h"
+#include "obis.h"
+#include "frame_pool.h"
+
+/* ===== GATEWAY CONFIGURATION ===== */
+#define GATEWAY_MAX_METERS              1024
+#define GATEWAY_MAX_EVENTS              64          /* < Events of one epoll_wait */
+#define GATEWAY_JOBS_PER_WORKER         8           /* < Telegrams queued or decoded at once, per worker */
+#define GATEWAY_NAME_LENGTH             32
+#define GATEWAY_DEVICE_LENGTH           128
+#define GATEWAY_LINE_LENGTH             256
+#define GATEWAY_READ_SIZE               512         /* < Bytes read at once */
+
+/* Counters of one meter, written by workers */
+typedef struct {
+    uint32_t decoded;
+    uint32_t failed;                    /* < Invalid M-Bus, DLMS or OBIS layer, e.g. wrong key */
+    uint32_t dropped;                   /* < All jobs were in use */
+    uint32_t overflows;                 /* < Telegram longer than a frame */
+    uint32_t skipped;                   /* < Frame counters not received */
+    uint32_t last_frame_counter;
+    int64_t latency_sum_us;             /* < First byte until decoded */
+    int64_t latency_max_us;
+    int64_t decode_sum_us;              /* < Telegram complete until decoded */
+    int64_t decode_max_us;
+} gateway_stats_t;
+
+typedef struct {
+    char name[GATEWAY_NAME_LENGTH];
+    char device[GATEWAY_DEVICE_LENGTH];
+    uint8_t key[GUE_KEY_LENGTH];
+    int fd;
+
+    /* Telegram being received, only used by event loop */
+    uint8_t buffer[FRAME_POOL_FRAME_SIZE];
+    size_t size;
+    bool overflow;
+    int64_t first_byte_us;
+    int64_t last_byte_us;
+
+    /* Key is expanded once, workers take turns on it */
+    pthread_mutex_t decrypt_mutex;
+    dlms_decryptor_t decryptor;
+
+    pthread_mutex_t mutex;
+    gateway_stats_t stats;
+} gateway_meter_t;
+
+/* Telegram handed to a worker, decoded in place */
+typedef struct {
+    gateway_meter_t *meter;
+    int64_t first_byte_us;
+    int64_t complete_us;
+    frame_t frame;
+} gateway_job_t;
+
+/* Queue of complete telegrams and free jobs */
+static struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t ready;
+    gateway_job_t *jobs;
+    gateway_job_t **free_jobs;
+    size_t free_count;
+    gateway_job_t **queue;
+    size_t capacity;
+    size_t head;
+    size_t count;
+    size_t peak;
+    bool stopping;
+} work = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .ready = PTHREAD_COND_INITIALIZER,
+};
+
+static gateway_meter_t *meters = NULL;
+static size_t meter_count = 0;
+static bool verbose = false;
+
+static volatile sig_atomic_t running = 1;
+
+/* ===== HELPER FUNCTIONS ===== */
+static void print_usage(const char *name)
+{
+    printf("Usage: %s -c meters [-w workers] [-b baud] [-t idle ms] [-s seconds] [-i status interval s] [-q] [-v]\n", name);
+    printf("  meters: one line per meter with device, key hex and optional name\n");
+    printf("  -b baud rate of serial devices, default %d, -t idle time ending a telegram, default %d ms\n", UART_BAUD_RATE, UART_RX_TIMEOUT);
+}
+
+static void stop(int signal)
+{
+    running = 0;
+}
+
+static int64_t now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int parse_hex(const char *hex, uint8_t *data, size_t size)
+{
+    if(strlen(hex) != size * 2){ return -1; }
+    for(size_t i = 0; i < size; i++)
+    {
+        unsigned int byte;
+        if(sscanf(&hex[i * 2], "%2x", &byte) != 1){ return -1; }
+        data[i] = (uint8_t)byte;
+    }
+    return 0;
+}
+
+static speed_t baud_to_speed(int baud_rate)
+{
+    switch(baud_rate)
+    {
+        case 2400: return B2400;
+        case 4800: return B4800;
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 115200: return B115200;
+        default: return B0;
+    }
+}
+
+/* ===== METERS ===== */
+static int load_meters(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if(file == NULL)
+    {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return -1;
+    }
+
+    meters = calloc(GATEWAY_MAX_METERS, sizeof(gateway_meter_t));
+    if(meters == NULL)
+    {
+        fclose(file);
+        return -1;
+    }
+
+    char line[GATEWAY_LINE_LENGTH];
+    unsigned int line_number = 0;
+    while(fgets(line, sizeof(line), file) != NULL)
+    {
+        line_number++;
+        char device[GATEWAY_DEVICE_LENGTH];
+        char key[2 * GUE_KEY_LENGTH + 2];
+        char name[GATEWAY_NAME_LENGTH] = "";
+        if(line[0] == '#' || line[0] == '\n'){ continue; }
+
+        int fields = sscanf(line, "%127s %33s %31s", device, key, name);
+        if(fields < 2 || meter_count == GATEWAY_MAX_METERS || parse_hex(key, meters[meter_count].key, GUE_KEY_LENGTH) != 0)
+        {
+            fprintf(stderr, "%s:%u: invalid meter\n", path, line_number);
+            fclose(file);
+            return -1;
+        }
+
+        gateway_meter_t *meter = &meters[meter_count];
+        strcpy(meter->device, device);
+        snprintf(meter->name, sizeof(meter->name), "%.*s", GATEWAY_NAME_LENGTH - 1, fields == 3 ? name : device);
+        meter->fd = -1;
+        pthread_mutex_init(&meter->mutex, NULL);
+        pthread_mutex_init(&meter->decrypt_mutex, NULL);
+        dlms_decryptor_init(&meter->decryptor);
+        meter_count++;
+    }
+    fclose(file);
+
+    if(meter_count == 0){ fprintf(stderr, "No meters in %s\n", path); }
+    return meter_count > 0 ? 0 : -1;
+}
+
+/* Raw 8E1 like the uart of the firmware, pseudo terminals ignore the line settings */
+static int open_meter(gateway_meter_t *meter, int baud_rate)
+{
+    meter->fd = open(meter->device, O_RDONLY | O_NOCTTY | O_NONBLOCK);
+    if(meter->fd < 0){ return -1; }
+
+    struct termios tio;
+    if(tcgetattr(meter->fd, &tio) == 0)
+    {
+        cfmakeraw(&tio);
+        tio.c_cflag |= PARENB | CREAD | CLOCAL;
+        tio.c_cflag &= ~PARODD;
+        speed_t speed = baud_to_speed(baud_rate);
+        if(speed != B0){ cfsetspeed(&tio, speed); }
+        tcsetattr(meter->fd, TCSANOW, &tio);
+    }
+
+    /* Bytes received before the gateway started are no complete telegram, like the uart flush at startup */
+    tcflush(meter->fd, TCIFLUSH);
+    return 0;
+}
+
+/* ===== WORKERS ===== */
+static void decode_job(gateway_job_t *job)
+{
+    static __thread obis_data_t obis;
+    gateway_meter_t *meter = job->meter;
+    frame_t *frame = &job->frame;
+
+    /* Same layers as uart event task, with the key of the meter */
+    size_t user_data_size = 0;
+    esp_err_t err = parse_mbus_long_frame_layer(frame->data, frame->size, frame->data, &user_data_size);
+    if(err == ESP_OK)
+    {
+        /* Telegrams of one meter are seconds apart, the lock is hardly ever contended */
+        pthread_mutex_lock(&meter->decrypt_mutex);
+        err = parse_dlms_layer_with(&meter->decryptor, frame->data, user_data_size, &frame->offset, &frame->size, meter->key);
+        pthread_mutex_unlock(&meter->decrypt_mutex);
+    }
+    if(err == ESP_OK){ err = parse_obis(&frame->data[frame->offset], frame->size, &obis); }
+
+    uint32_t frame_counter = 0;
+    if(err == ESP_OK){ get_dlms_frame_counter(frame->data, user_data_size, &frame_counter); }
+    int64_t done_us = now_us();
+
+    pthread_mutex_lock(&meter->mutex);
+    gateway_stats_t *stats = &meter->stats;
+    if(err == ESP_OK)
+    {
+        stats->decoded++;
+        if(stats->last_frame_counter != 0 && frame_counter > stats->last_frame_counter + 1)
+        {
+            stats->skipped += frame_counter - stats->last_frame_counter - 1;
+        }
+        if(frame_counter > stats->last_frame_counter){ stats->last_frame_counter = frame_counter; }
+
+        int64_t latency_us = done_us - job->first_byte_us;
+        int64_t decode_us = done_us - job->complete_us;
+        stats->latency_sum_us += latency_us;
+        stats->decode_sum_us += decode_us;
+        if(latency_us > stats->latency_max_us){ stats->latency_max_us = latency_us; }
+        if(decode_us > stats->decode_max_us){ stats->decode_max_us = decode_us; }
+    }
+    else
+    {
+        stats->failed++;
+    }
+    pthread_mutex_unlock(&meter->mutex);
+
+    if(verbose && err == ESP_OK)
+    {
+        const obis_record_t *power = obis_find_record(&obis, ActivePowerPlus);
+        const obis_record_t *energy = obis_find_record(&obis, ActiveEnergyPlus);
+        printf("%s: frame counter %lu, power %lld, energy %lld\n", meter->name, (unsigned long)frame_counter,
+               power != NULL ? (long long)power->value : -1LL, energy != NULL ? (long long)energy->value : -1LL);
+    }
+}
+
+static void *worker_thread(void *arg)
+{
+    for(;;)
+    {
+        pthread_mutex_lock(&work.mutex);
+        while(work.count == 0 && !work.stopping){ pthread_cond_wait(&work.ready, &work.mutex); }
+        if(work.count == 0)
+        {
+            pthread_mutex_unlock(&work.mutex);
+            break;
+        }
+        gateway_job_t *job = work.queue[work.head];
+        work.head = (work.head + 1) % work.capacity;
+        work.count--;
+        pthread_mutex_unlock(&work.mutex);
+
+        decode_job(job);
+
+        pthread_mutex_lock(&work.mutex);
+        work.free_jobs[work.free_count++] = job;
+        pthread_mutex_unlock(&work.mutex);
+    }
+    return NULL;
+}
+
+static int start_workers(size_t worker_count, pthread_t *threads)
+{
+    work.capacity = worker_count * GATEWAY_JOBS_PER_WORKER;
+    work.jobs = calloc(work.capacity, sizeof(gateway_job_t));
+    work.free_jobs = calloc(work.capacity, sizeof(gateway_job_t *));
+    work.queue = calloc(work.capacity, sizeof(gateway_job_t *));
+    if(work.jobs == NULL || work.free_jobs == NULL || work.queue == NULL){ return -1; }
+
+    for(size_t i = 0; i < work.capacity; i++){ work.free_jobs[i] = &work.jobs[i]; }
+    work.free_count = work.capacity;
+
+    for(size_t i = 0; i < worker_count; i++)
+    {
+        if(pthread_create(&threads[i], NULL, worker_thread, NULL) != 0){ return -1; }
+    }
+    return 0;
+}
+
+/* Hand complete telegram to workers, dropped if all jobs are in use like with an empty frame pool */
+static void submit(gateway_meter_t *meter, int64_t complete_us)
+{
+    if(meter->overflow || meter->size < MBUS_HEADER_LENGTH + MBUS_FOOTER_LENGTH)
+    {
+        if(meter->overflow)
+        {
+            pthread_mutex_lock(&meter->mutex);
+            meter->stats.overflows++;
+            pthread_mutex_unlock(&meter->mutex);
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&work.mutex);
+    gateway_job_t *job = work.free_count > 0 ? work.free_jobs[--work.free_count] : NULL;
+    if(job != NULL)
+    {
+        job->meter = meter;
+        job->first_byte_us = meter->first_byte_us;
+        job->complete_us = complete_us;
+        memcpy(job->frame.data, meter->buffer, meter->size);
+        job->frame.size = meter->size;
+        job->frame.offset = 0;
+
+        work.queue[(work.head + work.count) % work.capacity] = job;
+        work.count++;
+        if(work.count > work.peak){ work.peak = work.count; }
+        pthread_cond_signal(&work.ready);
+    }
+    pthread_mutex_unlock(&work.mutex);
+
+    if(job == NULL)
+    {
+        pthread_mutex_lock(&meter->mutex);
+        meter->stats.dropped++;
+        pthread_mutex_unlock(&meter->mutex);
+    }
+}
+
+/* ===== EVENT LOOP ===== */
+/* Read all available bytes, returns false if the other end is closed */
+static bool receive(gateway_meter_t *meter)
+{
+    for(;;)
+    {
+        uint8_t data[GATEWAY_READ_SIZE];
+        ssize_t size = read(meter->fd, data, sizeof(data));
+        if(size < 0 && errno == EAGAIN){ return true; }
+        if(size <= 0){ return false; }
+
+        int64_t now = now_us();
+        if(meter->size == 0 && !meter->overflow){ meter->first_byte_us = now; }
+        meter->last_byte_us = now;
+
+        /* Longer than a frame, rest of telegram is discarded */
+        size_t space = sizeof(meter->buffer) - meter->size;
+        if((size_t)size > space){ meter->overflow = true; }
+        if(!meter->overflow)
+        {
+            memcpy(&meter->buffer[meter->size], data, (size_t)size);
+            meter->size += (size_t)size;
+        }
+    }
+}
+
+/* Submit telegrams of lines idle for the timeout, returns time until the next one is due in ms, -1 if none */
+static int check_idle(int64_t idle_us)
+{
+    int64_t now = now_us();
+    int64_t next_us = -1;
+
+    /* Linear scan, fine for some hundred meters with telegrams every few seconds */
+    for(size_t i = 0; i < meter_count; i++)
+    {
+        gateway_meter_t *meter = &meters[i];
+        if(meter->size == 0 && !meter->overflow){ continue; }
+
+        int64_t due_us = meter->last_byte_us + idle_us;
+        if(due_us <= now)
+        {
+            submit(meter, now);
+            meter->size = 0;
+            meter->overflow = false;
+        }
+        else if(next_us < 0 || due_us - now < next_us)
+        {
+            next_us = due_us - now;
+        }
+    }
+    return next_us < 0 ? -1 : (int)((next_us + 999) / 1000);
+}
+
+static void print_status(unsigned int seconds, uint32_t *previous, size_t connected)
+{
+    uint32_t decoded = 0, failed = 0, dropped = 0;
+    for(size_t i = 0; i < meter_count; i++)
+    {
+        pthread_mutex_lock(&meters[i].mutex);
+        decoded += meters[i].stats.decoded;
+        failed += meters[i].stats.failed;
+        dropped += meters[i].stats.dropped;
+        pthread_mutex_unlock(&meters[i].mutex);
+    }
+    pthread_mutex_lock(&work.mutex);
+    size_t peak = work.peak;
+    pthread_mutex_unlock(&work.mutex);
+
+    printf("%4u s: %lu decoded (%lu/s), %lu failed, %lu dropped, queue peak %zu/%zu, %zu/%zu meters connected\n", seconds,
+           (unsigned long)decoded, (unsigned long)(decoded - *previous), (unsigned long)failed, (unsigned long)dropped,
+           peak, work.capacity, connected, meter_count);
+    fflush(stdout);
+    *previous = decoded;
+}
+
+static void print_meters()
+{
+    int64_t latency_sum = 0, latency_max = 0, decode_sum = 0, decode_max = 0;
+    uint32_t decoded = 0;
+
+    printf("%-20s %8s %6s %6s %6s %8s %10s %10s %10s %10s\n", "meter", "decoded", "failed", "drop", "skip", "overflow",
+           "mean ms", "max ms", "decode us", "max us");
+    for(size_t i = 0; i < meter_count; i++)
+    {
+        const gateway_stats_t *s = &meters[i].stats;
+        double count = s->decoded > 0 ? (double)s->decoded : 1.0;
+        printf("%-20s %8lu %6lu %6lu %6lu %8lu %10.1f %10.1f %10.0f %10lld\n", meters[i].name, (unsigned long)s->decoded,
+               (unsigned long)s->failed, (unsigned long)s->dropped, (unsigned long)s->skipped, (unsigned long)s->overflows,
+               (double)s->latency_sum_us / count / 1000.0, (double)s->latency_max_us / 1000.0,
+               (double)s->decode_sum_us / count, (long long)s->decode_max_us);
+
+        decoded += s->decoded;
+        latency_sum += s->latency_sum_us;
+        decode_sum += s->decode_sum_us;
+        if(s->latency_max_us > latency_max){ latency_max = s->latency_max_us; }
+        if(s->decode_max_us > decode_max){ decode_max = s->decode_max_us; }
+    }
+
+    double count = decoded > 0 ? (double)decoded : 1.0;
+    printf("%-20s %8lu %6s %6s %6s %8s %10.1f %10.1f %10.0f %10lld\n", "all", (unsigned long)decoded, "", "", "", "",
+           (double)latency_sum / count / 1000.0, (double)latency_max / 1000.0, (double)decode_sum / count, (long long)decode_max);
+}
+
+int main(int argc, char **argv)
+{
+    const char *config = NULL;
+    long worker_count = sysconf(_SC_NPROCESSORS_ONLN);
+    int baud_rate = UART_BAUD_RATE;
+    unsigned int idle_ms = UART_RX_TIMEOUT;
+    unsigned int duration = 0;
+    unsigned int status_interval = 1;
+
+    int opt;
+    while((opt = getopt(argc, argv, "c:w:b:t:s:i:qvh")) != -1)
+    {
+        switch(opt)
+        {
+            case 'c': config = optarg; break;
+            case 'w': worker_count = strtol(optarg, NULL, 10); break;
+            case 'b': baud_rate = atoi(optarg); break;
+            case 't': idle_ms = (unsigned int)strtoul(optarg, NULL, 10); break;
+            case 's': duration = (unsigned int)strtoul(optarg, NULL, 10); break;
+            case 'i': status_interval = (unsigned int)strtoul(optarg, NULL, 10); break;
+            case 'q': host_log_level = 0; break;
+            case 'v': verbose = true; break;
+            default: print_usage(argv[0]); return 2;
+        }
+    }
+    if(config == NULL || worker_count < 1 || idle_ms == 0 || status_interval == 0)
+    {
+        print_usage(argv[0]);
+        return 2;
+    }
+    if(load_meters(config) != 0){ return 2; }
+
+    int epoll_fd = epoll_create1(0);
+    if(epoll_fd < 0)
+    {
+        fprintf(stderr, "epoll_create1 failed\n");
+        return 2;
+    }
+    size_t connected = 0;
+    for(size_t i = 0; i < meter_count; i++)
+    {
+        struct epoll_event event = {.events = EPOLLIN, .data.ptr = &meters[i]};
+        if(open_meter(&meters[i], baud_rate) != 0 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, meters[i].fd, &event) != 0)
+        {
+            fprintf(stderr, "Cannot open %s\n", meters[i].device);
+            return 2;
+        }
+        connected++;
+    }
+
+    pthread_t *threads = calloc((size_t)worker_count, sizeof(pthread_t));
+    if(threads == NULL || start_workers((size_t)worker_count, threads) != 0)
+    {
+        fprintf(stderr, "Starting workers failed\n");
+        return 2;
+    }
+    printf("%zu meters, %ld workers, telegram ends after %u ms idle\n", meter_count, worker_count, idle_ms);
+    fflush(stdout);
+
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
+
+    int64_t start_us = now_us();
+    int64_t next_status_us = start_us + (int64_t)status_interval * 1000000;
+    uint32_t previous = 0;
+    while(running && connected > 0)
+    {
+        /* Wake up for the next idle line or status */
+        int timeout_ms = check_idle((int64_t)idle_ms * 1000);
+        int status_ms = (int)((next_status_us - now_us() + 999) / 1000);
+        if(status_ms < 0){ status_ms = 0; }
+        if(timeout_ms < 0 || timeout_ms > status_ms){ timeout_ms = status_ms; }
+
+        struct epoll_event events[GATEWAY_MAX_EVENTS];
+        int count = epoll_wait(epoll_fd, events, GATEWAY_MAX_EVENTS, timeout_ms);
+        if(count < 0 && errno != EINTR)
+        {
+            fprintf(stderr, "epoll_wait failed\n");
+            break;
+        }
+
+        for(int i = 0; i < count; i++)
+        {
+            gateway_meter_t *meter = events[i].data.ptr;
+            if(!receive(meter))
+            {
+                /* Other end is closed, telegram in progress is submitted by the idle check */
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, meter->fd, NULL);
+                close(meter->fd);
+                meter->fd = -1;
+                connected--;
+                if(verbose){ printf("%s: closed\n", meter->name); }
+            }
+        }
+
+        int64_t now = now_us();
+        if(now >= next_status_us)
+        {
+            unsigned int seconds = (unsigned int)((now - start_us) / 1000000);
+            print_status(seconds, &previous, connected);
+            next_status_us += (int64_t)status_interval * 1000000;
+            if(duration > 0 && seconds >= duration){ break; }
+        }
+    }
+
+    /* Last telegrams, then workers finish the queue */
+    usleep(idle_ms * 1000);
+    check_idle(0);
+    pthread_mutex_lock(&work.mutex);
+    work.stopping = true;
+    pthread_cond_broadcast(&work.ready);
+    pthread_mutex_unlock(&work.mutex);
+    for(long i = 0; i < worker_count; i++){ pthread_join(threads[i], NULL); }
+
+    print_status((unsigned int)((now_us() - start_us) / 1000000), &previous, connected);
+    print_meters();
+
+    close(epoll_fd);
+    free(threads);
+    for(size_t i = 0; i < meter_count; i++){ dlms_decryptor_free(&meters[i].decryptor); }
+    return 0;
+}
@@ -0,0 +1,268 @@
+/**
+ * @file history_sim.c
+ * @brief Simulates network outages and restarts and checks the upload of the history log
+ *
+ * Every step is one telegram. While the network is down the telegram is appended to the history log,
+ * after rejoin the backlog is uploaded in batches between live telegrams. The device restarts at random
+ * steps, sometimes while a page is written. The received batches are decoded like a coordinator would
+ * and checked for order, gaps and duplicates. The flash is a file with the behavior of NOR flash.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "flash_file.h"
+#include "history.h"
+#include "meter_convert.h"
+
+/* ===== SIMULATION CONFIGURATION ===== */
+#define SIM_DEFAULT_STEPS               500000      /* < Number of simulated telegrams */
+#define SIM_DEFAULT_SECTORS             16          /* < Size of history partition */
+#define SIM_TELEGRAM_INTERVAL_S         5           /* < Interval of telegrams of the meter */
+#define SIM_OUTAGE_PROBABILITY          0.0005      /* < Probability that network goes down in a step */
+#define SIM_MAX_OUTAGE_STEPS            4000        /* < Longest outage, longer than the ring to test overwriting */
+#define SIM_BACKFILL_PROBABILITY        0.2         /* < Probability of a poll without new telegram in a step */
+#define SIM_RESTART_PROBABILITY         0.0002      /* < Probability of a restart in a step */
+#define SIM_TORN_PROBABILITY            0.3         /* < Probability that a restart interrupts a page write */
+#define SIM_SEND_FAILURE_PROBABILITY    0.02        /* < Probability that a batch isn't marked as uploaded */
+#define SIM_START_TIME                  1692199170  /* < Time of first telegram */
+
+/* Values of telegram n, all fields depend on n to detect mixed records */
+static void make_record(uint32_t n, history_record_t *record)
+{
+    memset(record, 0, sizeof(history_record_t));
+    record->time = SIM_START_TIME + n * SIM_TELEGRAM_INTERVAL_S;
+    record->frame_counter = n;
+    record->energy_delivered = 1000000 + n * 3;
+    record->energy_received = n / 2;
+    record->active_power = (int32_t)(n % 3000) - 1000;
+    for(int i = 0; i < 3; i++)
+    {
+        record->voltage[i] = (uint16_t)(2300 + (n + i) % 40);
+        record->current[i] = (uint16_t)((n * (i + 1)) % 2000);
+    }
+}
+
+static bool is_consistent(const zb_history_entry_t *entry)
+{
+    history_record_t record;
+    zb_history_entry_t expected;
+    uint32_t n = (entry->time - SIM_START_TIME) / SIM_TELEGRAM_INTERVAL_S;
+
+    make_record(n, &record);
+    meter_convert_history(&record, &expected);
+    return memcmp(entry, &expected, sizeof(expected)) == 0;
+}
+
+static double random_uniform()
+{
+    return (double)rand() / ((double)RAND_MAX + 1.0);
+}
+
+static void print_usage(const char *name)
+{
+    printf("Usage: %s [-n steps] [-s sectors] [-p flash file] [-r seed]\n", name);
+}
+
+/* ===== MAIN ===== */
+int main(int argc, char **argv)
+{
+    size_t steps = SIM_DEFAULT_STEPS;
+    size_t sectors = SIM_DEFAULT_SECTORS;
+    const char *path = "history_sim.bin";
+    unsigned int seed = 1;
+
+    int opt;
+    while((opt = getopt(argc, argv, "n:s:p:r:h")) != -1)
+    {
+        switch(opt)
+        {
+            case 'n': steps = (size_t)strtoul(optarg, NULL, 10); break;
+            case 's': sectors = (size_t)strtoul(optarg, NULL, 10); break;
+            case 'p': path = optarg; break;
+            case 'r': seed = (unsigned int)strtoul(optarg, NULL, 10); break;
+            default: print_usage(argv[0]); return 2;
+        }
+    }
+
+    /* Start with empty flash */
+    remove(path);
+    static flash_file_t flash;
+    flash_ops_t ops;
+    if(flash_file_open(&flash, path, sectors * FLASH_OPS_SECTOR_SIZE, &ops) != ESP_OK)
+    {
+        fprintf(stderr, "Can't open %s\n", path);
+        return 2;
+    }
+
+    static history_t history;
+    if(history_init(&history, &ops) != ESP_OK)
+    {
+        fprintf(stderr, "Initialization failed\n");
+        return 2;
+    }
+
+    static history_record_t records[ZB_HISTORY_MAX_ENTRIES];
+    static zb_history_entry_t entries[ZB_HISTORY_MAX_ENTRIES];
+    static zb_history_entry_t received[ZB_HISTORY_MAX_ENTRIES];
+    static uint8_t payload[ZB_HISTORY_MAX_PAYLOAD_SIZE];
+
+    srand(seed);
+    size_t outage_steps = 0;
+    size_t failures = 0;
+    size_t stored = 0;
+    size_t uploaded = 0;
+    size_t duplicates = 0;
+    size_t batches = 0;
+    size_t payload_bytes = 0;
+    size_t restarts = 0;
+    size_t torn_writes = 0;
+    size_t lost_on_restart = 0;
+    uint32_t lost_pages = 0;
+    uint32_t last_time = 0;
+
+    /* Last step drains the backlog */
+    for(size_t step = 0; step <= steps; step++)
+    {
+        bool draining = step == steps;
+        history_record_t record;
+        make_record((uint32_t)step, &record);
+
+        /* Network state */
+        if(outage_steps == 0 && !draining && random_uniform() < SIM_OUTAGE_PROBABILITY)
+        {
+            outage_steps = 1 + (size_t)(random_uniform() * SIM_MAX_OUTAGE_STEPS);
+        }
+
+        if(outage_steps > 0 && !draining)
+        {
+            /* Network down, store telegram */
+            outage_steps--;
+            if(history_append(&history, &record) != ESP_OK)
+            {
+                fprintf(stderr, "Step %zu: append failed\n", step);
+                failures++;
+            }
+            stored++;
+        }
+        else
+        {
+            /* Network up, backlog is uploaded in polls without new telegram */
+            while(history_backlog(&history) > 0 && (draining || random_uniform() < SIM_BACKFILL_PROBABILITY))
+            {
+                size_t count = 0;
+                uint32_t last_sequence = 0;
+                if(history_flush(&history) != ESP_OK || history_read_batch(&history, records, ZB_HISTORY_MAX_ENTRIES, &count, &last_sequence) != ESP_OK)
+                {
+                    break;
+                }
+
+                /* Encode like the zigbee endpoint, decode like the coordinator */
+                for(size_t i = 0; i < count; i++)
+                {
+                    meter_convert_history(&records[i], &entries[i]);
+                }
+                size_t size = zb_history_encode(entries, (uint8_t)count, payload, sizeof(payload));
+                uint8_t received_count = 0;
+                if(size == 0 || zb_history_decode(payload, size, received, &received_count) != ESP_OK || received_count != count)
+                {
+                    fprintf(stderr, "Step %zu: encoding of %zu entries failed\n", step, count);
+                    failures++;
+                    break;
+                }
+                batches++;
+                payload_bytes += size;
+
+                /* Coordinator discards entries which it already received */
+                for(uint8_t i = 0; i < received_count; i++)
+                {
+                    if(!is_consistent(&received[i]))
+                    {
+                        fprintf(stderr, "Step %zu: entry with time %lu is corrupted\n", step, (unsigned long)received[i].time);
+                        failures++;
+                    }
+                    if(received[i].time <= last_time)
+                    {
+                        duplicates++;
+                        continue;
+                    }
+                    last_time = received[i].time;
+                    uploaded++;
+                }
+
+                /* Without acknowledgement the batch is sent again */
+                if(draining || random_uniform() >= SIM_SEND_FAILURE_PROBABILITY)
+                {
+                    history_mark_uploaded(&history, last_sequence);
+                }
+            }
+        }
+
+        /* Restart, collected records are lost, supply may die during page write */
+        if(!draining && random_uniform() < SIM_RESTART_PROBABILITY)
+        {
+            restarts++;
+            lost_pages += history.lost_pages;
+            size_t pending = history.buffer.header.count;
+            uint32_t sequence = history.sequence;
+            if(pending > 0 && random_uniform() < SIM_TORN_PROBABILITY)
+            {
+                flash.torn_bytes = 1 + (size_t)(random_uniform() * (sizeof(history_page_t) - 1));
+                history_flush(&history);
+                flash.torn_bytes = 0;
+                torn_writes++;
+            }
+
+            if(history_init(&history, &ops) != ESP_OK)
+            {
+                fprintf(stderr, "Step %zu: initialization failed\n", step);
+                failures++;
+            }
+
+            /* Write may have completed if the rest of the page was erased anyway */
+            if(history.sequence != sequence + 1)
+            {
+                lost_on_restart += pending;
+            }
+        }
+    }
+    lost_pages += history.lost_pages;
+
+    /* Every stored telegram is received once, except lost ones */
+    size_t missing = stored - uploaded;
+    if(missing < lost_on_restart || missing > lost_on_restart + lost_pages * HISTORY_MAX_RECORDS_PER_PAGE || (lost_pages == 0 && missing != lost_on_restart))
+    {
+        fprintf(stderr, "%zu telegrams missing, %zu lost on restart, %lu pages overwritten\n", missing, lost_on_restart, (unsigned long)lost_pages);
+        failures++;
+    }
+
+    /* Sectors are erased in ring order */
+    uint32_t min_erases = UINT32_MAX;
+    uint32_t max_erases = 0;
+    for(size_t i = 0; i < sectors; i++)
+    {
+        if(flash.sector_erases[i] < min_erases){ min_erases = flash.sector_erases[i]; }
+        if(flash.sector_erases[i] > max_erases){ max_erases = flash.sector_erases[i]; }
+    }
+    if(max_erases - min_erases > 1)
+    {
+        fprintf(stderr, "Uneven wear, sector erases between %lu and %lu\n", (unsigned long)min_erases, (unsigned long)max_erases);
+        failures++;
+    }
+
+    printf("Simulated %zu telegrams, %zu stored during outages, %zu restarts (%zu during page write)\n", steps, stored, restarts, torn_writes);
+    printf("Uploaded %zu in %zu batches, %.1f bytes per entry, %zu duplicates discarded\n", uploaded, batches,
+           uploaded + duplicates > 0 ? (double)payload_bytes / (double)(uploaded + duplicates) : 0.0, duplicates);
+    printf("Lost %zu on restart, %lu pages overwritten before upload\n", lost_on_restart, (unsigned long)lost_pages);
+    printf("Sector erases between %lu and %lu, %lu page writes\n", (unsigned long)min_erases, (unsigned long)max_erases, (unsigned long)flash.writes);
+    printf("%s\n", failures == 0 ? "All checks passed" : "FAILED");
+
+    flash_file_close(&flash);
+    remove(path);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,91 @@
+/**
+ * @file uart.h
+ * @brief Host replacement of the ESP-IDF uart driver, reads from a serial device or pseudo terminal
+ * @copyright Copyright (c) 2023
+ * 
+ */
+
+// Multiple inclusion protection
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+/* ===== HOST UART CONFIGURATION ===== */
+#define HOST_UART_RX_FULL_THRESHOLD     120         /* < Data event after this many bytes, default of the driver */
+#define HOST_UART_RX_TIMEOUT_SYMBOLS    10          /* < Data event after the line is idle for this many symbols */
+#define HOST_UART_BITS_PER_SYMBOL       11          /* < 8E1 */
+
+typedef int uart_port_t;
+#define UART_NUM_0                      0
+#define UART_NUM_1                      1
+#define UART_PIN_NO_CHANGE              (-1)
+
+/* Same order as ESP-IDF */
+typedef enum {
+    UART_DATA,
+    UART_BREAK,
+    UART_BUFFER_FULL,
+    UART_FIFO_OVF,
+    UART_FRAME_ERR,
+    UART_PARITY_ERR,
+    UART_DATA_BREAK,
+    UART_PATTERN_DET,
+    UART_EVENT_MAX,
+} uart_event_type_t;
+
+typedef struct {
+    uart_event_type_t type;
+    size_t size;
+    int timeout_flag;
+} uart_event_t;
+
+/* Settings of a pseudo terminal don't matter, only the baud rate is used for the timing of events */
+typedef enum { UART_DATA_5_BITS, UART_DATA_6_BITS, UART_DATA_7_BITS, UART_DATA_8_BITS } uart_word_length_t;
+typedef enum { UART_PARITY_DISABLE, UART_PARITY_EVEN = 2, UART_PARITY_ODD } uart_parity_t;
+typedef enum { UART_STOP_BITS_1 = 1, UART_STOP_BITS_1_5, UART_STOP_BITS_2 } uart_stop_bits_t;
+typedef enum { UART_HW_FLOWCTRL_DISABLE } uart_hw_flowcontrol_t;
+typedef enum { UART_SCLK_DEFAULT } uart_sclk_t;
+
+typedef struct {
+    int baud_rate;
+    uart_word_length_t data_bits;
+    uart_parity_t parity;
+    uart_stop_bits_t stop_bits;
+    uart_hw_flowcontrol_t flow_ctrl;
+    uart_sclk_t source_clk;
+} uart_config_t;
+
+/**
+ * @brief Select device of the uart, call before the driver is installed
+ * 
+ * @param path serial device or pseudo terminal
+ * @param baud_rate symbol timing of events, 0 for the baud rate of uart_param_config
+ * @return esp_err_t 
+ */
+esp_err_t host_uart_open(const char *path, int baud_rate);
+
+esp_err_t uart_param_config(uart_port_t port, const uart_config_t *config);
+esp_err_t uart_set_pin(uart_port_t port, int tx, int rx, int rts, int cts);
+
+/**
+ * @brief Start reader thread, events are sent like by the driver: data after the rx threshold or an idle line,
+ * buffer full if the ring buffer overflows, events are dropped while the queue is full
+ */
+esp_err_t uart_driver_install(uart_port_t port, int rx_buffer_size, int tx_buffer_size, int queue_size, QueueHandle_t *queue, int intr_flags);
+
+int uart_read_bytes(uart_port_t port, void *buffer, uint32_t length, TickType_t ticks);
+esp_err_t uart_get_buffered_data_len(uart_port_t port, size_t *size);
+esp_err_t uart_flush_input(uart_port_t port);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,12 @@
+/**
+ * @file esp_check.h
+ * @brief Host replacement of esp_check.h
+ * @copyright Copyright (c) 2023
+ * 
+ */
+
+// Multiple inclusion protection
+#pragma once
+
+#include "esp_err.h"
+#include "esp_log.h"
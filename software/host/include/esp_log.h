@@ -0,0 +1,40 @@
+/**
+ * @file esp_log.h
+ * @brief Host replacement of the ESP-IDF logging macros, errors and warnings are written to stderr
+ * @copyright Copyright (c) 2023
+ * 
+ */
+
+// Multiple inclusion protection
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* Set to 0 to silence parser errors, e.g. when fault injection is used */
+extern int host_log_level;
+
+/* Log levels as in ESP-IDF */
+#define HOST_LOG_ERROR                  1
+#define HOST_LOG_WARN                   2
+#define HOST_LOG_INFO                   3
+
+#define HOST_LOG(level, letter, tag, format, ...) do {                              \
+        if(host_log_level >= (level)) {                                             \
+            fprintf(stderr, letter " (%s) " format "\n", tag, ##__VA_ARGS__);       \
+        }                                                                           \
+    } while(0)
+
+#define ESP_LOGE(tag, format, ...)      HOST_LOG(HOST_LOG_ERROR, "E", tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...)      HOST_LOG(HOST_LOG_WARN, "W", tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...)      HOST_LOG(HOST_LOG_INFO, "I", tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...)      do { (void)(tag); } while(0)
+#define ESP_LOGV(tag, format, ...)      do { (void)(tag); } while(0)
+
+#ifdef __cplusplus
+}
+#endif
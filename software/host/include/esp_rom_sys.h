@@ -0,0 +1,16 @@
+/**
+ * @file esp_rom_sys.h
+ * @brief Host replacement of esp_rom_sys.h, the cycle counter of the host counts nanoseconds
+ * @copyright Copyright (c) 2023
+ * 
+ */
+
+// Multiple inclusion protection
+#pragma once
+
+#include <stdint.h>
+
+static inline uint32_t esp_rom_get_cpu_ticks_per_us(void)
+{
+    return 1000;
+}
@@ -0,0 +1,345 @@
+/**
+ * @file esp_zigbee_core.h
+ * @brief Host replacement of the subset of esp-zigbee-lib used by the electricity meter endpoint
+ *
+ * Attribute lists hold the values like the stack does. Attribute reports and cluster commands aren't
+ * sent but recorded as frames with the size they have on air, see host_zigbee_set_frame_cb.
+ * Scheduler alarms run on a virtual clock which is advanced by the host tool.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+// Multiple inclusion protection
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+/* ===== HOST ZIGBEE CONFIGURATION ===== */
+#define HOST_ZIGBEE_MAX_ATTRIBUTES      32          /* < Attributes of one cluster */
+#define HOST_ZIGBEE_MAX_CLUSTERS        8           /* < Clusters of one endpoint */
+#define HOST_ZIGBEE_MAX_ENDPOINTS       2
+#define HOST_ZIGBEE_MAX_VALUE_SIZE      512         /* < Largest attribute value, long octet strings included */
+#define HOST_ZIGBEE_MAX_ALARMS          16          /* < Pending scheduler alarms */
+#define HOST_ZIGBEE_MAX_NEIGHBORS       4
+
+/* Frames on air, without PHY header */
+#define HOST_ZIGBEE_FRAME_OVERHEAD_BYTES    45      /* < MAC header and FCS, NWK header with security, APS header */
+#define HOST_ZIGBEE_ZCL_HEADER_BYTES        3       /* < Frame control, sequence number and command */
+#define HOST_ZIGBEE_ZCL_MANUF_CODE_BYTES    2       /* < Manufacturer code of manufacturer specific frames */
+#define HOST_ZIGBEE_APS_MAX_PAYLOAD         82      /* < Larger payloads are fragmented by the APS layer */
+
+/* ===== ZCL ===== */
+typedef enum {
+    ESP_ZB_ZCL_CLUSTER_ID_BASIC = 0x0000,
+    ESP_ZB_ZCL_CLUSTER_ID_IDENTIFY = 0x0003,
+    ESP_ZB_ZCL_CLUSTER_ID_METERING = 0x0702,
+    ESP_ZB_ZCL_CLUSTER_ID_ELECTRICAL_MEASUREMENT = 0x0B04,
+    ESP_ZB_ZCL_CLUSTER_ID_DIAGNOSTICS = 0x0B05,
+} esp_zb_zcl_cluster_id_t;
+
+typedef enum {
+    ESP_ZB_ZCL_CLUSTER_SERVER_ROLE = 0x01,
+    ESP_ZB_ZCL_CLUSTER_CLIENT_ROLE = 0x02,
+} esp_zb_zcl_cluster_role_t;
+
+typedef enum {
+    ESP_ZB_ZCL_STATUS_SUCCESS = 0x00,
+    ESP_ZB_ZCL_STATUS_FAIL = 0x01,
+    ESP_ZB_ZCL_STATUS_UNSUP_ATTRIB = 0x86,
+} esp_zb_zcl_status_t;
+
+typedef enum {
+    ESP_ZB_APS_ADDR_MODE_DST_ADDR_ENDP_NOT_PRESENT = 0x00,
+    ESP_ZB_APS_ADDR_MODE_16_ENDP_PRESENT = 0x02,
+} esp_zb_aps_address_mode_t;
+
+typedef enum {
+    ESP_ZB_ZCL_CMD_DIRECTION_TO_SRV = 0x00,
+    ESP_ZB_ZCL_CMD_DIRECTION_TO_CLI = 0x01,
+} esp_zb_zcl_cmd_direction_t;
+
+/* Data types of the specification, the value size follows from the type */
+typedef enum {
+    ESP_ZB_ZCL_ATTR_TYPE_BOOL = 0x10,
+    ESP_ZB_ZCL_ATTR_TYPE_8BITMAP = 0x18,
+    ESP_ZB_ZCL_ATTR_TYPE_16BITMAP = 0x19,
+    ESP_ZB_ZCL_ATTR_TYPE_32BITMAP = 0x1B,
+    ESP_ZB_ZCL_ATTR_TYPE_U8 = 0x20,
+    ESP_ZB_ZCL_ATTR_TYPE_U16 = 0x21,
+    ESP_ZB_ZCL_ATTR_TYPE_U24 = 0x22,
+    ESP_ZB_ZCL_ATTR_TYPE_U32 = 0x23,
+    ESP_ZB_ZCL_ATTR_TYPE_U48 = 0x25,
+    ESP_ZB_ZCL_ATTR_TYPE_S16 = 0x29,
+    ESP_ZB_ZCL_ATTR_TYPE_S32 = 0x2B,
+    ESP_ZB_ZCL_ATTR_TYPE_8BIT_ENUM = 0x30,
+    ESP_ZB_ZCL_ATTR_TYPE_OCTET_STRING = 0x41,
+    ESP_ZB_ZCL_ATTR_TYPE_CHAR_STRING = 0x42,
+    ESP_ZB_ZCL_ATTR_TYPE_LONG_OCTET_STRING = 0x43,
+} esp_zb_zcl_attr_type_t;
+
+typedef enum {
+    ESP_ZB_ZCL_ATTR_ACCESS_READ_ONLY = 0x01,
+    ESP_ZB_ZCL_ATTR_ACCESS_WRITE_ONLY = 0x02,
+    ESP_ZB_ZCL_ATTR_ACCESS_READ_WRITE = 0x03,
+    ESP_ZB_ZCL_ATTR_ACCESS_REPORTING = 0x04,
+} esp_zb_zcl_attr_access_t;
+
+/* Attributes of the standard clusters */
+enum {
+    ESP_ZB_ZCL_ATTR_BASIC_ZCL_VERSION_ID = 0x0000,
+    ESP_ZB_ZCL_ATTR_BASIC_APPLICATION_VERSION_ID = 0x0001,
+    ESP_ZB_ZCL_ATTR_BASIC_STACK_VERSION_ID = 0x0002,
+    ESP_ZB_ZCL_ATTR_BASIC_HW_VERSION_ID = 0x0003,
+    ESP_ZB_ZCL_ATTR_BASIC_MANUFACTURER_NAME_ID = 0x0004,
+    ESP_ZB_ZCL_ATTR_BASIC_MODEL_IDENTIFIER_ID = 0x0005,
+    ESP_ZB_ZCL_ATTR_BASIC_POWER_SOURCE_ID = 0x0007,
+};
+
+enum {
+    ESP_ZB_ZCL_ATTR_IDENTIFY_IDENTIFY_TIME_ID = 0x0000,
+};
+
+enum {
+    ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_MEASUREMENT_TYPE_ID = 0x0000,
+    ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_TOTAL_ACTIVE_POWER_ID = 0x0304,
+    ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_RMSVOLTAGE_ID = 0x0505,
+    ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_RMSCURRENT_ID = 0x0508,
+    ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_ACVOLTAGE_MULTIPLIER_ID = 0x0600,
+    ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_ACVOLTAGE_DIVISOR_ID = 0x0601,
+    ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_ACCURRENT_MULTIPLIER_ID = 0x0602,
+    ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_ACCURRENT_DIVISOR_ID = 0x0603,
+    ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_ACPOWER_MULTIPLIER_ID = 0x0604,
+    ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_ACPOWER_DIVISOR_ID = 0x0605,
+    ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_RMSVOLTAGE_PHB_ID = 0x0905,
+    ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_RMSCURRENT_PHB_ID = 0x0908,
+    ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_RMSVOLTAGE_PHC_ID = 0x0A05,
+    ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_RMSCURRENT_PHC_ID = 0x0A08,
+};
+
+/* Default values */
+#define ESP_ZB_ZCL_BASIC_ZCL_VERSION_DEFAULT_VALUE          0x03
+#define ESP_ZB_ZCL_BASIC_APPLICATION_VERSION_DEFAULT_VALUE  0x00
+#define ESP_ZB_ZCL_BASIC_STACK_VERSION_DEFAULT_VALUE        0x00
+#define ESP_ZB_ZCL_BASIC_HW_VERSION_DEFAULT_VALUE           0x00
+#define ESP_ZB_ZCL_IDENTIFY_IDENTIFY_TIME_DEFAULT_VALUE     0x0000
+
+/* Profile and device */
+#define ESP_ZB_AF_HA_PROFILE_ID                 0x0104
+#define ESP_ZB_HA_METER_INTERFACE_DEVICE_ID     0x0053
+
+/* Integers of the specification without native type */
+typedef struct {
+    uint32_t low;
+    uint16_t high;
+} __attribute__((packed)) esp_zb_uint48_t;
+
+typedef struct {
+    uint16_t low;
+    uint8_t high;
+} __attribute__((packed)) esp_zb_uint24_t;
+
+/* Lists of the data model, defined by host_zigbee.c */
+typedef struct esp_zb_attribute_list_s esp_zb_attribute_list_t;
+typedef struct esp_zb_cluster_list_s esp_zb_cluster_list_t;
+typedef struct esp_zb_ep_list_s esp_zb_ep_list_t;
+
+typedef struct {
+    union {
+        uint16_t addr_short;
+        uint8_t addr_long[8];
+    } dst_addr_u;
+    uint8_t dst_endpoint;
+    uint8_t src_endpoint;
+} esp_zb_zcl_basic_cmd_t;
+
+typedef struct {
+    esp_zb_zcl_basic_cmd_t zcl_basic_cmd;
+    esp_zb_aps_address_mode_t address_mode;
+    uint16_t clusterID;
+    uint16_t attributeID;
+    uint8_t cluster_role;
+} esp_zb_zcl_report_attr_cmd_t;
+
+typedef struct {
+    esp_zb_zcl_attr_type_t type;
+    uint16_t size;
+    void *value;
+} esp_zb_zcl_attribute_data_t;
+
+typedef struct {
+    esp_zb_zcl_basic_cmd_t zcl_basic_cmd;
+    esp_zb_aps_address_mode_t address_mode;
+    uint16_t profile_id;
+    uint16_t cluster_id;
+    uint8_t manuf_specific;
+    uint8_t direction;
+    uint8_t dis_default_resp;
+    uint16_t manuf_code;
+    uint8_t custom_cmd_id;
+    esp_zb_zcl_attribute_data_t data;
+} esp_zb_zcl_custom_cluster_cmd_req_t;
+
+/* APS confirm of a sent command, reported in request order */
+typedef struct {
+    uint8_t tsn;
+    uint8_t dst_endpoint;
+    uint8_t src_endpoint;
+    esp_err_t status;
+} esp_zb_zcl_command_send_status_message_t;
+
+typedef void (*esp_zb_zcl_command_send_status_callback_t)(esp_zb_zcl_command_send_status_message_t message);
+
+/* ===== NWK ===== */
+typedef uint32_t esp_zb_nwk_info_iterator_t;
+#define ESP_ZB_NWK_INFO_ITERATOR_INIT   0
+
+typedef enum {
+    ESP_ZB_NWK_RELATIONSHIP_PARENT = 0x00,
+    ESP_ZB_NWK_RELATIONSHIP_CHILD = 0x01,
+    ESP_ZB_NWK_RELATIONSHIP_SIBLING = 0x02,
+} esp_zb_nwk_relationship_t;
+
+typedef struct {
+    uint8_t ieee_addr[8];
+    uint16_t short_addr;
+    uint8_t device_type;
+    uint8_t depth;
+    uint8_t rx_on_when_idle;
+    uint8_t relationship;
+    uint8_t lqi;
+    int8_t rssi;
+    uint8_t outgoing_cost;
+    uint8_t age;
+} esp_zb_nwk_neighbor_info_t;
+
+/* ===== SCHEDULER ===== */
+typedef void (*esp_zb_callback_t)(uint8_t param);
+
+/* ===== DATA MODEL FUNCTIONS ===== */
+esp_zb_attribute_list_t *esp_zb_zcl_attr_list_create(uint16_t cluster_id);
+esp_err_t esp_zb_basic_cluster_add_attr(esp_zb_attribute_list_t *attr_list, uint16_t attr_id, void *value_p);
+esp_err_t esp_zb_identify_cluster_add_attr(esp_zb_attribute_list_t *attr_list, uint16_t attr_id, void *value_p);
+esp_err_t esp_zb_electrical_meas_cluster_add_attr(esp_zb_attribute_list_t *attr_list, uint16_t attr_id, void *value_p);
+esp_err_t esp_zb_custom_cluster_add_custom_attr(esp_zb_attribute_list_t *attr_list, uint16_t attr_id, uint8_t attr_type, uint8_t attr_access, void *value_p);
+
+esp_zb_cluster_list_t *esp_zb_zcl_cluster_list_create(void);
+esp_err_t esp_zb_cluster_list_add_basic_cluster(esp_zb_cluster_list_t *cluster_list, esp_zb_attribute_list_t *attr_list, uint8_t role_mask);
+esp_err_t esp_zb_cluster_list_add_identify_cluster(esp_zb_cluster_list_t *cluster_list, esp_zb_attribute_list_t *attr_list, uint8_t role_mask);
+esp_err_t esp_zb_cluster_list_add_electrical_meas_cluster(esp_zb_cluster_list_t *cluster_list, esp_zb_attribute_list_t *attr_list, uint8_t role_mask);
+esp_err_t esp_zb_cluster_list_add_custom_cluster(esp_zb_cluster_list_t *cluster_list, esp_zb_attribute_list_t *attr_list, uint8_t role_mask);
+
+esp_zb_ep_list_t *esp_zb_ep_list_create(void);
+esp_err_t esp_zb_ep_list_add_ep(esp_zb_ep_list_t *ep_list, esp_zb_cluster_list_t *cluster_list, uint8_t endpoint, uint16_t profile_id, uint16_t device_id);
+esp_err_t esp_zb_device_register(esp_zb_ep_list_t *ep_list);
+
+/* ===== ZCL FUNCTIONS ===== */
+/**
+ * @brief Write value of a registered attribute, size follows from the type of the attribute
+ *
+ * @return esp_zb_zcl_status_t ESP_ZB_ZCL_STATUS_UNSUP_ATTRIB if the attribute doesn't exist
+ */
+esp_zb_zcl_status_t esp_zb_zcl_set_attribute_val(uint8_t endpoint, uint16_t cluster_id, uint8_t cluster_role, uint16_t attr_id, void *value_p, bool check);
+
+/**
+ * @brief Record report of one attribute to the bound device
+ *
+ * @return esp_zb_zcl_status_t ESP_ZB_ZCL_STATUS_UNSUP_ATTRIB if the attribute doesn't exist
+ */
+esp_zb_zcl_status_t esp_zb_zcl_report_attr_cmd_req(esp_zb_zcl_report_attr_cmd_t *cmd_req);
+
+/**
+ * @brief Record command to the bound device, payloads larger than HOST_ZIGBEE_APS_MAX_PAYLOAD are fragmented
+ */
+esp_err_t esp_zb_zcl_custom_cluster_cmd_req(esp_zb_zcl_custom_cluster_cmd_req_t *cmd_req);
+
+/**
+ * @brief Register callback for the send status of every request, called before the request returns
+ */
+void esp_zb_zcl_command_send_status_handler_register(esp_zb_zcl_command_send_status_callback_t cb);
+
+/* ===== NWK AND SCHEDULER FUNCTIONS ===== */
+esp_err_t esp_zb_nwk_get_next_neighbor(esp_zb_nwk_info_iterator_t *iterator, esp_zb_nwk_neighbor_info_t *nbr_info);
+bool esp_zb_bdb_dev_joined(void);
+
+/**
+ * @brief Run callback after time_ms of virtual time, see host_zigbee_advance
+ */
+void esp_zb_scheduler_alarm(esp_zb_callback_t cb, uint8_t param, uint32_t time_ms);
+
+/* ===== HOST FUNCTIONS ===== */
+typedef enum {
+    HOST_ZIGBEE_FRAME_REPORT,           /* < Attribute report */
+    HOST_ZIGBEE_FRAME_COMMAND,          /* < Cluster specific command */
+} host_zigbee_frame_type_t;
+
+/* One frame on air, a fragmented command is recorded as one frame per fragment */
+typedef struct {
+    uint32_t time_ms;                   /* < Virtual time of the request */
+    host_zigbee_frame_type_t type;
+    uint16_t cluster_id;
+    uint16_t id;                        /* < Attribute of a report, command of a command */
+    uint8_t fragment;                   /* < Index of fragment */
+    uint8_t fragment_count;             /* < 1 if not fragmented */
+    uint16_t payload_size;              /* < ZCL bytes in this frame */
+    uint16_t size;                      /* < Bytes on air without PHY header */
+} host_zigbee_frame_t;
+
+/* Totals since start or host_zigbee_reset_stats */
+typedef struct {
+    uint32_t requests;                  /* < Reports and commands */
+    uint32_t frames;                    /* < Frames on air, fragments counted separately */
+    uint64_t payload_bytes;             /* < ZCL bytes */
+    uint64_t bytes;                     /* < Bytes on air without PHY header */
+    uint32_t rejected;                  /* < Requests for attributes which don't exist */
+    uint32_t send_failures;             /* < Requests with failed send status */
+} host_zigbee_stats_t;
+
+typedef void (*host_zigbee_frame_cb_t)(const host_zigbee_frame_t *frame);
+
+/**
+ * @brief Register callback for every recorded frame, NULL to only count
+ */
+void host_zigbee_set_frame_cb(host_zigbee_frame_cb_t frame_cb);
+
+/**
+ * @brief Advance virtual time and run due scheduler alarms in order
+ *
+ * @param time_ms new virtual time, not earlier than the current one
+ */
+void host_zigbee_advance(uint32_t time_ms);
+
+/**
+ * @brief Replace neighbor table by a parent with the given link quality, joined is set too
+ */
+void host_zigbee_set_parent(uint8_t lqi, int8_t rssi);
+
+/**
+ * @brief Let the given share of requests fail with ESP_FAIL in their send status, 0 for a perfect link
+ *
+ * @param percent 0 to 100, failed requests are drawn from a fixed seed to be reproducible
+ */
+void host_zigbee_set_send_failure_percent(uint8_t percent);
+
+/**
+ * @brief Read value of a registered attribute
+ *
+ * @param value output, at least HOST_ZIGBEE_MAX_VALUE_SIZE bytes
+ * @return size_t size of value, 0 if the attribute doesn't exist
+ */
+size_t host_zigbee_get_attribute(uint8_t endpoint, uint16_t cluster_id, uint8_t cluster_role, uint16_t attr_id, void *value);
+
+void host_zigbee_get_stats(host_zigbee_stats_t *stats);
+void host_zigbee_reset_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,32 @@
+/**
+ * @file FreeRTOS.h
+ * @brief Host replacement of the FreeRTOS types used by the components, tasks are threads, one tick is one millisecond
+ * @copyright Copyright (c) 2023
+ * 
+ */
+
+// Multiple inclusion protection
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdFALSE                         0
+#define pdTRUE                          1
+#define pdFAIL                          pdFALSE
+#define pdPASS                          pdTRUE
+
+#define portMAX_DELAY                   UINT32_MAX
+#define portTICK_PERIOD_MS              1
+#define pdMS_TO_TICKS(ms)               ((TickType_t)(ms))
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,49 @@
+/**
+ * @file queue.h
+ * @brief Host replacement of the FreeRTOS queues, a ring of items with mutex and condition variable
+ * @copyright Copyright (c) 2023
+ * 
+ */
+
+// Multiple inclusion protection
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_queue* QueueHandle_t;
+
+/**
+ * @brief Create queue
+ * 
+ * @return QueueHandle_t NULL if out of memory
+ */
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+
+/**
+ * @brief Copy item to back of queue, wait up to ticks while full
+ * 
+ * @return BaseType_t pdTRUE if item was queued
+ */
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks);
+
+/**
+ * @brief Copy item from front of queue, wait up to ticks while empty
+ * 
+ * @return BaseType_t pdTRUE if an item was received
+ */
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks);
+
+/**
+ * @brief Drop all items
+ * 
+ * @return BaseType_t always pdPASS
+ */
+BaseType_t xQueueReset(QueueHandle_t queue);
+
+#ifdef __cplusplus
+}
+#endif
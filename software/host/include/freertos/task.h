@@ -0,0 +1,39 @@
+/**
+ * @file task.h
+ * @brief Host replacement of the FreeRTOS tasks, each task is a detached thread, priorities are ignored
+ * @copyright Copyright (c) 2023
+ * 
+ */
+
+// Multiple inclusion protection
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "freertos/FreeRTOS.h"
+
+typedef void (* TaskFunction_t)(void *pvParameters);
+typedef struct host_task* TaskHandle_t;
+
+/**
+ * @brief Start task as thread
+ * 
+ * @return BaseType_t pdPASS or pdFAIL
+ */
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stack_size, void *parameters, UBaseType_t priority, TaskHandle_t *handle);
+
+/**
+ * @brief End calling task, other tasks can't be deleted
+ */
+void vTaskDelete(TaskHandle_t task);
+
+/**
+ * @brief Sleep for ticks
+ */
+void vTaskDelay(TickType_t ticks);
+
+#ifdef __cplusplus
+}
+#endif
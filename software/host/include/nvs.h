@@ -0,0 +1,46 @@
+/**
+ * @file nvs.h
+ * @brief Host replacement of the ESP-IDF non volatile storage, blobs are kept in memory
+ * @copyright Copyright (c) 2023
+ * 
+ */
+
+// Multiple inclusion protection
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+/* ===== HOST NVS CONFIGURATION ===== */
+#define HOST_NVS_MAX_ENTRIES            16          /* < Blobs of all namespaces */
+#define HOST_NVS_MAX_BLOB_SIZE          512
+#define HOST_NVS_KEY_LENGTH             16          /* < Including terminator, like NVS_KEY_NAME_MAX_SIZE */
+
+/* Same values as ESP-IDF */
+#define ESP_ERR_NVS_NOT_FOUND           0x1102
+
+typedef uint32_t nvs_handle_t;
+
+typedef enum {
+    NVS_READONLY,
+    NVS_READWRITE
+} nvs_open_mode_t;
+
+/**
+ * @brief Open namespace, read only fails while the namespace has no entries, like on target
+ */
+esp_err_t nvs_open(const char *namespace_name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle);
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length);
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length);
+esp_err_t nvs_commit(nvs_handle_t handle);
+void nvs_close(nvs_handle_t handle);
+
+#ifdef __cplusplus
+}
+#endif
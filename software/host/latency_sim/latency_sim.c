@@ -0,0 +1,384 @@
+/**
+ * @file latency_sim.c
+ * @brief Checks the end-to-end latency budget of the combined firmware on the host
+ * 
+ * Decoding is measured with the real parser and scaled by the speed difference of host and target.
+ * Handoff and radio transmission are simulated with the timing of the firmware and IEEE 802.15.4.
+ * The decoding stages are also marked with the latency trace of the firmware, its histograms and the
+ * overhead of one mark are printed.
+ * 
+ * @copyright Copyright (c) 2023
+ * 
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "telegram.h"
+#include "obis.h"
+#include "meter_convert.h"
+#include "latency_budget.h"
+#include "latency_trace.h"
+
+/* ===== SIMULATION CONFIGURATION ===== */
+#define SIM_DEFAULT_ITERATIONS          10000       /* < Number of simulated telegrams */
+#define SIM_DEFAULT_CPU_SCALE           30.0        /* < ESP32-C6 at 160 MHz with software AES compared to a desktop CPU */
+#define SIM_DEFAULT_RETRY_PROBABILITY   0.1         /* < Probability that a frame is not acknowledged */
+#define SIM_DEFAULT_BUSY_PROBABILITY    0.05        /* < Probability that clear channel assessment fails */
+#define SIM_MAX_TELEGRAMS               16          /* < Maximum number of telegrams loaded from file */
+#define SIM_TRACE_OVERHEAD_MARKS        1000000     /* < Marks to measure overhead of latency trace */
+
+/* IEEE 802.15.4 at 2.4 GHz */
+#define RADIO_BYTE_US                   32          /* < 250 kbit/s */
+#define RADIO_PHY_HEADER_BYTES          6           /* < Preamble, SFD and length */
+#define RADIO_UNIT_BACKOFF_US           320         /* < aUnitBackoffPeriod */
+#define RADIO_CCA_US                    128         /* < Clear channel assessment */
+#define RADIO_TURNAROUND_US             192         /* < aTurnaroundTime */
+#define RADIO_ACK_BYTES                 5           /* < MAC acknowledgement */
+#define RADIO_ACK_WAIT_US               864         /* < macAckWaitDuration */
+#define RADIO_MIN_BE                    3           /* < macMinBE */
+#define RADIO_MAX_BE                    5           /* < macMaxBE */
+#define RADIO_MAX_CSMA_BACKOFFS         4           /* < macMaxCSMABackoffs */
+#define RADIO_MAX_FRAME_RETRIES         3           /* < macMaxFrameRetries */
+
+/* Zigbee frames */
+#define ZB_REPORT_FRAME_BYTES           48          /* < MAC, NWK, APS and ZCL header with one attribute */
+#define ZB_FRAGMENT_PAYLOAD_BYTES       82          /* < APS payload of one fragment */
+#define ZB_FRAGMENT_OVERHEAD_BYTES      45          /* < Headers of one fragment */
+#define ZB_REPORT_COUNT                 9           /* < Power, 3 voltages, 3 currents, 2 summations */
+#define ZB_STACK_PROCESSING_US          2000        /* < Processing of one request in the zigbee stack */
+
+/* Latency of the stages of one telegram in microseconds */
+typedef struct {
+    double rx_idle;
+    double decode;
+    double handoff;
+    double radio;
+    double total;
+} sim_sample_t;
+
+/* ===== HELPER FUNCTIONS ===== */
+static double now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec / 1e3;
+}
+
+static double random_uniform()
+{
+    return (double)rand() / ((double)RAND_MAX + 1.0);
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* Transmission of one frame with unslotted CSMA-CA and MAC retries, returns time in us */
+static double simulate_frame(size_t frame_bytes, double retry_probability, double busy_probability)
+{
+    double time_us = ZB_STACK_PROCESSING_US;
+
+    for(int attempt = 0; attempt <= RADIO_MAX_FRAME_RETRIES; attempt++)
+    {
+        /* Random backoff until channel is clear */
+        int be = RADIO_MIN_BE;
+        for(int backoff = 0; backoff <= RADIO_MAX_CSMA_BACKOFFS; backoff++)
+        {
+            time_us += (double)(rand() % (1 << be)) * RADIO_UNIT_BACKOFF_US + RADIO_CCA_US;
+            if(random_uniform() >= busy_probability){ break; }
+            if(be < RADIO_MAX_BE){ be++; }
+        }
+
+        /* Frame and acknowledgement */
+        time_us += RADIO_TURNAROUND_US + (double)(RADIO_PHY_HEADER_BYTES + frame_bytes) * RADIO_BYTE_US;
+        if(random_uniform() >= retry_probability)
+        {
+            time_us += RADIO_TURNAROUND_US + (double)(RADIO_PHY_HEADER_BYTES + RADIO_ACK_BYTES) * RADIO_BYTE_US;
+            break;
+        }
+        time_us += RADIO_ACK_WAIT_US;
+    }
+    return time_us;
+}
+
+/* Attribute reports and bulk snapshot, returns time in us */
+static double simulate_radio(size_t bulk_size, double retry_probability, double busy_probability)
+{
+    double time_us = 0;
+
+    for(int i = 0; i < ZB_REPORT_COUNT; i++)
+    {
+        time_us += simulate_frame(ZB_REPORT_FRAME_BYTES, retry_probability, busy_probability);
+    }
+
+    /* Long octet string is fragmented by the APS layer */
+    size_t remaining = bulk_size + 2;
+    while(remaining > 0)
+    {
+        size_t fragment = remaining > ZB_FRAGMENT_PAYLOAD_BYTES ? ZB_FRAGMENT_PAYLOAD_BYTES : remaining;
+        time_us += simulate_frame(fragment + ZB_FRAGMENT_OVERHEAD_BYTES, retry_probability, busy_probability);
+        remaining -= fragment;
+    }
+    return time_us;
+}
+
+/* Largest bulk snapshot must fit into the payload buffer of the firmware and nothing smaller */
+static bool check_bulk_worst_case()
+{
+    static zb_bulk_snapshot_t bulk;
+    static zb_bulk_snapshot_t decoded;
+    static uint8_t payload[ZB_BULK_MAX_PAYLOAD_SIZE];
+
+    /* Full OBIS codes and values with the longest varint */
+    memset(&bulk, 0, sizeof(bulk));
+    bulk.serial_number_length = ZB_BULK_SERIAL_NUMBER_MAX_LENGTH;
+    bulk.register_count = ZB_BULK_MAX_REGISTERS;
+    for(uint8_t i = 0; i < ZB_BULK_MAX_REGISTERS; i++)
+    {
+        zb_bulk_register_t *reg = &bulk.registers[i];
+        memcpy(reg->obis_code, (const uint8_t[]){0x00, 0x00, 0x60, 0x01, i, 0x00}, sizeof(reg->obis_code));
+        reg->value = i % 2 == 0 ? INT64_MIN : INT64_MAX;
+    }
+
+    size_t size = zb_bulk_encode(&bulk, payload, sizeof(payload));
+    if(size != ZB_BULK_MAX_PAYLOAD_SIZE || zb_bulk_decode(payload, size, &decoded) != ESP_OK
+       || memcmp(decoded.registers, bulk.registers, sizeof(bulk.registers)) != 0)
+    {
+        fprintf(stderr, "Bulk snapshot of worst case encoded to %zu bytes, expected %d\n", size, ZB_BULK_MAX_PAYLOAD_SIZE);
+        return false;
+    }
+
+    /* Encoding fails explicitly if the buffer is too small */
+    if(zb_bulk_encode(&bulk, payload, sizeof(payload) - 1) != 0)
+    {
+        fprintf(stderr, "Bulk snapshot encoded into too small buffer\n");
+        return false;
+    }
+    return true;
+}
+
+static void print_stage(const char *name, double *values, size_t count, double budget_ms)
+{
+    qsort(values, count, sizeof(double), compare_double);
+    printf("%-10s %10.2f %10.2f %10.2f %10.0f\n", name,
+           values[count / 2] / 1000.0, values[(count * 99) / 100] / 1000.0, values[count - 1] / 1000.0, budget_ms);
+}
+
+static void print_usage(const char *name)
+{
+    printf("Usage: %s [-n iterations] [-s cpu scale] [-r retry probability] [-b busy probability] [-f plaintext file] [-v]\n", name);
+}
+
+/* ===== MAIN ===== */
+int main(int argc, char **argv)
+{
+    size_t iterations = SIM_DEFAULT_ITERATIONS;
+    double cpu_scale = SIM_DEFAULT_CPU_SCALE;
+    double retry_probability = SIM_DEFAULT_RETRY_PROBABILITY;
+    double busy_probability = SIM_DEFAULT_BUSY_PROBABILITY;
+    const char *path = HOST_DATA_DIR "/sample_plaintext.hex";
+    bool verbose = false;
+
+    int opt;
+    while((opt = getopt(argc, argv, "n:s:r:b:f:vh")) != -1)
+    {
+        switch(opt)
+        {
+            case 'n': iterations = (size_t)strtoul(optarg, NULL, 10); break;
+            case 's': cpu_scale = strtod(optarg, NULL); break;
+            case 'r': retry_probability = strtod(optarg, NULL); break;
+            case 'b': busy_probability = strtod(optarg, NULL); break;
+            case 'f': path = optarg; break;
+            case 'v': verbose = true; break;
+            default: print_usage(argv[0]); return 2;
+        }
+    }
+    if(iterations == 0)
+    {
+        print_usage(argv[0]);
+        return 2;
+    }
+
+    /* Telegrams as sent by the meter */
+    static telegram_plaintext_t plaintexts[SIM_MAX_TELEGRAMS];
+    size_t plaintext_count = telegram_load_hex_file(path, plaintexts, SIM_MAX_TELEGRAMS);
+    if(plaintext_count == 0)
+    {
+        fprintf(stderr, "No telegrams loaded from %s\n", path);
+        return 2;
+    }
+
+    sim_sample_t *samples = calloc(iterations, sizeof(sim_sample_t));
+    double *values = calloc(iterations, sizeof(double));
+    if(samples == NULL || values == NULL)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 2;
+    }
+
+    if(!check_bulk_worst_case()){ return 1; }
+
+    telegram_params_t params;
+    telegram_default_params(&params);
+    srand(1);
+
+    for(size_t i = 0; i < iterations; i++)
+    {
+        static uint8_t telegram[TELEGRAM_MAX_SIZE];
+        static obis_data_t obis_result;
+        static zb_electricity_meter_snapshot_t snapshot;
+        static zb_bulk_snapshot_t bulk;
+        static uint8_t bulk_payload[ZB_BULK_MAX_PAYLOAD_SIZE];
+
+        /* Changing measurement with new frame counter */
+        telegram_plaintext_t plaintext = plaintexts[i % plaintext_count];
+        telegram_set_register(&plaintext, 1, 7, (uint64_t)(rand() % 10000));
+        params.frame_counter++;
+        size_t telegram_size = telegram_build(&params, plaintext.data, plaintext.size, telegram, sizeof(telegram));
+        if(telegram_size == 0)
+        {
+            fprintf(stderr, "Building telegram failed\n");
+            return 2;
+        }
+
+        /* Same decoding chain as uart event task and meter bridge, in place in a frame of the pool */
+        frame_t *frame = frame_pool_take();
+        memcpy(frame->data, telegram, telegram_size);
+        frame->size = telegram_size;
+        size_t user_data_size = 0;
+        latency_trace_mark(LATENCY_STAGE_FIRST_BYTE);
+        latency_trace_mark(LATENCY_STAGE_TELEGRAM_COMPLETE);
+        double start_us = now_us();
+        esp_err_t err = parse_mbus_long_frame_layer(frame->data, frame->size, frame->data, &user_data_size);
+        if(err == ESP_OK)
+        {
+            latency_trace_mark(LATENCY_STAGE_MBUS_PARSED);
+            err = parse_dlms_layer(frame->data, user_data_size, &frame->offset, &frame->size, decryption_key);
+        }
+        if(err == ESP_OK)
+        {
+            latency_trace_mark(LATENCY_STAGE_DECRYPTED);
+            err = parse_obis(&frame->data[frame->offset], frame->size, &obis_result);
+        }
+        frame_pool_give(frame);
+        if(err == ESP_OK)
+        {
+            latency_trace_mark(LATENCY_STAGE_OBIS_DECODED);
+            meter_convert_snapshot(&obis_result, &snapshot);
+            meter_convert_bulk(&obis_result, &bulk);
+            latency_trace_mark(LATENCY_STAGE_REPORT_QUEUED);
+            latency_trace_mark(LATENCY_STAGE_REPORT_CONFIRMED);
+        }
+        double decode_us = (now_us() - start_us) * cpu_scale;
+        if(err != ESP_OK)
+        {
+            fprintf(stderr, "Decoding telegram %zu failed\n", i);
+            return 2;
+        }
+
+        size_t bulk_size = zb_bulk_encode(&bulk, bulk_payload, sizeof(bulk_payload));
+
+        /* Values of first telegram, to check conversion */
+        if(verbose && i == 0)
+        {
+            printf("Power %d W, voltage %u %u %u (0.1 V), current %u %u %u (0.01 A), energy %llu %llu Wh, bulk %zu bytes\n",
+                   (int)snapshot.total_active_power, snapshot.rms_voltage[0], snapshot.rms_voltage[1], snapshot.rms_voltage[2],
+                   snapshot.rms_current[0], snapshot.rms_current[1], snapshot.rms_current[2],
+                   (unsigned long long)snapshot.summation_delivered, (unsigned long long)snapshot.summation_received, bulk_size);
+        }
+
+        /* Telegram is decoded at a random point of the poll interval of the zigbee task */
+        sim_sample_t *sample = &samples[i];
+        sample->rx_idle = (double)LATENCY_BUDGET_RX_IDLE_MS * 1000.0;
+        sample->decode = decode_us;
+        sample->handoff = random_uniform() * METER_BRIDGE_POLL_INTERVAL_MS * 1000.0;
+        sample->radio = simulate_radio(bulk_size, retry_probability, busy_probability);
+        sample->total = sample->rx_idle + sample->decode + sample->handoff + sample->radio;
+    }
+
+    /* Statistics of each stage */
+    printf("Latency of %zu telegrams (cpu scale %.1f, retry probability %.2f, busy probability %.2f)\n",
+           iterations, cpu_scale, retry_probability, busy_probability);
+    printf("%-10s %10s %10s %10s %10s\n", "stage", "p50 ms", "p99 ms", "max ms", "budget ms");
+
+    int exceeded = 0;
+    const struct {
+        const char *name;
+        size_t offset;
+        double budget_ms;
+    } stages[] = {
+        {"rx idle", offsetof(sim_sample_t, rx_idle), LATENCY_BUDGET_RX_IDLE_MS},
+        {"decode", offsetof(sim_sample_t, decode), LATENCY_BUDGET_DECODE_MS},
+        {"handoff", offsetof(sim_sample_t, handoff), LATENCY_BUDGET_HANDOFF_MS},
+        {"radio", offsetof(sim_sample_t, radio), LATENCY_BUDGET_RADIO_MS},
+        {"total", offsetof(sim_sample_t, total), LATENCY_BUDGET_TOTAL_MS},
+    };
+    for(size_t s = 0; s < sizeof(stages) / sizeof(stages[0]); s++)
+    {
+        for(size_t i = 0; i < iterations; i++)
+        {
+            values[i] = *(const double *)((const uint8_t *)&samples[i] + stages[s].offset);
+        }
+        print_stage(stages[s].name, values, iterations, stages[s].budget_ms);
+
+        /* Max of measured decoding depends on host load, it is only printed */
+        if(values[(iterations * 99) / 100] > stages[s].budget_ms * 1000.0)
+        {
+            exceeded = 1;
+        }
+    }
+
+    /* Every stage of every telegram is in the histograms */
+    latency_trace_histograms_t histograms;
+    latency_trace_get(&histograms);
+    for(int stage = 0; stage < LATENCY_STAGE_COUNT; stage++)
+    {
+        uint32_t count = 0;
+        for(int i = 0; i < LATENCY_TRACE_BUCKETS; i++)
+        {
+            count += histograms.buckets[stage][i];
+        }
+        if(count != (iterations < UINT16_MAX ? iterations : UINT16_MAX))
+        {
+            fprintf(stderr, "Histogram of %s has %lu samples\n", latency_trace_stage_name((latency_stage_t)stage), (unsigned long)count);
+            exceeded = 1;
+        }
+    }
+    uint8_t encoded[LATENCY_TRACE_ENCODED_SIZE];
+    if(latency_trace_encode(encoded, sizeof(encoded)) != LATENCY_TRACE_ENCODED_SIZE)
+    {
+        fprintf(stderr, "Encoding histograms failed\n");
+        exceeded = 1;
+    }
+    if(verbose)
+    {
+        printf("Latency trace measured on host, not scaled:\n");
+        fflush(stdout);
+        host_log_level = HOST_LOG_INFO;
+        latency_trace_log();
+        host_log_level = HOST_LOG_ERROR;
+        fflush(stderr);
+    }
+
+    /* Overhead of one mark, first byte resets the trace so the other stages are recorded */
+    double start_us = now_us();
+    for(size_t i = 0; i < SIM_TRACE_OVERHEAD_MARKS; i++)
+    {
+        latency_trace_mark((latency_stage_t)(i % LATENCY_STAGE_COUNT));
+    }
+    double mark_ns = (now_us() - start_us) * 1000.0 / SIM_TRACE_OVERHEAD_MARKS;
+    printf("Latency trace: %.1f ns per mark on host including clock read, %zu bytes of histograms\n", mark_ns, sizeof(latency_trace_histograms_t));
+
+    free(samples);
+    free(values);
+
+    printf("Budget %s\n", exceeded ? "EXCEEDED" : "met");
+    return exceeded;
+}
@@ -0,0 +1,332 @@
+/**
+ * @file meter_sim.c
+ * @brief Simulates a meter on a pseudo terminal, sends encrypted telegrams like a Sagemcom T210-D
+ *
+ * Each telegram is a DataNotification of the corpus with changing power and energy, encrypted with
+ * AES-GCM and split into M-Bus long frames. The bytes are paced with the baud rate, faults are injected
+ * per telegram or byte. The host build of the uart front end, uart_frontend, or any other program reads
+ * the other end of the pseudo terminal as if it was the meter.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "telegram.h"
+
+/* ===== SIMULATOR CONFIGURATION ===== */
+#define SIM_MAX_TELEGRAMS               16          /* < Maximum number of telegrams loaded from file */
+#define SIM_MAX_REGISTERS               16          /* < Maximum number of fixed registers */
+#define SIM_DEFAULT_PERIOD_MS           5000        /* < Sagemcom T210-D sends every 5 seconds */
+#define SIM_DEFAULT_GAP_MS              100         /* < Length of an injected gap */
+#define SIM_WRITE_BLOCK                 16          /* < Bytes written at once, pacing resolution */
+#define SIM_BITS_PER_BYTE               11          /* < 8E1 */
+
+/* Register with fixed value, value group C.D */
+typedef struct {
+    uint8_t c;
+    uint8_t d;
+    uint64_t value;
+} sim_register_t;
+
+/* Settings */
+typedef struct {
+    telegram_params_t params;
+    sim_register_t registers[SIM_MAX_REGISTERS];
+    size_t register_count;
+    uint32_t period_ms;
+    uint32_t baud_rate;                 /* < 0 writes without pacing */
+    size_t count;                       /* < 0 sends until interrupted */
+    double bit_error_probability;       /* < Per byte */
+    double truncate_probability;        /* < Per telegram */
+    double gap_probability;             /* < Per telegram */
+    uint32_t gap_ms;
+} sim_config_t;
+
+/* Statistics */
+typedef struct {
+    size_t telegrams;
+    size_t bytes;
+    size_t dropped_bytes;               /* < Not taken by the pseudo terminal, the reader is too slow or missing */
+    size_t bit_errors;
+    size_t truncated;
+    size_t gaps;
+} sim_stats_t;
+
+static volatile sig_atomic_t running = 1;
+
+/* ===== HELPER FUNCTIONS ===== */
+static void print_usage(const char *name)
+{
+    printf("Usage: %s [-l link] [-p period ms] [-b baud] [-n telegrams] [-t plaintext file]\n", name);
+    printf("          [-k key hex] [-s system title hex] [-r C.D=value]...\n");
+    printf("          [-e bit error probability] [-x truncate probability] [-g gap probability] [-G gap ms]\n");
+    printf("  -b 0 writes without pacing, -n 0 sends until interrupted\n");
+}
+
+static void stop(int signal)
+{
+    running = 0;
+}
+
+static double random_uniform()
+{
+    return (double)rand() / ((double)RAND_MAX + 1.0);
+}
+
+static int parse_hex(const char *hex, uint8_t *data, size_t size)
+{
+    if(strlen(hex) != size * 2){ return -1; }
+    for(size_t i = 0; i < size; i++)
+    {
+        unsigned int byte;
+        if(sscanf(&hex[i * 2], "%2x", &byte) != 1){ return -1; }
+        data[i] = (uint8_t)byte;
+    }
+    return 0;
+}
+
+static int parse_register(const char *text, sim_register_t *reg)
+{
+    unsigned int c, d;
+    unsigned long long value;
+    if(sscanf(text, "%u.%u=%llu", &c, &d, &value) != 3 || c > UINT8_MAX || d > UINT8_MAX){ return -1; }
+    reg->c = (uint8_t)c;
+    reg->d = (uint8_t)d;
+    reg->value = value;
+    return 0;
+}
+
+static void add_ns(struct timespec *ts, uint64_t ns)
+{
+    ns += (uint64_t)ts->tv_nsec;
+    ts->tv_sec += (time_t)(ns / 1000000000ULL);
+    ts->tv_nsec = (long)(ns % 1000000000ULL);
+}
+
+static void sleep_until(const struct timespec *ts)
+{
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, ts, NULL) == EINTR && running){ }
+}
+
+/* ===== SENDING ===== */
+/* Write bytes with the timing of the line, starting at time */
+static void send_bytes(int fd, const uint8_t *data, size_t size, uint32_t baud_rate, struct timespec *time, sim_stats_t *stats)
+{
+    uint64_t byte_ns = baud_rate > 0 ? 1000000000ULL * SIM_BITS_PER_BYTE / baud_rate : 0;
+    for(size_t offset = 0; offset < size && running; offset += SIM_WRITE_BLOCK)
+    {
+        size_t block = size - offset < SIM_WRITE_BLOCK ? size - offset : SIM_WRITE_BLOCK;
+
+        /* A meter doesn't wait for the receiver */
+        ssize_t written = write(fd, &data[offset], block);
+        if(written < 0){ written = 0; }
+        stats->bytes += (size_t)written;
+        stats->dropped_bytes += block - (size_t)written;
+
+        add_ns(time, byte_ns * block);
+        if(byte_ns > 0){ sleep_until(time); }
+    }
+}
+
+static void send_telegram(int fd, const sim_config_t *config, uint8_t *telegram, size_t size, struct timespec *time, sim_stats_t *stats)
+{
+    /* Bit errors on the line, not detected by the pseudo terminal */
+    if(config->bit_error_probability > 0.0)
+    {
+        for(size_t i = 0; i < size; i++)
+        {
+            if(random_uniform() < config->bit_error_probability)
+            {
+                telegram[i] ^= (uint8_t)(1u << (rand() % 8));
+                stats->bit_errors++;
+            }
+        }
+    }
+
+    /* Meter stops in the middle of a telegram */
+    if(random_uniform() < config->truncate_probability)
+    {
+        size = 1 + (size_t)rand() % (size - 1);
+        stats->truncated++;
+    }
+
+    /* Pause in the middle of a telegram */
+    size_t gap_offset = size;
+    if(random_uniform() < config->gap_probability)
+    {
+        gap_offset = 1 + (size_t)rand() % (size - 1);
+        stats->gaps++;
+    }
+
+    send_bytes(fd, telegram, gap_offset, config->baud_rate, time, stats);
+    if(gap_offset < size)
+    {
+        add_ns(time, (uint64_t)config->gap_ms * 1000000ULL);
+        sleep_until(time);
+        send_bytes(fd, &telegram[gap_offset], size - gap_offset, config->baud_rate, time, stats);
+    }
+    stats->telegrams++;
+}
+
+/* Master side of a new pseudo terminal, path of the other side is returned */
+static int open_pty(const char *link, char *path, size_t path_size)
+{
+    int fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if(fd < 0 || grantpt(fd) != 0 || unlockpt(fd) != 0 || ptsname_r(fd, path, path_size) != 0)
+    {
+        return -1;
+    }
+
+    /* Raw bytes on both sides, writes never block */
+    struct termios tio;
+    if(tcgetattr(fd, &tio) == 0)
+    {
+        cfmakeraw(&tio);
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    if(link != NULL)
+    {
+        unlink(link);
+        if(symlink(path, link) != 0)
+        {
+            fprintf(stderr, "Cannot create link %s\n", link);
+        }
+    }
+    return fd;
+}
+
+int main(int argc, char **argv)
+{
+    static sim_config_t config;
+    telegram_default_params(&config.params);
+    config.period_ms = SIM_DEFAULT_PERIOD_MS;
+    config.baud_rate = UART_BAUD_RATE;
+    config.gap_ms = SIM_DEFAULT_GAP_MS;
+    const char *path = HOST_DATA_DIR "/sample_plaintext.hex";
+    const char *link = NULL;
+
+    int opt;
+    while((opt = getopt(argc, argv, "l:p:b:n:t:k:s:r:e:x:g:G:h")) != -1)
+    {
+        switch(opt)
+        {
+            case 'l': link = optarg; break;
+            case 'p': config.period_ms = (uint32_t)strtoul(optarg, NULL, 10); break;
+            case 'b': config.baud_rate = (uint32_t)strtoul(optarg, NULL, 10); break;
+            case 'n': config.count = (size_t)strtoul(optarg, NULL, 10); break;
+            case 't': path = optarg; break;
+            case 'k':
+                if(parse_hex(optarg, config.params.key, GUE_KEY_LENGTH) != 0){ print_usage(argv[0]); return 2; }
+                break;
+            case 's':
+                if(parse_hex(optarg, config.params.system_title, TELEGRAM_SYSTEM_TITLE_LENGTH) != 0){ print_usage(argv[0]); return 2; }
+                break;
+            case 'r':
+                if(config.register_count == SIM_MAX_REGISTERS || parse_register(optarg, &config.registers[config.register_count]) != 0)
+                {
+                    print_usage(argv[0]);
+                    return 2;
+                }
+                config.register_count++;
+                break;
+            case 'e': config.bit_error_probability = strtod(optarg, NULL); break;
+            case 'x': config.truncate_probability = strtod(optarg, NULL); break;
+            case 'g': config.gap_probability = strtod(optarg, NULL); break;
+            case 'G': config.gap_ms = (uint32_t)strtoul(optarg, NULL, 10); break;
+            default: print_usage(argv[0]); return 2;
+        }
+    }
+
+    static telegram_plaintext_t plaintexts[SIM_MAX_TELEGRAMS];
+    size_t plaintext_count = telegram_load_hex_file(path, plaintexts, SIM_MAX_TELEGRAMS);
+    if(plaintext_count == 0)
+    {
+        fprintf(stderr, "No telegrams loaded from %s\n", path);
+        return 2;
+    }
+
+    char pty[64];
+    int fd = open_pty(link, pty, sizeof(pty));
+    if(fd < 0)
+    {
+        fprintf(stderr, "Cannot open pseudo terminal\n");
+        return 2;
+    }
+    printf("Meter on %s%s%s, %u baud, every %u ms\n", pty, link != NULL ? " linked as " : "", link != NULL ? link : "",
+           config.baud_rate, config.period_ms);
+    fflush(stdout);
+
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
+    srand(1);
+
+    sim_stats_t stats = {0};
+    uint64_t energy = 0;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    struct timespec next = start;
+    for(size_t i = 0; running && (config.count == 0 || i < config.count); i++)
+    {
+        static uint8_t telegram[TELEGRAM_MAX_SIZE];
+
+        /* Power changes, energy counts up with it */
+        telegram_plaintext_t plaintext = plaintexts[i % plaintext_count];
+        uint64_t power = (uint64_t)(rand() % 10000);
+        energy += power * config.period_ms / 3600000 + 1;
+        telegram_set_register(&plaintext, 1, 7, power);
+        telegram_set_register(&plaintext, 1, 8, energy);
+        for(size_t r = 0; r < config.register_count; r++)
+        {
+            if(telegram_set_register(&plaintext, config.registers[r].c, config.registers[r].d, config.registers[r].value) != 0)
+            {
+                fprintf(stderr, "Register %u.%u not in telegram\n", config.registers[r].c, config.registers[r].d);
+                return 2;
+            }
+        }
+
+        config.params.frame_counter++;
+        size_t size = telegram_build(&config.params, plaintext.data, plaintext.size, telegram, sizeof(telegram));
+        if(size < 2)
+        {
+            fprintf(stderr, "Building telegram failed\n");
+            return 2;
+        }
+
+        /* Telegrams start every period, back to back if the line is slower */
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if(now.tv_sec > next.tv_sec || (now.tv_sec == next.tv_sec && now.tv_nsec > next.tv_nsec)){ next = now; }
+        struct timespec time = next;
+        sleep_until(&time);
+        send_telegram(fd, &config, telegram, size, &time, &stats);
+        add_ns(&next, (uint64_t)config.period_ms * 1000000ULL);
+    }
+
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%zu telegrams, %zu bytes in %.1f s (%.1f telegrams/s), %zu bytes dropped\n", stats.telegrams, stats.bytes, seconds,
+           seconds > 0.0 ? stats.telegrams / seconds : 0.0, stats.dropped_bytes);
+    printf("Injected %zu bit errors, %zu truncated telegrams, %zu gaps\n", stats.bit_errors, stats.truncated, stats.gaps);
+
+    /* Let the reader drain the pseudo terminal before it is closed */
+    sleep(1);
+    if(link != NULL){ unlink(link); }
+    close(fd);
+    return 0;
+}
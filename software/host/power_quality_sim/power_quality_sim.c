@@ -0,0 +1,197 @@
+/**
+ * @file power_quality_sim.c
+ * @brief Runs the power quality detection of the combined firmware over a generated voltage and current trace
+ *
+ * The first telegram of the corpus is decoded to check that all phases are monitored. The trace contains
+ * a sag, a swell, a phase loss and an overcurrent at known telegrams, between them the voltage flaps
+ * around the sag threshold. Every condition must be raised with the first telegram beyond the threshold
+ * and cleared after the configured number of good telegrams, the flapping must not flood the network.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "telegram.h"
+#include "obis.h"
+#include "power_quality.h"
+
+/* ===== SIMULATION CONFIGURATION ===== */
+#define SIM_DEFAULT_TELEGRAMS           20000       /* < Number of simulated telegrams */
+#define SIM_NOMINAL_VOLTAGE             2300        /* < 0.1 V */
+#define SIM_NOMINAL_CURRENT             1000        /* < 0.01 A */
+#define SIM_EVENT_LENGTH                10          /* < Telegrams of each scripted event */
+#define SIM_FLAP_AMPLITUDE              60          /* < Voltage flaps by +/- 6 V around the sag threshold */
+
+/* Scripted events */
+typedef struct {
+    size_t start;                       /* < First telegram beyond the threshold */
+    uint8_t phase;
+    power_quality_condition_t condition;
+    uint16_t value;
+} sim_event_t;
+
+static const sim_event_t scripted_events[] = {
+    {.start = 100, .phase = 0, .condition = POWER_QUALITY_SAG, .value = 1950},
+    {.start = 200, .phase = 1, .condition = POWER_QUALITY_SWELL, .value = 2600},
+    {.start = 300, .phase = 1, .condition = POWER_QUALITY_PHASE_LOSS, .value = 0},
+    {.start = 400, .phase = 2, .condition = POWER_QUALITY_OVERCURRENT, .value = 7000},
+};
+#define SIM_EVENT_COUNT (sizeof(scripted_events) / sizeof(scripted_events[0]))
+#define SIM_FLAP_START  1000            /* < Flapping of L3 starts after scripted events */
+
+static double random_uniform()
+{
+    return (double)rand() / ((double)RAND_MAX + 1.0);
+}
+
+static void print_usage(const char *name)
+{
+    printf("Usage: %s [-n telegrams] [-f plaintext file] [-v]\n", name);
+}
+
+/* ===== MAIN ===== */
+int main(int argc, char **argv)
+{
+    size_t count = SIM_DEFAULT_TELEGRAMS;
+    const char *path = HOST_DATA_DIR "/sample_plaintext.hex";
+    bool verbose = false;
+
+    int opt;
+    while((opt = getopt(argc, argv, "n:f:vh")) != -1)
+    {
+        switch(opt)
+        {
+            case 'n': count = (size_t)strtoul(optarg, NULL, 10); break;
+            case 'f': path = optarg; break;
+            case 'v': verbose = true; break;
+            default: print_usage(argv[0]); return 2;
+        }
+    }
+    if(count <= SIM_FLAP_START)
+    {
+        print_usage(argv[0]);
+        return 2;
+    }
+
+    size_t failures = 0;
+    power_quality_t power_quality;
+    power_quality_event_t events[POWER_QUALITY_MAX_EVENTS];
+    power_quality_sample_t sample;
+
+    /* Telegram of corpus, all phases and no alarm */
+    static telegram_plaintext_t plaintext;
+    static obis_data_t data;
+    if(telegram_load_hex_file(path, &plaintext, 1) != 1 || parse_obis(plaintext.data, plaintext.size, &data) != ESP_OK)
+    {
+        fprintf(stderr, "No telegram loaded from %s\n", path);
+        return 2;
+    }
+    power_quality_init(&power_quality);
+    power_quality_sample_from_obis(&data, &sample);
+    printf("Corpus telegram: phases 0x%x, voltage %u/%u/%u, current %u/%u/%u\n", sample.phases, sample.voltage[0], sample.voltage[1],
+           sample.voltage[2], sample.current[0], sample.current[1], sample.current[2]);
+    if(sample.phases != 0x07 || power_quality_update(&power_quality, &sample, events) != 0)
+    {
+        fprintf(stderr, "Corpus telegram raised an alarm or misses a phase\n");
+        failures++;
+    }
+
+    /* Generated trace */
+    srand(1);
+    power_quality_init(&power_quality);
+    size_t raised[SIM_EVENT_COUNT] = {0};
+    size_t cleared[SIM_EVENT_COUNT] = {0};
+    size_t reports = 0;
+    size_t flap_events = 0;
+    size_t naive_events = 0;
+    bool naive_active = false;
+
+    for(size_t n = 0; n < count; n++)
+    {
+        sample.phases = 0x07;
+        for(int phase = 0; phase < 3; phase++)
+        {
+            sample.voltage[phase] = (uint16_t)(SIM_NOMINAL_VOLTAGE - 30 + rand() % 60);
+            sample.current[phase] = (uint16_t)(SIM_NOMINAL_CURRENT + rand() % 500);
+        }
+        for(size_t i = 0; i < SIM_EVENT_COUNT; i++)
+        {
+            const sim_event_t *event = &scripted_events[i];
+            if(n < event->start || n >= event->start + SIM_EVENT_LENGTH){ continue; }
+            if(event->condition == POWER_QUALITY_OVERCURRENT){ sample.current[event->phase] = event->value; }
+            else{ sample.voltage[event->phase] = event->value; }
+        }
+        if(n >= SIM_FLAP_START)
+        {
+            sample.voltage[2] = (uint16_t)(POWER_QUALITY_SAG_ENTER - SIM_FLAP_AMPLITUDE + (int)(random_uniform() * 2 * SIM_FLAP_AMPLITUDE));
+
+            /* Detector without hysteresis for comparison */
+            bool naive = sample.voltage[2] < POWER_QUALITY_SAG_ENTER;
+            if(naive != naive_active){ naive_events++; }
+            naive_active = naive;
+        }
+
+        size_t event_count = power_quality_update(&power_quality, &sample, events);
+        if(event_count > 0){ reports++; }
+
+        for(size_t e = 0; e < event_count; e++)
+        {
+            if(verbose)
+            {
+                printf("Telegram %zu: L%d %s %s, value %u\n", n, events[e].phase + 1, power_quality_condition_name(events[e].condition),
+                       events[e].active ? "raised" : "cleared", events[e].value);
+            }
+            if(n >= SIM_FLAP_START)
+            {
+                flap_events++;
+                continue;
+            }
+
+            /* Scripted events must be raised without delay and cleared after the hold */
+            bool expected = false;
+            for(size_t i = 0; i < SIM_EVENT_COUNT; i++)
+            {
+                const sim_event_t *event = &scripted_events[i];
+                if(events[e].phase != event->phase || events[e].condition != event->condition){ continue; }
+                if(events[e].active && n == event->start){ raised[i]++; expected = true; }
+                if(!events[e].active && n == event->start + SIM_EVENT_LENGTH + POWER_QUALITY_CLEAR_COUNT - 1){ cleared[i]++; expected = true; }
+            }
+            if(!expected)
+            {
+                fprintf(stderr, "Telegram %zu: unexpected %s %s on L%d\n", n, power_quality_condition_name(events[e].condition),
+                        events[e].active ? "raised" : "cleared", events[e].phase + 1);
+                failures++;
+            }
+        }
+    }
+
+    for(size_t i = 0; i < SIM_EVENT_COUNT; i++)
+    {
+        if(raised[i] != 1 || cleared[i] != 1)
+        {
+            fprintf(stderr, "%s on L%d raised %zu times, cleared %zu times\n", power_quality_condition_name(scripted_events[i].condition),
+                    scripted_events[i].phase + 1, raised[i], cleared[i]);
+            failures++;
+        }
+    }
+
+    /* Flapping causes at most one raise and one clear per hold period */
+    size_t flap_telegrams = count - SIM_FLAP_START;
+    size_t flap_limit = 2 * (flap_telegrams / (POWER_QUALITY_CLEAR_COUNT + 1) + 1);
+    printf("Simulated %zu telegrams, %zu with alarm reports\n", count, reports);
+    printf("Scripted events raised in first telegram beyond threshold, cleared after %d good telegrams\n", POWER_QUALITY_CLEAR_COUNT);
+    printf("Flapping of +/- %.1f V around sag threshold: %zu events with hysteresis, %zu without\n", SIM_FLAP_AMPLITUDE / 10.0, flap_events, naive_events);
+    if(flap_events > flap_limit)
+    {
+        fprintf(stderr, "Flapping caused %zu events, limit %zu\n", flap_events, flap_limit);
+        failures++;
+    }
+
+    printf("%s\n", failures == 0 ? "All checks passed" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
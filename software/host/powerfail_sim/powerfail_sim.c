@@ -0,0 +1,267 @@
+/**
+ * @file powerfail_sim.c
+ * @brief Simulates power fail interrupts at random points and checks the flush of the powerfail store
+ * 
+ * A producer thread prepares records like the uart event task, the power fail interrupt flushes
+ * at a random time. The flash is simulated as NOR flash with worst case timing of the datasheet.
+ * After each power fail the device is restarted and the restored record is checked.
+ * 
+ * @copyright Copyright (c) 2023
+ * 
+ */
+
+#include <getopt.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "telegram.h"
+#include "obis.h"
+#include "powerfail_store.h"
+#include "powerfail.h"
+
+/* ===== SIMULATION CONFIGURATION ===== */
+#define SIM_DEFAULT_CYCLES              2000        /* < Number of simulated power fails */
+#define SIM_DEFAULT_TORN_PROBABILITY    0.05        /* < Probability that supply dies during the flash write */
+#define SIM_MAX_INTERRUPT_DELAY_US      2000        /* < Interrupt is triggered randomly within this time */
+
+/* NOR flash timing, worst case of a typical SPI flash datasheet */
+#define FLASH_WRITE_OVERHEAD_US         100         /* < Cache disable, write enable and command */
+#define FLASH_PAGE_SIZE                 256         /* < Program unit */
+#define FLASH_PAGE_PROGRAM_TYP_US       700         /* < Typical page program time */
+#define FLASH_PAGE_PROGRAM_MAX_US       2400        /* < Maximum page program time */
+#define FLASH_SECTOR_ERASE_MAX_US       300000      /* < Maximum sector erase time */
+
+#define FLASH_SIZE                      (POWERFAIL_SECTOR_SIZE * POWERFAIL_SECTOR_COUNT)
+
+/* Simulated flash */
+typedef struct {
+    uint8_t data[FLASH_SIZE];
+    uint32_t reads;
+    uint32_t writes;
+    uint32_t erases;
+    uint64_t time_us;                               /* < Simulated worst case time of all operations */
+    size_t torn_bytes;                              /* < If not 0, next write stops after this number of bytes */
+} sim_flash_t;
+
+/* Producer state */
+static powerfail_store_t store;
+static obis_data_t base_data;
+static atomic_bool producer_running;
+static atomic_uint produced_counter;
+
+/* ===== FLASH OPERATIONS ===== */
+static esp_err_t sim_read(void *ctx, size_t offset, void *data, size_t size)
+{
+    sim_flash_t *flash = ctx;
+    if(offset + size > FLASH_SIZE){ return ESP_ERR_INVALID_SIZE; }
+    memcpy(data, &flash->data[offset], size);
+    flash->reads++;
+    return ESP_OK;
+}
+
+static esp_err_t sim_write(void *ctx, size_t offset, const void *data, size_t size)
+{
+    sim_flash_t *flash = ctx;
+    if(offset + size > FLASH_SIZE){ return ESP_ERR_INVALID_SIZE; }
+
+    /* NOR flash can only clear bits, supply may die during write */
+    size_t written = flash->torn_bytes != 0 && flash->torn_bytes < size ? flash->torn_bytes : size;
+    const uint8_t *bytes = data;
+    for(size_t i = 0; i < written; i++)
+    {
+        flash->data[offset + i] &= bytes[i];
+    }
+
+    size_t pages = (offset + size - 1) / FLASH_PAGE_SIZE - offset / FLASH_PAGE_SIZE + 1;
+    flash->time_us += FLASH_WRITE_OVERHEAD_US + pages * FLASH_PAGE_PROGRAM_MAX_US;
+    flash->writes++;
+    return ESP_OK;
+}
+
+static esp_err_t sim_erase(void *ctx, size_t offset, size_t size)
+{
+    sim_flash_t *flash = ctx;
+    if(offset % POWERFAIL_SECTOR_SIZE != 0 || size % POWERFAIL_SECTOR_SIZE != 0 || offset + size > FLASH_SIZE)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(&flash->data[offset], 0xFF, size);
+    flash->time_us += (size / POWERFAIL_SECTOR_SIZE) * FLASH_SECTOR_ERASE_MAX_US;
+    flash->erases++;
+    return ESP_OK;
+}
+
+/* ===== PRODUCER ===== */
+/* Values of measurement n, all fields depend on n to detect mixed records */
+static void make_data(uint32_t n, obis_data_t *data)
+{
+    *data = base_data;
+    for(uint8_t i = 0; i < data->record_count; i++)
+    {
+        obis_record_t *record = &data->records[i];
+        record->scaler = 0;
+        switch(record->type)
+        {
+            case ActivePowerPlus: record->value = n % 5000; break;
+            case ActivePowerMinus: record->value = 0; break;
+            case ActiveEnergyPlus: record->value = n; break;
+            case ActiveEnergyMinus: record->value = n / 2; break;
+            default: break;
+        }
+    }
+}
+
+static bool is_consistent(const powerfail_record_t *record)
+{
+    uint32_t n = record->frame_counter;
+    return record->active_power == (int32_t)(n % 5000) && record->energy_delivered == n && record->energy_received == n / 2;
+}
+
+/* Like uart event task, prepares a record for every telegram */
+static void *producer_thread(void *arg)
+{
+    obis_data_t data;
+    powerfail_record_t record;
+    while(atomic_load(&producer_running))
+    {
+        uint32_t n = atomic_load(&produced_counter) + 1;
+        make_data(n, &data);
+        powerfail_record_from_obis(&data, n, &record);
+        powerfail_store_prepare(&store, &record);
+        atomic_store(&produced_counter, n);
+    }
+    return NULL;
+}
+
+static double random_uniform()
+{
+    return (double)rand() / ((double)RAND_MAX + 1.0);
+}
+
+static void print_usage(const char *name)
+{
+    printf("Usage: %s [-n cycles] [-t torn write probability] [-f plaintext file]\n", name);
+}
+
+/* ===== MAIN ===== */
+int main(int argc, char **argv)
+{
+    size_t cycles = SIM_DEFAULT_CYCLES;
+    double torn_probability = SIM_DEFAULT_TORN_PROBABILITY;
+    const char *path = HOST_DATA_DIR "/sample_plaintext.hex";
+
+    int opt;
+    while((opt = getopt(argc, argv, "n:t:f:h")) != -1)
+    {
+        switch(opt)
+        {
+            case 'n': cycles = (size_t)strtoul(optarg, NULL, 10); break;
+            case 't': torn_probability = strtod(optarg, NULL); break;
+            case 'f': path = optarg; break;
+            default: print_usage(argv[0]); return 2;
+        }
+    }
+
+    /* Registers of a real telegram */
+    static telegram_plaintext_t plaintext;
+    if(telegram_load_hex_file(path, &plaintext, 1) != 1 || parse_obis(plaintext.data, plaintext.size, &base_data) != ESP_OK)
+    {
+        fprintf(stderr, "No telegram loaded from %s\n", path);
+        return 2;
+    }
+
+    static sim_flash_t flash;
+    memset(flash.data, 0x5A, sizeof(flash.data));   /* < Random content of new flash */
+    const flash_ops_t ops = {.read = sim_read, .write = sim_write, .erase = sim_erase, .ctx = &flash, .size = FLASH_SIZE};
+
+    srand(1);
+    powerfail_record_t expected;
+    bool has_expected = false;
+    uint64_t max_flush_us = 0;
+    size_t failures = 0;
+    size_t torn_writes = 0;
+    size_t boot_erases = 0;
+
+    for(size_t cycle = 0; cycle < cycles; cycle++)
+    {
+        /* Boot: load newest record, erase is allowed here */
+        powerfail_record_t restored;
+        uint32_t erases_before = flash.erases;
+        esp_err_t err = powerfail_store_init(&store, &ops, &restored);
+        boot_erases += flash.erases - erases_before;
+        if(has_expected && (err != ESP_OK || memcmp(&restored, &expected, sizeof(expected)) != 0))
+        {
+            fprintf(stderr, "Cycle %zu: restored record %lu does not match written record %lu\n", cycle,
+                    (unsigned long)restored.sequence, (unsigned long)expected.sequence);
+            failures++;
+        }
+        if(err == ESP_OK && !is_consistent(&restored))
+        {
+            fprintf(stderr, "Cycle %zu: restored record mixes two measurements\n", cycle);
+            failures++;
+        }
+
+        /* Running: telegrams are prepared continuously */
+        atomic_store(&produced_counter, (uint32_t)(cycle * 1000000));
+        atomic_store(&producer_running, true);
+        pthread_t producer;
+        pthread_create(&producer, NULL, producer_thread, NULL);
+        while(atomic_load(&produced_counter) == (uint32_t)(cycle * 1000000)){ }
+
+        /* Power fail at random time */
+        usleep((useconds_t)(random_uniform() * SIM_MAX_INTERRUPT_DELAY_US));
+        bool torn = random_uniform() < torn_probability;
+        flash.torn_bytes = torn ? 1 + (size_t)(random_uniform() * (POWERFAIL_RECORD_SIZE - 1)) : 0;
+
+        uint32_t reads = flash.reads;
+        uint32_t erases = flash.erases;
+        uint64_t time_us = flash.time_us;
+        size_t offset = store.next_offset;
+        err = powerfail_store_flush(&store);
+        uint64_t flush_us = flash.time_us - time_us;
+
+        atomic_store(&producer_running, false);
+        pthread_join(producer, NULL);
+        flash.torn_bytes = 0;
+
+        /* Critical path: one write, no erase, no read, within budget */
+        if(err != ESP_OK)
+        {
+            fprintf(stderr, "Cycle %zu: flush failed (0x%x)\n", cycle, err);
+            failures++;
+            continue;
+        }
+        if(flash.erases != erases || flash.reads != reads)
+        {
+            fprintf(stderr, "Cycle %zu: flash was erased or read during flush\n", cycle);
+            failures++;
+        }
+        if(flush_us > POWERFAIL_FLUSH_BUDGET_US)
+        {
+            fprintf(stderr, "Cycle %zu: flush took %llu us, budget %d us\n", cycle, (unsigned long long)flush_us, POWERFAIL_FLUSH_BUDGET_US);
+            failures++;
+        }
+        if(flush_us > max_flush_us){ max_flush_us = flush_us; }
+
+        /* Torn write must be ignored, previous record is expected after restart */
+        if(torn)
+        {
+            torn_writes++;
+        }
+        else
+        {
+            memcpy(&expected, &flash.data[offset], sizeof(expected));
+            has_expected = true;
+        }
+    }
+
+    printf("Simulated %zu power fails (%zu torn writes, %zu erases at boot)\n", cycles, torn_writes, boot_erases);
+    printf("Worst case flush: %llu us, budget %d us\n", (unsigned long long)max_flush_us, POWERFAIL_FLUSH_BUDGET_US);
+    printf("%s\n", failures == 0 ? "All checks passed" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,426 @@
+/**
+ * @file report_bench.c
+ * @brief Throughput and latency of the zigbee reporting of the electricity meter for a telegram stream
+ *
+ * The endpoint, the reporter and the snapshot of the zigbee_electricity_meter component run on the host
+ * replacement of esp-zigbee-lib, which records every frame with its size on air, see esp_zigbee_core.h.
+ * Telegrams are generated from the corpus or read from a raw telegram capture of the firmware and passed
+ * on like the poll callback of the bridge does. Each reporting configuration runs in its own process on
+ * the same stream. Frames are sent one after the other on a channel with mean CSMA-CA backoff and no
+ * retries. Report latency is the time from decoding a telegram until the last frame carrying its values
+ * is acknowledged, the handoff to the zigbee task is counted with its worst case.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "telegram.h"
+#include "obis.h"
+#include "meter_capture.h"
+#include "meter_convert.h"
+#include "latency_budget.h"
+#include "esp_zigbee_core.h"
+#include "zb_electricity_meter_endpoint.h"
+#include "zb_electricity_meter_update.h"
+#include "zb_electricity_meter_reporter.h"
+
+/* ===== BENCH CONFIGURATION ===== */
+#define BENCH_DEFAULT_TELEGRAMS         720         /* < One hour of a Sagemcom T210-D */
+#define BENCH_TELEGRAM_INTERVAL_MS      5000        /* < Sagemcom T210-D sends every 5 seconds */
+#define BENCH_MAX_TELEGRAMS             100000
+#define BENCH_MAX_PLAINTEXTS            16          /* < Maximum number of telegrams loaded from file */
+#define BENCH_MAX_DUMP_SIZE             (1024 * 1024)
+#define BENCH_GOOD_LQI                  200         /* < Parent of a good link */
+#define BENCH_GOOD_RSSI                 -60
+#define BENCH_WEAK_LQI                  60          /* < Parent of a degraded link, see LINK_DEGRADED_LQI */
+#define BENCH_WEAK_RSSI                 -90
+#define BENCH_LOSSY_PERCENT             30          /* < Failed send status of a lossy link, see LINK_DEGRADED_FAILURE_PERCENT */
+
+/* IEEE 802.15.4 at 2.4 GHz, as in latency_sim */
+#define RADIO_BYTE_US                   32          /* < 250 kbit/s */
+#define RADIO_PHY_HEADER_BYTES          6           /* < Preamble, SFD and length */
+#define RADIO_UNIT_BACKOFF_US           320         /* < aUnitBackoffPeriod */
+#define RADIO_CCA_US                    128         /* < Clear channel assessment */
+#define RADIO_TURNAROUND_US             192         /* < aTurnaroundTime */
+#define RADIO_ACK_BYTES                 5           /* < MAC acknowledgement */
+#define RADIO_MIN_BE                    3           /* < macMinBE */
+#define ZB_STACK_PROCESSING_US          2000        /* < Processing of one request in the zigbee stack */
+
+/* Reporting configuration */
+typedef struct {
+    const char *name;
+    bool reports;                       /* < Attribute reports by the reporter */
+    bool bulk;                          /* < Bulk snapshot command */
+    uint8_t lqi;                        /* < Link of parent */
+    int8_t rssi;
+    uint8_t send_failure_percent;       /* < Requests with failed APS confirm */
+    zb_reporting_mode_t mode;           /* < Expected reporting mode at the end of the run */
+} bench_config_t;
+
+static const bench_config_t configs[] = {
+    {"firmware", true, true, BENCH_GOOD_LQI, BENCH_GOOD_RSSI, 0, ZB_REPORTING_MODE_FULL},       /* < As sent by the bridge */
+    {"reports", true, false, BENCH_GOOD_LQI, BENCH_GOOD_RSSI, 0, ZB_REPORTING_MODE_FULL},
+    {"bulk", false, true, BENCH_GOOD_LQI, BENCH_GOOD_RSSI, 0, ZB_REPORTING_MODE_FULL},
+    {"reduced", true, true, BENCH_WEAK_LQI, BENCH_WEAK_RSSI, 0, ZB_REPORTING_MODE_REDUCED},   /* < Reporter switches to reduced rate at first evaluation */
+    {"lossy", true, true, BENCH_GOOD_LQI, BENCH_GOOD_RSSI, BENCH_LOSSY_PERCENT, ZB_REPORTING_MODE_REDUCED},    /* < Good parent, failed confirms reduce the rate */
+};
+
+/* Decoded telegram of the stream */
+typedef struct {
+    uint32_t time_ms;
+    obis_data_t data;
+} bench_telegram_t;
+
+/* Channel and latency of one run */
+static struct {
+    double channel_free_us;             /* < End of last frame on air */
+    double last_done_us;                /* < End of last frame of current submission */
+    bool carries_values;                /* < Frame of current submission contains measurement values */
+    bool verbose;
+} run;
+
+/* ===== HELPER FUNCTIONS ===== */
+static void print_usage(const char *name)
+{
+    printf("Usage: %s [-n telegrams] [-t plaintext file] [-i interval] [-c config] [-v]\n", name);
+    printf("       %s -f capture [-i interval] [-c config] [-v]\n", name);
+    printf("  -i every n-th telegram is decoded, default %d for generated telegrams and 1 for captures\n", DATA_UPDATE_INTERVAL);
+    printf("  -c one of firmware, reports, bulk, reduced, lossy\n");
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* Frame and acknowledgement after mean backoff, in us */
+static double frame_airtime_us(size_t size)
+{
+    double backoff_us = (double)((1 << RADIO_MIN_BE) - 1) / 2.0 * RADIO_UNIT_BACKOFF_US;
+    return ZB_STACK_PROCESSING_US + backoff_us + RADIO_CCA_US
+         + RADIO_TURNAROUND_US + (double)(RADIO_PHY_HEADER_BYTES + size) * RADIO_BYTE_US
+         + RADIO_TURNAROUND_US + (double)(RADIO_PHY_HEADER_BYTES + RADIO_ACK_BYTES) * RADIO_BYTE_US;
+}
+
+/* Called by host zigbee for every recorded frame */
+static void frame_cb(const host_zigbee_frame_t *frame)
+{
+    double start_us = (double)frame->time_ms * 1000.0;
+    if(run.channel_free_us > start_us){ start_us = run.channel_free_us; }
+    run.channel_free_us = start_us + frame_airtime_us(frame->size);
+    run.last_done_us = run.channel_free_us;
+
+    bool values = frame->cluster_id == ESP_ZB_ZCL_CLUSTER_ID_ELECTRICAL_MEASUREMENT || frame->cluster_id == ESP_ZB_ZCL_CLUSTER_ID_METERING
+               || (frame->type == HOST_ZIGBEE_FRAME_COMMAND && frame->id == ZB_MANUFACTURER_CMD_BULK_SNAPSHOT_ID);
+    if(values){ run.carries_values = true; }
+
+    if(run.verbose)
+    {
+        printf("    %u.%03u s %s cluster 0x%04x %s 0x%04x, fragment %u/%u, %u bytes\n",
+               (unsigned int)(frame->time_ms / 1000), (unsigned int)(frame->time_ms % 1000),
+               frame->type == HOST_ZIGBEE_FRAME_REPORT ? "report" : "command", frame->cluster_id,
+               frame->type == HOST_ZIGBEE_FRAME_REPORT ? "attribute" : "command", frame->id,
+               frame->fragment + 1, frame->fragment_count, frame->size);
+    }
+}
+
+/* Called by host zigbee for the send status of every request, like the status handler of the bridge */
+static void send_status_cb(esp_zb_zcl_command_send_status_message_t message)
+{
+    zb_reporter_send_status(message.status);
+}
+
+/* ===== STREAM ===== */
+static size_t generate_stream(const char *path, size_t count, unsigned int interval, bench_telegram_t *stream)
+{
+    static telegram_plaintext_t plaintexts[BENCH_MAX_PLAINTEXTS];
+    size_t plaintext_count = telegram_load_hex_file(path, plaintexts, BENCH_MAX_PLAINTEXTS);
+    if(plaintext_count == 0)
+    {
+        fprintf(stderr, "No telegrams loaded from %s\n", path);
+        return 0;
+    }
+
+    /* Changing power and energy like meter_sim, all telegrams are sent, every n-th is decoded */
+    srand(1);
+    uint64_t energy = 0;
+    size_t decoded = 0;
+    for(size_t i = 0; i < count && decoded < BENCH_MAX_TELEGRAMS; i++)
+    {
+        uint64_t power = (uint64_t)(rand() % 10000);
+        energy += power * BENCH_TELEGRAM_INTERVAL_MS / 3600000;
+        if((i + 1) % interval != 0){ continue; }
+
+        telegram_plaintext_t plaintext = plaintexts[i % plaintext_count];
+        telegram_set_register(&plaintext, 1, 7, power);
+        telegram_set_register(&plaintext, 1, 8, energy);
+        if(parse_obis(plaintext.data, plaintext.size, &stream[decoded].data) != ESP_OK)
+        {
+            fprintf(stderr, "Decoding telegram %zu failed\n", i);
+            return 0;
+        }
+        stream[decoded].time_ms = (uint32_t)(i * BENCH_TELEGRAM_INTERVAL_MS);
+        decoded++;
+    }
+    return decoded;
+}
+
+static size_t load_capture(const char *capture, unsigned int interval, bench_telegram_t *stream)
+{
+    FILE *file = fopen(capture, "rb");
+    if(file == NULL)
+    {
+        fprintf(stderr, "Cannot open %s\n", capture);
+        return 0;
+    }
+
+    /* Partition images are larger than the capture, the header holds the size */
+    uint8_t *dump = malloc(BENCH_MAX_DUMP_SIZE);
+    if(dump == NULL)
+    {
+        fclose(file);
+        fprintf(stderr, "Out of memory\n");
+        return 0;
+    }
+    size_t size = fread(dump, 1, BENCH_MAX_DUMP_SIZE, file);
+    fclose(file);
+
+    /* Damaged telegrams of a capture are expected */
+    int log_level = host_log_level;
+    host_log_level = 0;
+
+    meter_capture_file_header_t header;
+    if(meter_capture_parse_header(dump, size, &header) != ESP_OK)
+    {
+        fprintf(stderr, "No valid capture\n");
+        host_log_level = log_level;
+        free(dump);
+        return 0;
+    }
+
+    /* Same decoding chain as uart event task, telegrams which fail are skipped like by the firmware */
+    const uint8_t *records = &dump[sizeof(header)];
+    size_t offset = 0;
+    size_t index = 0;
+    size_t decoded = 0;
+    meter_capture_record_t record;
+    while(meter_capture_next_record(records, header.records_size, &offset, &record) == ESP_OK && decoded < BENCH_MAX_TELEGRAMS)
+    {
+        if(++index % interval != 0 || record.header.size > FRAME_POOL_FRAME_SIZE){ continue; }
+
+        frame_t *frame = frame_pool_take();
+        memcpy(frame->data, record.data, record.header.size);
+        frame->size = record.header.size;
+
+        size_t user_data_size = 0;
+        esp_err_t err = parse_mbus_long_frame_layer(frame->data, frame->size, frame->data, &user_data_size);
+        if(err == ESP_OK){ err = parse_dlms_layer(frame->data, user_data_size, &frame->offset, &frame->size, decryption_key); }
+        if(err == ESP_OK){ err = parse_obis(&frame->data[frame->offset], frame->size, &stream[decoded].data); }
+        frame_pool_give(frame);
+
+        if(err == ESP_OK)
+        {
+            stream[decoded].time_ms = record.header.timestamp_ms;
+            decoded++;
+        }
+    }
+    free(dump);
+    host_log_level = log_level;
+
+    if(decoded == 0){ fprintf(stderr, "No telegram of %s decoded\n", capture); }
+    return decoded;
+}
+
+/* ===== BENCH ===== */
+/* Runs in its own process, the component keeps its state in static variables */
+static int run_config(const bench_config_t *config, const bench_telegram_t *stream, size_t count, bool verbose)
+{
+    static zb_electricity_meter_snapshot_t snapshot;
+    static zb_bulk_snapshot_t bulk;
+
+    memset(&run, 0, sizeof(run));
+    run.verbose = verbose;
+
+    /* Same start up as zigbee task, data model is created before the device is registered */
+    esp_zb_ep_list_t *ep_list = esp_zb_ep_list_create();
+    zb_electricity_meter_ep(ep_list);
+    ESP_ERROR_CHECK(esp_zb_device_register(ep_list));
+    host_zigbee_set_parent(config->lqi, config->rssi);
+    host_zigbee_set_frame_cb(frame_cb);
+    host_zigbee_set_send_failure_percent(config->send_failure_percent);
+    esp_zb_zcl_command_send_status_handler_register(send_status_cb);
+    host_zigbee_advance(stream[0].time_ms);
+    zb_reporter_start();
+
+    double *latencies = malloc(count * sizeof(double));
+    if(latencies == NULL)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 2;
+    }
+    size_t reported = 0;
+    size_t pending = 0;             /* < First telegram not carried by a frame yet */
+
+    if(verbose){ printf("%s:\n", config->name); }
+    for(size_t i = 0; i < count; i++)
+    {
+        /* Worst case handoff from uart event task to poll callback of zigbee task */
+        uint32_t submit_ms = stream[i].time_ms + LATENCY_BUDGET_HANDOFF_MS;
+        host_zigbee_advance(submit_ms);
+
+        run.carries_values = false;
+        meter_convert_snapshot(&stream[i].data, &snapshot);
+        meter_convert_bulk(&stream[i].data, &bulk);
+        if(config->reports){ zb_reporter_submit(&snapshot); }
+        if(config->bulk){ zb_reporter_submit_bulk(&bulk); }
+
+        /* Values of earlier telegrams of reduced mode are carried as average */
+        if(run.carries_values)
+        {
+            for(; pending <= i; pending++)
+            {
+                latencies[reported++] = (run.last_done_us - (double)stream[pending].time_ms * 1000.0) / 1000.0;
+            }
+        }
+    }
+    host_zigbee_advance(stream[count - 1].time_ms + BENCH_TELEGRAM_INTERVAL_MS);
+
+    host_zigbee_stats_t stats;
+    host_zigbee_get_stats(&stats);
+    double minutes = (double)(stream[count - 1].time_ms - stream[0].time_ms + BENCH_TELEGRAM_INTERVAL_MS) / 60000.0;
+
+    double mean = 0.0;
+    for(size_t i = 0; i < reported; i++){ mean += latencies[i]; }
+    if(reported > 0){ mean /= (double)reported; }
+    qsort(latencies, reported, sizeof(double), compare_double);
+    double p95 = reported > 0 ? latencies[(size_t)(0.95 * (double)(reported - 1))] : 0.0;
+    double max = reported > 0 ? latencies[reported - 1] : 0.0;
+    free(latencies);
+
+    printf("%-10s %9zu %9zu %11.1f %11.0f %11.0f %10.1f %10.1f %10.1f %-8s\n", config->name, count, reported,
+           stats.frames / minutes, stats.bytes / minutes, stats.payload_bytes / minutes, mean, p95, max,
+           zb_reporter_get_mode() == ZB_REPORTING_MODE_FULL ? "full" : "reduced");
+    fflush(stdout);
+
+    /* Every request must match an attribute of the data model */
+    if(stats.rejected > 0)
+    {
+        fprintf(stderr, "%s: %lu requests for attributes which don't exist\n", config->name, (unsigned long)stats.rejected);
+        return 1;
+    }
+
+    /* Reporting rate follows the link */
+    if(config->reports && zb_reporter_get_mode() != config->mode)
+    {
+        fprintf(stderr, "%s: reporting mode is %s\n", config->name, zb_reporter_get_mode() == ZB_REPORTING_MODE_FULL ? "full" : "reduced");
+        return 1;
+    }
+
+    /* Attribute table holds the values of the last telegram */
+    int32_t power = 0;
+    if(config->reports && zb_reporter_get_mode() == ZB_REPORTING_MODE_FULL
+       && (host_zigbee_get_attribute(HA_DLMS_ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_ELECTRICAL_MEASUREMENT, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE,
+                                     ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_TOTAL_ACTIVE_POWER_ID, &power) != sizeof(power)
+           || power != snapshot.total_active_power))
+    {
+        fprintf(stderr, "%s: total active power attribute is %ld, last telegram %ld\n", config->name, (long)power, (long)snapshot.total_active_power);
+        return 1;
+    }
+
+    /* Telegrams of the firmware configuration at full rate must stay within the budget from decoding to sending */
+    if(config->reports && config->bulk && config->mode == ZB_REPORTING_MODE_FULL && max > LATENCY_BUDGET_HANDOFF_MS + LATENCY_BUDGET_RADIO_MS)
+    {
+        fprintf(stderr, "%s: latency %.1f ms exceeds budget of %d ms\n", config->name, max, LATENCY_BUDGET_HANDOFF_MS + LATENCY_BUDGET_RADIO_MS);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *capture = NULL;
+    const char *path = HOST_DATA_DIR "/sample_plaintext.hex";
+    const char *selected = NULL;
+    size_t count = BENCH_DEFAULT_TELEGRAMS;
+    unsigned int interval = 0;
+    bool verbose = false;
+
+    int opt;
+    while((opt = getopt(argc, argv, "f:n:t:i:c:vh")) != -1)
+    {
+        switch(opt)
+        {
+            case 'f': capture = optarg; break;
+            case 'n': count = (size_t)strtoul(optarg, NULL, 10); break;
+            case 't': path = optarg; break;
+            case 'i': interval = (unsigned int)strtoul(optarg, NULL, 10); break;
+            case 'c': selected = optarg; break;
+            case 'v': verbose = true; break;
+            default: print_usage(argv[0]); return 2;
+        }
+    }
+    if(count == 0 || count > BENCH_MAX_TELEGRAMS)
+    {
+        print_usage(argv[0]);
+        return 2;
+    }
+
+    bench_telegram_t *stream = malloc(BENCH_MAX_TELEGRAMS * sizeof(bench_telegram_t));
+    if(stream == NULL)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 2;
+    }
+    size_t decoded = capture != NULL ? load_capture(capture, interval > 0 ? interval : 1, stream)
+                                     : generate_stream(path, count, interval > 0 ? interval : DATA_UPDATE_INTERVAL, stream);
+    if(decoded == 0)
+    {
+        free(stream);
+        return 2;
+    }
+
+    printf("%zu decoded telegrams over %.1f minutes\n", decoded, (double)(stream[decoded - 1].time_ms - stream[0].time_ms + BENCH_TELEGRAM_INTERVAL_MS) / 60000.0);
+    printf("%-10s %9s %9s %11s %11s %11s %10s %10s %10s %-8s\n", "config", "telegrams", "reported", "frames/min", "bytes/min",
+           "zcl B/min", "mean ms", "p95 ms", "max ms", "mode");
+    fflush(stdout);
+
+    int result = 0;
+    bool found = false;
+    for(size_t c = 0; c < sizeof(configs) / sizeof(configs[0]); c++)
+    {
+        if(selected != NULL && strcmp(selected, configs[c].name) != 0){ continue; }
+        found = true;
+
+        pid_t pid = fork();
+        if(pid < 0)
+        {
+            fprintf(stderr, "fork failed\n");
+            result = 2;
+            break;
+        }
+        if(pid == 0){ exit(run_config(&configs[c], stream, decoded, verbose)); }
+
+        int status = 0;
+        waitpid(pid, &status, 0);
+        int code = WIFEXITED(status) ? WEXITSTATUS(status) : 2;
+        if(code > result){ result = code; }
+    }
+    free(stream);
+
+    if(!found)
+    {
+        print_usage(argv[0]);
+        return 2;
+    }
+    return result;
+}
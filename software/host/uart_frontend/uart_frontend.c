@@ -0,0 +1,156 @@
+/**
+ * @file uart_frontend.c
+ * @brief Host build of the uart front end of the firmware, reads telegrams from a serial device or pseudo terminal
+ *
+ * The uart event task, the frame pool, the parsers, the snapshot and the diagnostics counters are the
+ * sources of the firmware. The uart driver and FreeRTOS are replaced by threads, see driver/uart.h.
+ * Fed by meter_sim, the decoding path can be loaded far beyond one telegram every 5 seconds. Every second
+ * the decoded telegrams, frame counters skipped and the diagnostics counters are printed. Energy is
+ * checked to never decrease, a bit error in the ciphertext isn't detected by any layer.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <getopt.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "smartmeter.h"
+#include "general.h"
+#include "uart.h"
+#include "meter_snapshot.h"
+#include "meter_diagnostics.h"
+#include "frame_pool.h"
+#include "driver/uart.h"
+
+/* ===== FRONTEND CONFIGURATION ===== */
+#define FRONTEND_ENERGY_C               1           /* < Active energy import, 1.8.0 */
+#define FRONTEND_ENERGY_D               8
+
+/* Results of the callback, written by uart event task */
+static atomic_uint decoded = 0;
+static atomic_uint skipped = 0;     /* < Frame counters not decoded, also telegrams skipped by DATA_UPDATE_INTERVAL */
+static atomic_uint implausible = 0; /* < Energy lower than in previous telegram */
+static uint32_t last_frame_counter = 0;
+static int64_t last_energy = -1;
+
+static volatile sig_atomic_t running = 1;
+
+/* ===== HELPER FUNCTIONS ===== */
+static void print_usage(const char *name)
+{
+    printf("Usage: %s -d device [-b baud] [-s seconds] [-q] [-v]\n", name);
+    printf("  -b timing of uart events, default baud rate of the firmware\n");
+}
+
+static void stop(int signal)
+{
+    running = 0;
+}
+
+/* Called by uart event task for every decoded telegram, after the snapshot is published */
+static void data_cb(const obis_data_t *data)
+{
+    static meter_snapshot_t snapshot;
+    if(meter_snapshot_read(&snapshot) == ESP_OK)
+    {
+        if(last_frame_counter != 0 && snapshot.frame_counter > last_frame_counter + 1)
+        {
+            atomic_fetch_add(&skipped, snapshot.frame_counter - last_frame_counter - 1);
+        }
+        last_frame_counter = snapshot.frame_counter;
+    }
+
+    for(size_t i = 0; i < data->record_count; i++)
+    {
+        const obis_record_t *record = &data->records[i];
+        if(record->code[2] == FRONTEND_ENERGY_C && record->code[3] == FRONTEND_ENERGY_D)
+        {
+            if(record->value < last_energy){ atomic_fetch_add(&implausible, 1); }
+            last_energy = record->value;
+        }
+    }
+    atomic_fetch_add(&decoded, 1);
+}
+
+static void print_status(unsigned int seconds, unsigned int previous)
+{
+    unsigned int count = atomic_load(&decoded);
+    frame_pool_stats_t pool;
+    frame_pool_get_stats(&pool);
+    printf("%4u s: %u decoded (%u/s), %u skipped, %u implausible, fifo %lu, full %lu, parity %lu, parse %lu, decrypt %lu, pool empty %lu\n",
+           seconds, count, count - previous, atomic_load(&skipped), atomic_load(&implausible),
+           (unsigned long)meter_diag_get(METER_DIAG_FIFO_OVERFLOW), (unsigned long)meter_diag_get(METER_DIAG_BUFFER_FULL),
+           (unsigned long)meter_diag_get(METER_DIAG_PARITY_ERROR), (unsigned long)meter_diag_get(METER_DIAG_PARSE_FAILURE),
+           (unsigned long)meter_diag_get(METER_DIAG_DECRYPT_FAILURE), (unsigned long)pool.empty);
+    fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    const char *device = NULL;
+    int baud_rate = 0;
+    unsigned int duration = 0;
+
+    int opt;
+    while((opt = getopt(argc, argv, "d:b:s:qvh")) != -1)
+    {
+        switch(opt)
+        {
+            case 'd': device = optarg; break;
+            case 'b': baud_rate = atoi(optarg); break;
+            case 's': duration = (unsigned int)strtoul(optarg, NULL, 10); break;
+            case 'q': host_log_level = 0; break;
+            case 'v': host_log_level = HOST_LOG_INFO; break;
+            default: print_usage(argv[0]); return 2;
+        }
+    }
+    if(device == NULL)
+    {
+        print_usage(argv[0]);
+        return 2;
+    }
+
+    if(host_uart_open(device, baud_rate) != ESP_OK)
+    {
+        fprintf(stderr, "Cannot open %s\n", device);
+        return 2;
+    }
+
+    /* Same start up as the firmware */
+    smartmeter_register_data_cb(data_cb);
+    esp_err_t err = smartmeter_init();
+    if(err != ESP_OK)
+    {
+        fprintf(stderr, "Starting smartmeter failed (0x%x)\n", err);
+        return 2;
+    }
+    printf("Reading %s, rx timeout %u ms, every %u. telegram is decoded\n", device, UART_RX_TIMEOUT, DATA_UPDATE_INTERVAL);
+
+    /* Uart event task splits telegrams if data events are further apart than its timeout */
+    int line_baud = baud_rate > 0 ? baud_rate : UART_BAUD_RATE;
+    if(HOST_UART_RX_FULL_THRESHOLD * HOST_UART_BITS_PER_SYMBOL * 1000 / line_baud >= UART_RX_TIMEOUT)
+    {
+        fprintf(stderr, "Data events at %d baud are further apart than the rx timeout, use e.g. -b 115200 on both sides\n", line_baud);
+    }
+
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
+
+    unsigned int previous = 0;
+    for(unsigned int seconds = 1; running && (duration == 0 || seconds <= duration); seconds++)
+    {
+        sleep(1);
+        print_status(seconds, previous);
+        previous = atomic_load(&decoded);
+    }
+
+    /* Energy never decreases, a decrease is a corrupted telegram that was published */
+    return atomic_load(&implausible) == 0 ? 0 : 1;
+}
@@ -0,0 +1,160 @@
+/**
+ * @file binary_log.h
+ * @brief Tokenised log, the hot path writes a format id and raw arguments into a lock-free ring, formatting is done later by a low priority task or the host decoder
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+// Multiple inclusion protection
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_check.h"
+
+#include "binary_log_formats.h"
+
+/* ===== LOG CONFIGURATION ===== */
+#define BINARY_LOG_RING_SIZE            4096        /* < Bytes, power of two, holds about ten telegram dumps */
+#define BINARY_LOG_MAX_ARGS             4           /* < 32 bit arguments of one record */
+#define BINARY_LOG_MAX_DATA_SIZE        512         /* < Longer data is truncated, log its size as argument */
+#define BINARY_LOG_FLUSH_INTERVAL_MS    100         /* < Formatter task checks the ring at this interval */
+#define BINARY_LOG_TASK_PRIORITY        1           /* < Formatting only runs if nothing else has to */
+#define BINARY_LOG_TASK_STACK_SIZE      3072
+#define BINARY_LOG_LINE_SIZE            (2 * BINARY_LOG_MAX_DATA_SIZE + 160)    /* < Formatted message or raw line */
+
+/* Set to 1 to print records as hex lines prefixed with BINARY_LOG_RAW_PREFIX instead of formatting them, */
+/* render the console capture with the host tool binlog_decode */
+#ifndef BINARY_LOG_RAW_OUTPUT
+#define BINARY_LOG_RAW_OUTPUT           0
+#endif
+#define BINARY_LOG_RAW_PREFIX           "#BL "
+
+/* Levels of formats */
+typedef enum {
+    BINARY_LOG_LEVEL_ERROR = 1,
+    BINARY_LOG_LEVEL_WARN,
+    BINARY_LOG_LEVEL_INFO,
+} binary_log_level_t;
+
+/* Format ids, see binary_log_formats.h */
+typedef enum {
+#define BINARY_LOG_ID(id, level, tag, format) id,
+    BINARY_LOG_FORMATS(BINARY_LOG_ID)
+#undef BINARY_LOG_ID
+    BINARY_LOG_FORMAT_COUNT
+} binary_log_id_t;
+
+/* Header of a record, followed by arguments and data, little endian */
+typedef struct {
+    uint32_t timestamp_us;              /* < Low 32 bits of esp_timer, wraps after 71 minutes */
+    uint16_t id;                        /* < binary_log_id_t */
+    uint16_t data_size;                 /* < Bytes after arguments */
+    uint8_t arg_count;                  /* < 32 bit arguments */
+    uint8_t reserved[3];
+} binary_log_header_t;
+
+/* Record read from ring */
+typedef struct {
+    binary_log_header_t header;
+    uint32_t args[BINARY_LOG_MAX_ARGS];
+    uint8_t data[BINARY_LOG_MAX_DATA_SIZE];
+} binary_log_record_t;
+
+/* Number and array of 32 bit arguments, the leading 0 allows an empty list */
+#define BINARY_LOG_ARGS(...)            ((const uint32_t[]){0, ##__VA_ARGS__} + 1)
+#define BINARY_LOG_ARG_COUNT(...)       (sizeof((const uint32_t[]){0, ##__VA_ARGS__}) / sizeof(uint32_t) - 1)
+
+/* Write record with 32 bit arguments, e.g. BINARY_LOG(BINARY_LOG_UART_EVENT, event.type) */
+#define BINARY_LOG(id, ...)                                                                             \
+    binary_log_write((id), BINARY_LOG_ARGS(__VA_ARGS__), BINARY_LOG_ARG_COUNT(__VA_ARGS__), NULL, 0)
+
+/* Write record with data for %H and 32 bit arguments */
+#define BINARY_LOG_DATA(id, data, size, ...)                                                            \
+    binary_log_write((id), BINARY_LOG_ARGS(__VA_ARGS__), BINARY_LOG_ARG_COUNT(__VA_ARGS__), (data), (size))
+
+/**
+ * @brief Start formatter task
+ *
+ * @return esp_err_t
+ */
+esp_err_t binary_log_init();
+
+/**
+ * @brief Copy record into ring, a few hundred cycles, never blocks
+ *
+ * @note Single producer, only the uart event task writes
+ *
+ * @param id format id
+ * @param args 32 bit arguments, at most BINARY_LOG_MAX_ARGS
+ * @param arg_count number of arguments
+ * @param data bytes for %H, truncated to BINARY_LOG_MAX_DATA_SIZE, can be NULL
+ * @param data_size number of bytes
+ * @return true if written, false if ring is full and the record was dropped
+ */
+bool binary_log_write(binary_log_id_t id, const uint32_t *args, size_t arg_count, const void *data, size_t data_size);
+
+/**
+ * @brief Take oldest record from ring
+ *
+ * @note Single consumer, only the formatter task reads
+ *
+ * @param record oldest record
+ * @return true if a record was read, false if ring is empty
+ */
+bool binary_log_read(binary_log_record_t *record);
+
+/**
+ * @brief Get number of records dropped because the ring was full
+ *
+ * @return uint32_t
+ */
+uint32_t binary_log_dropped();
+
+/**
+ * @brief Render message of record, used by formatter task and host decoder
+ *
+ * @param record record
+ * @param line output, message without level, tag and timestamp
+ * @param size size of line
+ * @return esp_err_t ESP_ERR_NOT_FOUND if format id is unknown
+ */
+esp_err_t binary_log_format(const binary_log_record_t *record, char *line, size_t size);
+
+/**
+ * @brief Encode record as hex of header, arguments and data
+ *
+ * @param record record
+ * @param line output, without prefix
+ * @param size size of line
+ * @return size_t number of characters, 0 if line is too small
+ */
+size_t binary_log_encode_hex(const binary_log_record_t *record, char *line, size_t size);
+
+/**
+ * @brief Decode record from hex line written by binary_log_encode_hex
+ *
+ * @param line hex characters, without prefix
+ * @param record decoded record
+ * @return esp_err_t ESP_ERR_INVALID_SIZE if line is truncated or too long
+ */
+esp_err_t binary_log_decode_hex(const char *line, binary_log_record_t *record);
+
+/**
+ * @brief Get level and tag of format
+ *
+ * @param id format id
+ * @param tag tag of format, "?" if id is unknown
+ * @return binary_log_level_t
+ */
+binary_log_level_t binary_log_get_level(uint16_t id, const char **tag);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
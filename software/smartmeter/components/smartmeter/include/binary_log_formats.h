@@ -0,0 +1,20 @@
+/**
+ * @file binary_log_formats.h
+ * @brief Format strings of the binary log, shared by the firmware and the host decoder
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+// Multiple inclusion protection
+#pragma once
+
+/* Entries are X(id, level, tag, format), ids are numbered in order, only append to keep old captures readable */
+/* Conversions d, i, u, x, X and c with flags and width take one 32 bit argument, %H prints the data bytes as hex */
+#define BINARY_LOG_FORMATS(X)                                                                           \
+    X(BINARY_LOG_UART_FIFO_OVERFLOW,    BINARY_LOG_LEVEL_INFO,  "UART", "FIFO overflow")                \
+    X(BINARY_LOG_UART_BUFFER_FULL,      BINARY_LOG_LEVEL_INFO,  "UART", "Ringbuffer full")              \
+    X(BINARY_LOG_UART_BREAK,            BINARY_LOG_LEVEL_INFO,  "UART", "RX Break")                     \
+    X(BINARY_LOG_UART_PARITY_ERROR,     BINARY_LOG_LEVEL_INFO,  "UART", "Parity Error")                 \
+    X(BINARY_LOG_UART_FRAME_ERROR,      BINARY_LOG_LEVEL_INFO,  "UART", "Frame Error")                  \
+    X(BINARY_LOG_UART_EVENT,            BINARY_LOG_LEVEL_INFO,  "UART", "Event Type: %d")               \
+    X(BINARY_LOG_UART_DECRYPTED_DATA,   BINARY_LOG_LEVEL_INFO,  "UART", "Decrypted data size: %u, data: %H")
@@ -12,7 +12,12 @@
 extern "C" {
 #endif
 
+#include <stdbool.h>
+
 #include "esp_check.h"
+#include "mbedtls/gcm.h"
+
+#include "general.h"
 
 /* ===== DLMS PARSER CONFIGURATION ===== */
 /* == INFO: OFFSETS ARE ALWAYS CALCULATED FROM THE BEGINNING OF THE RELEVANT LAYER == */
@@ -32,7 +37,11 @@ extern "C" {
 #define DLMS_SYSTEM_TITLE_LENGTH_OFFSET 3           /* < Position of system title length byte */
 #define DLMS_SYSTEM_TITLE_OFFSET        4           /* < Position of system title */
 
-#define DLMS_UNKNOWN_SIZE               3           /* < 3 Bytes after system title, always 0x81F820 */
+#define DLMS_UNKNOWN_SIZE               3           /* < 3 Bytes after system title, length 0x81XX and security control */
+#define DLMS_SECURITY_CONTROL_OFFSET    2           /* < Position of security control byte after system title */
+#define DLMS_SECURITY_AUTHENTICATED     0x10        /* < Bit of security control, authentication tag follows cipher text */
+#define DLMS_AUTH_TAG_SIZE              12          /* < Size of authentication tag at the end of the data */
+#define DLMS_PLAINTEXT_START            0x0F        /* < First byte of decrypted data, Data-Notification, checked if there is no tag */
 
 /* Only for subsequent user data packets */
 #define DLMS_DATA_START_OFFSET          2           /* < Offset where user data begins when receiving subsequent frames after first one */
@@ -41,17 +50,67 @@ extern "C" {
 #define AES_IV_SIZE                     12          /* < Size of initialization vector */
 #define AES_IV_SYST_LENGTH_OFFSET       1           /* < Offset at which the length of the system title is stored in the initialization vector */
 
+/* Decryption context, the expanded key is kept as long as telegrams use the same key */
+typedef struct {
+    mbedtls_gcm_context gcm;
+    uint8_t key[GUE_KEY_LENGTH];                            /* < Key of gcm */
+    bool has_key;                                           /* < False until first telegram */
+} dlms_decryptor_t;
+
 /**
- * @brief Parser for DLMS-Layer
+ * @brief Initialize decryption context, one per thread
  * 
- * @param user_data user data from mbus layer
+ * @param decryptor context to initialize
+ */
+void dlms_decryptor_init(dlms_decryptor_t* decryptor);
+
+/**
+ * @brief Free decryption context
+ * 
+ * @param decryptor context of dlms_decryptor_init
+ */
+void dlms_decryptor_free(dlms_decryptor_t* decryptor);
+
+/**
+ * @brief Parser for DLMS-Layer, combines and decrypts the frames in place
+ * 
+ * @note Header with system title and frame counter is kept, get_dlms_frame_counter works afterwards
+ * @note The tag is verified if the security control byte announces one, otherwise a wrong key is detected by the first decrypted byte
+ * 
+ * @param user_data user data from mbus layer, decrypted in place
  * @param user_data_size size of user data
- * @param decrypted_data decrypted user data
- * @param decrypted_data_size size of decrypted user data
+ * @param decrypted_data_offset position of decrypted data in user_data
+ * @param decrypted_data_size size of decrypted data
  * @param gue_key key used for decryption
+ * @return esp_err_t ESP_FAIL if the layer is invalid or the key is wrong
+ */
+esp_err_t parse_dlms_layer(uint8_t* user_data, size_t user_data_size, size_t* decrypted_data_offset, size_t* decrypted_data_size, const uint8_t* gue_key);
+
+/**
+ * @brief Parser for DLMS-Layer like parse_dlms_layer, with a decryption context which is reused
+ * 
+ * @note The key is only expanded again if it differs from the previous telegram, a context must not be shared by threads
+ * 
+ * @param decryptor context of dlms_decryptor_init
+ * @param user_data user data from mbus layer, decrypted in place
+ * @param user_data_size size of user data
+ * @param decrypted_data_offset position of decrypted data in user_data
+ * @param decrypted_data_size size of decrypted data
+ * @param gue_key key used for decryption
+ * @return esp_err_t 
+ */
+esp_err_t parse_dlms_layer_with(dlms_decryptor_t* decryptor, uint8_t* user_data, size_t user_data_size, size_t* decrypted_data_offset,
+                                size_t* decrypted_data_size, const uint8_t* gue_key);
+
+/**
+ * @brief Get frame counter of DLMS-Layer, it's incremented by the meter for every telegram
+ * 
+ * @param user_data user data from mbus layer
+ * @param user_data_size size of user data
+ * @param frame_counter frame counter of telegram
  * @return esp_err_t 
  */
-esp_err_t parse_dlms_layer(uint8_t* user_data, size_t user_data_size, uint8_t* decrypted_data, size_t* decrypted_data_size, const uint8_t* gue_key);
+esp_err_t get_dlms_frame_counter(const uint8_t* user_data, size_t user_data_size, uint32_t* frame_counter);
             
 #ifdef __cplusplus
 } // extern "C"
@@ -0,0 +1,55 @@
+/**
+ * @file flash_ops.h
+ * @brief Flash operations of a reserved area, implemented for partitions and for files on the host
+ * @copyright Copyright (c) 2023
+ * 
+ */
+
+// Multiple inclusion protection
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_check.h"
+
+/* ===== FLASH CONFIGURATION ===== */
+#define FLASH_OPS_SECTOR_SIZE           4096        /* < Erase unit of flash */
+#define FLASH_OPS_PAGE_SIZE             256         /* < Program unit of flash */
+
+/* Flash operations, offsets are relative to the start of the reserved area */
+typedef struct {
+    esp_err_t (* read)(void *ctx, size_t offset, void *data, size_t size);
+    esp_err_t (* write)(void *ctx, size_t offset, const void *data, size_t size);   /* < Can only clear bits */
+    esp_err_t (* erase)(void *ctx, size_t offset, size_t size);                     /* < Sets whole sectors to 0xFF */
+    void *ctx;
+    size_t size;                                    /* < Size of reserved area, multiple of FLASH_OPS_SECTOR_SIZE */
+} flash_ops_t;
+
+/**
+ * @brief Get flash operations of a data partition
+ * 
+ * @param label label of partition
+ * @param subtype subtype of partition
+ * @param ops flash operations
+ * @return esp_err_t ESP_ERR_NOT_FOUND if partition doesn't exist
+ */
+esp_err_t flash_ops_partition(const char *label, uint8_t subtype, flash_ops_t *ops);
+
+/**
+ * @brief CRC-32 (IEEE 802.3) to check records in flash
+ * 
+ * @param crc initial value, 0 for new calculation or result of previous call to continue
+ * @param data data
+ * @param size size of data
+ * @return uint32_t 
+ */
+uint32_t flash_ops_crc32(uint32_t crc, const void *data, size_t size);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
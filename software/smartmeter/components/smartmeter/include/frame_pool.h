@@ -0,0 +1,68 @@
+/**
+ * @file frame_pool.h
+ * @brief Static pool of frame buffers, borrowed by the uart event task and handed from layer to layer, all layers work in place
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+// Multiple inclusion protection
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mbus.h"
+#include "uart.h"
+
+/* ===== POOL CONFIGURATION ===== */
+/* This part can be different for other smartmeters, e.g. the Sagemcom T210-D sends two M-Bus frames per telegram */
+#define FRAME_POOL_FRAME_SIZE           (2 * MBUS_MAX_SIZE)     /* < Raw telegram, M-Bus user data and plaintext share one frame */
+#define FRAME_POOL_COUNT                1                       /* < Decoded by the uart event task and given back before the next telegram */
+
+/* RAM of the meter pipeline, pool and ring buffer of the uart driver */
+#define SMARTMETER_PIPELINE_RAM         (FRAME_POOL_COUNT * FRAME_POOL_FRAME_SIZE + UART_RX_BUFFER_SIZE)
+
+/* One frame, the payload of the current layer is data[offset] to data[offset + size - 1] */
+typedef struct {
+    size_t offset;
+    size_t size;
+    uint8_t data[FRAME_POOL_FRAME_SIZE];
+} frame_t;
+
+/* Usage since boot */
+typedef struct {
+    uint32_t in_use;                    /* < Frames currently borrowed */
+    uint32_t peak;                      /* < Maximum of frames borrowed at the same time */
+    uint32_t empty;                     /* < Takes failed because all frames were borrowed */
+} frame_pool_stats_t;
+
+/**
+ * @brief Borrow a frame, lock-free, never blocks, can be called from any task
+ *
+ * @note Owner of the frame is the caller until it is given back or handed to another task, e.g. with a queue of frame pointers
+ *
+ * @return frame_t* empty frame, NULL if all frames are borrowed
+ */
+frame_t* frame_pool_take();
+
+/**
+ * @brief Give frame back to pool, called by the last owner
+ *
+ * @param frame frame of frame_pool_take, NULL is ignored
+ */
+void frame_pool_give(frame_t *frame);
+
+/**
+ * @brief Get usage of pool
+ *
+ * @param stats usage
+ */
+void frame_pool_get_stats(frame_pool_stats_t *stats);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
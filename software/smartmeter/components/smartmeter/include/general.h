@@ -13,9 +13,6 @@ extern "C" {
 #endif
 
 /* ===== GENERAL CONFIGURATION ===== */
-/* General buffer size for data handling */
-#define DATA_BUFFER_SIZE                1024            
-
 /* Parsing/Update interval of data */
 /* e.g. smartmeter sends data every 5s * DATA_UPDATE_INTERVAL = data is sent via ZigBee every 10 seconds */
 #define DATA_UPDATE_INTERVAL            2
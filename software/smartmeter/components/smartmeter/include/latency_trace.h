@@ -0,0 +1,100 @@
+/**
+ * @file latency_trace.h
+ * @brief Timestamps of the stages of each telegram from first byte to confirmed report, collected in fixed histograms
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+// Multiple inclusion protection
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* ===== TRACE CONFIGURATION ===== */
+/* Set to 0 to compile out all timestamps, histograms and their attribute */
+#ifndef LATENCY_TRACE_ENABLED
+#define LATENCY_TRACE_ENABLED           1
+#endif
+
+#define LATENCY_TRACE_BUCKETS           16          /* < Bucket 0 is below LATENCY_TRACE_BASE_US, each further bucket doubles */
+#define LATENCY_TRACE_BASE_US           128         /* < Last bucket starts at 128 us * 2^14 = 2.1 s */
+#define LATENCY_TRACE_FORMAT_VERSION    1           /* < Version of encoded histograms */
+
+/* Stages of one telegram, in order */
+typedef enum {
+    LATENCY_STAGE_FIRST_BYTE = 0,       /* < First data event of uart driver after idle line */
+    LATENCY_STAGE_TELEGRAM_COMPLETE,    /* < No data for UART_RX_TIMEOUT, includes the timeout */
+    LATENCY_STAGE_MBUS_PARSED,          /* < Frames of M-Bus layer combined */
+    LATENCY_STAGE_DECRYPTED,            /* < DLMS layer decrypted */
+    LATENCY_STAGE_OBIS_DECODED,         /* < Registers decoded and published */
+    LATENCY_STAGE_REPORT_QUEUED,        /* < Attribute reports requested in zigbee task */
+    LATENCY_STAGE_REPORT_CONFIRMED,     /* < First report of the telegram confirmed by the stack */
+    LATENCY_STAGE_COUNT
+} latency_stage_t;
+
+/* Histogram of a stage is the time since the previous stage, histogram 0 is first byte to confirmed report */
+typedef struct {
+    uint16_t buckets[LATENCY_STAGE_COUNT][LATENCY_TRACE_BUCKETS];  /* < Saturating counters */
+    uint32_t max_us[LATENCY_STAGE_COUNT];
+} latency_trace_histograms_t;
+
+/* Size of encoded histograms: version, stage count, bucket count, base, then buckets and maximum per stage */
+#define LATENCY_TRACE_ENCODED_SIZE      (5 + LATENCY_STAGE_COUNT * (2 * LATENCY_TRACE_BUCKETS + 4))
+
+#if LATENCY_TRACE_ENABLED
+#define LATENCY_TRACE_MARK(stage)       latency_trace_mark(stage)
+#else
+#define LATENCY_TRACE_MARK(stage)       do { } while(0)
+#endif
+
+/**
+ * @brief Record timestamp of a stage of the current telegram, a few cycles, can be called from any task
+ *
+ * @note Only the first mark of a stage per telegram counts, a stage is skipped if the previous stage wasn't marked
+ *
+ * @param stage stage
+ */
+void latency_trace_mark(latency_stage_t stage);
+
+/**
+ * @brief Copy histograms
+ *
+ * @param histograms copy
+ */
+void latency_trace_get(latency_trace_histograms_t *histograms);
+
+/**
+ * @brief Clear histograms
+ */
+void latency_trace_reset();
+
+/**
+ * @brief Write count, median bucket, p90 bucket and maximum of each stage to the log
+ */
+void latency_trace_log();
+
+/**
+ * @brief Encode histograms as little endian bytes, e.g. for a zigbee attribute
+ *
+ * @param buffer output
+ * @param size size of buffer, at least LATENCY_TRACE_ENCODED_SIZE
+ * @return size_t number of bytes, 0 if buffer is too small
+ */
+size_t latency_trace_encode(uint8_t *buffer, size_t size);
+
+/**
+ * @brief Name of stage for logging, only with LATENCY_TRACE_ENABLED
+ *
+ * @param stage stage
+ * @return const char*
+ */
+const char* latency_trace_stage_name(latency_stage_t stage);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -29,6 +29,7 @@ extern "C" {
 
 #define MBUS_USER_DATA_SIZE_OFFSET      3           /* < C-Field, A-Field and CI-Field */
 #define MBUS_USER_DATA_OFFSET           7           /* < Position where MBUS Data starts */
+#define MBUS_CHECKSUM_START_OFFSET      4           /* < Position of C-Field, first byte of checksum */
 
 #define MBUS_STOP_OFFSET                2           /* < Offset added to the position of last data byte */
 #define MBUS_STOP_VALUE                 0x16        /* < Value of MBUS stop indicator */
@@ -38,8 +39,9 @@ extern "C" {
  * 
  * @param payload data from physical layer
  * @param payload_size size of data from physical layer
- * @param user_data extracted user data
+ * @param user_data extracted user data, can be payload to parse in place
  * @param user_data_size size of extracted user data
+ * @return esp_err_t ESP_FAIL if a frame is invalid, longer than payload or has a wrong checksum
  */
 esp_err_t parse_mbus_long_frame_layer(uint8_t* payload, size_t payload_size, uint8_t* user_data, size_t* user_data_size);
 
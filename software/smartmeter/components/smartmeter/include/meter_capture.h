@@ -0,0 +1,181 @@
+/**
+ * @file meter_capture.h
+ * @brief Optional capture of raw telegrams with reception time and arrival of uart chunks, kept in a RAM ring and spilled to flash on decode failures
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+// Multiple inclusion protection
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_check.h"
+
+/* ===== CAPTURE CONFIGURATION ===== */
+/* Set to 1 to capture raw telegrams, costs METER_CAPTURE_RING_SIZE of RAM and one copy per telegram */
+#ifndef METER_CAPTURE_ENABLED
+#define METER_CAPTURE_ENABLED           0
+#endif
+
+#define METER_CAPTURE_RING_SIZE         4096        /* < Bytes, about 12 telegrams of a Sagemcom T210-D */
+#define METER_CAPTURE_MAX_CHUNKS        16          /* < Uart data events per telegram, later events are added to the last one */
+#define METER_CAPTURE_PARTITION_LABEL   "capture"   /* < Optional, at least METER_CAPTURE_RING_SIZE + header, spill is skipped without it */
+#define METER_CAPTURE_PARTITION_SUBTYPE 0x42        /* < Custom data subtype */
+#define METER_CAPTURE_SPILL_INTERVAL_MS 600000      /* < Minimum time between two spills, limits flash wear */
+#define METER_CAPTURE_TASK_PRIORITY     1           /* < Spill erases flash for tens of ms, below the uart event task */
+#define METER_CAPTURE_TASK_STACK_SIZE   2048
+
+/* Dump format, little endian: file header, then records oldest first */
+#define METER_CAPTURE_MAGIC             0x5041434D  /* < "MCAP" */
+#define METER_CAPTURE_FORMAT_VERSION    1
+
+/* Flags of a record, reserved byte of version 1 */
+#define METER_CAPTURE_FLAG_TRUNCATED    0x01        /* < Telegram longer than a frame, only the first bytes are kept, chunks have all */
+#define METER_CAPTURE_FLAG_POOL_EMPTY   0x02        /* < No frame was free, telegram was dropped without decoding */
+
+/* Header of dump, spilled capture in flash starts with it */
+typedef struct {
+    uint32_t magic;                     /* < METER_CAPTURE_MAGIC */
+    uint8_t version;                    /* < METER_CAPTURE_FORMAT_VERSION */
+    uint8_t reserved;
+    uint16_t record_count;
+    uint32_t records_size;              /* < Bytes of all records after header */
+    uint32_t crc;                       /* < CRC-32 of records */
+} meter_capture_file_header_t;
+
+/* Header of one record, followed by chunks and raw bytes */
+typedef struct {
+    uint32_t timestamp_ms;              /* < First uart data event of telegram, ms since boot */
+    uint16_t size;                      /* < Raw bytes as read from uart */
+    uint8_t chunk_count;                /* < Uart data events */
+    uint8_t flags;                      /* < METER_CAPTURE_FLAG_*, 0 if the telegram was decoded */
+} meter_capture_record_header_t;
+
+/* Uart data event, the driver reports data after the rx fifo threshold or a gap of 10 symbols */
+typedef struct {
+    uint16_t offset_ms;                 /* < Time after first event */
+    uint16_t size;                      /* < Bytes of event */
+} meter_capture_chunk_t;
+
+/* Record of a dump, pointers into the dump */
+typedef struct {
+    meter_capture_record_header_t header;
+    const meter_capture_chunk_t *chunks;
+    const uint8_t *data;
+} meter_capture_record_t;
+
+#if METER_CAPTURE_ENABLED
+#define METER_CAPTURE_CHUNK(size, first) meter_capture_chunk(size, first)
+#define METER_CAPTURE_COMMIT(data, size, flags) meter_capture_commit(data, size, flags)
+#define METER_CAPTURE_FAILED()          meter_capture_failed()
+#else
+#define METER_CAPTURE_CHUNK(size, first) do { } while(0)
+#define METER_CAPTURE_COMMIT(data, size, flags) do { } while(0)
+#define METER_CAPTURE_FAILED()          do { } while(0)
+#endif
+
+/**
+ * @brief Create lock of ring, check for capture partition and start spill task
+ *
+ * @return esp_err_t
+ */
+esp_err_t meter_capture_init();
+
+/**
+ * @brief Note uart data event of current telegram
+ *
+ * @note Only called by the uart event task
+ *
+ * @param size bytes of event
+ * @param first true for first event after idle line, starts a telegram and sets its reception time
+ */
+void meter_capture_chunk(size_t size, bool first);
+
+/**
+ * @brief Copy raw telegram with its chunks into the ring, oldest records are overwritten, never blocks
+ *
+ * @note Only called by the uart event task, before the layers are parsed in place
+ *
+ * @param data raw bytes
+ * @param size number of bytes
+ * @param flags METER_CAPTURE_FLAG_* if the telegram was not decoded completely
+ */
+void meter_capture_commit(const uint8_t *data, size_t size, uint8_t flags);
+
+/**
+ * @brief Decoding of last committed telegram failed, spill ring to flash if the interval has passed
+ *
+ * @note Never blocks, the spill task erases and writes the partition
+ */
+void meter_capture_failed();
+
+/**
+ * @brief Write ring to capture partition, overwrites previous spill
+ *
+ * @return esp_err_t ESP_ERR_NOT_FOUND if partition is missing
+ */
+esp_err_t meter_capture_spill();
+
+/**
+ * @brief Write dump of ring, header first, then records oldest first
+ *
+ * @param write called with consecutive parts of the dump
+ * @param ctx context of write
+ * @return esp_err_t first error of write
+ */
+esp_err_t meter_capture_dump(esp_err_t (* write)(void *ctx, size_t offset, const void *data, size_t size), void *ctx);
+
+/**
+ * @brief Encode record as in dump
+ *
+ * @param timestamp_ms first uart data event
+ * @param chunks uart data events
+ * @param chunk_count number of events
+ * @param data raw bytes
+ * @param size number of bytes
+ * @param buffer output
+ * @param buffer_size size of output
+ * @return size_t size of record, 0 if buffer is too small
+ */
+size_t meter_capture_encode_record(uint32_t timestamp_ms, const meter_capture_chunk_t *chunks, size_t chunk_count, const uint8_t *data, size_t size,
+                                   uint8_t *buffer, size_t buffer_size);
+
+/**
+ * @brief Get size of encoded record from its header
+ *
+ * @param header header of record
+ * @return size_t
+ */
+size_t meter_capture_record_size(const meter_capture_record_header_t *header);
+
+/**
+ * @brief Check header of dump
+ *
+ * @param dump dump, e.g. read from capture partition
+ * @param size size of dump
+ * @param header header of dump
+ * @return esp_err_t ESP_ERR_NOT_FOUND if no capture, ESP_ERR_INVALID_CRC if records are damaged
+ */
+esp_err_t meter_capture_parse_header(const uint8_t *dump, size_t size, meter_capture_file_header_t *header);
+
+/**
+ * @brief Get record at offset of dump
+ *
+ * @param dump dump
+ * @param size size of dump
+ * @param offset offset of record, advanced to next record
+ * @param record record, points into dump
+ * @return esp_err_t ESP_ERR_NOT_FOUND at end of dump, ESP_ERR_INVALID_SIZE if record is truncated
+ */
+esp_err_t meter_capture_next_record(const uint8_t *dump, size_t size, size_t *offset, meter_capture_record_t *record);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
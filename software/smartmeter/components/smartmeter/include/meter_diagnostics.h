@@ -0,0 +1,46 @@
+/**
+ * @file meter_diagnostics.h
+ * @brief Counters of uart events and parser results, incremented by the uart event task and read by any other task
+ * @copyright Copyright (c) 2023
+ * 
+ */
+
+// Multiple inclusion protection
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* Counted events of the meter link */
+typedef enum {
+    METER_DIAG_TELEGRAMS_OK = 0,        /* < Telegram decoded and published */
+    METER_DIAG_FIFO_OVERFLOW,           /* < Hardware rx fifo overflowed */
+    METER_DIAG_BUFFER_FULL,             /* < Ring buffer of uart driver was full */
+    METER_DIAG_PARITY_ERROR,            /* < Parity error of a received byte */
+    METER_DIAG_FRAME_ERROR,             /* < Missing stop bit of a received byte */
+    METER_DIAG_PARSE_FAILURE,           /* < M-Bus or OBIS layer invalid */
+    METER_DIAG_DECRYPT_FAILURE,         /* < DLMS layer invalid, authentication failed, e.g. wrong key, or frame counter replayed */
+    METER_DIAG_COUNTER_COUNT
+} meter_diag_counter_t;
+
+/**
+ * @brief Increment counter, atomic, never blocks
+ * 
+ * @param counter counter
+ */
+void meter_diag_increment(meter_diag_counter_t counter);
+
+/**
+ * @brief Get value of counter, wraps after 2^32 events
+ * 
+ * @param counter counter
+ * @return uint32_t
+ */
+uint32_t meter_diag_get(meter_diag_counter_t counter);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,67 @@
+/**
+ * @file meter_snapshot.h
+ * @brief Last decoded telegram, written by uart event task and read by any other task without locking
+ * @copyright Copyright (c) 2023
+ * 
+ */
+
+// Multiple inclusion protection
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "esp_check.h"
+
+#include "obis.h"
+
+/* ===== SNAPSHOT CONFIGURATION ===== */
+/* Two buffers are used, so a reader only retries if the writer published twice during one copy */
+#define METER_SNAPSHOT_BUFFERS          2
+#define METER_SNAPSHOT_READ_RETRIES     8           /* < Attempts of a reader before giving up */
+
+/* All values of one telegram */
+typedef struct {
+    uint32_t sequence;                  /* < Incremented for every published telegram, starts with 1 */
+    uint32_t frame_counter;             /* < Frame counter of DLMS-Layer */
+    int64_t received_time_us;           /* < esp_timer time when telegram was decoded */
+    obis_data_t data;                   /* < Decoded registers, including timestamp of meter */
+} meter_snapshot_t;
+
+/**
+ * @brief Publish decoded telegram, only one task may write
+ * 
+ * @note Never blocks, readers retry if they read while the buffer is written
+ * 
+ * @param frame_counter frame counter of DLMS-Layer
+ * @param data decoded registers
+ */
+void meter_snapshot_publish(uint32_t frame_counter, const obis_data_t* data);
+
+/**
+ * @brief Read last published telegram, can be called from any task
+ * 
+ * @param snapshot copy of last telegram, all registers are from the same telegram
+ * @return esp_err_t ESP_ERR_NOT_FOUND if nothing was published yet, ESP_ERR_TIMEOUT if writer was always faster
+ */
+esp_err_t meter_snapshot_read(meter_snapshot_t* snapshot);
+
+/**
+ * @brief Get sequence of last published telegram
+ * 
+ * @return uint32_t 0 if nothing was published yet
+ */
+uint32_t meter_snapshot_sequence();
+
+/**
+ * @brief Check if a telegram was published after the given one
+ * 
+ * @param sequence sequence of last read snapshot, 0 if none was read
+ * @return true if a newer telegram is available
+ */
+bool meter_snapshot_changed_since(uint32_t sequence);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
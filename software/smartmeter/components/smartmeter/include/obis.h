@@ -24,19 +24,17 @@ extern "C" {
 #define OBIS_INTEGRITY_VAL1             0x0F    /* < Value of first integrity check */
 
 /* ===== DATA STRUCTURE ===== */
-#define OBIS_DECODER_START_OFFSET = 20;         /* < Offset for starting OBIS decoding, skip header, timestamp and break block */
-
-#define OBIS_TYPE_OFFSET = 0;                   /* < Offset for data type in header (only OctetString supported)*/
-#define OBIS_LENGTH_OFFSET = 1;
-
-#define OBIS_CODE_OFFSET = 2;
-
-#define OBIS_A = 0;
-#define OBIS_B = 1;
-#define OBIS_C = 2;
-#define OBIS_D = 3;
-#define OBIS_E = 4;
-#define OBIS_F = 5;
+#define OBIS_A                          0       /* < Position of value group A (medium) in obis code */
+#define OBIS_B                          1       /* < Position of value group B (channel) in obis code */
+#define OBIS_C                          2       /* < Position of value group C (physical value) in obis code */
+#define OBIS_D                          3       /* < Position of value group D (measurement type) in obis code */
+#define OBIS_E                          4       /* < Position of value group E (tariff) in obis code */
+#define OBIS_F                          5       /* < Position of value group F (billing period) in obis code */
+
+#define OBIS_MAX_RECORDS                16      /* < Maximum number of registers in one telegram */
+#define OBIS_MAX_DEPTH                  4       /* < Maximum nesting of structures and arrays */
+#define OBIS_SERIAL_NUMBER_MAX_LENGTH   16      /* < Maximum length of serial number string */
+#define OBIS_UNIT_NONE                  0xFF    /* < DLMS unit "count", used if register has no unit */
 
 /* === OBIS DATA TYPES === */
 #define OBIS_DATE_TIME_LENGTH           0x0C    /* < Length of a date time octet string */
@@ -100,7 +98,8 @@ enum CodeType
     ActiveEnergyPlus,
     ActiveEnergyMinus,
     ReactiveEnergyPlus,
-    ReactiveEnergyMinus
+    ReactiveEnergyMinus,
+    PowerFactor
 };
 
 /* === Accury of measurement as per specification === */
@@ -116,7 +115,7 @@ enum Accuracy
  * Metadata
  */
 
-static uint8_t ESPDM_TIMESTAMP[] = 
+static const uint8_t ESPDM_TIMESTAMP[] = 
 {
     0x01, 0x00
 };
@@ -135,7 +134,7 @@ static const uint8_t ESPDM_DEVICE_NAME[] =
  * Voltage
  */
 
-static uint8_t ESPDM_VOLTAGE_L1[] = 
+static const uint8_t ESPDM_VOLTAGE_L1[] = 
 {
     0x20, 0x07
 };
@@ -209,14 +208,87 @@ static const uint8_t ESPDM_REACTIVE_ENERGY_MINUS[] =
     0x04, 0x08
 };
 
+/*
+ * Power factor
+ */
+
+static const uint8_t ESPDM_POWER_FACTOR[] = 
+{
+    0x0D, 0x07
+};
+
+/* === DECODED DATA === */
+/* One register of the meter, real value = value * 10^scaler */
+typedef struct
+{
+    uint8_t code[OBIS_CODE_LENGTH];                         /* < OBIS code A-F */
+    enum CodeType type;                                     /* < Known measurement, Unknown otherwise */
+    int8_t scaler;                                          /* < Decimal exponent of value */
+    uint8_t unit;                                           /* < DLMS unit, e.g. 0x1E = Wh, 0x1B = W, 0x23 = V, 0x21 = A */
+    int64_t value;                                          /* < Raw value as sent by the meter */
+} obis_record_t;
+
+/* All values of one telegram */
+typedef struct
+{
+    uint8_t timestamp[OBIS_DATE_TIME_LENGTH];               /* < DLMS date time of meter */
+    uint8_t serial_number[OBIS_SERIAL_NUMBER_MAX_LENGTH];   /* < Serial number string, not terminated */
+    uint8_t serial_number_length;                           /* < Length of serial number */
+    uint8_t record_count;                                   /* < Number of used records */
+    obis_record_t records[OBIS_MAX_RECORDS];                /* < Registers in order of telegram */
+} obis_data_t;
+
+/* Types of the three phases, index 0 is L1 */
+extern const enum CodeType obis_voltage_types[3];
+extern const enum CodeType obis_current_types[3];
+
 /**
- * @brief 
+ * @brief Parser for OBIS-Layer, decodes all registers of a DataNotification
  * 
- * @param obis_data 
- * @param obis_data_size 
+ * @param obis_data decrypted data from dlms layer
+ * @param obis_data_size size of decrypted data
+ * @param result decoded registers
  * @return esp_err_t 
  */
-esp_err_t parse_obis(uint8_t* obis_data, size_t obis_data_size);
+esp_err_t parse_obis(uint8_t* obis_data, size_t obis_data_size, obis_data_t* result);
+
+/**
+ * @brief Find first record of given type
+ * 
+ * @param data decoded registers
+ * @param type type to search for
+ * @return const obis_record_t* NULL if not found
+ */
+const obis_record_t* obis_find_record(const obis_data_t* data, enum CodeType type);
+
+/**
+ * @brief Convert value of record to given decimal exponent, e.g. -1 for 0.1 V
+ * 
+ * @param record record to convert
+ * @param target_scaler decimal exponent of result
+ * @return int64_t converted value, digits below target resolution are truncated
+ */
+int64_t obis_scale_value(const obis_record_t* record, int8_t target_scaler);
+
+/**
+ * @brief Find first record of given type and convert its value to given decimal exponent
+ * 
+ * @param data decoded registers
+ * @param type type to search for
+ * @param target_scaler decimal exponent of result
+ * @param found set to false if the record is missing, may be NULL
+ * @return int64_t converted value, 0 if the record is missing
+ */
+int64_t obis_get_scaled(const obis_data_t* data, enum CodeType type, int8_t target_scaler, bool* found);
+
+/**
+ * @brief Convert DLMS date time of meter to seconds since 1970-01-01 UTC
+ * 
+ * @param timestamp DLMS date time (OBIS_DATE_TIME_LENGTH bytes), deviation is applied if specified
+ * @param unix_time seconds since 1970-01-01 UTC
+ * @return esp_err_t ESP_FAIL if date or time is not specified
+ */
+esp_err_t obis_timestamp_to_unix(const uint8_t* timestamp, uint32_t* unix_time);
 
 #ifdef __cplusplus
 } // extern "C"
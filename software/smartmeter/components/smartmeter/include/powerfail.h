@@ -0,0 +1,62 @@
+/**
+ * @file powerfail.h
+ * @brief Writes last measurement to flash when the M-Bus converter signals a power fail
+ * @copyright Copyright (c) 2023
+ * 
+ */
+
+// Multiple inclusion protection
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "esp_check.h"
+
+#include "obis.h"
+#include "powerfail_store.h"
+
+/* ===== POWERFAIL CONFIGURATION ===== */
+/* GPIO is POWER_FAIL_SIGNAL_GPIO of uart.h */
+#define POWERFAIL_SIGNAL_ACTIVE_LEVEL   0           /* < Level of power fail output of the M-Bus converter when power fails */
+#define POWERFAIL_PARTITION_LABEL       "powerfail" /* < Partition with POWERFAIL_SECTOR_COUNT sectors */
+#define POWERFAIL_PARTITION_SUBTYPE     0x40        /* < Custom data subtype */
+#define POWERFAIL_TASK_PRIORITY         (configMAX_PRIORITIES - 1)  /* < Above all other tasks, flush starts immediately */
+#define POWERFAIL_TASK_STACK_SIZE       2048
+
+/* Time from interrupt to end of flash write, hold-up time of the supply must be longer */
+#define POWERFAIL_FLUSH_BUDGET_US       3000
+
+/**
+ * @brief Load last record, prepare erased slot and enable power fail interrupt
+ * 
+ * @note Called by smartmeter_init, may be called earlier to get the restored record, later calls return the first result
+ * 
+ * @return esp_err_t ESP_ERR_NOT_FOUND if partition is missing
+ */
+esp_err_t powerfail_init();
+
+/**
+ * @brief Serialize values of decoded telegram, written to flash when power fails
+ * 
+ * @note Called from uart event task
+ * 
+ * @param data decoded telegram
+ * @param frame_counter frame counter of DLMS-Layer
+ */
+void powerfail_prepare(const obis_data_t *data, uint32_t frame_counter);
+
+/**
+ * @brief Get record written at last power fail, valid after powerfail_init
+ * 
+ * @note The record stays in flash until it is replaced, it may be older than values stored elsewhere
+ * 
+ * @param record record
+ * @return esp_err_t ESP_ERR_NOT_FOUND if no record was stored
+ */
+esp_err_t powerfail_get_restored(powerfail_record_t *record);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
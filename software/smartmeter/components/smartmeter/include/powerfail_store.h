@@ -0,0 +1,91 @@
+/**
+ * @file powerfail_store.h
+ * @brief Record of last measurement, written to a pre-erased flash slot when power fails
+ * @copyright Copyright (c) 2023
+ * 
+ */
+
+// Multiple inclusion protection
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdatomic.h>
+
+#include "esp_check.h"
+
+#include "obis.h"
+#include "flash_ops.h"
+
+/* ===== POWERFAIL STORE CONFIGURATION ===== */
+#define POWERFAIL_SECTOR_SIZE           FLASH_OPS_SECTOR_SIZE
+#define POWERFAIL_SECTOR_COUNT          2           /* < One sector is written, the other one is erased before it's needed */
+#define POWERFAIL_RECORD_SIZE           64          /* < Size of one slot, multiple of flash write alignment */
+#define POWERFAIL_RECORD_MAGIC          0x50465231  /* < "PFR1", increment on format changes */
+
+/* Last measurement, serialized as is, all values little endian */
+typedef struct {
+    uint32_t magic;                                 /* < POWERFAIL_RECORD_MAGIC */
+    uint32_t sequence;                              /* < Incremented for every written record, newest record is used */
+    uint32_t frame_counter;                         /* < Frame counter of DLMS-Layer */
+    uint8_t timestamp[OBIS_DATE_TIME_LENGTH];       /* < DLMS date time of meter */
+    int32_t active_power;                           /* < A+ minus A- in W */
+    uint16_t voltage[3];                            /* < Voltage L1-L3 in 0.1 V */
+    uint16_t current[3];                            /* < Current L1-L3 in 0.01 A */
+    uint64_t energy_delivered;                      /* < Active energy A+ in Wh */
+    uint64_t energy_received;                       /* < Active energy A- in Wh */
+    uint32_t reserved;                              /* < 0 */
+    uint32_t crc;                                   /* < CRC32 of all previous bytes */
+} powerfail_record_t;
+
+_Static_assert(sizeof(powerfail_record_t) == POWERFAIL_RECORD_SIZE, "powerfail record must fill one slot");
+
+/* State of the store */
+typedef struct {
+    flash_ops_t flash;
+    size_t next_offset;                             /* < Erased slot for next record, SIZE_MAX if none left */
+    uint32_t sequence;                              /* < Sequence of newest written record */
+    powerfail_record_t prepared[2];                 /* < Serialized records, one is written while the other is read */
+    atomic_uint prepared_index;                     /* < Index of last prepared record, bit 1 set if none is prepared */
+} powerfail_store_t;
+
+/**
+ * @brief Fill record with values of decoded telegram
+ * 
+ * @param data decoded telegram
+ * @param frame_counter frame counter of DLMS-Layer
+ * @param record record to fill, sequence and crc are set by powerfail_store_prepare
+ */
+void powerfail_record_from_obis(const obis_data_t *data, uint32_t frame_counter, powerfail_record_t *record);
+
+/**
+ * @brief Find newest record and make sure an erased slot is available, may erase a sector
+ * 
+ * @param store store to initialize
+ * @param flash flash operations of reserved area with at least POWERFAIL_SECTOR_COUNT sectors
+ * @param last newest valid record
+ * @return esp_err_t ESP_ERR_NOT_FOUND if no valid record is stored, store is usable anyway
+ */
+esp_err_t powerfail_store_init(powerfail_store_t *store, const flash_ops_t *flash, powerfail_record_t *last);
+
+/**
+ * @brief Serialize record for next flush, called by one task after every telegram
+ * 
+ * @param store store
+ * @param record values to store
+ */
+void powerfail_store_prepare(powerfail_store_t *store, const powerfail_record_t *record);
+
+/**
+ * @brief Write prepared record into erased slot, only one flash write and no erase
+ * 
+ * @param store store
+ * @return esp_err_t ESP_ERR_INVALID_STATE if nothing was prepared, ESP_ERR_NO_MEM if no erased slot is left
+ */
+esp_err_t powerfail_store_flush(powerfail_store_t *store);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
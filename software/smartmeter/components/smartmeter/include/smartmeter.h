@@ -14,6 +14,16 @@ extern "C" {
 
 #include "esp_check.h"
 
+/* Decoded data */
+#include "obis.h"
+
+/**
+ * @brief Callback for decoded data of each telegram
+ * 
+ * @note Called from uart task, must not block
+ */
+typedef void (* smartmeter_data_cb_t)(const obis_data_t *data);
+
 /**
  * @brief Initialize uart and dlms
  * 
@@ -21,6 +31,14 @@ extern "C" {
  */
 esp_err_t smartmeter_init();
 
+/**
+ * @brief Register callback for decoded data, call before smartmeter_init
+ * 
+ * @param data_cb callback, called for every successfully decoded telegram
+ * @return esp_err_t 
+ */
+esp_err_t smartmeter_register_data_cb(smartmeter_data_cb_t data_cb);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
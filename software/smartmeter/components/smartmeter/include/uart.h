@@ -24,7 +24,17 @@ extern "C" {
 /* For example the Sagemcom T210-D sends two frames every 5 seconds */
 /* After receiving the first byte, all bytes are collected in a buffer */
 /* If no new bytes is receive for a time of UART_RX_TIMEOUT, data will be parsed */
+/* Host builds fed faster than the meter sends, e.g. by meter_sim, use a shorter timeout */
+#ifndef UART_RX_TIMEOUT
 #define UART_RX_TIMEOUT                 1000        /* < Time to wait before received bytes are processed */
+#endif
+#define UART_RX_BUFFER_SIZE             1024        /* < Ring buffer of uart driver */
+
+/* ===== TASK CONFIGURATION ===== */
+/* Decoding runs below the zigbee task (priority 5), the uart driver buffers UART_RX_BUFFER_SIZE bytes */
+/* (more than 4 s at 2400 baud) in the meantime, so no data is lost while the zigbee stack is busy */
+#define UART_TASK_PRIORITY              4           /* < Priority of uart event task */
+#define UART_TASK_STACK_SIZE            5120        /* < Stack size of uart event task, frames are in the frame pool */
 
 #ifdef __cplusplus
 } // extern "C"
@@ -0,0 +1,262 @@
+/**
+ * @file binary_log.c
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "esp_timer.h"
+
+/* Header */
+#include "binary_log.h"
+
+_Static_assert((BINARY_LOG_RING_SIZE & (BINARY_LOG_RING_SIZE - 1)) == 0, "ring size must be a power of two");
+_Static_assert(sizeof(binary_log_header_t) == 12, "header is part of the raw output format");
+
+/* Format table */
+static const struct {
+    binary_log_level_t level;
+    const char *tag;
+    const char *format;
+} formats[BINARY_LOG_FORMAT_COUNT] = {
+#define BINARY_LOG_ENTRY(id, level, tag, format) [id] = {level, tag, format},
+    BINARY_LOG_FORMATS(BINARY_LOG_ENTRY)
+#undef BINARY_LOG_ENTRY
+};
+
+/* Records are padded to 4 bytes and may wrap at the end of the ring */
+static uint8_t ring[BINARY_LOG_RING_SIZE];
+
+/* Free running byte positions, head is only written by the producer, tail only by the consumer */
+static atomic_uint head = 0;
+static atomic_uint tail = 0;
+static atomic_uint dropped = 0;
+
+/* ===== HELPER FUNCTIONS ===== */
+static void ring_copy_in(uint32_t position, const void *source, size_t size)
+{
+    if(size == 0){ return; }
+    uint32_t offset = position & (BINARY_LOG_RING_SIZE - 1);
+    size_t first = BINARY_LOG_RING_SIZE - offset;
+    if(first > size){ first = size; }
+
+    memcpy(&ring[offset], source, first);
+    memcpy(&ring[0], (const uint8_t *)source + first, size - first);
+}
+
+static void ring_copy_out(uint32_t position, void *destination, size_t size)
+{
+    if(size == 0){ return; }
+    uint32_t offset = position & (BINARY_LOG_RING_SIZE - 1);
+    size_t first = BINARY_LOG_RING_SIZE - offset;
+    if(first > size){ first = size; }
+
+    memcpy(destination, &ring[offset], first);
+    memcpy((uint8_t *)destination + first, &ring[0], size - first);
+}
+
+static size_t get_record_size(const binary_log_header_t *header)
+{
+    size_t size = sizeof(binary_log_header_t) + header->arg_count * sizeof(uint32_t) + header->data_size;
+    return (size + 3) & ~(size_t)3;
+}
+
+static int hex_value(char c)
+{
+    if(c >= '0' && c <= '9'){ return c - '0'; }
+    if(c >= 'A' && c <= 'F'){ return c - 'A' + 10; }
+    if(c >= 'a' && c <= 'f'){ return c - 'a' + 10; }
+    return -1;
+}
+
+/* ===== RING FUNCTIONS ===== */
+bool binary_log_write(binary_log_id_t id, const uint32_t *args, size_t arg_count, const void *data, size_t data_size)
+{
+    if(arg_count > BINARY_LOG_MAX_ARGS){ arg_count = BINARY_LOG_MAX_ARGS; }
+    if(data == NULL){ data_size = 0; }
+    if(data_size > BINARY_LOG_MAX_DATA_SIZE){ data_size = BINARY_LOG_MAX_DATA_SIZE; }
+
+    binary_log_header_t header = {
+        .timestamp_us = (uint32_t)esp_timer_get_time(),
+        .id = (uint16_t)id,
+        .data_size = (uint16_t)data_size,
+        .arg_count = (uint8_t)arg_count,
+    };
+    size_t size = get_record_size(&header);
+
+    /* Consumer frees space by advancing tail, acquire so its reads are finished before the bytes are overwritten */
+    uint32_t position = atomic_load_explicit(&head, memory_order_relaxed);
+    uint32_t used = position - atomic_load_explicit(&tail, memory_order_acquire);
+    if(used + size > BINARY_LOG_RING_SIZE)
+    {
+        atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+        return false;
+    }
+
+    ring_copy_in(position, &header, sizeof(header));
+    ring_copy_in(position + sizeof(header), args, arg_count * sizeof(uint32_t));
+    ring_copy_in(position + sizeof(header) + arg_count * sizeof(uint32_t), data, data_size);
+
+    /* Release, record is complete before the consumer sees it */
+    atomic_store_explicit(&head, position + size, memory_order_release);
+    return true;
+}
+
+bool binary_log_read(binary_log_record_t *record)
+{
+    uint32_t position = atomic_load_explicit(&tail, memory_order_relaxed);
+    if(position == atomic_load_explicit(&head, memory_order_acquire)){ return false; }
+
+    ring_copy_out(position, &record->header, sizeof(binary_log_header_t));
+    ring_copy_out(position + sizeof(binary_log_header_t), record->args, record->header.arg_count * sizeof(uint32_t));
+    ring_copy_out(position + sizeof(binary_log_header_t) + record->header.arg_count * sizeof(uint32_t), record->data, record->header.data_size);
+
+    atomic_store_explicit(&tail, position + get_record_size(&record->header), memory_order_release);
+    return true;
+}
+
+uint32_t binary_log_dropped()
+{
+    return (uint32_t)atomic_load_explicit(&dropped, memory_order_relaxed);
+}
+
+/* ===== FORMAT FUNCTIONS ===== */
+esp_err_t binary_log_format(const binary_log_record_t *record, char *line, size_t size)
+{
+    if(size == 0){ return ESP_ERR_INVALID_SIZE; }
+    if(record->header.id >= BINARY_LOG_FORMAT_COUNT)
+    {
+        snprintf(line, size, "Unknown format %u", record->header.id);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    const char *format = formats[record->header.id].format;
+    size_t length = 0;
+    size_t arg = 0;
+    line[0] = '\0';
+
+    while(*format != '\0' && length + 1 < size)
+    {
+        if(*format != '%')
+        {
+            line[length++] = *format++;
+            continue;
+        }
+
+        /* Copy conversion with flags and width, e.g. %02X */
+        char spec[16] = "%";
+        size_t spec_length = 1;
+        format++;
+        while(*format != '\0' && strchr("-+ #0123456789", *format) != NULL && spec_length < sizeof(spec) - 2)
+        {
+            spec[spec_length++] = *format++;
+        }
+        char conversion = *format;
+        if(conversion == '\0'){ break; }
+        format++;
+
+        int written = 0;
+        if(conversion == '%')
+        {
+            written = snprintf(&line[length], size - length, "%%");
+        }
+        else if(conversion == 'H')
+        {
+            for(size_t i = 0; i < record->header.data_size && length + 2 < size; i++)
+            {
+                length += (size_t)snprintf(&line[length], size - length, "%02X", record->data[i]);
+            }
+        }
+        else if(strchr("diuxXc", conversion) != NULL)
+        {
+            /* Missing arguments are printed as 0 */
+            uint32_t value = arg < record->header.arg_count ? record->args[arg] : 0;
+            arg++;
+            spec[spec_length++] = conversion;
+            spec[spec_length] = '\0';
+            if(conversion == 'd' || conversion == 'i'){ written = snprintf(&line[length], size - length, spec, (int)(int32_t)value); }
+            else{ written = snprintf(&line[length], size - length, spec, (unsigned int)value); }
+        }
+
+        if(written > 0){ length += (size_t)written < size - length ? (size_t)written : size - length - 1; }
+    }
+    line[length] = '\0';
+
+    return ESP_OK;
+}
+
+size_t binary_log_encode_hex(const binary_log_record_t *record, char *line, size_t size)
+{
+    size_t arg_size = record->header.arg_count * sizeof(uint32_t);
+    size_t total = sizeof(binary_log_header_t) + arg_size + record->header.data_size;
+    if(size < 2 * total + 1){ return 0; }
+
+    /* Target and supported hosts are little endian, fields are written as in memory */
+    static const char digits[] = "0123456789ABCDEF";
+    const uint8_t *parts[] = {(const uint8_t *)&record->header, (const uint8_t *)record->args, record->data};
+    const size_t sizes[] = {sizeof(binary_log_header_t), arg_size, record->header.data_size};
+    size_t length = 0;
+    for(size_t part = 0; part < 3; part++)
+    {
+        for(size_t i = 0; i < sizes[part]; i++)
+        {
+            line[length++] = digits[parts[part][i] >> 4];
+            line[length++] = digits[parts[part][i] & 0x0F];
+        }
+    }
+    line[length] = '\0';
+
+    return length;
+}
+
+esp_err_t binary_log_decode_hex(const char *line, binary_log_record_t *record)
+{
+    uint8_t *header = (uint8_t *)&record->header;
+    size_t length = 0;
+    size_t total = sizeof(binary_log_header_t);
+
+    while(length < total)
+    {
+        int high = hex_value(line[2 * length]);
+        int low = high < 0 ? -1 : hex_value(line[2 * length + 1]);
+        if(low < 0){ return ESP_ERR_INVALID_SIZE; }
+        uint8_t byte = (uint8_t)((high << 4) | low);
+
+        if(length < sizeof(binary_log_header_t))
+        {
+            header[length] = byte;
+            if(length + 1 == sizeof(binary_log_header_t))
+            {
+                if(record->header.arg_count > BINARY_LOG_MAX_ARGS || record->header.data_size > BINARY_LOG_MAX_DATA_SIZE){ return ESP_ERR_INVALID_SIZE; }
+                total += record->header.arg_count * sizeof(uint32_t) + record->header.data_size;
+            }
+        }
+        else if(length < sizeof(binary_log_header_t) + record->header.arg_count * sizeof(uint32_t))
+        {
+            ((uint8_t *)record->args)[length - sizeof(binary_log_header_t)] = byte;
+        }
+        else
+        {
+            record->data[length - sizeof(binary_log_header_t) - record->header.arg_count * sizeof(uint32_t)] = byte;
+        }
+        length++;
+    }
+
+    /* Trailing characters, e.g. line break, are ignored if they are not hex */
+    return hex_value(line[2 * length]) < 0 ? ESP_OK : ESP_ERR_INVALID_SIZE;
+}
+
+binary_log_level_t binary_log_get_level(uint16_t id, const char **tag)
+{
+    if(id >= BINARY_LOG_FORMAT_COUNT)
+    {
+        *tag = "?";
+        return BINARY_LOG_LEVEL_INFO;
+    }
+    *tag = formats[id].tag;
+    return formats[id].level;
+}
@@ -0,0 +1,73 @@
+/**
+ * @file binary_log_task.c
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <stdio.h>
+
+/* Logging */
+#include "esp_log.h"
+static const char* TAG = "binary_log";
+
+/* Header */
+#include "binary_log.h"
+
+/* FreeRTOS Libraries */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/* ===== TASK ===== */
+/* Formats or prints records while the ring isn't empty, then sleeps */
+static void binary_log_task(void *pvParameters)
+{
+    static binary_log_record_t record;
+    static char line[BINARY_LOG_LINE_SIZE];
+    uint32_t reported_drops = 0;
+
+    for(;;)
+    {
+        while(binary_log_read(&record))
+        {
+#if BINARY_LOG_RAW_OUTPUT
+            if(binary_log_encode_hex(&record, line, sizeof(line)) > 0)
+            {
+                printf(BINARY_LOG_RAW_PREFIX "%s\n", line);
+            }
+#else
+            const char *tag = NULL;
+            binary_log_level_t level = binary_log_get_level(record.header.id, &tag);
+            binary_log_format(&record, line, sizeof(line));
+
+            /* Time of record, the log prefix shows the time of formatting */
+            unsigned long time_ms = (unsigned long)(record.header.timestamp_us / 1000);
+            switch(level)
+            {
+                case BINARY_LOG_LEVEL_ERROR: ESP_LOGE(tag, "[%lu] %s", time_ms, line); break;
+                case BINARY_LOG_LEVEL_WARN: ESP_LOGW(tag, "[%lu] %s", time_ms, line); break;
+                default: ESP_LOGI(tag, "[%lu] %s", time_ms, line); break;
+            }
+#endif
+        }
+
+        uint32_t drops = binary_log_dropped();
+        if(drops != reported_drops)
+        {
+            ESP_LOGW(TAG, "%lu records dropped, ring full", (unsigned long)(drops - reported_drops));
+            reported_drops = drops;
+        }
+
+        vTaskDelay(pdMS_TO_TICKS(BINARY_LOG_FLUSH_INTERVAL_MS));
+    }
+}
+
+/* ===== LOG FUNCTIONS ===== */
+esp_err_t binary_log_init()
+{
+    if(xTaskCreate(binary_log_task, "binary_log", BINARY_LOG_TASK_STACK_SIZE, NULL, BINARY_LOG_TASK_PRIORITY, NULL) != pdPASS)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
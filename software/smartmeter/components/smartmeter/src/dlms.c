@@ -15,20 +15,47 @@ static const char* TAG = "DLMS";
 #include "general.h"
 #include "dlms.h"
 
-/* Encryption Library */
-#include "mbedtls/gcm.h"
+/* ===== DECRYPTION CONTEXT ===== */
+void dlms_decryptor_init(dlms_decryptor_t* decryptor)
+{
+    mbedtls_gcm_init(&decryptor->gcm);
+    decryptor->has_key = false;
+}
+
+void dlms_decryptor_free(dlms_decryptor_t* decryptor)
+{
+    mbedtls_gcm_free(&decryptor->gcm);
+    decryptor->has_key = false;
+}
 
 /* ===== DLMS Layer ===== */
-esp_err_t parse_dlms_layer(uint8_t* user_data, size_t user_data_size, uint8_t* decrypted_data, size_t* decrypted_data_size, const uint8_t* gue_key)
+esp_err_t parse_dlms_layer(uint8_t* user_data, size_t user_data_size, size_t* decrypted_data_offset, size_t* decrypted_data_size, const uint8_t* gue_key)
+{
+    /* Context for one telegram */
+    dlms_decryptor_t decryptor;
+    dlms_decryptor_init(&decryptor);
+    esp_err_t err = parse_dlms_layer_with(&decryptor, user_data, user_data_size, decrypted_data_offset, decrypted_data_size, gue_key);
+    dlms_decryptor_free(&decryptor);
+    return err;
+}
+
+esp_err_t parse_dlms_layer_with(dlms_decryptor_t* decryptor, uint8_t* user_data, size_t user_data_size, size_t* decrypted_data_offset,
+                                size_t* decrypted_data_size, const uint8_t* gue_key)
 {
-    /* Encrypted data buffer */
-    static uint8_t encrypted_data[DATA_BUFFER_SIZE];
+    /* Encrypted data is combined and decrypted in place, header with system title and frame counter stays in front */
     uint16_t encrypted_data_size = 0;
 
     /* ===== GET RELEVANT DATA AND COMBINE FRAMES ===== */
     /* This part can be different for other smartmeters */
 
     /* === HANDLE FIRST FRAME OF DLMS DATA === */
+    /* Header up to system title length must be there, e.g. after a short last M-Bus frame */
+    if(user_data_size < DLMS_SYSTEM_TITLE_OFFSET)
+    {
+        ESP_LOGE(TAG, "DLMS: Packet too short");
+        return ESP_FAIL;
+    }
+
     /* Check for data packet start value */
     if((user_data[0] != DLMS_START_VAL1) || (user_data[1] != DLMS_START_VAL2))
     {
@@ -46,10 +73,22 @@ esp_err_t parse_dlms_layer(uint8_t* user_data, size_t user_data_size, uint8_t* d
     /* Get system title length */
     uint8_t title_length = user_data[DLMS_SYSTEM_TITLE_LENGTH_OFFSET];
 
+    /* System title and frame counter form the initialization vector */
+    if(title_length > AES_IV_SIZE - DLMS_FRAME_COUNTER_SIZE)
+    {
+        ESP_LOGE(TAG, "DLMS: Invalid system title length");
+        return ESP_FAIL;
+    }
+
     /* Calculate offset via title length */
     uint8_t curr_offset = DLMS_SYSTEM_TITLE_OFFSET + title_length + DLMS_UNKNOWN_SIZE + DLMS_FRAME_COUNTER_SIZE;
+    if(user_data_size < curr_offset)
+    {
+        ESP_LOGE(TAG, "DLMS: Packet too short");
+        return ESP_FAIL;
+    }
 
-    /* Calculate size to copy */
+    /* Calculate size of first frame, it stays where it is */
     if(user_data_size < DLMS_MAX_SIZE)
     {
         encrypted_data_size = user_data_size - curr_offset;
@@ -59,13 +98,17 @@ esp_err_t parse_dlms_layer(uint8_t* user_data, size_t user_data_size, uint8_t* d
         encrypted_data_size = DLMS_MAX_SIZE - curr_offset;
     }
 
-    /* Copy first frame */
-    memcpy(&encrypted_data[0], &user_data[DLMS_SYSTEM_TITLE_OFFSET + title_length + DLMS_UNKNOWN_SIZE + DLMS_FRAME_COUNTER_SIZE], encrypted_data_size);
-
     /* === HANDLE SUBSEQUENT FRAMES === */
-    for(int i = DLMS_MAX_SIZE; user_data_size > i; i += DLMS_MAX_SIZE)
+    for(size_t i = DLMS_MAX_SIZE; user_data_size > i; i += DLMS_MAX_SIZE)
     {
-        /* Check for data packet start value */
+        /* Start value of a frame must be complete, a last frame of one byte can't be one */
+        if(i + DLMS_DATA_START_OFFSET > user_data_size)
+        {
+            ESP_LOGE(TAG, "DLMS: Packet too short");
+            return ESP_FAIL;
+        }
+
+        /* Check for data packet start value, not overwritten yet as each frame moves by DLMS_DATA_START_OFFSET only */
         if((user_data[i] != DLMS_START_VAL1) || (user_data[i + 1] != DLMS_START_VAL2))
         {
             ESP_LOGE(TAG, "DLMS: Invalid packet start value");
@@ -82,8 +125,15 @@ esp_err_t parse_dlms_layer(uint8_t* user_data, size_t user_data_size, uint8_t* d
         {
             frame_size = user_data_size - i - DLMS_DATA_START_OFFSET;
         }
-        /* Copy frame */
-        memcpy(&encrypted_data[encrypted_data_size], &user_data[i + DLMS_DATA_START_OFFSET], frame_size);
+
+        /* Data only moves left, never beyond the user data */
+        if((size_t)curr_offset + encrypted_data_size + frame_size > user_data_size)
+        {
+            ESP_LOGE(TAG, "DLMS: Invalid frame size");
+            return ESP_FAIL;
+        }
+        /* Move frame behind previous one */
+        memmove(&user_data[curr_offset + encrypted_data_size], &user_data[i + DLMS_DATA_START_OFFSET], frame_size);
         
         /* Increment data size */
         encrypted_data_size += frame_size;
@@ -99,21 +149,74 @@ esp_err_t parse_dlms_layer(uint8_t* user_data, size_t user_data_size, uint8_t* d
     /* Copy frame counter to the end of iv */
     memcpy(&iv[AES_IV_SIZE - DLMS_FRAME_COUNTER_SIZE], &user_data[DLMS_FRAME_COUNTER_OFFSET], DLMS_FRAME_COUNTER_SIZE);
 
-    /* Create context structure */
-    mbedtls_gcm_context aes;
-
-    /* Initialize context structure */
-    mbedtls_gcm_init(&aes);
+    /* Set decryption key, expanding it costs more than decrypting a telegram */
+    if(!decryptor->has_key || memcmp(decryptor->key, gue_key, GUE_KEY_LENGTH) != 0)
+    {
+        if(mbedtls_gcm_setkey(&decryptor->gcm, MBEDTLS_CIPHER_ID_AES, gue_key, GUE_KEY_LENGTH * 8) != 0)
+        {
+            decryptor->has_key = false;
+            ESP_LOGE(TAG, "DLMS: Setting key failed");
+            return ESP_FAIL;
+        }
+        memcpy(decryptor->key, gue_key, GUE_KEY_LENGTH);
+        decryptor->has_key = true;
+    }
 
-    /* Set decryption key */
-    mbedtls_gcm_setkey(&aes, MBEDTLS_CIPHER_ID_AES, gue_key, GUE_KEY_LENGTH * 8);
+    /* Decrypt data, GCM allows output to be the input buffer */
+    if(user_data[DLMS_SYSTEM_TITLE_OFFSET + title_length + DLMS_SECURITY_CONTROL_OFFSET] & DLMS_SECURITY_AUTHENTICATED)
+    {
+        /* Tag follows cipher text, a wrong key or modified data fails authentication */
+        if(encrypted_data_size < DLMS_AUTH_TAG_SIZE)
+        {
+            ESP_LOGE(TAG, "DLMS: Packet too short");
+            return ESP_FAIL;
+        }
+        encrypted_data_size -= DLMS_AUTH_TAG_SIZE;
+        if(mbedtls_gcm_auth_decrypt(&decryptor->gcm, encrypted_data_size, &iv[0], AES_IV_SIZE, NULL, 0, &user_data[curr_offset + encrypted_data_size],
+                                    DLMS_AUTH_TAG_SIZE, &user_data[curr_offset], &user_data[curr_offset]) != 0)
+        {
+            ESP_LOGE(TAG, "DLMS: Authentication failed");
+            return ESP_FAIL;
+        }
+    }
+    else
+    {
+        /* No tag is transmitted, the computed one is not needed */
+        uint8_t tag[DLMS_AUTH_TAG_SIZE];
+        if(mbedtls_gcm_crypt_and_tag(&decryptor->gcm, MBEDTLS_GCM_DECRYPT, encrypted_data_size, &iv[0], AES_IV_SIZE, NULL, 0, &user_data[curr_offset],
+                                     &user_data[curr_offset], DLMS_AUTH_TAG_SIZE, tag) != 0)
+        {
+            ESP_LOGE(TAG, "DLMS: Decryption failed");
+            return ESP_FAIL;
+        }
 
-    /* Decrypt data */
-    mbedtls_gcm_auth_decrypt(&aes, encrypted_data_size, &iv[0], AES_IV_SIZE, NULL, 0, NULL, 0, &encrypted_data[0], decrypted_data);
+        /* Wrong key results in random data */
+        if(encrypted_data_size == 0 || user_data[curr_offset] != DLMS_PLAINTEXT_START)
+        {
+            ESP_LOGE(TAG, "DLMS: Invalid decrypted data, wrong key?");
+            return ESP_FAIL;
+        }
+    }
+    *decrypted_data_offset = curr_offset;
     *decrypted_data_size = encrypted_data_size;
 
-    /* Free contest structure */
-    mbedtls_gcm_free(&aes);
+    return ESP_OK;
+}
+
+esp_err_t get_dlms_frame_counter(const uint8_t* user_data, size_t user_data_size, uint32_t* frame_counter)
+{
+    /* Frame counter follows system title and 0x81F820 */
+    if(user_data_size <= DLMS_SYSTEM_TITLE_LENGTH_OFFSET)
+    {
+        return ESP_FAIL;
+    }
+    size_t offset = DLMS_SYSTEM_TITLE_OFFSET + user_data[DLMS_SYSTEM_TITLE_LENGTH_OFFSET] + DLMS_UNKNOWN_SIZE;
+    if(offset + DLMS_FRAME_COUNTER_SIZE > user_data_size)
+    {
+        return ESP_FAIL;
+    }
 
+    /* Big endian */
+    *frame_counter = ((uint32_t)user_data[offset] << 24) | ((uint32_t)user_data[offset + 1] << 16) | ((uint32_t)user_data[offset + 2] << 8) | user_data[offset + 3];
     return ESP_OK;
-}
\ No newline at end of file
+}
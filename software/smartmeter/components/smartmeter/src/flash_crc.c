@@ -0,0 +1,31 @@
+/**
+ * @file flash_crc.c
+ * 
+ * @copyright Copyright (c) 2023
+ * 
+ */
+
+/* Header */
+#include "flash_ops.h"
+
+/* ===== CHECKSUM ===== */
+/* CRC of each nibble value, 64 bytes instead of 1 KiB of a byte table */
+static const uint32_t crc32_nibble_table[16] =
+{
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+uint32_t flash_ops_crc32(uint32_t crc, const void *data, size_t size)
+{
+    /* Two table lookups per byte, fast enough for host tools checking large captures */
+    const uint8_t *bytes = data;
+    crc = ~crc;
+    for(size_t i = 0; i < size; i++)
+    {
+        crc ^= bytes[i];
+        crc = (crc >> 4) ^ crc32_nibble_table[crc & 0x0F];
+        crc = (crc >> 4) ^ crc32_nibble_table[crc & 0x0F];
+    }
+    return ~crc;
+}
@@ -0,0 +1,43 @@
+/**
+ * @file flash_ops.c
+ * 
+ * @copyright Copyright (c) 2023
+ * 
+ */
+
+/* Header */
+#include "flash_ops.h"
+
+#include "esp_partition.h"
+
+/* ===== PARTITION OPERATIONS ===== */
+static esp_err_t partition_read(void *ctx, size_t offset, void *data, size_t size)
+{
+    return esp_partition_read((const esp_partition_t *)ctx, offset, data, size);
+}
+
+static esp_err_t partition_write(void *ctx, size_t offset, const void *data, size_t size)
+{
+    return esp_partition_write((const esp_partition_t *)ctx, offset, data, size);
+}
+
+static esp_err_t partition_erase(void *ctx, size_t offset, size_t size)
+{
+    return esp_partition_erase_range((const esp_partition_t *)ctx, offset, size);
+}
+
+esp_err_t flash_ops_partition(const char *label, uint8_t subtype, flash_ops_t *ops)
+{
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, subtype, label);
+    if(partition == NULL)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    ops->read = partition_read;
+    ops->write = partition_write;
+    ops->erase = partition_erase;
+    ops->ctx = (void *)partition;
+    ops->size = partition->size - (partition->size % FLASH_OPS_SECTOR_SIZE);
+    return ESP_OK;
+}
@@ -0,0 +1,65 @@
+/**
+ * @file frame_pool.c
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <stdatomic.h>
+
+/* Header */
+#include "frame_pool.h"
+
+_Static_assert(FRAME_POOL_COUNT <= 32, "free frames are one bit each");
+
+/* Frames and bitmap of free frames */
+static frame_t frames[FRAME_POOL_COUNT];
+static atomic_uint free_frames = (FRAME_POOL_COUNT == 32) ? UINT32_MAX : ((1u << FRAME_POOL_COUNT) - 1);
+
+/* Usage */
+static atomic_uint in_use = 0;
+static atomic_uint peak = 0;
+static atomic_uint empty = 0;
+
+/* ===== POOL FUNCTIONS ===== */
+frame_t* frame_pool_take()
+{
+    unsigned int state = atomic_load(&free_frames);
+    unsigned int bit;
+    do {
+        if(state == 0)
+        {
+            atomic_fetch_add_explicit(&empty, 1, memory_order_relaxed);
+            return NULL;
+        }
+        bit = state & (~state + 1);     /* < Lowest free frame */
+    } while(!atomic_compare_exchange_weak(&free_frames, &state, state & ~bit));
+
+    /* Peak only grows */
+    unsigned int used = atomic_fetch_add_explicit(&in_use, 1, memory_order_relaxed) + 1;
+    unsigned int maximum = atomic_load_explicit(&peak, memory_order_relaxed);
+    while(used > maximum && !atomic_compare_exchange_weak_explicit(&peak, &maximum, used, memory_order_relaxed, memory_order_relaxed)){ }
+
+    frame_t *frame = &frames[__builtin_ctz(bit)];
+    frame->offset = 0;
+    frame->size = 0;
+    return frame;
+}
+
+void frame_pool_give(frame_t *frame)
+{
+    if(frame == NULL){ return; }
+
+    size_t index = (size_t)(frame - frames);
+    if(index >= FRAME_POOL_COUNT){ return; }
+
+    atomic_fetch_sub_explicit(&in_use, 1, memory_order_relaxed);
+    atomic_fetch_or(&free_frames, 1u << index);
+}
+
+void frame_pool_get_stats(frame_pool_stats_t *stats)
+{
+    stats->in_use = (uint32_t)atomic_load_explicit(&in_use, memory_order_relaxed);
+    stats->peak = (uint32_t)atomic_load_explicit(&peak, memory_order_relaxed);
+    stats->empty = (uint32_t)atomic_load_explicit(&empty, memory_order_relaxed);
+}
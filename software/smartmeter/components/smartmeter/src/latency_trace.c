@@ -0,0 +1,171 @@
+/**
+ * @file latency_trace.c
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <string.h>
+#include <stdatomic.h>
+
+/* Setup logging */
+#include "esp_log.h"
+static const char* TAG = "latency";
+
+/* Cycle counter */
+#include "esp_cpu.h"
+#include "esp_rom_sys.h"
+
+/* Header */
+#include "latency_trace.h"
+
+#if LATENCY_TRACE_ENABLED
+
+/* Cycle count of each stage of the current telegram, 32 bit wraps after 26 s at 160 MHz */
+static uint32_t stamps[LATENCY_STAGE_COUNT];
+
+/* Stages marked for the current telegram */
+static atomic_uint marked = 0;
+
+/* Each row is written by one task only, uart event task for stages up to OBIS_DECODED, zigbee task for the others */
+static latency_trace_histograms_t histograms;
+
+/* ===== HELPER FUNCTIONS ===== */
+static uint32_t get_bucket(uint32_t us)
+{
+    uint32_t scaled = us / LATENCY_TRACE_BASE_US;
+    if(scaled == 0){ return 0; }
+
+    uint32_t bucket = 32 - (uint32_t)__builtin_clz(scaled);
+    return bucket < LATENCY_TRACE_BUCKETS ? bucket : LATENCY_TRACE_BUCKETS - 1;
+}
+
+static void add_sample(latency_stage_t row, uint32_t cycles)
+{
+    uint32_t us = cycles / esp_rom_get_cpu_ticks_per_us();
+    uint16_t *count = &histograms.buckets[row][get_bucket(us)];
+    if(*count < UINT16_MAX){ (*count)++; }
+    if(us > histograms.max_us[row]){ histograms.max_us[row] = us; }
+}
+
+/* Upper limit of bucket in which the given fraction of samples is reached */
+static uint32_t get_percentile_us(const uint16_t *buckets, uint32_t count, uint32_t percent)
+{
+    uint32_t target = (count * percent + 99) / 100;
+    uint32_t sum = 0;
+    for(uint32_t i = 0; i < LATENCY_TRACE_BUCKETS; i++)
+    {
+        sum += buckets[i];
+        if(sum >= target){ return (uint32_t)LATENCY_TRACE_BASE_US << i; }
+    }
+    return (uint32_t)LATENCY_TRACE_BASE_US << (LATENCY_TRACE_BUCKETS - 1);
+}
+
+static void put_le(uint8_t *buffer, uint32_t value, size_t bytes)
+{
+    for(size_t i = 0; i < bytes; i++)
+    {
+        buffer[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+/* ===== TRACE FUNCTIONS ===== */
+void latency_trace_mark(latency_stage_t stage)
+{
+    uint32_t now = esp_cpu_get_cycle_count();
+    uint32_t bit = 1u << stage;
+
+    /* First byte starts a new telegram */
+    if(stage == LATENCY_STAGE_FIRST_BYTE)
+    {
+        stamps[stage] = now;
+        atomic_store(&marked, bit);
+        return;
+    }
+
+    /* Previous stage missing, e.g. parsing failed, or stage already marked */
+    uint32_t state = atomic_load(&marked);
+    if(stage >= LATENCY_STAGE_COUNT || !(state & (bit >> 1)) || (state & bit)){ return; }
+
+    stamps[stage] = now;
+    atomic_fetch_or(&marked, bit);
+    add_sample(stage, now - stamps[stage - 1]);
+
+    /* End to end */
+    if(stage == LATENCY_STAGE_REPORT_CONFIRMED)
+    {
+        add_sample(LATENCY_STAGE_FIRST_BYTE, now - stamps[LATENCY_STAGE_FIRST_BYTE]);
+    }
+}
+
+void latency_trace_get(latency_trace_histograms_t *copy)
+{
+    memcpy(copy, &histograms, sizeof(latency_trace_histograms_t));
+}
+
+void latency_trace_reset()
+{
+    memset(&histograms, 0, sizeof(histograms));
+}
+
+void latency_trace_log()
+{
+    latency_trace_histograms_t copy;
+    latency_trace_get(&copy);
+
+    for(int stage = 0; stage < LATENCY_STAGE_COUNT; stage++)
+    {
+        uint32_t count = 0;
+        for(int i = 0; i < LATENCY_TRACE_BUCKETS; i++)
+        {
+            count += copy.buckets[stage][i];
+        }
+        if(count == 0){ continue; }
+
+        ESP_LOGI(TAG, "%-18s n=%-6lu p50<%-8lu p90<%-8lu max=%lu us", latency_trace_stage_name((latency_stage_t)stage), (unsigned long)count,
+                 (unsigned long)get_percentile_us(copy.buckets[stage], count, 50), (unsigned long)get_percentile_us(copy.buckets[stage], count, 90),
+                 (unsigned long)copy.max_us[stage]);
+    }
+}
+
+size_t latency_trace_encode(uint8_t *buffer, size_t size)
+{
+    if(size < LATENCY_TRACE_ENCODED_SIZE){ return 0; }
+
+    latency_trace_histograms_t copy;
+    latency_trace_get(&copy);
+
+    buffer[0] = LATENCY_TRACE_FORMAT_VERSION;
+    buffer[1] = LATENCY_STAGE_COUNT;
+    buffer[2] = LATENCY_TRACE_BUCKETS;
+    put_le(&buffer[3], LATENCY_TRACE_BASE_US, 2);
+    size_t offset = 5;
+    for(int stage = 0; stage < LATENCY_STAGE_COUNT; stage++)
+    {
+        for(int i = 0; i < LATENCY_TRACE_BUCKETS; i++)
+        {
+            put_le(&buffer[offset], copy.buckets[stage][i], 2);
+            offset += 2;
+        }
+        put_le(&buffer[offset], copy.max_us[stage], 4);
+        offset += 4;
+    }
+    return offset;
+}
+
+const char* latency_trace_stage_name(latency_stage_t stage)
+{
+    switch(stage)
+    {
+        case LATENCY_STAGE_FIRST_BYTE: return "total";
+        case LATENCY_STAGE_TELEGRAM_COMPLETE: return "telegram complete";
+        case LATENCY_STAGE_MBUS_PARSED: return "mbus parsed";
+        case LATENCY_STAGE_DECRYPTED: return "decrypted";
+        case LATENCY_STAGE_OBIS_DECODED: return "obis decoded";
+        case LATENCY_STAGE_REPORT_QUEUED: return "report queued";
+        case LATENCY_STAGE_REPORT_CONFIRMED: return "report confirmed";
+        default: return "unknown";
+    }
+}
+
+#endif
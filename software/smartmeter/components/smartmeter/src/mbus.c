@@ -19,7 +19,7 @@ static const char* TAG = "MBUS";
 esp_err_t parse_mbus_long_frame_layer(uint8_t* payload, size_t payload_size, uint8_t* user_data, size_t* user_data_size)
 {
     /* Offset if multiple frames need to be parsed */
-    uint16_t curr_offset = 0;
+    size_t curr_offset = 0;
     
     /* New data, set user data size to zero */
     *user_data_size = 0;
@@ -41,8 +41,18 @@ esp_err_t parse_mbus_long_frame_layer(uint8_t* payload, size_t payload_size, uin
             return ESP_FAIL;
         }
         
-        /* Get user data size (l-field) */
+        /* L-field counts C-, A- and CI-field too, frame must be complete */
+        if(payload[curr_offset + MBUS_LENGTH1_OFFSET] < MBUS_USER_DATA_SIZE_OFFSET)
+        {
+            ESP_LOGE(TAG, "Invalid length!");
+            return ESP_FAIL;
+        }
         uint8_t l_field = payload[curr_offset + MBUS_LENGTH1_OFFSET] - MBUS_USER_DATA_SIZE_OFFSET;
+        if(curr_offset + MBUS_HEADER_LENGTH + l_field + MBUS_FOOTER_LENGTH > payload_size)
+        {
+            ESP_LOGE(TAG, "Frame truncated!");
+            return ESP_FAIL;
+        }
         
         /* Check Stop-field integrity */
         if(payload[curr_offset + MBUS_HEADER_LENGTH + l_field + MBUS_FOOTER_LENGTH - 1] != MBUS_STOP_VALUE)
@@ -51,8 +61,20 @@ esp_err_t parse_mbus_long_frame_layer(uint8_t* payload, size_t payload_size, uin
             return ESP_FAIL;
         }
         
-        /* Frame check passed, everything ok, copy user data to buffer */
-        memcpy(&user_data[*user_data_size], &payload[curr_offset + MBUS_USER_DATA_OFFSET], l_field);
+        /* Check sum of C-field up to the last user data byte */
+        uint8_t checksum = 0;
+        for(size_t i = curr_offset + MBUS_CHECKSUM_START_OFFSET; i < curr_offset + MBUS_HEADER_LENGTH + l_field; i++)
+        {
+            checksum += payload[i];
+        }
+        if(payload[curr_offset + MBUS_HEADER_LENGTH + l_field] != checksum)
+        {
+            ESP_LOGE(TAG, "Invalid checksum!");
+            return ESP_FAIL;
+        }
+        
+        /* Frame check passed, everything ok, copy user data to buffer, moves left if it is the payload buffer */
+        memmove(&user_data[*user_data_size], &payload[curr_offset + MBUS_USER_DATA_OFFSET], l_field);
      
         /* Set offset to next frame */
         curr_offset += MBUS_HEADER_LENGTH + l_field + MBUS_FOOTER_LENGTH;
@@ -0,0 +1,265 @@
+/**
+ * @file meter_capture.c
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <string.h>
+
+/* Header */
+#include "meter_capture.h"
+#include "flash_ops.h"
+
+#if METER_CAPTURE_ENABLED
+
+/* Logging */
+#include "esp_log.h"
+static const char* TAG = "CAPTURE";
+
+/* FreeRTOS Libraries */
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "esp_timer.h"
+
+_Static_assert(METER_CAPTURE_RING_SIZE % 4 == 0, "records are padded to 4 bytes");
+
+/* Records padded to 4 bytes, may wrap at the end of the ring */
+static uint8_t ring[METER_CAPTURE_RING_SIZE];
+
+/* Free running byte positions of oldest record and end of newest record */
+static uint32_t tail = 0;
+static uint32_t head = 0;
+static uint16_t record_count = 0;
+static SemaphoreHandle_t ring_mutex = NULL;
+
+/* Uart data events of current telegram, only used by uart event task */
+static meter_capture_chunk_t chunks[METER_CAPTURE_MAX_CHUNKS];
+static size_t chunk_count = 0;
+static int64_t first_chunk_us = 0;
+
+/* Spill to flash */
+static flash_ops_t flash;
+static bool flash_available = false;
+static int64_t spill_time_us = 0;
+static bool spilled = false;
+static TaskHandle_t spill_task_handle = NULL;
+
+/* ===== HELPER FUNCTIONS ===== */
+static void ring_copy_in(uint32_t position, const void *source, size_t size)
+{
+    if(size == 0){ return; }
+    uint32_t offset = position % METER_CAPTURE_RING_SIZE;
+    size_t first = METER_CAPTURE_RING_SIZE - offset;
+    if(first > size){ first = size; }
+
+    memcpy(&ring[offset], source, first);
+    memcpy(&ring[0], (const uint8_t *)source + first, size - first);
+}
+
+static void ring_copy_out(uint32_t position, void *destination, size_t size)
+{
+    uint32_t offset = position % METER_CAPTURE_RING_SIZE;
+    size_t first = METER_CAPTURE_RING_SIZE - offset;
+    if(first > size){ first = size; }
+
+    memcpy(destination, &ring[offset], first);
+    memcpy((uint8_t *)destination + first, &ring[0], size - first);
+}
+
+/* Ring as at most two contiguous parts, oldest first */
+static size_t get_parts(const uint8_t **parts, size_t *sizes)
+{
+    uint32_t used = head - tail;
+    uint32_t offset = tail % METER_CAPTURE_RING_SIZE;
+    size_t first = METER_CAPTURE_RING_SIZE - offset;
+    if(first > used){ first = used; }
+
+    parts[0] = &ring[offset];
+    sizes[0] = first;
+    parts[1] = &ring[0];
+    sizes[1] = used - first;
+    return sizes[1] > 0 ? 2 : 1;
+}
+
+/* ===== SPILL TASK ===== */
+/* Erasing blocks for tens of ms, the uart event task only wakes this task */
+static void meter_capture_task(void *pvParameters)
+{
+    for(;;)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        /* Uart event task skips captures while the ring is written, not while erasing */
+        esp_err_t err = meter_capture_spill();
+        if(err != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Spilling capture failed (%s)", esp_err_to_name(err));
+        }
+        else
+        {
+            ESP_LOGI(TAG, "Capture of %d telegrams spilled to flash", record_count);
+        }
+    }
+}
+
+/* ===== CAPTURE FUNCTIONS ===== */
+esp_err_t meter_capture_init()
+{
+    ring_mutex = xSemaphoreCreateMutex();
+    if(ring_mutex == NULL){ return ESP_ERR_NO_MEM; }
+
+    /* Optional, capture stays in RAM without partition */
+    esp_err_t err = flash_ops_partition(METER_CAPTURE_PARTITION_LABEL, METER_CAPTURE_PARTITION_SUBTYPE, &flash);
+    flash_available = err == ESP_OK && flash.size >= sizeof(meter_capture_file_header_t) + METER_CAPTURE_RING_SIZE;
+    if(!flash_available)
+    {
+        ESP_LOGW(TAG, "No capture partition, captured telegrams are not spilled to flash");
+        return ESP_OK;
+    }
+
+    if(xTaskCreate(meter_capture_task, "capture_task", METER_CAPTURE_TASK_STACK_SIZE, NULL, METER_CAPTURE_TASK_PRIORITY, &spill_task_handle) != pdPASS)
+    {
+        flash_available = false;
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void meter_capture_chunk(size_t size, bool first)
+{
+    int64_t now_us = esp_timer_get_time();
+
+    /* First event after idle line starts a telegram, previous one may not have been committed */
+    if(first || chunk_count == 0)
+    {
+        chunk_count = 0;
+        first_chunk_us = now_us;
+    }
+
+    int64_t offset_ms = (now_us - first_chunk_us) / 1000;
+    if(chunk_count < METER_CAPTURE_MAX_CHUNKS)
+    {
+        chunks[chunk_count].offset_ms = offset_ms > UINT16_MAX ? UINT16_MAX : (uint16_t)offset_ms;
+        chunks[chunk_count].size = 0;
+        chunk_count++;
+    }
+    uint32_t total = chunks[chunk_count - 1].size + size;
+    chunks[chunk_count - 1].size = total > UINT16_MAX ? UINT16_MAX : (uint16_t)total;
+}
+
+void meter_capture_commit(const uint8_t *data, size_t size, uint8_t flags)
+{
+    meter_capture_record_header_t header = {
+        .timestamp_ms = (uint32_t)(first_chunk_us / 1000),
+        .size = (uint16_t)size,
+        .chunk_count = (uint8_t)chunk_count,
+        .flags = flags,
+    };
+    size_t record_size = meter_capture_record_size(&header);
+    chunk_count = 0;
+
+    /* Dump or spill in progress, uart event task doesn't wait */
+    if(ring_mutex == NULL || record_size > METER_CAPTURE_RING_SIZE){ return; }
+    if(xSemaphoreTake(ring_mutex, 0) != pdTRUE){ return; }
+
+    /* Overwrite oldest records */
+    while(head - tail + record_size > METER_CAPTURE_RING_SIZE)
+    {
+        meter_capture_record_header_t oldest;
+        ring_copy_out(tail, &oldest, sizeof(oldest));
+        tail += meter_capture_record_size(&oldest);
+        record_count--;
+    }
+
+    static const uint8_t padding[3] = {0};
+    uint32_t position = head;
+    ring_copy_in(position, &header, sizeof(header));
+    position += sizeof(header);
+    ring_copy_in(position, chunks, header.chunk_count * sizeof(meter_capture_chunk_t));
+    position += header.chunk_count * sizeof(meter_capture_chunk_t);
+    ring_copy_in(position, data, size);
+    position += size;
+    ring_copy_in(position, padding, head + record_size - position);
+    head += record_size;
+    record_count++;
+
+    xSemaphoreGive(ring_mutex);
+}
+
+void meter_capture_failed()
+{
+    if(!flash_available){ return; }
+
+    /* First failure after boot is always kept */
+    int64_t now_us = esp_timer_get_time();
+    if(spilled && now_us - spill_time_us < METER_CAPTURE_SPILL_INTERVAL_MS * 1000LL){ return; }
+    spill_time_us = now_us;
+    spilled = true;
+
+    /* Spill task dumps the ring as it is then, including telegrams received until it runs */
+    xTaskNotifyGive(spill_task_handle);
+}
+
+esp_err_t meter_capture_spill()
+{
+    if(!flash_available){ return ESP_ERR_NOT_FOUND; }
+
+    size_t erase_size = sizeof(meter_capture_file_header_t) + METER_CAPTURE_RING_SIZE;
+    erase_size = (erase_size + FLASH_OPS_SECTOR_SIZE - 1) / FLASH_OPS_SECTOR_SIZE * FLASH_OPS_SECTOR_SIZE;
+    if(erase_size > flash.size){ erase_size = flash.size; }
+
+    esp_err_t err = flash.erase(flash.ctx, 0, erase_size);
+    if(err != ESP_OK){ return err; }
+
+    return meter_capture_dump(flash.write, flash.ctx);
+}
+
+esp_err_t meter_capture_dump(esp_err_t (* write)(void *ctx, size_t offset, const void *data, size_t size), void *ctx)
+{
+    if(ring_mutex == NULL){ return ESP_ERR_INVALID_STATE; }
+    xSemaphoreTake(ring_mutex, portMAX_DELAY);
+
+    const uint8_t *parts[2];
+    size_t sizes[2];
+    size_t part_count = get_parts(parts, sizes);
+
+    meter_capture_file_header_t header = {
+        .magic = METER_CAPTURE_MAGIC,
+        .version = METER_CAPTURE_FORMAT_VERSION,
+        .record_count = record_count,
+        .records_size = head - tail,
+        .crc = 0,
+    };
+    for(size_t i = 0; i < part_count; i++)
+    {
+        header.crc = flash_ops_crc32(header.crc, parts[i], sizes[i]);
+    }
+
+    esp_err_t err = write(ctx, 0, &header, sizeof(header));
+    size_t offset = sizeof(header);
+    for(size_t i = 0; i < part_count && err == ESP_OK; i++)
+    {
+        err = write(ctx, offset, parts[i], sizes[i]);
+        offset += sizes[i];
+    }
+
+    xSemaphoreGive(ring_mutex);
+    return err;
+}
+
+#else
+
+esp_err_t meter_capture_init()
+{
+    return ESP_OK;
+}
+
+esp_err_t meter_capture_spill()
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+#endif
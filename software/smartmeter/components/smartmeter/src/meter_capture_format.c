@@ -0,0 +1,79 @@
+/**
+ * @file meter_capture_format.c
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <string.h>
+
+/* Header */
+#include "meter_capture.h"
+#include "flash_ops.h"
+
+_Static_assert(sizeof(meter_capture_file_header_t) == 16, "header is part of the dump format");
+_Static_assert(sizeof(meter_capture_record_header_t) == 8, "header is part of the dump format");
+_Static_assert(sizeof(meter_capture_chunk_t) == 4, "chunk is part of the dump format");
+
+/* ===== FORMAT FUNCTIONS ===== */
+size_t meter_capture_record_size(const meter_capture_record_header_t *header)
+{
+    /* Padded, so headers and chunks of all records are aligned */
+    size_t size = sizeof(meter_capture_record_header_t) + header->chunk_count * sizeof(meter_capture_chunk_t) + header->size;
+    return (size + 3) & ~(size_t)3;
+}
+
+size_t meter_capture_encode_record(uint32_t timestamp_ms, const meter_capture_chunk_t *chunks, size_t chunk_count, const uint8_t *data, size_t size,
+                                   uint8_t *buffer, size_t buffer_size)
+{
+    if(chunk_count > METER_CAPTURE_MAX_CHUNKS || size > UINT16_MAX){ return 0; }
+
+    meter_capture_record_header_t header = {
+        .timestamp_ms = timestamp_ms,
+        .size = (uint16_t)size,
+        .chunk_count = (uint8_t)chunk_count,
+    };
+    size_t record_size = meter_capture_record_size(&header);
+    if(record_size > buffer_size){ return 0; }
+
+    /* Target and supported hosts are little endian, fields are written as in memory */
+    size_t offset = 0;
+    memcpy(&buffer[offset], &header, sizeof(header));
+    offset += sizeof(header);
+    if(chunk_count > 0){ memcpy(&buffer[offset], chunks, chunk_count * sizeof(meter_capture_chunk_t)); }
+    offset += chunk_count * sizeof(meter_capture_chunk_t);
+    memcpy(&buffer[offset], data, size);
+    offset += size;
+    memset(&buffer[offset], 0, record_size - offset);
+
+    return record_size;
+}
+
+esp_err_t meter_capture_parse_header(const uint8_t *dump, size_t size, meter_capture_file_header_t *header)
+{
+    if(size < sizeof(meter_capture_file_header_t)){ return ESP_ERR_NOT_FOUND; }
+    memcpy(header, dump, sizeof(meter_capture_file_header_t));
+
+    /* Erased flash or other data */
+    if(header->magic != METER_CAPTURE_MAGIC || header->version != METER_CAPTURE_FORMAT_VERSION){ return ESP_ERR_NOT_FOUND; }
+    if(header->records_size > size - sizeof(meter_capture_file_header_t)){ return ESP_ERR_INVALID_SIZE; }
+
+    uint32_t crc = flash_ops_crc32(0, &dump[sizeof(meter_capture_file_header_t)], header->records_size);
+    return crc == header->crc ? ESP_OK : ESP_ERR_INVALID_CRC;
+}
+
+esp_err_t meter_capture_next_record(const uint8_t *dump, size_t size, size_t *offset, meter_capture_record_t *record)
+{
+    if(*offset >= size){ return ESP_ERR_NOT_FOUND; }
+    if(size - *offset < sizeof(meter_capture_record_header_t)){ return ESP_ERR_INVALID_SIZE; }
+
+    memcpy(&record->header, &dump[*offset], sizeof(meter_capture_record_header_t));
+    size_t record_size = meter_capture_record_size(&record->header);
+    if(record->header.chunk_count > METER_CAPTURE_MAX_CHUNKS || record_size > size - *offset){ return ESP_ERR_INVALID_SIZE; }
+
+    record->chunks = (const meter_capture_chunk_t *)&dump[*offset + sizeof(meter_capture_record_header_t)];
+    record->data = &dump[*offset + sizeof(meter_capture_record_header_t) + record->header.chunk_count * sizeof(meter_capture_chunk_t)];
+    *offset += record_size;
+
+    return ESP_OK;
+}
@@ -0,0 +1,27 @@
+/**
+ * @file meter_diagnostics.c
+ * 
+ * @copyright Copyright (c) 2023
+ * 
+ */
+
+#include <stdatomic.h>
+
+/* Header */
+#include "meter_diagnostics.h"
+
+/* Counters since boot, relaxed order is enough as no other data depends on them */
+static atomic_uint counters[METER_DIAG_COUNTER_COUNT];
+
+/* ===== DIAGNOSTICS FUNCTIONS ===== */
+void meter_diag_increment(meter_diag_counter_t counter)
+{
+    if(counter >= METER_DIAG_COUNTER_COUNT){ return; }
+    atomic_fetch_add_explicit(&counters[counter], 1, memory_order_relaxed);
+}
+
+uint32_t meter_diag_get(meter_diag_counter_t counter)
+{
+    if(counter >= METER_DIAG_COUNTER_COUNT){ return 0; }
+    return (uint32_t)atomic_load_explicit(&counters[counter], memory_order_relaxed);
+}
@@ -0,0 +1,95 @@
+/**
+ * @file meter_snapshot.c
+ * 
+ * @copyright Copyright (c) 2023
+ * 
+ */
+
+#include <stdatomic.h>
+#include <string.h>
+
+/* Logging */
+#include "esp_log.h"
+static const char* TAG = "SNAPSHOT";
+
+#include "esp_timer.h"
+
+/* Header */
+#include "meter_snapshot.h"
+
+/* Buffer with sequence lock, sequence is odd while buffer is written */
+typedef struct
+{
+    atomic_uint lock;
+    meter_snapshot_t snapshot;
+} snapshot_buffer_t;
+
+static snapshot_buffer_t buffers[METER_SNAPSHOT_BUFFERS];
+
+/* Sequence of last published telegram, buffer is selected by sequence */
+static atomic_uint published_sequence = 0;
+
+/* ===== WRITER ===== */
+void meter_snapshot_publish(uint32_t frame_counter, const obis_data_t* data)
+{
+    /* Only one writer, so no other task changes the sequence */
+    uint32_t sequence = atomic_load_explicit(&published_sequence, memory_order_relaxed) + 1;
+    snapshot_buffer_t* buffer = &buffers[sequence % METER_SNAPSHOT_BUFFERS];
+
+    /* Mark buffer as being written */
+    unsigned int lock = atomic_load_explicit(&buffer->lock, memory_order_relaxed);
+    atomic_store_explicit(&buffer->lock, lock + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    buffer->snapshot.sequence = sequence;
+    buffer->snapshot.frame_counter = frame_counter;
+    buffer->snapshot.received_time_us = esp_timer_get_time();
+    memcpy(&buffer->snapshot.data, data, sizeof(obis_data_t));
+
+    /* Buffer is consistent again, then make it visible */
+    atomic_store_explicit(&buffer->lock, lock + 2, memory_order_release);
+    atomic_store_explicit(&published_sequence, sequence, memory_order_release);
+}
+
+/* ===== READERS ===== */
+esp_err_t meter_snapshot_read(meter_snapshot_t* snapshot)
+{
+    for(int attempt = 0; attempt < METER_SNAPSHOT_READ_RETRIES; attempt++)
+    {
+        uint32_t sequence = atomic_load_explicit(&published_sequence, memory_order_acquire);
+        if(sequence == 0)
+        {
+            return ESP_ERR_NOT_FOUND;
+        }
+        snapshot_buffer_t* buffer = &buffers[sequence % METER_SNAPSHOT_BUFFERS];
+
+        /* Buffer is being written, writer already moved on to it */
+        unsigned int lock = atomic_load_explicit(&buffer->lock, memory_order_acquire);
+        if(lock & 1)
+        {
+            continue;
+        }
+
+        memcpy(snapshot, &buffer->snapshot, sizeof(meter_snapshot_t));
+
+        /* Copy is only valid if buffer wasn't written in the meantime */
+        atomic_thread_fence(memory_order_acquire);
+        if(atomic_load_explicit(&buffer->lock, memory_order_relaxed) == lock)
+        {
+            return ESP_OK;
+        }
+    }
+
+    ESP_LOGW(TAG, "Reading snapshot failed, writer too fast");
+    return ESP_ERR_TIMEOUT;
+}
+
+uint32_t meter_snapshot_sequence()
+{
+    return atomic_load_explicit(&published_sequence, memory_order_acquire);
+}
+
+bool meter_snapshot_changed_since(uint32_t sequence)
+{
+    return meter_snapshot_sequence() != sequence;
+}
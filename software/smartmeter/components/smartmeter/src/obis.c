@@ -1,8 +1,8 @@
 /**
  * @file obis.c
- * 
+ *
  * @copyright Copyright (c) 2023
- * 
+ *
  */
 
 #include <string.h>
@@ -14,53 +14,281 @@ static const char* TAG = "OBIS";
 /* Header */
 #include "obis.h"
 
+/* Single decoded data element */
+typedef struct
+{
+    uint8_t type;                   /* < OBISDataType */
+    int64_t value;                  /* < Value of numeric types */
+    const uint8_t* data;            /* < Content of strings */
+    uint8_t length;                 /* < Length of strings, number of elements of structures and arrays */
+} obis_element_t;
+
+const enum CodeType obis_voltage_types[3] = {VoltageL1, VoltageL2, VoltageL3};
+const enum CodeType obis_current_types[3] = {CurrentL1, CurrentL2, CurrentL3};
+
+/* ===== HELPER FUNCTIONS ===== */
+static int64_t read_unsigned(const uint8_t* data, uint8_t size)
+{
+    /* Values are big endian */
+    uint64_t value = 0;
+    for(uint8_t i = 0; i < size; i++)
+    {
+        value = (value << 8) | data[i];
+    }
+    return (int64_t)value;
+}
+
+static int64_t read_signed(const uint8_t* data, uint8_t size)
+{
+    /* Sign extend from highest bit */
+    uint64_t value = (uint64_t)read_unsigned(data, size);
+    uint64_t sign_bit = 1ULL << (size * 8 - 1);
+    return (int64_t)((value ^ sign_bit) - sign_bit);
+}
+
+static enum CodeType get_code_type(const uint8_t* code)
+{
+    /* Only electricity is supported */
+    if(code[OBIS_A] != Electricity)
+    {
+        return Unknown;
+    }
+
+    /* Compare C and D against code */
+    static const struct
+    {
+        const uint8_t* code;
+        enum CodeType type;
+    } code_types[] = {
+        {ESPDM_VOLTAGE_L1, VoltageL1},
+        {ESPDM_VOLTAGE_L2, VoltageL2},
+        {ESPDM_VOLTAGE_L3, VoltageL3},
+        {ESPDM_CURRENT_L1, CurrentL1},
+        {ESPDM_CURRENT_L2, CurrentL2},
+        {ESPDM_CURRENT_L3, CurrentL3},
+        {ESPDM_ACTIVE_POWER_PLUS, ActivePowerPlus},
+        {ESPDM_ACTIVE_POWER_MINUS, ActivePowerMinus},
+        {ESPDM_ACTIVE_ENERGY_PLUS, ActiveEnergyPlus},
+        {ESPDM_ACTIVE_ENERGY_MINUS, ActiveEnergyMinus},
+        {ESPDM_REACTIVE_ENERGY_PLUS, ReactiveEnergyPlus},
+        {ESPDM_REACTIVE_ENERGY_MINUS, ReactiveEnergyMinus},
+        {ESPDM_POWER_FACTOR, PowerFactor},
+    };
+
+    for(size_t i = 0; i < sizeof(code_types) / sizeof(code_types[0]); i++)
+    {
+        if(memcmp(&code[OBIS_C], code_types[i].code, 2) == 0)
+        {
+            return code_types[i].type;
+        }
+    }
+    return Unknown;
+}
+
 /* ===== OBIS Layer ===== */
-esp_err_t parse_obis_data_type(uint8_t* obis_data, size_t* curr_offset)
+/* Decode one element, structures and arrays only return number of elements */
+static esp_err_t parse_obis_data_type(const uint8_t* obis_data, size_t obis_data_size, size_t* curr_offset, obis_element_t* element)
 {
+    /* Size of fixed length data types */
+    uint8_t size = 0;
+    bool is_signed = false;
+
+    if(*curr_offset >= obis_data_size)
+    {
+        ESP_LOGE(TAG, "Unexpected end of data");
+        return ESP_FAIL;
+    }
+
     /* Check which data type to expect */
-    switch(obis_data[*curr_offset])
+    element->type = obis_data[(*curr_offset)++];
+    element->value = 0;
+    element->data = NULL;
+    element->length = 0;
+
+    switch(element->type)
     {
         case NullData:
-            /* No following data, skip */
-            (*curr_offset)++;
-            break;
+            /* No following data */
+            return ESP_OK;
         case Array:
-            /* Check how many entries are in array */
-            uint8_t len = obis_data[*curr_offset + 1];
-            /* Loop through array */
-            //TODO: Recursive loop?
-            break;
+        case Structure:
         case OctetString:
-            /* Check length of octet string */
-            if(obis_data[*curr_offset + 1] == OBIS_DATE_TIME_LENGTH)
+        case VisibleString:
+        case Utf8String:
+            /* Next byte is number of elements or length of string */
+            if(*curr_offset >= obis_data_size)
             {
-                /* String is <DateTime Value>, skip */
-                *curr_offset += 2 + OBIS_DATE_TIME_LENGTH;
-                ESP_LOGI(TAG, "Skipped <DateTime Value>");
+                ESP_LOGE(TAG, "Unexpected end of data");
+                return ESP_FAIL;
             }
-            else if(obis_data[*curr_offset + 1] == OBIS_CODE_LENGTH)
+            element->length = obis_data[(*curr_offset)++];
+
+            /* Elements of structures and arrays follow */
+            if(element->type == Array || element->type == Structure)
             {
-                /* Important, this is what we want */
-                //TODO: Parse obis code and save in structure?
-                //Structure could be uint32 + divisor, when divisor = 1 -> ganzzahlig
+                return ESP_OK;
             }
-            else
+
+            /* Content of string */
+            if(*curr_offset + element->length > obis_data_size)
             {
-                /* Unknown octet string, skip */
-                *curr_offset += 2 + obis_data[*curr_offset + 1];
+                ESP_LOGE(TAG, "String exceeds data");
+                return ESP_FAIL;
             }
+            element->data = &obis_data[*curr_offset];
+            *curr_offset += element->length;
+            return ESP_OK;
+        case Boolean:
+        case Unsigned:
+        case Enum:
+            size = 1;
+            break;
+        case Integer:
+            size = 1;
+            is_signed = true;
+            break;
+        case LongUnsigned:
+            size = 2;
+            break;
+        case Long:
+            size = 2;
+            is_signed = true;
+            break;
+        case DoubleLongUnsigned:
+            size = 4;
+            break;
+        case DoubleLong:
+            size = 4;
+            is_signed = true;
+            break;
+        case Long64Unsigned:
+            size = 8;
+            break;
+        case Long64:
+            size = 8;
+            is_signed = true;
             break;
         default:
-            ESP_LOGE(TAG, "Unsupported data type");
+            ESP_LOGE(TAG, "Unsupported data type 0x%02X", element->type);
             return ESP_FAIL;
     }
+
+    /* Numeric value */
+    if(*curr_offset + size > obis_data_size)
+    {
+        ESP_LOGE(TAG, "Value exceeds data");
+        return ESP_FAIL;
+    }
+    element->value = is_signed ? read_signed(&obis_data[*curr_offset], size) : read_unsigned(&obis_data[*curr_offset], size);
+    *curr_offset += size;
+    return ESP_OK;
+}
+
+/* Decode elements of structure or array, registers consist of <OBIS code> <value> <structure with scaler and unit> */
+static esp_err_t parse_obis_structure(const uint8_t* obis_data, size_t obis_data_size, size_t* curr_offset, uint8_t count, uint8_t depth, obis_data_t* result)
+{
+    /* Current register, NULL if no obis code was found or value was already read */
+    obis_record_t* record = NULL;
+
+    if(depth > OBIS_MAX_DEPTH)
+    {
+        ESP_LOGE(TAG, "Nesting too deep");
+        return ESP_FAIL;
+    }
+
+    for(uint8_t i = 0; i < count; i++)
+    {
+        obis_element_t element;
+        esp_err_t err = parse_obis_data_type(obis_data, obis_data_size, curr_offset, &element);
+        if(err != ESP_OK){ return err; }
+
+        switch(element.type)
+        {
+            case OctetString:
+                if(element.length == OBIS_CODE_LENGTH)
+                {
+                    /* OBIS code, start new register */
+                    if(result->record_count >= OBIS_MAX_RECORDS)
+                    {
+                        ESP_LOGE(TAG, "Too many registers");
+                        return ESP_FAIL;
+                    }
+                    record = &result->records[result->record_count];
+                    memcpy(record->code, element.data, OBIS_CODE_LENGTH);
+                    record->type = get_code_type(record->code);
+                    record->scaler = 0;
+                    record->unit = OBIS_UNIT_NONE;
+                    record->value = 0;
+                }
+                else if(element.length == OBIS_DATE_TIME_LENGTH && result->record_count == 0)
+                {
+                    /* Timestamp of measurement */
+                    memcpy(result->timestamp, element.data, OBIS_DATE_TIME_LENGTH);
+                }
+                else if(element.length <= OBIS_SERIAL_NUMBER_MAX_LENGTH)
+                {
+                    /* Other strings, the only one sent is the serial number */
+                    memcpy(result->serial_number, element.data, element.length);
+                    result->serial_number_length = element.length;
+                }
+                break;
+            case Structure:
+            case Array:
+                /* Scaler and unit of last register: <Integer scaler> <Enum unit> */
+                if(depth > 0 && element.type == Structure && element.length == 2 && result->record_count > 0)
+                {
+                    obis_element_t scaler;
+                    obis_element_t unit;
+                    err = parse_obis_data_type(obis_data, obis_data_size, curr_offset, &scaler);
+                    if(err != ESP_OK){ return err; }
+                    err = parse_obis_data_type(obis_data, obis_data_size, curr_offset, &unit);
+                    if(err != ESP_OK){ return err; }
+
+                    if(scaler.type == Integer && unit.type == Enum)
+                    {
+                        result->records[result->record_count - 1].scaler = (int8_t)scaler.value;
+                        result->records[result->record_count - 1].unit = (uint8_t)unit.value;
+                    }
+                }
+                else
+                {
+                    err = parse_obis_structure(obis_data, obis_data_size, curr_offset, element.length, depth + 1, result);
+                    if(err != ESP_OK){ return err; }
+                }
+                break;
+            case NullData:
+            case VisibleString:
+            case Utf8String:
+                /* Not needed, skip */
+                break;
+            default:
+                /* Numeric value, belongs to last obis code */
+                if(record != NULL)
+                {
+                    record->value = element.value;
+                    result->record_count++;
+                    record = NULL;
+                }
+                break;
+        }
+    }
     return ESP_OK;
 }
 
-esp_err_t parse_obis(uint8_t* obis_data, size_t obis_data_size)
+esp_err_t parse_obis(uint8_t* obis_data, size_t obis_data_size, obis_data_t* result)
 {
     size_t curr_offset = 0;
-    
+
+    /* New data, clear result */
+    memset(result, 0, sizeof(obis_data_t));
+
+    /* Header: start byte, <LongInvokeIdAndPriority>, length of DateTime and <DateTime Value> */
+    if(obis_data_size < 2 + OBIS_HEADER_LONG_INVOKE_ID_PRIO_BYTES + OBIS_DATE_TIME_LENGTH)
+    {
+        ESP_LOGE(TAG, "data too short");
+        return ESP_FAIL;
+    }
+
     /* === CHECK OBIS HEADER === */
     /* Check for obis start byte */
     if(obis_data[curr_offset] != OBIS_HEADER_START)
@@ -89,12 +317,83 @@ esp_err_t parse_obis(uint8_t* obis_data, size_t obis_data_size)
         curr_offset++;
     }
 
-    /* Skip <DateTime Value> */
+    /* Header <DateTime Value>, used if notification body has no timestamp */
+    memcpy(result->timestamp, &obis_data[curr_offset], OBIS_DATE_TIME_LENGTH);
     curr_offset += OBIS_DATE_TIME_LENGTH;
 
     /* === CHECK OBIS NOTIFICATION BODY === */
-    //TODO: Parse until footer?
-    parse_obis_data_type(obis_data, &curr_offset);
+    /* <NotificationBody><DataValue> is one structure or array with all registers */
+    return parse_obis_structure(obis_data, obis_data_size, &curr_offset, 1, 0, result);
+}
+
+const obis_record_t* obis_find_record(const obis_data_t* data, enum CodeType type)
+{
+    for(uint8_t i = 0; i < data->record_count; i++)
+    {
+        if(data->records[i].type == type)
+        {
+            return &data->records[i];
+        }
+    }
+    return NULL;
+}
+
+int64_t obis_scale_value(const obis_record_t* record, int8_t target_scaler)
+{
+    int64_t value = record->value;
 
+    /* Multiply or divide by 10 until scaler matches */
+    for(int8_t scaler = record->scaler; scaler > target_scaler; scaler--)
+    {
+        value *= 10;
+    }
+    for(int8_t scaler = record->scaler; scaler < target_scaler; scaler++)
+    {
+        value /= 10;
+    }
+    return value;
+}
+
+int64_t obis_get_scaled(const obis_data_t* data, enum CodeType type, int8_t target_scaler, bool* found)
+{
+    const obis_record_t* record = obis_find_record(data, type);
+    if(found != NULL)
+    {
+        *found = record != NULL;
+    }
+    return record != NULL ? obis_scale_value(record, target_scaler) : 0;
+}
+
+esp_err_t obis_timestamp_to_unix(const uint8_t* timestamp, uint32_t* unix_time)
+{
+    /* <year high> <year low> <month> <day> <weekday> <hour> <minute> <second> <hundredths> <deviation high> <deviation low> <status> */
+    int32_t year = (timestamp[0] << 8) | timestamp[1];
+    int32_t month = timestamp[2];
+    int32_t day = timestamp[3];
+    int16_t deviation = (int16_t)((timestamp[9] << 8) | timestamp[10]);
+
+    /* 0xFFFF and 0xFF are "not specified" */
+    if(year == 0xFFFF || year < 1970 || month < 1 || month > 12 || day < 1 || day > 31 || timestamp[5] > 23 || timestamp[6] > 59 || timestamp[7] > 59)
+    {
+        return ESP_FAIL;
+    }
+
+    /* Days since 1970-01-01 of proleptic gregorian calendar, year starts in march */
+    if(month <= 2){ year--; }
+    int32_t era = year / 400;
+    int32_t year_of_era = year - era * 400;
+    int32_t day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    int32_t day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    int64_t days = (int64_t)era * 146097 + day_of_era - 719468;
+
+    int64_t seconds = days * 86400 + timestamp[5] * 3600 + timestamp[6] * 60 + timestamp[7];
+
+    /* Deviation of local time to UTC in minutes, 0x8000 is "not specified" */
+    if(deviation != (int16_t)0x8000)
+    {
+        seconds += (int64_t)deviation * 60;
+    }
+
+    *unix_time = (uint32_t)seconds;
     return ESP_OK;
-}
\ No newline at end of file
+}
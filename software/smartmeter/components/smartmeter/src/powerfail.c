@@ -0,0 +1,150 @@
+/**
+ * @file powerfail.c
+ * 
+ * @copyright Copyright (c) 2023
+ * 
+ */
+
+#include <string.h>
+
+/* Logging */
+#include "esp_log.h"
+static const char* TAG = "POWERFAIL";
+
+/* Header */
+#include "uart.h"
+#include "powerfail.h"
+
+/* FreeRTOS Libraries */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/* Hardware */
+#include "driver/gpio.h"
+#include "esp_timer.h"
+
+static bool enabled = false;
+static bool initialized = false;
+static esp_err_t init_result = ESP_OK;
+static powerfail_store_t store;
+static TaskHandle_t powerfail_task_handle = NULL;
+
+/* Record of last power fail */
+static powerfail_record_t restored_record;
+static bool restored = false;
+
+/* ===== INTERRUPT AND TASK ===== */
+static void IRAM_ATTR powerfail_isr(void *arg)
+{
+    /* Flash can't be written in interrupt, wake task with highest priority */
+    BaseType_t higher_priority_task_woken = pdFALSE;
+    vTaskNotifyGiveFromISR(powerfail_task_handle, &higher_priority_task_woken);
+    portYIELD_FROM_ISR(higher_priority_task_woken);
+}
+
+static void powerfail_task(void *pvParameters)
+{
+    for(;;)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        /* Prepared record is written into erased slot, no logging before write */
+        int64_t start_us = esp_timer_get_time();
+        esp_err_t err = powerfail_store_flush(&store);
+        int64_t duration_us = esp_timer_get_time() - start_us;
+
+        /* Only reached if supply holds up long enough */
+        if(err != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Writing record failed (%s)", esp_err_to_name(err));
+        }
+        else if(duration_us > POWERFAIL_FLUSH_BUDGET_US)
+        {
+            ESP_LOGW(TAG, "Writing record took %d us, budget exceeded", (int)duration_us);
+        }
+        else
+        {
+            ESP_LOGI(TAG, "Record written in %d us", (int)duration_us);
+        }
+    }
+}
+
+/* ===== HELPER FUNCTIONS ===== */
+static esp_err_t init_once()
+{
+    flash_ops_t flash;
+    esp_err_t err = flash_ops_partition(POWERFAIL_PARTITION_LABEL, POWERFAIL_PARTITION_SUBTYPE, &flash);
+    if(err != ESP_OK || flash.size < POWERFAIL_SECTOR_SIZE * POWERFAIL_SECTOR_COUNT)
+    {
+        ESP_LOGW(TAG, "No powerfail partition, values are not stored on power fail");
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    /* Load last record, erasing is only done here */
+    err = powerfail_store_init(&store, &flash, &restored_record);
+    if(err == ESP_OK)
+    {
+        restored = true;
+        ESP_LOGI(TAG, "Restored record %lu, frame counter %lu, energy %llu Wh", (unsigned long)restored_record.sequence,
+                 (unsigned long)restored_record.frame_counter, (unsigned long long)restored_record.energy_delivered);
+    }
+    else if(err != ESP_ERR_NOT_FOUND)
+    {
+        return err;
+    }
+
+    if(xTaskCreate(powerfail_task, "powerfail_task", POWERFAIL_TASK_STACK_SIZE, NULL, POWERFAIL_TASK_PRIORITY, &powerfail_task_handle) != pdPASS)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    /* Interrupt when power fail output becomes active */
+    gpio_config_t io_config = {
+        .pin_bit_mask = 1ULL << POWER_FAIL_SIGNAL_GPIO,
+        .mode = GPIO_MODE_INPUT,
+        .pull_up_en = GPIO_PULLUP_DISABLE,
+        .pull_down_en = GPIO_PULLDOWN_DISABLE,
+        .intr_type = POWERFAIL_SIGNAL_ACTIVE_LEVEL ? GPIO_INTR_POSEDGE : GPIO_INTR_NEGEDGE,
+    };
+    err = gpio_config(&io_config);
+    if(err != ESP_OK){ return err; }
+
+    /* Service may already be installed by another component */
+    err = gpio_install_isr_service(ESP_INTR_FLAG_IRAM);
+    if(err != ESP_OK && err != ESP_ERR_INVALID_STATE){ return err; }
+
+    err = gpio_isr_handler_add(POWER_FAIL_SIGNAL_GPIO, powerfail_isr, NULL);
+    if(err != ESP_OK){ return err; }
+
+    enabled = true;
+    return ESP_OK;
+}
+
+/* ===== POWERFAIL FUNCTIONS ===== */
+esp_err_t powerfail_init()
+{
+    /* Application may load the record before smartmeter_init */
+    if(!initialized)
+    {
+        init_result = init_once();
+        initialized = true;
+    }
+    return init_result;
+}
+
+void powerfail_prepare(const obis_data_t *data, uint32_t frame_counter)
+{
+    if(!enabled){ return; }
+
+    powerfail_record_t record;
+    powerfail_record_from_obis(data, frame_counter, &record);
+    powerfail_store_prepare(&store, &record);
+}
+
+esp_err_t powerfail_get_restored(powerfail_record_t *record)
+{
+    if(!restored){ return ESP_ERR_NOT_FOUND; }
+
+    *record = restored_record;
+    return ESP_OK;
+}
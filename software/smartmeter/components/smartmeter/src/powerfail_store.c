@@ -0,0 +1,140 @@
+/**
+ * @file powerfail_store.c
+ * 
+ * @copyright Copyright (c) 2023
+ * 
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+/* Logging */
+#include "esp_log.h"
+static const char* TAG = "POWERFAIL";
+
+/* Header */
+#include "powerfail_store.h"
+
+#define NONE_PREPARED                   2           /* < Value of prepared_index before first record */
+#define SLOTS_PER_SECTOR                (POWERFAIL_SECTOR_SIZE / POWERFAIL_RECORD_SIZE)
+#define AREA_SIZE                       (POWERFAIL_SECTOR_SIZE * POWERFAIL_SECTOR_COUNT)
+
+/* ===== HELPER FUNCTIONS ===== */
+static bool is_valid(const powerfail_record_t *record)
+{
+    return record->magic == POWERFAIL_RECORD_MAGIC && record->crc == flash_ops_crc32(0, record, offsetof(powerfail_record_t, crc));
+}
+
+static bool is_erased(const powerfail_record_t *record)
+{
+    const uint8_t *bytes = (const uint8_t *)record;
+    for(size_t i = 0; i < sizeof(powerfail_record_t); i++)
+    {
+        if(bytes[i] != 0xFF){ return false; }
+    }
+    return true;
+}
+
+/* ===== RECORD ===== */
+void powerfail_record_from_obis(const obis_data_t *data, uint32_t frame_counter, powerfail_record_t *record)
+{
+    memset(record, 0, sizeof(powerfail_record_t));
+    record->frame_counter = frame_counter;
+    memcpy(record->timestamp, data->timestamp, OBIS_DATE_TIME_LENGTH);
+    record->active_power = (int32_t)(obis_get_scaled(data, ActivePowerPlus, 0, NULL) - obis_get_scaled(data, ActivePowerMinus, 0, NULL));
+    for(int i = 0; i < 3; i++)
+    {
+        record->voltage[i] = (uint16_t)obis_get_scaled(data, obis_voltage_types[i], -1, NULL);
+        record->current[i] = (uint16_t)obis_get_scaled(data, obis_current_types[i], -2, NULL);
+    }
+    record->energy_delivered = (uint64_t)obis_get_scaled(data, ActiveEnergyPlus, 0, NULL);
+    record->energy_received = (uint64_t)obis_get_scaled(data, ActiveEnergyMinus, 0, NULL);
+}
+
+/* ===== STORE ===== */
+esp_err_t powerfail_store_init(powerfail_store_t *store, const flash_ops_t *flash, powerfail_record_t *last)
+{
+    powerfail_record_t record;
+    size_t newest_offset = SIZE_MAX;
+
+    memset(store, 0, sizeof(powerfail_store_t));
+    store->flash = *flash;
+    atomic_store(&store->prepared_index, NONE_PREPARED);
+
+    /* Find newest valid record */
+    for(size_t offset = 0; offset < AREA_SIZE; offset += POWERFAIL_RECORD_SIZE)
+    {
+        esp_err_t err = store->flash.read(store->flash.ctx, offset, &record, sizeof(record));
+        if(err != ESP_OK){ return err; }
+
+        if(is_valid(&record) && (newest_offset == SIZE_MAX || (int32_t)(record.sequence - store->sequence) > 0))
+        {
+            newest_offset = offset;
+            store->sequence = record.sequence;
+            *last = record;
+        }
+    }
+
+    /* Next erased slot after newest record in the same sector, interrupted writes are skipped */
+    size_t offset = newest_offset == SIZE_MAX ? 0 : newest_offset + POWERFAIL_RECORD_SIZE;
+    size_t sector_end = newest_offset == SIZE_MAX ? POWERFAIL_SECTOR_SIZE : (newest_offset / POWERFAIL_SECTOR_SIZE + 1) * POWERFAIL_SECTOR_SIZE;
+    store->next_offset = SIZE_MAX;
+    for(; offset < sector_end; offset += POWERFAIL_RECORD_SIZE)
+    {
+        esp_err_t err = store->flash.read(store->flash.ctx, offset, &record, sizeof(record));
+        if(err != ESP_OK){ return err; }
+        if(is_erased(&record))
+        {
+            store->next_offset = offset;
+            break;
+        }
+    }
+
+    /* Sector is full, erase next one now instead of when power fails */
+    if(store->next_offset == SIZE_MAX)
+    {
+        size_t next_sector = (sector_end % AREA_SIZE);
+        esp_err_t err = store->flash.erase(store->flash.ctx, next_sector, POWERFAIL_SECTOR_SIZE);
+        if(err != ESP_OK){ return err; }
+        store->next_offset = next_sector;
+        ESP_LOGI(TAG, "Erased sector at 0x%x", (unsigned int)next_sector);
+    }
+
+    return newest_offset == SIZE_MAX ? ESP_ERR_NOT_FOUND : ESP_OK;
+}
+
+void powerfail_store_prepare(powerfail_store_t *store, const powerfail_record_t *record)
+{
+    /* Write into buffer which is not read by flush */
+    unsigned int index = atomic_load(&store->prepared_index);
+    powerfail_record_t *prepared = &store->prepared[index == 0 ? 1 : 0];
+
+    *prepared = *record;
+    prepared->magic = POWERFAIL_RECORD_MAGIC;
+    prepared->sequence = store->sequence + 1;
+    prepared->reserved = 0;
+    prepared->crc = flash_ops_crc32(0, prepared, offsetof(powerfail_record_t, crc));
+
+    /* Publish */
+    atomic_store(&store->prepared_index, index == 0 ? 1 : 0);
+}
+
+esp_err_t powerfail_store_flush(powerfail_store_t *store)
+{
+    unsigned int index = atomic_load(&store->prepared_index);
+    if(index == NONE_PREPARED){ return ESP_ERR_INVALID_STATE; }
+    if(store->next_offset == SIZE_MAX){ return ESP_ERR_NO_MEM; }
+
+    /* Single write of one slot, slot was erased during initialization */
+    esp_err_t err = store->flash.write(store->flash.ctx, store->next_offset, &store->prepared[index], POWERFAIL_RECORD_SIZE);
+    if(err != ESP_OK){ return err; }
+
+    /* Next slot for another power fail without restart, none left at end of sector */
+    store->sequence = store->prepared[index].sequence;
+    store->next_offset += POWERFAIL_RECORD_SIZE;
+    if(store->next_offset % POWERFAIL_SECTOR_SIZE == 0)
+    {
+        store->next_offset = SIZE_MAX;
+    }
+    return ESP_OK;
+}
@@ -21,6 +21,15 @@ static const char* TAG = "UART";
 #include "dlms.h"
 #include "obis.h"
 
+/* Shared result */
+#include "meter_snapshot.h"
+#include "powerfail.h"
+#include "latency_trace.h"
+#include "meter_diagnostics.h"
+#include "binary_log.h"
+#include "frame_pool.h"
+#include "meter_capture.h"
+
 /* FreeRTOS Libraries */
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -32,11 +41,21 @@ static const char* TAG = "UART";
 /* UART Event Queue */
 static QueueHandle_t uart1_queue = NULL;
 
+/* Callback for decoded data */
+static smartmeter_data_cb_t smartmeter_data_cb = NULL;
+
+/* Frame counter of last accepted telegram, starts at the one recorded at last power fail */
+static uint32_t frame_counter_floor = 0;
+static bool frame_counter_floor_valid = false;
+
 /* SMALL INFODUMP */
 /* Structure of data and how it's processed */
 /* 1. Physical Layer -> UART */
 /* 2. MBUS-Layer -> parse with "parse_mbus_long_frame_layer", supports multiple frames, returns user data */
-/* 3. DLMS (Application)-Layer -> decrypt and parse with "todo" */
+/* 3. DLMS (Application)-Layer -> decrypt with "parse_dlms_layer" */
+/*    Layers 2 and 3 work in place in one frame of the frame pool */
+/* 4. OBIS-Layer -> decode registers with "parse_obis", result is published with "meter_snapshot_publish" */
+/*    and passed to registered callback */
 
 /* ===== Physical Layer (UART) ===== */
 /* UART Event Handler */
@@ -45,11 +64,8 @@ static void uart_event_task(void *pvParameters)
     /* Store current event */
     uart_event_t event;
 
-    /* First buffer for processing data */
-    static uint8_t buff0[DATA_BUFFER_SIZE];
-
-    /* Second buffer for processing data */
-    static uint8_t buff1[DATA_BUFFER_SIZE];
+    /* Decoded data */
+    static obis_data_t obis_result;
 
     /* Current measurement interval */
     static uint8_t curr_interval = DATA_UPDATE_INTERVAL;
@@ -71,13 +87,18 @@ static void uart_event_task(void *pvParameters)
             {
                 /* Received data */
                 case UART_DATA:
+                    /* Driver reports data after rx fifo threshold or timeout, close to first byte */
+                    if(!data_received){ LATENCY_TRACE_MARK(LATENCY_STAGE_FIRST_BYTE); }
+                    METER_CAPTURE_CHUNK(event.size, !data_received);
+
                     /* Set data received to true */
                     data_received = true;
                     break;
 
                 /* FIFO Overflow */
                 case UART_FIFO_OVF:
-                    ESP_LOGI(TAG, "FIFO overflow");
+                    BINARY_LOG(BINARY_LOG_UART_FIFO_OVERFLOW);
+                    meter_diag_increment(METER_DIAG_FIFO_OVERFLOW);
 
                     /* Flush ringbuffer */
                     uart_flush_input(UART_PORT_NUMBER);
@@ -88,7 +109,8 @@ static void uart_event_task(void *pvParameters)
 
                 /* Ringbuffer full */
                 case UART_BUFFER_FULL:
-                    ESP_LOGI(TAG, "Ringbuffer full");
+                    BINARY_LOG(BINARY_LOG_UART_BUFFER_FULL);
+                    meter_diag_increment(METER_DIAG_BUFFER_FULL);
                     
                     /* Flush ringbuffer */
                     uart_flush_input(UART_PORT_NUMBER);
@@ -99,73 +121,146 @@ static void uart_event_task(void *pvParameters)
 
                 /* RX break detected */
                 case UART_BREAK:
-                    ESP_LOGI(TAG, "RX Break");
+                    BINARY_LOG(BINARY_LOG_UART_BREAK);
                     break;
 
                 /* Parity check error */
                 case UART_PARITY_ERR:
-                    ESP_LOGI(TAG, "Parity Error");
+                    BINARY_LOG(BINARY_LOG_UART_PARITY_ERROR);
+                    meter_diag_increment(METER_DIAG_PARITY_ERROR);
                     break;
 
                 /* Frame error */
                 case UART_FRAME_ERR:
-                    ESP_LOGI(TAG, "Frame Error");
+                    BINARY_LOG(BINARY_LOG_UART_FRAME_ERROR);
+                    meter_diag_increment(METER_DIAG_FRAME_ERROR);
                     break;
 
                 /* Other events */
                 default:
                     /* Write event to log */
-                    ESP_LOGI(TAG, "Event Type: %d", event.type);
+                    BINARY_LOG(BINARY_LOG_UART_EVENT, (uint32_t)event.type);
                     break;
             }
         }
 
         /* Increment measurement interval */
         curr_interval++;
-
-        /* Set buffer sizes */
-        size_t buff0_size = 0;
-        size_t buff1_size = 0;
+        LATENCY_TRACE_MARK(LATENCY_STAGE_TELEGRAM_COMPLETE);
 
         /* No new data received within the given time UART_RX_TIMEOUT */
         /* Check how many bytes were received */ 
-        uart_get_buffered_data_len(UART_PORT_NUMBER, &buff0_size);
+        size_t received_size = 0;
+        uart_get_buffered_data_len(UART_PORT_NUMBER, &received_size);
 
         /* Check if received bytes are more than minimum of MBUS frame and if a new measurement should be made */
-        if(buff0_size >= (MBUS_HEADER_LENGTH + MBUS_FOOTER_LENGTH) && curr_interval >= DATA_UPDATE_INTERVAL)
+        if(received_size >= (MBUS_HEADER_LENGTH + MBUS_FOOTER_LENGTH) && curr_interval >= DATA_UPDATE_INTERVAL)
         {
-            /* Write bytes to buffer0 */
-            uart_read_bytes(UART_PORT_NUMBER, &buff0, buff0_size, portMAX_DELAY);
+            /* All layers are parsed in place in one frame */
+            frame_t *frame = frame_pool_take();
+            esp_err_t err = ESP_FAIL;
+            size_t user_data_size = 0;
+            uint32_t frame_counter = 0;
 
-            /* Process received data from buffer0 and write to buffer1 */
-            esp_err_t err = parse_mbus_long_frame_layer(&buff0[0], buff0_size, &buff1[0], &buff1_size);
-            
-            /* Check if mbus parsing was successfull */
-            if(err == ESP_OK)
+            if(frame != NULL && received_size <= FRAME_POOL_FRAME_SIZE)
             {
-                /* Process mbus data from buffer1 and write to buffer0 */
-                err = parse_dlms_layer(&buff1[0], buff1_size, &buff0[0], &buff0_size, &decryption_key[0]);
+                /* Write bytes to frame */
+                int read_size = uart_read_bytes(UART_PORT_NUMBER, frame->data, received_size, portMAX_DELAY);
+                frame->size = read_size > 0 ? (size_t)read_size : 0;
+                METER_CAPTURE_COMMIT(frame->data, frame->size, 0);
+
+                /* Replace raw bytes by user data of mbus layer */
+                err = parse_mbus_long_frame_layer(frame->data, frame->size, frame->data, &user_data_size);
+                if(err != ESP_OK)
+                {
+                    meter_diag_increment(METER_DIAG_PARSE_FAILURE);
+                }
+            }
+            else
+            {
+#if METER_CAPTURE_ENABLED
+                /* Telegram is flushed below, capture keeps the bytes which fit a frame */
+                static uint8_t capture_buffer[FRAME_POOL_FRAME_SIZE];
+                size_t capture_size = received_size < FRAME_POOL_FRAME_SIZE ? received_size : FRAME_POOL_FRAME_SIZE;
+                int read_size = uart_read_bytes(UART_PORT_NUMBER, capture_buffer, capture_size, portMAX_DELAY);
+                METER_CAPTURE_COMMIT(capture_buffer, read_size > 0 ? (size_t)read_size : 0,
+                                     (frame == NULL ? METER_CAPTURE_FLAG_POOL_EMPTY : 0) | (received_size > FRAME_POOL_FRAME_SIZE ? METER_CAPTURE_FLAG_TRUNCATED : 0));
+#endif
+                /* Telegram longer than a frame can't be parsed, pool empty is counted by pool */
+                if(frame != NULL)
+                {
+                    meter_diag_increment(METER_DIAG_PARSE_FAILURE);
+                }
             }
 
-            //TEST: PRINT DATA
-            printf("Decrypted data size: %d\n", buff0_size);
-        	for (int i = 0; i < buff0_size; i++)
-        	{
-        	    printf("%02X", buff0[i]);
-        	}
-            printf("\n");
+            /* Check if mbus parsing was successfull, pool empty is counted by pool */
+            if(err == ESP_OK)
+            {
+                LATENCY_TRACE_MARK(LATENCY_STAGE_MBUS_PARSED);
+
+                /* Decrypt user data, header stays in front */
+                err = parse_dlms_layer(frame->data, user_data_size, &frame->offset, &frame->size, &decryption_key[0]);
+                if(err == ESP_OK)
+                {
+                    /* Meter increments the counter with every telegram, a lower one is a replayed telegram */
+                    get_dlms_frame_counter(frame->data, user_data_size, &frame_counter);
+                    if(frame_counter_floor_valid && frame_counter <= frame_counter_floor)
+                    {
+                        ESP_LOGW(TAG, "Frame counter %lu not above %lu, telegram replayed", (unsigned long)frame_counter, (unsigned long)frame_counter_floor);
+                        err = ESP_ERR_INVALID_STATE;
+                    }
+                }
+                if(err == ESP_OK)
+                {
+                    LATENCY_TRACE_MARK(LATENCY_STAGE_DECRYPTED);
+
+                    /* Dump of decrypted data, formatted later by binary log task */
+                    BINARY_LOG_DATA(BINARY_LOG_UART_DECRYPTED_DATA, &frame->data[frame->offset], frame->size, (uint32_t)frame->size);
+                }
+                else
+                {
+                    meter_diag_increment(METER_DIAG_DECRYPT_FAILURE);
+                }
+            }
 
             /* Check if dlms parsing was successfull */
             if(err == ESP_OK)
             {
-                /* Process dlms data from buffer0 */
-                //err = parse_obis(&buff0[0], buff0_size);
+                /* Process decrypted data */
+                err = parse_obis(&frame->data[frame->offset], frame->size, &obis_result);
+                if(err != ESP_OK)
+                {
+                    meter_diag_increment(METER_DIAG_PARSE_FAILURE);
+                }
+            }
+
+            /* Publish decoded data for other tasks, never blocks */
+            if(err == ESP_OK)
+            {
+                frame_counter_floor = frame_counter;
+                frame_counter_floor_valid = true;
+                meter_snapshot_publish(frame_counter, &obis_result);
+                LATENCY_TRACE_MARK(LATENCY_STAGE_OBIS_DECODED);
+                meter_diag_increment(METER_DIAG_TELEGRAMS_OK);
+
+                /* Serialize now, so power fail only needs one flash write */
+                powerfail_prepare(&obis_result, frame_counter);
+            }
+
+            /* Decoded data is copied, frame is not needed anymore */
+            frame_pool_give(frame);
+
+            /* Pass decoded data on */
+            if(err == ESP_OK && smartmeter_data_cb != NULL)
+            {
+                smartmeter_data_cb(&obis_result);
             }
             
             /* Check if parsing failed */
             if(err != ESP_OK)
             {
                 ESP_LOGE(TAG, "Parsing failed.");
+                METER_CAPTURE_FAILED();
                 
                 /* Flush ringbuffer */
                 uart_flush_input(UART_PORT_NUMBER);
@@ -179,6 +274,11 @@ static void uart_event_task(void *pvParameters)
                 curr_interval = 0;
             }
         }
+        else if(received_size > 0)
+        {
+            /* Telegram isn't needed for this interval, drop it so it isn't parsed together with the next one */
+            uart_flush_input(UART_PORT_NUMBER);
+        }
     }
     /* Delete this task */
     vTaskDelete(NULL);
@@ -186,6 +286,29 @@ static void uart_event_task(void *pvParameters)
 
 esp_err_t smartmeter_init()
 {
+    /* === POWER FAIL HANDLING === */
+    /* Optional, runs without partition */
+    esp_err_t err = powerfail_init();
+    if(err != ESP_OK && err != ESP_ERR_NOT_FOUND){ return err; }
+
+    /* Telegrams must be newer than the one recorded at last power fail */
+    powerfail_record_t record;
+    if(powerfail_get_restored(&record) == ESP_OK)
+    {
+        frame_counter_floor = record.frame_counter;
+        frame_counter_floor_valid = true;
+    }
+
+    /* === RAW TELEGRAM CAPTURE === */
+    /* Only active with METER_CAPTURE_ENABLED */
+    err = meter_capture_init();
+    if(err != ESP_OK){ return err; }
+
+    /* === BINARY LOG === */
+    /* Formatter of the hot path log, started before the uart event task writes */
+    err = binary_log_init();
+    if(err != ESP_OK){ return err; }
+
     /* === CONFIGURE UART ===*/
     /* Create basic configuration */
     uart_config_t uart_config = {
@@ -198,7 +321,7 @@ esp_err_t smartmeter_init()
     };
 
     /* Set configuration */
-    esp_err_t err = uart_param_config(UART_PORT_NUMBER, &uart_config);
+    err = uart_param_config(UART_PORT_NUMBER, &uart_config);
     if(err != ESP_OK){ return err; }
 
     /* Set communication pins */
@@ -206,11 +329,17 @@ esp_err_t smartmeter_init()
     if(err != ESP_OK){ return err; }
 
     /* Install driver */
-    err = uart_driver_install(UART_PORT_NUMBER, DATA_BUFFER_SIZE, 0, 20, &uart1_queue, 0);
+    err = uart_driver_install(UART_PORT_NUMBER, UART_RX_BUFFER_SIZE, 0, 20, &uart1_queue, 0);
     if(err != ESP_OK){ return err; }
 
     /* Create a task to handle events */
-    xTaskCreate(uart_event_task, "uart_event_task", ((3 * DATA_BUFFER_SIZE) + 2048), NULL, 12, NULL);
+    xTaskCreate(uart_event_task, "uart_event_task", UART_TASK_STACK_SIZE, NULL, UART_TASK_PRIORITY, NULL);
 
     return err;
+}
+
+esp_err_t smartmeter_register_data_cb(smartmeter_data_cb_t data_cb)
+{
+    smartmeter_data_cb = data_cb;
+    return ESP_OK;
 }
\ No newline at end of file
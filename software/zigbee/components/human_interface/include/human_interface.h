@@ -18,8 +18,6 @@ extern "C" {
 #define BTTN_GPIO_NUM                 0
 #define BTTN_LONG_PRESS_TIME_MS       3000
 
-typedef void (* bttn_cb_t)(void *button_handle, void *usr_data);
-
 /* ===== LED CONFIGURATION ===== */
 #define LED_GPIO_NUM                    1
 #define LED_BLINK_NUM                   4
@@ -32,37 +30,57 @@ typedef enum {
     BLINK_START_UP
 } led_blink_type_t;
 
-/* ===== BUTTON FUNCTIONS ===== */
+/* ===== EVENT CONFIGURATION ===== */
+#define HI_EVENT_QUEUE_LENGTH           8           /* < Events are dropped if queue is full */
+#define HI_TASK_PRIORITY                2           /* < Below uart event task and zigbee task */
+#define HI_TASK_STACK_SIZE              2048
+#define HI_RESET_ANIMATION_TIME_MS      2500        /* < Reset animation is shown before factory reset */
+
+/* Events posted by other tasks, only queued and handled by human interface task */
+typedef enum {
+    HI_EVENT_NETWORK_SEARCH,            /* < Stack initialized, searching network */
+    HI_EVENT_NETWORK_JOINED,            /* < Joined network */
+    HI_EVENT_DATA_SENT,                 /* < Measurement was sent */
+    HI_EVENT_LEAVE_REQUEST,             /* < Coordinator requested leave with reset */
+    HI_EVENT_BUTTON_LONG_PRESS,         /* < Posted internally by button */
+    HI_EVENT_RESET_TIMEOUT              /* < Posted internally when reset animation is done */
+} hi_event_t;
+
+/* States of human interface */
+typedef enum {
+    HI_STATE_START_UP,
+    HI_STATE_SEARCHING,
+    HI_STATE_CONNECTED,
+    HI_STATE_RESETTING
+} hi_state_t;
+
 /**
- * @brief Initialize button and register callback for long press
- * 
- * @return esp_err_t 
+ * @brief Called from human interface task after reset animation, must only block shortly
  */
-esp_err_t button_init(bttn_cb_t button_cb);
+typedef void (* hi_reset_cb_t)(void);
 
-/* ===== LED FUNCTIONS ===== */
 /**
- * @brief Initialize led
+ * @brief Initialize led and button, start human interface task
  * 
+ * @param reset_cb called after reset was requested by button or leave request and the animation is done
  * @return esp_err_t 
  */
-esp_err_t led_init();
+esp_err_t human_interface_init(hi_reset_cb_t reset_cb);
 
 /**
- * @brief Start led animation
+ * @brief Post event to human interface, never blocks and can be called from any task
  * 
- * @param type animation type
- * @return esp_err_t 
+ * @param event event to post
+ * @return esp_err_t ESP_ERR_TIMEOUT if queue is full
  */
-esp_err_t led_animation_start(led_blink_type_t type);
+esp_err_t human_interface_post(hi_event_t event);
 
 /**
- * @brief Stop led animation
+ * @brief Get current state of human interface
  * 
- * @param type animation type
- * @return esp_err_t 
+ * @return hi_state_t 
  */
-esp_err_t led_animation_stop(led_blink_type_t type);
+hi_state_t human_interface_get_state();
 
 #ifdef __cplusplus
 } // extern "C"
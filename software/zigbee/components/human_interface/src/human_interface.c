@@ -14,6 +14,14 @@ static const char* TAG = "human_interface";
 /* Header */
 #include "human_interface.h"
 
+/* FreeRTOS libraries */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+/* Timer for delayed actions */
+#include "esp_timer.h"
+
 /* Button Library */
 #include "iot_button.h"
 
@@ -23,8 +31,25 @@ static const char* TAG = "human_interface";
 /* Led Handle */
 static led_indicator_handle_t led_handle = NULL;
 
+/* Event queue, state machine and timer of reset animation */
+static QueueHandle_t event_queue = NULL;
+static volatile hi_state_t state = HI_STATE_START_UP;
+static esp_timer_handle_t reset_timer = NULL;
+static hi_reset_cb_t reset_cb = NULL;
+
+/* ===== CALLBACK FUNCTIONS ===== */
+static void button_long_press_cb(void *button_handle, void *usr_data)
+{
+    human_interface_post(HI_EVENT_BUTTON_LONG_PRESS);
+}
+
+static void reset_timer_cb(void *arg)
+{
+    human_interface_post(HI_EVENT_RESET_TIMEOUT);
+}
+
 /* ===== BUTTON FUNCTIONS ===== */
-esp_err_t button_init(bttn_cb_t button_cb)
+static esp_err_t button_init()
 {
     /* Configuration */
     button_config_t button_config = {
@@ -46,12 +71,12 @@ esp_err_t button_init(bttn_cb_t button_cb)
         return ESP_FAIL;
     }
 
-    /* Register long press button callback */
-    return iot_button_register_cb(button_handle, BUTTON_LONG_PRESS_START, (button_cb_t)button_cb, NULL);
+    /* Register long press button callback, only posts event */
+    return iot_button_register_cb(button_handle, BUTTON_LONG_PRESS_START, button_long_press_cb, NULL);
 }
 
 /* ===== LED FUNCTIONS ===== */
-esp_err_t led_init()
+static esp_err_t led_init()
 {
     /* reset animation */
     static const blink_step_t blink_reset[] = {
@@ -115,12 +140,132 @@ esp_err_t led_init()
     return ESP_OK;
 }
 
-esp_err_t led_animation_start(led_blink_type_t type)
+static void led_animation_stop_all()
 {
-    return led_indicator_start(led_handle, type);
+    for(int type = 0; type < LED_BLINK_NUM; type++)
+    {
+        led_indicator_stop(led_handle, type);
+    }
 }
 
-esp_err_t led_animation_stop(led_blink_type_t type)
+/* ===== STATE MACHINE ===== */
+static void start_reset()
 {
-    return led_indicator_stop(led_handle, type);
-}
\ No newline at end of file
+    /* Show reset animation, reset is done by timer */
+    led_animation_stop_all();
+    led_indicator_start(led_handle, BLINK_RESET);
+    esp_timer_start_once(reset_timer, (uint64_t)HI_RESET_ANIMATION_TIME_MS * 1000);
+    state = HI_STATE_RESETTING;
+}
+
+static void handle_event(hi_event_t event)
+{
+    /* Reset has priority in every state */
+    if(state != HI_STATE_RESETTING && (event == HI_EVENT_BUTTON_LONG_PRESS || event == HI_EVENT_LEAVE_REQUEST))
+    {
+        ESP_LOGI(TAG, "Reset initiated by %s", event == HI_EVENT_BUTTON_LONG_PRESS ? "button press" : "leave request");
+        start_reset();
+        return;
+    }
+
+    switch(state)
+    {
+        case HI_STATE_START_UP:
+        case HI_STATE_CONNECTED:
+            if(event == HI_EVENT_NETWORK_SEARCH)
+            {
+                /* Indicate network search */
+                led_animation_stop_all();
+                led_indicator_start(led_handle, BLINK_COUPLING);
+                state = HI_STATE_SEARCHING;
+            }
+            else if(event == HI_EVENT_DATA_SENT && state == HI_STATE_CONNECTED)
+            {
+                /* Short flash, animation stops itself */
+                led_indicator_stop(led_handle, BLINK_SENDING_DATA);
+                led_indicator_start(led_handle, BLINK_SENDING_DATA);
+            }
+            break;
+        case HI_STATE_SEARCHING:
+            if(event == HI_EVENT_NETWORK_JOINED)
+            {
+                /* Stop led coupling indication */
+                led_indicator_stop(led_handle, BLINK_COUPLING);
+                state = HI_STATE_CONNECTED;
+            }
+            break;
+        case HI_STATE_RESETTING:
+            if(event == HI_EVENT_RESET_TIMEOUT && reset_cb != NULL)
+            {
+                /* Device restarts, state is not left */
+                reset_cb();
+            }
+            break;
+    }
+}
+
+static void human_interface_task(void *pvParameters)
+{
+    hi_event_t event;
+    for(;;)
+    {
+        if(xQueueReceive(event_queue, &event, portMAX_DELAY) == pdTRUE)
+        {
+            handle_event(event);
+        }
+    }
+}
+
+/* ===== HUMAN INTERFACE FUNCTIONS ===== */
+esp_err_t human_interface_init(hi_reset_cb_t cb)
+{
+    reset_cb = cb;
+
+    event_queue = xQueueCreate(HI_EVENT_QUEUE_LENGTH, sizeof(hi_event_t));
+    if(event_queue == NULL)
+    {
+        ESP_LOGE(TAG, "Creating event queue failed!");
+        return ESP_ERR_NO_MEM;
+    }
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = reset_timer_cb,
+        .name = "hi_reset",
+    };
+    esp_err_t err = esp_timer_create(&timer_args, &reset_timer);
+    if(err != ESP_OK){ return err; }
+
+    err = led_init();
+    if(err != ESP_OK){ return err; }
+    err = button_init();
+    if(err != ESP_OK){ return err; }
+
+    /* Start up animation until network search begins */
+    led_indicator_start(led_handle, BLINK_START_UP);
+    state = HI_STATE_START_UP;
+
+    if(xTaskCreate(human_interface_task, "hi_task", HI_TASK_STACK_SIZE, NULL, HI_TASK_PRIORITY, NULL) != pdPASS)
+    {
+        ESP_LOGE(TAG, "Creating task failed!");
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t human_interface_post(hi_event_t event)
+{
+    if(event_queue == NULL){ return ESP_ERR_INVALID_STATE; }
+
+    /* Never wait, caller may be the zigbee task */
+    if(xQueueSend(event_queue, &event, 0) != pdTRUE)
+    {
+        ESP_LOGW(TAG, "Event queue full, event %d dropped", event);
+        return ESP_ERR_TIMEOUT;
+    }
+    return ESP_OK;
+}
+
+hi_state_t human_interface_get_state()
+{
+    return state;
+}
@@ -14,8 +14,9 @@ extern "C" {
 
 #include "esp_zigbee_core.h"
 
-/* ===== ZIGBEE GENERAL CONFIGURATION ===== */
-#define RESET_BUTTON_ANIMATION_TIME_MS      2500
+/* ===== ZIGBEE TASK CONFIGURATION ===== */
+#define ZB_TASK_PRIORITY                    5                                     /* < Above uart event task, stack timing is not delayed by decoding */
+#define ZB_TASK_STACK_SIZE                  4096                                  /* < Stack size of zigbee task */
 
 /* ===== ZIGBEE RF CONFIGURATION ===== */
 // https://docs.espressif.com/projects/esp-zigbee-sdk/en/latest/esp32/developing.html
@@ -49,6 +50,11 @@ extern "C" {
     .host_connection_mode = HOST_CONNECTION_MODE_NONE,      \
 }
 
+/**
+ * @brief Callback which is called periodically from zigbee task
+ */
+typedef void (* zb_app_poll_cb_t)(void);
+
 /**
  * @brief Initialize and start ZB operation
  * 
@@ -56,6 +62,17 @@ extern "C" {
  */
 esp_err_t zb_run();
 
+/**
+ * @brief Register callback which is called periodically from zigbee task, call before zb_run
+ * 
+ * @note Zigbee API is only safe to use from zigbee task, other tasks hand over data to this callback
+ * 
+ * @param poll_cb callback
+ * @param interval_ms interval between calls
+ * @return esp_err_t 
+ */
+esp_err_t zb_register_app_poll_cb(zb_app_poll_cb_t poll_cb, uint32_t interval_ms);
+
 #ifdef __cplusplus
 }
 #endif
\ No newline at end of file
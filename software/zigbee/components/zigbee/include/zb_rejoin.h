@@ -0,0 +1,66 @@
+/**
+ * @file zb_rejoin.h
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+// Multiple inclusion protection
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "esp_check.h"
+
+/* ===== REJOIN CONFIGURATION ===== */
+#define REJOIN_NVS_NAMESPACE                "zb_rejoin"     /* < NVS namespace of the cached network */
+#define REJOIN_NVS_KEY                      "network"       /* < NVS key of the cached network */
+
+/* Steering for the cached network on its channel only, before scanning all channels for any network */
+#define REJOIN_CACHED_CHANNEL_ATTEMPTS      3               /* < Number of attempts for the cached network */
+
+/* Delay between steering attempts: base * 2^attempt, limited to max, +/- jitter */
+#define REJOIN_BACKOFF_BASE_MS              1000            /* < Delay after first failed attempt */
+#define REJOIN_BACKOFF_MAX_MS               120000          /* < Upper limit of delay */
+#define REJOIN_BACKOFF_JITTER_PERCENT       25              /* < Random jitter, so devices don't retry in sync */
+
+/**
+ * @brief Load cached network (channel and extended PAN-ID) from NVS, NVS must be initialized
+ *
+ * @return esp_err_t
+ */
+esp_err_t zb_rejoin_init();
+
+/**
+ * @brief Start network steering, first for cached network on its channel, then for any network on all channels
+ *
+ * @note Must be called from zigbee task
+ */
+void zb_rejoin_start_steering();
+
+/**
+ * @brief Handle successful steering, persist network and measure time to rejoin
+ *
+ * @note Must be called from zigbee task
+ */
+void zb_rejoin_steering_success();
+
+/**
+ * @brief Handle failed steering, schedule next attempt with exponential backoff
+ *
+ * @note Must be called from zigbee task
+ */
+void zb_rejoin_steering_failed();
+
+/**
+ * @brief Get time from first steering attempt until network was joined, attribute RejoinTime of diagnostics cluster
+ *
+ * @return uint32_t time in ms of last rejoin, 0 if not joined yet
+ */
+uint32_t zb_rejoin_get_time_ms();
+
+#ifdef __cplusplus
+}
+#endif
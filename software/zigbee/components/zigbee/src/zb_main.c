@@ -13,6 +13,7 @@ static const char* TAG = "zb_main";
 
 /* Header */
 #include "zb_main.h"
+#include "zb_rejoin.h"
 
 /* Human Interface Library */
 #include "human_interface.h"
@@ -20,6 +21,7 @@ static const char* TAG = "zb_main";
 /* Endpoint for electricity meter */
 #include "zb_electricity_meter_endpoint.h"
 #include "zb_electricity_meter_update.h"
+#include "zb_electricity_meter_reporter.h"
 
 /* Zigbee libraries */
 #include "ha/esp_zigbee_ha_standard.h"
@@ -36,25 +38,34 @@ static const char* TAG = "zb_main";
 #error Define ZB_ZCZR in idf.py menuconfig to compile light (Router) source code.
 #endif
 
+/* Application callback, called periodically from zigbee task */
+static zb_app_poll_cb_t app_poll_cb = NULL;
+static uint32_t app_poll_interval_ms = 0;
+
 /* ===== CALLBACK FUNCTIONS ===== */
-static void zb_reset_button_cb(void *button_handle, void *usr_data)
+/* Runs in zigbee task, scheduled by zb_reset_request_cb */
+static void factory_reset_alarm_cb(uint8_t param)
 {
-    ESP_LOGI(TAG, "Reset initiated by button press");
-
-    zb_update_voltage(PhaseB, 2000);
-    zb_update_total_active_power(10000);
-
-    /* Start led indication */
-    //led_animation_start(BLINK_RESET);
-    //vTaskDelay(RESET_BUTTON_ANIMATION_TIME_MS / portTICK_PERIOD_MS);
+    /* Factory reset, performs leave procedure and restarts */
+    ESP_LOGI(TAG, "Factory reset");
+    esp_zb_factory_reset();
+}
 
-    /* Factoy reset */
-    //esp_zb_factory_reset();
+/* Called from human interface task after reset animation */
+static void zb_reset_request_cb(void)
+{
+    /* Stack api is not thread safe, hand over to zigbee task */
+    esp_zb_lock_acquire(portMAX_DELAY);
+    esp_zb_scheduler_alarm((esp_zb_callback_t)factory_reset_alarm_cb, 0, 0);
+    esp_zb_lock_release();
 }
 
-static void bdb_start_top_level_commissioning_cb(uint8_t mode_mask)
+static void app_poll_alarm_cb(uint8_t param)
 {
-    ESP_ERROR_CHECK(esp_zb_bdb_start_top_level_commissioning(mode_mask));
+    app_poll_cb();
+
+    /* Schedule next call */
+    esp_zb_scheduler_alarm((esp_zb_callback_t)app_poll_alarm_cb, 0, app_poll_interval_ms);
 }
 
 /* ===== MAIN FUNCTIONS ===== */
@@ -91,12 +102,10 @@ void esp_zb_app_signal_handler(esp_zb_app_signal_t *signal_struct)
         case ESP_ZB_BDB_SIGNAL_DEVICE_REBOOT:
             if (err_status == ESP_OK) {
                 /* Indicate network search */
-                ESP_ERROR_CHECK(led_animation_stop(BLINK_START_UP));
-                ESP_ERROR_CHECK(led_animation_start(BLINK_COUPLING));
+                human_interface_post(HI_EVENT_NETWORK_SEARCH);
 
-                /* Start forming/joining zigbee network */
-                ESP_LOGI(TAG, "Start network steering");
-                esp_zb_bdb_start_top_level_commissioning(ESP_ZB_BDB_MODE_NETWORK_STEERING);
+                /* Start forming/joining zigbee network, cached channel first */
+                zb_rejoin_start_steering();
             } else {
                 /* Stack not initialized */
                 ESP_LOGW(TAG, "Failed to initialize Zigbee stack (status: %d)", err_status);
@@ -107,7 +116,7 @@ void esp_zb_app_signal_handler(esp_zb_app_signal_t *signal_struct)
             /* Successfully joined network */
             if (err_status == ESP_OK) {
                 /* Stop led coupling indication */
-                ESP_ERROR_CHECK(led_animation_stop(BLINK_COUPLING));
+                human_interface_post(HI_EVENT_NETWORK_JOINED);
 
                 /* Get and print PAN-ID of joined network */
                 esp_zb_ieee_addr_t extended_pan_id;
@@ -116,13 +125,22 @@ void esp_zb_app_signal_handler(esp_zb_app_signal_t *signal_struct)
                         extended_pan_id[7], extended_pan_id[6], extended_pan_id[5], extended_pan_id[4],
                         extended_pan_id[3], extended_pan_id[2], extended_pan_id[1], extended_pan_id[0],
                         esp_zb_get_pan_id(), esp_zb_get_current_channel());
+
+                /* Cache network and measure time to rejoin */
+                zb_rejoin_steering_success();
+
+                /* Report values immediately, restored values are flagged as stale */
+                zb_report_all_attributes();
+
+                /* Adapt reporting rate to link quality */
+                zb_reporter_start();
             } 
             else {
                 /* Failed to join network */
                 ESP_LOGI(TAG, "Network steering was not successful (status: %d)", err_status);
 
-                /* Try joining again after 1s */
-                esp_zb_scheduler_alarm((esp_zb_callback_t)bdb_start_top_level_commissioning_cb, ESP_ZB_BDB_MODE_NETWORK_STEERING, 1000);
+                /* Try joining again with exponential backoff */
+                zb_rejoin_steering_failed();
             }
             break;
 
@@ -133,15 +151,16 @@ void esp_zb_app_signal_handler(esp_zb_app_signal_t *signal_struct)
             if (leave_params->leave_type == ESP_ZB_NWK_LEAVE_TYPE_RESET) {
                 ESP_LOGI(TAG, "Resetting device because of external leave request");
 
-                /* Start led indication */
-                led_animation_start(BLINK_RESET);
-                vTaskDelay(RESET_BUTTON_ANIMATION_TIME_MS / portTICK_PERIOD_MS);
-
-                /* Factory reset, performs leave procedure */
-                esp_zb_factory_reset();
+                /* Reset is done after led indication, zigbee task is not blocked */
+                human_interface_post(HI_EVENT_LEAVE_REQUEST);
             }
             break;
 
+        /* Network status, e.g. link failure or no route */
+        case ESP_ZB_NLME_STATUS_INDICATION:
+            ESP_LOGI(TAG, "Network status: 0x%02x", ((esp_zb_zdo_signal_nwk_status_indication_params_t *)esp_zb_app_signal_get_params(p_sg_p))->status);
+            break;
+
         /* Handle all other signals */
         default:
             /* Print signal strength and status */
@@ -176,6 +195,12 @@ static void zb_task(void *pvParameters)
     /* Start zigbee stack */
     ESP_ERROR_CHECK(esp_zb_start(false));
 
+    /* Start periodic application callback */
+    if(app_poll_cb != NULL)
+    {
+        esp_zb_scheduler_alarm((esp_zb_callback_t)app_poll_alarm_cb, 0, app_poll_interval_ms);
+    }
+
     /* Run zigbee stack in loop */
     esp_zb_main_loop_iteration();
 }
@@ -187,14 +212,15 @@ static void zb_task(void *pvParameters)
  */
 esp_err_t zb_run()
 {
-    /* Initialize human interface */
-    ESP_ERROR_CHECK(led_init());
-    ESP_ERROR_CHECK(led_animation_start(BLINK_START_UP));
-    ESP_ERROR_CHECK(button_init(zb_reset_button_cb));
+    /* Initialize human interface, shows start up animation */
+    ESP_ERROR_CHECK(human_interface_init(zb_reset_request_cb));
 
     /* Initialize non-volatile flash */
     ESP_ERROR_CHECK(nvs_flash_init());
 
+    /* Load cached network for fast rejoin */
+    ESP_ERROR_CHECK(zb_rejoin_init());
+
     /* Operating mode */
     esp_zb_platform_config_t config = {
         .radio_config = ZB_DEFAULT_RADIO_CONFIG(),
@@ -205,7 +231,19 @@ esp_err_t zb_run()
     ESP_ERROR_CHECK(esp_zb_platform_config(&config));
 
     /* Create zigbee background task */
-    xTaskCreate(zb_task, "ZB_TASK", 4096, NULL, 5, NULL);
+    xTaskCreate(zb_task, "ZB_TASK", ZB_TASK_STACK_SIZE, NULL, ZB_TASK_PRIORITY, NULL);
+
+    return ESP_OK;
+}
+
+esp_err_t zb_register_app_poll_cb(zb_app_poll_cb_t poll_cb, uint32_t interval_ms)
+{
+    if(poll_cb == NULL || interval_ms == 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
 
+    app_poll_cb = poll_cb;
+    app_poll_interval_ms = interval_ms;
     return ESP_OK;
 }
\ No newline at end of file
@@ -0,0 +1,206 @@
+/**
+ * @file zb_rejoin.c
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+/* Setup logging */
+#include "esp_log.h"
+static const char* TAG = "zb_rejoin";
+
+/* Header */
+#include "zb_main.h"
+#include "zb_rejoin.h"
+
+/* System libraries */
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "nvs.h"
+
+/* Network which was joined last, stored in NVS */
+typedef struct {
+    uint8_t channel;                    /* < Channel of network */
+    uint16_t pan_id;                    /* < Short PAN-ID of network, changes after a PAN ID conflict, logged only */
+    esp_zb_ieee_addr_t extended_pan_id; /* < Extended PAN-ID of network, steering on the cached channel joins only this network */
+} zb_rejoin_network_t;
+
+/* Any extended PAN-ID, steering joins the first open network */
+static const esp_zb_ieee_addr_t any_extended_pan_id = {0};
+
+/* Cached network */
+static zb_rejoin_network_t cached_network;
+static bool cached_network_valid = false;
+
+/* Number of failed steering attempts since steering was started */
+static uint32_t steering_attempts = 0;
+
+/* Time when steering was started, 0 if not steering */
+static int64_t steering_start_time_us = 0;
+
+/* Time it took to join network */
+static uint32_t rejoin_time_ms = 0;
+
+/* ===== HELPER FUNCTIONS ===== */
+static void bdb_start_top_level_commissioning_cb(uint8_t mode_mask)
+{
+    /* Select network, cached one first and fall back to any network on all channels */
+    if(cached_network_valid && steering_attempts < REJOIN_CACHED_CHANNEL_ATTEMPTS)
+    {
+        esp_zb_set_primary_network_channel_set(1UL << cached_network.channel);
+        esp_zb_set_extended_pan_id(cached_network.extended_pan_id);
+    }
+    else
+    {
+        esp_zb_set_primary_network_channel_set(ESP_ZB_PRIMARY_CHANNEL_MASK);
+        esp_zb_set_extended_pan_id(any_extended_pan_id);
+    }
+
+    ESP_ERROR_CHECK(esp_zb_bdb_start_top_level_commissioning(mode_mask));
+}
+
+static uint32_t backoff_delay_ms(uint32_t attempt)
+{
+    /* Exponential delay, shift is limited to prevent overflow */
+    uint32_t delay = REJOIN_BACKOFF_MAX_MS;
+    if(attempt < 16 && (REJOIN_BACKOFF_BASE_MS << attempt) < REJOIN_BACKOFF_MAX_MS)
+    {
+        delay = REJOIN_BACKOFF_BASE_MS << attempt;
+    }
+
+    /* Add random jitter in range of +/- REJOIN_BACKOFF_JITTER_PERCENT */
+    uint32_t jitter_range = (delay * REJOIN_BACKOFF_JITTER_PERCENT) / 100;
+    if(jitter_range > 0)
+    {
+        delay = delay - jitter_range + (esp_random() % (2 * jitter_range + 1));
+    }
+
+    return delay;
+}
+
+/* ===== NVS FUNCTIONS ===== */
+static esp_err_t network_cache_store(const zb_rejoin_network_t *network)
+{
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(REJOIN_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if(err != ESP_OK){ return err; }
+
+    err = nvs_set_blob(handle, REJOIN_NVS_KEY, network, sizeof(zb_rejoin_network_t));
+    if(err == ESP_OK)
+    {
+        err = nvs_commit(handle);
+    }
+
+    nvs_close(handle);
+    return err;
+}
+
+esp_err_t zb_rejoin_init()
+{
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(REJOIN_NVS_NAMESPACE, NVS_READONLY, &handle);
+
+    /* Namespace doesn't exist before first join */
+    if(err == ESP_ERR_NVS_NOT_FOUND)
+    {
+        ESP_LOGI(TAG, "No cached network");
+        return ESP_OK;
+    }
+    if(err != ESP_OK){ return err; }
+
+    /* Read cached network */
+    size_t size = sizeof(zb_rejoin_network_t);
+    err = nvs_get_blob(handle, REJOIN_NVS_KEY, &cached_network, &size);
+    nvs_close(handle);
+
+    if(err == ESP_OK && size == sizeof(zb_rejoin_network_t) && cached_network.channel >= 11 && cached_network.channel <= 26)
+    {
+        cached_network_valid = true;
+        ESP_LOGI(TAG, "Cached network (PAN ID: 0x%04hx, Channel: %d)", cached_network.pan_id, cached_network.channel);
+    }
+    else if(err == ESP_ERR_NVS_NOT_FOUND)
+    {
+        ESP_LOGI(TAG, "No cached network");
+        err = ESP_OK;
+    }
+
+    return err;
+}
+
+/* ===== STEERING FUNCTIONS ===== */
+void zb_rejoin_start_steering()
+{
+    /* Remember start time to measure time to rejoin */
+    if(steering_start_time_us == 0)
+    {
+        steering_start_time_us = esp_timer_get_time();
+    }
+    steering_attempts = 0;
+
+    ESP_LOGI(TAG, "Start network steering");
+    bdb_start_top_level_commissioning_cb(ESP_ZB_BDB_MODE_NETWORK_STEERING);
+}
+
+void zb_rejoin_steering_success()
+{
+    /* Measure time to rejoin */
+    if(steering_start_time_us != 0)
+    {
+        rejoin_time_ms = (uint32_t)((esp_timer_get_time() - steering_start_time_us) / 1000);
+        steering_start_time_us = 0;
+    }
+    ESP_LOGI(TAG, "Joined network after %lu ms and %lu failed attempts", (unsigned long)rejoin_time_ms, (unsigned long)steering_attempts);
+    steering_attempts = 0;
+
+    /* Get joined network */
+    zb_rejoin_network_t network;
+    memset(&network, 0, sizeof(zb_rejoin_network_t));
+    network.channel = esp_zb_get_current_channel();
+    network.pan_id = esp_zb_get_pan_id();
+    esp_zb_get_extended_pan_id(network.extended_pan_id);
+
+    /* Restore all channels and any network, stack uses them also for later rejoins */
+    esp_zb_set_primary_network_channel_set(ESP_ZB_PRIMARY_CHANNEL_MASK);
+    esp_zb_set_extended_pan_id(any_extended_pan_id);
+
+    /* Only write flash if network changed */
+    if(cached_network_valid && memcmp(&network, &cached_network, sizeof(zb_rejoin_network_t)) == 0)
+    {
+        return;
+    }
+
+    if(network_cache_store(&network) == ESP_OK)
+    {
+        cached_network = network;
+        cached_network_valid = true;
+        ESP_LOGI(TAG, "Cached network (PAN ID: 0x%04hx, Channel: %d)", network.pan_id, network.channel);
+    }
+    else
+    {
+        ESP_LOGW(TAG, "Caching network failed");
+    }
+}
+
+void zb_rejoin_steering_failed()
+{
+    /* Calculate delay before incrementing, first retry uses base delay */
+    uint32_t delay = backoff_delay_ms(steering_attempts);
+    steering_attempts++;
+
+    if(cached_network_valid && steering_attempts == REJOIN_CACHED_CHANNEL_ATTEMPTS)
+    {
+        ESP_LOGI(TAG, "Network not found on cached channel %d, scanning all channels for any network", cached_network.channel);
+    }
+
+    /* Try joining again after delay */
+    ESP_LOGI(TAG, "Retry network steering in %lu ms", (unsigned long)delay);
+    esp_zb_scheduler_alarm((esp_zb_callback_t)bdb_start_top_level_commissioning_cb, ESP_ZB_BDB_MODE_NETWORK_STEERING, delay);
+}
+
+uint32_t zb_rejoin_get_time_ms()
+{
+    return rejoin_time_ms;
+}
@@ -0,0 +1,190 @@
+/**
+ * @file zb_electricity_meter_bulk.h
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+// Multiple inclusion protection
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_check.h"
+
+#include "zb_varint.h"
+
+/* ===== BULK SNAPSHOT CONFIGURATION ===== */
+#define ZB_BULK_FORMAT_VERSION              1       /* < First byte of payload, increment on format changes */
+#define ZB_BULK_MAX_REGISTERS               16      /* < Maximum number of registers of one telegram */
+#define ZB_BULK_TIMESTAMP_LENGTH            12      /* < Length of DLMS date time */
+#define ZB_BULK_SERIAL_NUMBER_MAX_LENGTH    16      /* < Maximum length of serial number */
+#define ZB_BULK_MAX_REGISTER_SIZE           (1 + 6 + 1 + 1 + ZB_VARINT_MAX_SIZE)   /* < Flags, OBIS code, scaler, unit and varint of the largest register */
+#define ZB_BULK_MAX_PAYLOAD_SIZE            (2 + ZB_BULK_TIMESTAMP_LENGTH + 1 + ZB_BULK_SERIAL_NUMBER_MAX_LENGTH + ZB_BULK_MAX_REGISTERS * ZB_BULK_MAX_REGISTER_SIZE)  /* < Worst case, fragmented by APS layer */
+
+/* ===== HISTORY BATCH CONFIGURATION ===== */
+#define ZB_HISTORY_FORMAT_VERSION           1       /* < First byte of history payload, increment on format changes */
+#define ZB_HISTORY_MAX_ENTRIES              21      /* < Maximum number of entries of one batch, at least one full page of the history log */
+#define ZB_HISTORY_MAX_PAYLOAD_SIZE         512     /* < Payload is fragmented by APS layer */
+
+/* ===== AGGREGATE WINDOW CONFIGURATION ===== */
+#define ZB_AGGREGATE_FORMAT_VERSION         1       /* < First byte of aggregate payload, increment on format changes */
+#define ZB_AGGREGATE_PAYLOAD_SIZE           58      /* < Fixed size of encoded window */
+
+/* Flags of a register in encoded payload */
+#define ZB_BULK_FLAG_SHORT_CODE             0x01    /* < Only C and D of OBIS code are encoded, A = 1, B = 0, E = 0, F = 255 */
+
+/* One register of the meter */
+typedef struct {
+    uint8_t obis_code[6];               /* < OBIS code A-F */
+    int8_t scaler;                      /* < Value is multiplied by 10^scaler */
+    uint8_t unit;                       /* < DLMS unit, e.g. 0x1E = Wh, 0x1B = W, 0x23 = V, 0x21 = A */
+    int64_t value;                      /* < Raw value as sent by the meter */
+} zb_bulk_register_t;
+
+/* All values of one telegram */
+typedef struct {
+    uint8_t timestamp[ZB_BULK_TIMESTAMP_LENGTH];                /* < DLMS date time of meter */
+    uint8_t serial_number[ZB_BULK_SERIAL_NUMBER_MAX_LENGTH];    /* < Serial number as sent by the meter */
+    uint8_t serial_number_length;                               /* < Length of serial number */
+    uint8_t register_count;                                     /* < Number of used registers */
+    zb_bulk_register_t registers[ZB_BULK_MAX_REGISTERS];        /* < Registers in order of telegram */
+} zb_bulk_snapshot_t;
+
+/* Values of one telegram stored while the network was down */
+typedef struct {
+    uint32_t time;                      /* < Meter time in seconds since 1970-01-01 UTC */
+    uint32_t summation_delivered;       /* < Active energy A+ in Wh */
+    uint32_t summation_received;        /* < Active energy A- in Wh */
+    int32_t total_active_power;         /* < A+ minus A- in W */
+    uint16_t rms_voltage[3];            /* < Voltage L1-L3 in 0.1 V */
+    uint16_t rms_current[3];            /* < Current L1-L3 in 0.01 A */
+} zb_history_entry_t;
+
+/* Aggregated values of one demand window */
+typedef struct {
+    uint32_t start_time;                /* < Start of window in seconds since 1970-01-01 UTC */
+    uint16_t duration;                  /* < Seconds covered by the energy difference */
+    uint16_t sample_count;              /* < Number of telegrams in window */
+    uint8_t tariff;                     /* < Tariff at start of window, 0 = Tier1 */
+    uint32_t demand_delivered;          /* < Average power of A+ in W */
+    uint32_t demand_received;           /* < Average power of A- in W */
+    int32_t average_power;              /* < Mean of active power in W */
+    uint16_t voltage_min[3];            /* < Voltage L1-L3 in 0.1 V */
+    uint16_t voltage_mean[3];
+    uint16_t voltage_max[3];
+    uint16_t current_min[3];            /* < Current L1-L3 in 0.01 A */
+    uint16_t current_mean[3];
+    uint16_t current_max[3];
+} zb_aggregate_window_t;
+
+/**
+ * @brief Encode snapshot into compact binary format
+ *
+ * Format (version 1), all multi byte values are little endian:
+ *  version (1) | register count (1) | timestamp (12) | serial length (1) | serial number (n)
+ *  per register: flags (1) | OBIS code (2 or 6) | scaler (1) | unit (1) | zig-zag varint value (1-10)
+ *
+ * @param snapshot snapshot to encode
+ * @param buffer output buffer
+ * @param buffer_size size of output buffer
+ * @return size_t encoded size, 0 if buffer is too small, never with ZB_BULK_MAX_PAYLOAD_SIZE bytes
+ */
+size_t zb_bulk_encode(const zb_bulk_snapshot_t *snapshot, uint8_t *buffer, size_t buffer_size);
+
+/**
+ * @brief Decode snapshot from compact binary format
+ *
+ * @param buffer encoded payload
+ * @param buffer_size size of encoded payload
+ * @param snapshot decoded snapshot
+ * @return esp_err_t ESP_ERR_NOT_SUPPORTED on unknown version, ESP_ERR_INVALID_SIZE on truncated payload
+ */
+esp_err_t zb_bulk_decode(const uint8_t *buffer, size_t buffer_size, zb_bulk_snapshot_t *snapshot);
+
+/**
+ * @brief Encode entries of history log, oldest entry first
+ *
+ * Format (version 1):
+ *  version (1) | entry count (1)
+ *  per entry: zig-zag varint difference to previous entry of time, summation delivered, summation received,
+ *  total active power, voltage L1-L3 and current L1-L3, the first entry is compared to zero
+ *
+ * @param entries entries in order of measurement
+ * @param count number of entries, at most ZB_HISTORY_MAX_ENTRIES
+ * @param buffer output buffer
+ * @param buffer_size size of output buffer
+ * @return size_t encoded size, 0 if buffer is too small
+ */
+size_t zb_history_encode(const zb_history_entry_t *entries, uint8_t count, uint8_t *buffer, size_t buffer_size);
+
+/**
+ * @brief Decode entries of history log
+ *
+ * @param buffer encoded payload
+ * @param buffer_size size of encoded payload
+ * @param entries output array with ZB_HISTORY_MAX_ENTRIES elements
+ * @param count number of decoded entries
+ * @return esp_err_t ESP_ERR_NOT_SUPPORTED on unknown version, ESP_ERR_INVALID_SIZE on truncated payload
+ */
+esp_err_t zb_history_decode(const uint8_t *buffer, size_t buffer_size, zb_history_entry_t *entries, uint8_t *count);
+
+/**
+ * @brief Encode aggregated window
+ *
+ * Format (version 1), all values little endian:
+ *  version (1) | start time (4) | duration (2) | sample count (2) | tariff (1) | demand delivered (4) | demand received (4)
+ *  | average power (4) | per phase: voltage min, mean, max (2 each) | per phase: current min, mean, max (2 each)
+ *
+ * @param window window to encode
+ * @param buffer output buffer
+ * @param buffer_size size of output buffer
+ * @return size_t encoded size (ZB_AGGREGATE_PAYLOAD_SIZE), 0 if buffer is too small
+ */
+size_t zb_aggregate_encode(const zb_aggregate_window_t *window, uint8_t *buffer, size_t buffer_size);
+
+/**
+ * @brief Decode aggregated window
+ *
+ * @param buffer encoded payload
+ * @param buffer_size size of encoded payload
+ * @param window decoded window
+ * @return esp_err_t ESP_ERR_NOT_SUPPORTED on unknown version, ESP_ERR_INVALID_SIZE on truncated payload
+ */
+esp_err_t zb_aggregate_decode(const uint8_t *buffer, size_t buffer_size, zb_aggregate_window_t *window);
+
+/**
+ * @brief Send snapshot as one command of the manufacturer specific cluster to bound devices
+ *
+ * @param snapshot snapshot to send
+ * @return esp_err_t
+ */
+esp_err_t zb_send_bulk_snapshot(const zb_bulk_snapshot_t *snapshot);
+
+/**
+ * @brief Send entries of history log as one command of the manufacturer specific cluster to bound devices
+ *
+ * @note Its send status is ZB_SENT_HISTORY of zb_pop_sent_request
+ *
+ * @param entries entries in order of measurement
+ * @param count number of entries, at most ZB_HISTORY_MAX_ENTRIES
+ * @return esp_err_t
+ */
+esp_err_t zb_send_history_batch(const zb_history_entry_t *entries, uint8_t count);
+
+/**
+ * @brief Send aggregated window as one command of the manufacturer specific cluster to bound devices
+ *
+ * @param window closed window
+ * @return esp_err_t
+ */
+esp_err_t zb_send_aggregate_window(const zb_aggregate_window_t *window);
+
+#ifdef __cplusplus
+}
+#endif
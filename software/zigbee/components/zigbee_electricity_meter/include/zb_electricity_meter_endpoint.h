@@ -18,6 +18,27 @@ extern "C" {
 /* General configuration values */
 #define HA_DLMS_ENDPOINT    	            1
 
+/* Same switch as latency_trace.h of the smartmeter component, set as compile definition of all components to 0 */
+#ifndef LATENCY_TRACE_ENABLED
+#define LATENCY_TRACE_ENABLED               1       /* < Latency histograms attribute */
+#endif
+
+/* Manufacturer specific cluster for device state */
+#define ZB_MANUFACTURER_CODE                    0x131B  /* < Espressif */
+#define ZB_MANUFACTURER_CLUSTER_ID              0xFC00
+#define ZB_MANUFACTURER_ATTR_DATA_STALE_ID      0x0000  /* < Bool, measurement values are restored from flash and not measured yet */
+#define ZB_MANUFACTURER_ATTR_BULK_VERSION_ID    0x0001  /* < U8, format version of bulk snapshot command */
+#define ZB_MANUFACTURER_ATTR_REPORTING_MODE_ID  0x0002  /* < Enum8, 0 = full rate, 1 = reduced rate because of weak link */
+#define ZB_MANUFACTURER_ATTR_POWER_QUALITY_ID   0x0003  /* < Bitmap16, active sag, swell, phase loss and overcurrent, 4 bits per phase */
+#define ZB_MANUFACTURER_ATTR_LATENCY_ID         0x0004  /* < Long octet string, latency histograms of the stages of a telegram, read on demand, only with LATENCY_TRACE_ENABLED */
+#define ZB_MANUFACTURER_LATENCY_MAX_SIZE        320     /* < Maximum size of latency histograms */
+#define ZB_MANUFACTURER_ATTR_SYSTEM_STATUS_ID   0x0005  /* < Long octet string, cpu time and stack of tasks and free heap, read on demand */
+#define ZB_MANUFACTURER_SYSTEM_STATUS_MAX_SIZE  300     /* < Maximum size of system status */
+
+#define ZB_MANUFACTURER_CMD_BULK_SNAPSHOT_ID    0x00    /* < Server to client, long octet string with all registers of one telegram */
+#define ZB_MANUFACTURER_CMD_HISTORY_BATCH_ID    0x01    /* < Server to client, long octet string with telegrams stored while the network was down */
+#define ZB_MANUFACTURER_CMD_AGGREGATE_WINDOW_ID 0x02    /* < Server to client, long octet string with demand, min, mean and max of one window */
+
 /**
  * @brief Create endpoint for electricity meter
  */
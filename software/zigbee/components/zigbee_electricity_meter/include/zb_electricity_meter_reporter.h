@@ -0,0 +1,84 @@
+/**
+ * @file zb_electricity_meter_reporter.h
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+// Multiple inclusion protection
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "esp_check.h"
+
+#include "zb_electricity_meter_snapshot.h"
+#include "zb_electricity_meter_bulk.h"
+
+/* ===== LINK QUALITY CONFIGURATION ===== */
+#define LINK_EVALUATE_INTERVAL_MS           10000   /* < Interval of link evaluation */
+
+/* Link is degraded if one of these limits is reached */
+#define LINK_DEGRADED_LQI                   80      /* < LQI of parent at or below */
+#define LINK_DEGRADED_RSSI                  -85     /* < RSSI of parent in dBm at or below */
+#define LINK_DEGRADED_FAILURE_PERCENT       20      /* < Failed APS confirms in percent of all confirms within one evaluation interval, at or above */
+#define LINK_MIN_CONFIRMS                   5       /* < Confirms within one evaluation interval needed to evaluate the failure ratio */
+
+/* Link is recovered if all of these limits are met for LINK_RECOVERED_INTERVALS */
+#define LINK_RECOVERED_LQI                  120     /* < LQI of parent above */
+#define LINK_RECOVERED_RSSI                 -78     /* < RSSI of parent in dBm above */
+#define LINK_RECOVERED_INTERVALS            6       /* < Number of consecutive good evaluations */
+
+/* In reduced mode only every n-th measurement is reported, with averaged values, and every n-th bulk snapshot is sent */
+#define LINK_REDUCED_RATE_DIVISOR           6
+
+/* Reporting mode, readable as attribute of manufacturer specific cluster */
+typedef enum {
+    ZB_REPORTING_MODE_FULL = 0,         /* < Every measurement is reported */
+    ZB_REPORTING_MODE_REDUCED = 1       /* < Averaged values of LINK_REDUCED_RATE_DIVISOR measurements are reported */
+} zb_reporting_mode_t;
+
+/**
+ * @brief Report measurement with rate depending on link quality
+ *
+ * @param measurement values of one telegram
+ * @return esp_err_t
+ */
+esp_err_t zb_reporter_submit(const zb_electricity_meter_snapshot_t *measurement);
+
+/**
+ * @brief Send bulk snapshot with rate depending on link quality, the latest of LINK_REDUCED_RATE_DIVISOR snapshots in reduced mode
+ *
+ * @param bulk registers of one telegram
+ * @return esp_err_t
+ */
+esp_err_t zb_reporter_submit_bulk(const zb_bulk_snapshot_t *bulk);
+
+/**
+ * @brief Start periodic link evaluation, e.g. after joining a network
+ *
+ * @note Must be called from zigbee task
+ */
+void zb_reporter_start();
+
+/**
+ * @brief Count the APS confirm of a sent command, e.g. from the send status handler
+ *
+ * @note Must be called from zigbee task
+ *
+ * @param status delivery status of the command
+ */
+void zb_reporter_send_status(esp_err_t status);
+
+/**
+ * @brief Get current reporting mode
+ *
+ * @return zb_reporting_mode_t
+ */
+zb_reporting_mode_t zb_reporter_get_mode();
+
+#ifdef __cplusplus
+}
+#endif
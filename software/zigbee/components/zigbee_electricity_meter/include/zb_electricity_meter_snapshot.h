@@ -0,0 +1,65 @@
+/**
+ * @file zb_electricity_meter_snapshot.h
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+// Multiple inclusion protection
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_check.h"
+
+/* ===== SNAPSHOT CONFIGURATION ===== */
+#define SNAPSHOT_NVS_NAMESPACE              "zb_snapshot"   /* < NVS namespace of the measurement snapshot */
+#define SNAPSHOT_NVS_KEY                    "measurement"   /* < NVS key of the measurement snapshot */
+
+/* Flash is only written every SNAPSHOT_STORE_INTERVAL_S to limit wear of the nvs partition */
+#define SNAPSHOT_STORE_INTERVAL_S           300
+
+/* Last measured values, as written to the attribute table */
+typedef struct {
+    int32_t total_active_power;         /* < TotalActivePower (0x0304) in W */
+    uint16_t rms_voltage[3];            /* < RMSVoltage of phase A, B and C in 0.1 V */
+    uint16_t rms_current[3];            /* < RMSCurrent of phase A, B and C in 0.01 A */
+    uint64_t summation_delivered;       /* < CurrentSummationDelivered in Wh (A+) */
+    uint64_t summation_received;        /* < CurrentSummationReceived in Wh (A-) */
+} zb_electricity_meter_snapshot_t;
+
+/**
+ * @brief Provide values recorded at the last power fail, must be called before the endpoint is created
+ *
+ * @note NVS is only written every SNAPSHOT_STORE_INTERVAL_S, the record of a power fail is usually newer
+ *
+ * @param snapshot recorded values
+ */
+void zb_snapshot_restore(const zb_electricity_meter_snapshot_t *snapshot);
+
+/**
+ * @brief Load last stored snapshot from NVS, NVS must be initialized
+ *
+ * Values of zb_snapshot_restore are used instead if their energy counters are not lower than the stored ones
+ *
+ * @param snapshot is overwritten with stored or restored values, left unchanged if there are none
+ * @return true if a stored or restored snapshot was loaded
+ */
+bool zb_snapshot_load(zb_electricity_meter_snapshot_t *snapshot);
+
+/**
+ * @brief Store snapshot to NVS, but not more often than SNAPSHOT_STORE_INTERVAL_S
+ *
+ * @param snapshot values to store
+ * @return esp_err_t
+ */
+esp_err_t zb_snapshot_store(const zb_electricity_meter_snapshot_t *snapshot);
+
+#ifdef __cplusplus
+}
+#endif
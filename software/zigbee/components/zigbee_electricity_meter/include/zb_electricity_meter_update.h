@@ -12,8 +12,39 @@
 extern "C" {
 #endif
 
+#include <stdbool.h>
 #include <stdio.h>
 
+#include "zb_electricity_meter_endpoint.h"
+
+/* Number of tiers of metering cluster, CurrentTierNSummationDelivered and -Received */
+#define ZB_METERING_TIER_COUNT  4
+
+/* Requests waiting for their send status, the oldest is forgotten if more are sent */
+#define ZB_SENT_REQUESTS_MAX    16
+
+/* Kind of a sent request, see zb_pop_sent_request */
+typedef enum {
+    ZB_SENT_MEASUREMENT,                /* < Attribute report of a measurement of the telegram */
+    ZB_SENT_HISTORY,                    /* < History batch, records are marked uploaded once it is confirmed */
+    ZB_SENT_OTHER,                      /* < Other attribute report or command */
+    ZB_SENT_UNKNOWN                     /* < No request waiting, e.g. sent by another component */
+} zb_sent_request_t;
+
+/* Counters of the meter link, attributes of diagnostics cluster */
+typedef struct {
+    uint32_t telegrams_ok;
+    uint32_t fifo_overflows;
+    uint32_t buffer_full;
+    uint32_t parity_errors;
+    uint32_t frame_errors;
+    uint32_t parse_failures;
+    uint32_t decrypt_failures;
+    uint32_t frame_pool_peak;
+    uint32_t frame_pool_empty;
+    uint32_t rejoin_time_ms;            /* < Time of last join from first steering attempt */
+} zb_diagnostics_t;
+
 /* Typedef to choose phase to update */
 typedef enum {
     PhaseA,
@@ -47,6 +78,102 @@ esp_err_t zb_update_voltage(phase_t phase, int16_t voltage);
  */
 esp_err_t zb_update_current(phase_t phase, int16_t current);
 
+/**
+ * @brief Update energy summation of metering cluster
+ * 
+ * @param delivered_wh Active energy A+ in Wh, as counted by the meter
+ * @param received_wh Active energy A- in Wh, as counted by the meter
+ * @return esp_err_t 
+ */
+esp_err_t zb_update_energy(uint64_t delivered_wh, uint64_t received_wh);
+
+/**
+ * @brief End update with values of one telegram, clears DataStale and stores the values for the next boot if power, voltages, currents and energy were all set since the last call
+ * 
+ * @note Single updates, e.g. of a phase with a power quality event, neither clear DataStale nor are stored on their own
+ */
+void zb_update_complete();
+
+/**
+ * @brief Update and report energy summation of one tier of metering cluster
+ * 
+ * @param tier Index of tier, 0 for CurrentTier1Summation
+ * @param delivered_wh Active energy A+ in Wh counted while tier was active
+ * @param received_wh Active energy A- in Wh counted while tier was active
+ * @return esp_err_t 
+ */
+esp_err_t zb_update_tier_summation(uint8_t tier, uint64_t delivered_wh, uint64_t received_wh);
+
+/**
+ * @brief Update power quality alarms of manufacturer specific cluster, reported immediately
+ * 
+ * @note Bypasses the reduced reporting rate, the alarms change only a few times per day
+ * 
+ * @param alarms Active conditions, 4 bits per phase starting with L1: sag, swell, phase loss, overcurrent
+ * @param report Send attribute report, false while not joined
+ * @return esp_err_t 
+ */
+esp_err_t zb_update_power_quality(uint16_t alarms, bool report);
+
+/**
+ * @brief Update reporting mode of manufacturer specific cluster, reported immediately
+ * 
+ * @param mode Reporting mode of reporter
+ * @return esp_err_t 
+ */
+esp_err_t zb_update_reporting_mode(uint8_t mode);
+
+#if LATENCY_TRACE_ENABLED
+/**
+ * @brief Update latency histograms of manufacturer specific cluster, not reported
+ * 
+ * @param data Encoded histograms
+ * @param size Size of data, at most ZB_MANUFACTURER_LATENCY_MAX_SIZE
+ * @return esp_err_t 
+ */
+esp_err_t zb_update_latency_histograms(const uint8_t *data, size_t size);
+#endif
+
+/**
+ * @brief Update system status attribute of manufacturer cluster, not reported
+ * 
+ * @param data Encoded status of system monitor
+ * @param size Size of data, at most ZB_MANUFACTURER_SYSTEM_STATUS_MAX_SIZE
+ * @return esp_err_t 
+ */
+esp_err_t zb_update_system_status(const uint8_t *data, size_t size);
+
+/**
+ * @brief Update counters of diagnostics cluster, only changed attributes are written, not reported
+ * 
+ * @param diagnostics Counters since boot
+ * @return esp_err_t 
+ */
+esp_err_t zb_update_diagnostics(const zb_diagnostics_t *diagnostics);
+
+/**
+ * @brief Send reports of all measurement attributes, e.g. after joining a network
+ * 
+ * @return esp_err_t 
+ */
+esp_err_t zb_report_all_attributes();
+
+/**
+ * @brief Take oldest request of this component which waits for its send status
+ * 
+ * @note Call once for every send status from the zigbee task, the stack confirms requests in order
+ * 
+ * @return zb_sent_request_t ZB_SENT_UNKNOWN if no request is waiting
+ */
+zb_sent_request_t zb_pop_sent_request();
+
+/**
+ * @brief Get time from boot until first attribute report was sent
+ * 
+ * @return uint32_t time in ms, 0 if nothing was reported yet
+ */
+uint32_t zb_get_first_report_time_ms();
+
 #ifdef __cplusplus
 }
 #endif
\ No newline at end of file
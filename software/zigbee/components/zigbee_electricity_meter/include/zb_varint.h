@@ -0,0 +1,44 @@
+/**
+ * @file zb_varint.h
+ * @brief Zig-zag varint of signed values, used by the bulk payloads and the history codec
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+// Multiple inclusion protection
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* ===== VARINT CONFIGURATION ===== */
+#define ZB_VARINT_MAX_SIZE              10          /* < 64 bit value, 7 bits per byte */
+
+/**
+ * @brief Encode value as zig-zag varint, 7 bits per byte, highest bit indicates following byte
+ *
+ * @param value value to encode, small negative values get small codes too
+ * @param buffer output buffer
+ * @param buffer_size size of output buffer
+ * @return size_t encoded size, 0 if buffer is too small
+ */
+size_t zb_varint_put(int64_t value, uint8_t *buffer, size_t buffer_size);
+
+/**
+ * @brief Decode zig-zag varint
+ *
+ * @param buffer encoded value
+ * @param buffer_size bytes which may be read, limits the size of the value too
+ * @param value decoded value
+ * @return size_t decoded size, 0 if the value doesn't end within buffer_size or ZB_VARINT_MAX_SIZE bytes
+ */
+size_t zb_varint_get(const uint8_t *buffer, size_t buffer_size, int64_t *value);
+
+#ifdef __cplusplus
+}
+#endif
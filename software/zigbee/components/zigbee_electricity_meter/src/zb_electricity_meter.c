@@ -6,6 +6,7 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 
 /* Setup logging */
 #include "esp_log.h"
@@ -14,6 +15,12 @@ static const char* TAG = "zb_dlms_ep";
 /* Header */
 #include "zb_electricity_meter_endpoint.h"
 #include "zb_electricity_meter_update.h"
+#include "zb_electricity_meter_snapshot.h"
+#include "zb_electricity_meter_bulk.h"
+#include "zb_electricity_meter_reporter.h"
+
+/* System libraries */
+#include "esp_timer.h"
 
 /* Values for basic cluster */
 #define BASIC_ZCL_VERSION                   ESP_ZB_ZCL_BASIC_ZCL_VERSION_DEFAULT_VALUE
@@ -32,6 +39,77 @@ static const char* TAG = "zb_dlms_ep";
 /* Values for electrical measurement cluster */
 #define ELECTRICAL_MEASUREMENT_RMS_VOLTAGE  0xFFFF                  /* < Default value from specification */
 #define ELECTRICAL_MEASUREMENT_RMS_CURRENT  0xFFFF                  /* < Default value from specification */
+#define ELECTRICAL_MEASUREMENT_AC_VOLTAGE_MULTIPLIER    1           /* < RMSVoltage is in 0.1 V ... */
+#define ELECTRICAL_MEASUREMENT_AC_VOLTAGE_DIVISOR       10          /* < ... like the registers of the meter */
+#define ELECTRICAL_MEASUREMENT_AC_CURRENT_MULTIPLIER    1           /* < RMSCurrent is in 0.01 A ... */
+#define ELECTRICAL_MEASUREMENT_AC_CURRENT_DIVISOR       100         /* < ... like the registers of the meter */
+#define ELECTRICAL_MEASUREMENT_AC_POWER_MULTIPLIER      1           /* < TotalActivePower is in W */
+#define ELECTRICAL_MEASUREMENT_AC_POWER_DIVISOR         1
+
+/* Values for metering cluster, not part of the SDK yet, created as custom cluster */
+#define METERING_ATTR_CURRENT_SUMMATION_DELIVERED_ID    0x0000  /* < U48, A+ */
+#define METERING_ATTR_CURRENT_SUMMATION_RECEIVED_ID     0x0001  /* < U48, A- */
+#define METERING_ATTR_CURRENT_TIER1_SUMMATION_DELIVERED_ID  0x0100  /* < U48, TierN delivered is 0x0100 + 2 * (N - 1) */
+#define METERING_ATTR_CURRENT_TIER1_SUMMATION_RECEIVED_ID   0x0101  /* < U48, TierN received is 0x0101 + 2 * (N - 1) */
+#define METERING_ATTR_UNIT_OF_MEASURE_ID                0x0300  /* < Enum8 */
+#define METERING_ATTR_MULTIPLIER_ID                     0x0301  /* < U24 */
+#define METERING_ATTR_DIVISOR_ID                        0x0302  /* < U24 */
+#define METERING_ATTR_SUMMATION_FORMATTING_ID           0x0303  /* < Bitmap8 */
+#define METERING_ATTR_METERING_DEVICE_TYPE_ID           0x0306  /* < Bitmap8 */
+
+/* Values for diagnostics cluster, counters of the meter link in the manufacturer specific range, read on demand */
+#define DIAGNOSTICS_ATTR_TELEGRAMS_OK_ID                0x4000  /* < U32, telegrams decoded */
+#define DIAGNOSTICS_ATTR_FIFO_OVERFLOWS_ID              0x4001  /* < U32, rx fifo overflows of uart */
+#define DIAGNOSTICS_ATTR_BUFFER_FULL_ID                 0x4002  /* < U32, ring buffer of uart driver full */
+#define DIAGNOSTICS_ATTR_PARITY_ERRORS_ID               0x4003  /* < U32, parity errors of uart */
+#define DIAGNOSTICS_ATTR_FRAME_ERRORS_ID                0x4004  /* < U32, frame errors of uart */
+#define DIAGNOSTICS_ATTR_PARSE_FAILURES_ID              0x4005  /* < U32, invalid M-Bus or OBIS layer */
+#define DIAGNOSTICS_ATTR_DECRYPT_FAILURES_ID            0x4006  /* < U32, invalid DLMS layer or wrong key */
+#define DIAGNOSTICS_ATTR_FRAME_POOL_PEAK_ID             0x4007  /* < U32, frames of frame pool borrowed at the same time */
+#define DIAGNOSTICS_ATTR_FRAME_POOL_EMPTY_ID            0x4008  /* < U32, telegrams dropped because frame pool was empty */
+#define DIAGNOSTICS_ATTR_REJOIN_TIME_ID                 0x4009  /* < U32, ms from first steering attempt until network was joined */
+
+#define METERING_UNIT_OF_MEASURE            0x00                    /* < kWh, binary format */
+#define METERING_MULTIPLIER                 1                       /* < Summation is in Wh ... */
+#define METERING_DIVISOR                    1000                    /* < ... and divided by 1000 to get kWh */
+#define METERING_SUMMATION_FORMATTING       0x33                    /* < 6 digits left, 3 digits right of decimal point */
+#define METERING_DEVICE_TYPE                0x00                    /* < Electric metering */
+
+/* Current measurement values, restored from flash at startup */
+static zb_electricity_meter_snapshot_t meter_snapshot = {
+        .total_active_power = 0,
+        .rms_voltage = {ELECTRICAL_MEASUREMENT_RMS_VOLTAGE, ELECTRICAL_MEASUREMENT_RMS_VOLTAGE, ELECTRICAL_MEASUREMENT_RMS_VOLTAGE},
+        .rms_current = {ELECTRICAL_MEASUREMENT_RMS_CURRENT, ELECTRICAL_MEASUREMENT_RMS_CURRENT, ELECTRICAL_MEASUREMENT_RMS_CURRENT}
+    };
+
+/* Initial command to request attribute report of metering cluster */
+static esp_zb_zcl_report_attr_cmd_t metering_cmd_req = {
+        .zcl_basic_cmd.src_endpoint = HA_DLMS_ENDPOINT,
+        .address_mode = ESP_ZB_APS_ADDR_MODE_DST_ADDR_ENDP_NOT_PRESENT,
+        .clusterID = ESP_ZB_ZCL_CLUSTER_ID_METERING,
+        .cluster_role = ESP_ZB_ZCL_CLUSTER_SERVER_ROLE
+    };
+
+/* Values in attribute table are restored from flash and not measured yet */
+static bool data_stale = false;
+
+/* Attributes of snapshot set since last complete telegram, one bit each */
+#define SNAPSHOT_FIELD_POWER            (1U << 0)
+#define SNAPSHOT_FIELD_VOLTAGE(phase)   (1U << (1 + (phase)))
+#define SNAPSHOT_FIELD_CURRENT(phase)   (1U << (4 + (phase)))
+#define SNAPSHOT_FIELD_ENERGY           (1U << 7)
+#define SNAPSHOT_FIELDS_ALL             0xFFU
+static uint32_t updated_fields = 0;
+
+/* Time from boot until first report was sent */
+static uint32_t first_report_time_ms = 0;
+
+/* Kinds of sent requests waiting for their send status, oldest at head */
+static struct {
+    zb_sent_request_t kinds[ZB_SENT_REQUESTS_MAX];
+    uint8_t head;
+    uint8_t count;
+} sent_requests;
 
 /* Initial command to request attribute report */
 static esp_zb_zcl_report_attr_cmd_t electrical_measurement_cmd_req = {
@@ -41,6 +119,58 @@ static esp_zb_zcl_report_attr_cmd_t electrical_measurement_cmd_req = {
         .cluster_role = ESP_ZB_ZCL_CLUSTER_SERVER_ROLE
     };
 
+/* ===== HELPER FUNCTIONS ===== */
+static esp_zb_uint48_t to_uint48(uint64_t value)
+{
+    esp_zb_uint48_t result = {
+        .low = (uint32_t)(value & 0xFFFFFFFF),
+        .high = (uint16_t)((value >> 32) & 0xFFFF),
+    };
+    return result;
+}
+
+static void measure_first_report()
+{
+    /* esp_timer starts counting at boot */
+    if(first_report_time_ms == 0)
+    {
+        first_report_time_ms = (uint32_t)(esp_timer_get_time() / 1000);
+        ESP_LOGI(TAG, "First report %lu ms after boot%s", (unsigned long)first_report_time_ms, data_stale ? " (stale data)" : "");
+    }
+}
+
+static void snapshot_updated(uint32_t field)
+{
+    /* Restored values stay stale until all were replaced, stored in zb_update_complete */
+    updated_fields |= field;
+}
+
+/* Remember kind of request before it is sent, the send status may be reported before the request returns */
+static void push_sent_request(zb_sent_request_t kind)
+{
+    if(sent_requests.count == ZB_SENT_REQUESTS_MAX)
+    {
+        sent_requests.head = (sent_requests.head + 1) % ZB_SENT_REQUESTS_MAX;
+        sent_requests.count--;
+    }
+    sent_requests.kinds[(sent_requests.head + sent_requests.count) % ZB_SENT_REQUESTS_MAX] = kind;
+    sent_requests.count++;
+}
+
+/* Request was not accepted by the stack, no send status follows */
+static void drop_sent_request()
+{
+    if(sent_requests.count > 0){ sent_requests.count--; }
+}
+
+static esp_zb_zcl_status_t report_attribute(esp_zb_zcl_report_attr_cmd_t *cmd_req, zb_sent_request_t kind)
+{
+    push_sent_request(kind);
+    esp_zb_zcl_status_t state = esp_zb_zcl_report_attr_cmd_req(cmd_req);
+    if(state != ESP_ZB_ZCL_STATUS_SUCCESS){ drop_sent_request(); }
+    return state;
+}
+
 /* ===== FUNCTIONS TO UPDATE AND SEND CLUSTER VALUES ===== */
 esp_err_t zb_update_total_active_power(int32_t power)
 {
@@ -57,8 +187,12 @@ esp_err_t zb_update_total_active_power(int32_t power)
         return ESP_FAIL;
     }
 
+    /* Update snapshot */
+    meter_snapshot.total_active_power = power;
+    snapshot_updated(SNAPSHOT_FIELD_POWER);
+
     /* Request sending new total active power */
-    state = esp_zb_zcl_report_attr_cmd_req(&electrical_measurement_cmd_req);
+    state = report_attribute(&electrical_measurement_cmd_req, ZB_SENT_MEASUREMENT);
 
     /* Check for error */
     if(state != ESP_ZB_ZCL_STATUS_SUCCESS)
@@ -66,6 +200,7 @@ esp_err_t zb_update_total_active_power(int32_t power)
         ESP_LOGE(TAG, "Sending total active power attribute report command failed!");
         return ESP_FAIL;
     }
+    measure_first_report();
     
     return ESP_OK;
 }
@@ -89,6 +224,7 @@ esp_err_t zb_update_voltage(phase_t phase, int16_t voltage)
             break;
         default:
             ESP_LOGE(TAG, "Update request on invalid phase");
+            return ESP_ERR_INVALID_ARG;
     }
 
     /* Write new local phase voltage */
@@ -100,14 +236,19 @@ esp_err_t zb_update_voltage(phase_t phase, int16_t voltage)
         return ESP_FAIL;
     }
 
+    /* Update snapshot */
+    meter_snapshot.rms_voltage[phase] = voltage;
+    snapshot_updated(SNAPSHOT_FIELD_VOLTAGE(phase));
+
     /* Request sending new phase voltage */
-    state = esp_zb_zcl_report_attr_cmd_req(&electrical_measurement_cmd_req);
+    state = report_attribute(&electrical_measurement_cmd_req, ZB_SENT_MEASUREMENT);
 
     /* Check for error */
     if(state != ESP_ZB_ZCL_STATUS_SUCCESS) {
         ESP_LOGE(TAG, "Sending voltage attribute report command failed!");
         return ESP_FAIL;
     }
+    measure_first_report();
 
     return ESP_OK;
 }
@@ -131,6 +272,7 @@ esp_err_t zb_update_current(phase_t phase, int16_t current)
             break;
         default:
             ESP_LOGE(TAG, "Update request on invalid phase");
+            return ESP_ERR_INVALID_ARG;
     }
 
     /* Write new local phase voltage */
@@ -142,23 +284,438 @@ esp_err_t zb_update_current(phase_t phase, int16_t current)
         return ESP_FAIL;
     }
 
+    /* Update snapshot */
+    meter_snapshot.rms_current[phase] = current;
+    snapshot_updated(SNAPSHOT_FIELD_CURRENT(phase));
+
     /* Request sending new phase voltage */
-    state = esp_zb_zcl_report_attr_cmd_req(&electrical_measurement_cmd_req);
+    state = report_attribute(&electrical_measurement_cmd_req, ZB_SENT_MEASUREMENT);
 
     /* Check for error */
     if(state != ESP_ZB_ZCL_STATUS_SUCCESS) {
         ESP_LOGE(TAG, "Sending current attribute report command failed!");
         return ESP_FAIL;   
     }
+    measure_first_report();
+
+    return ESP_OK;
+}
+
+esp_err_t zb_update_energy(uint64_t delivered_wh, uint64_t received_wh)
+{
+    /* Both summations are written first, so a read request always gets values of same telegram */
+    esp_zb_uint48_t delivered = to_uint48(delivered_wh);
+    esp_zb_zcl_status_t state = esp_zb_zcl_set_attribute_val(HA_DLMS_ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_METERING, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, METERING_ATTR_CURRENT_SUMMATION_DELIVERED_ID, &delivered, false);
+    if(state != ESP_ZB_ZCL_STATUS_SUCCESS)
+    {
+        ESP_LOGE(TAG, "Setting summation delivered attribute failed!");
+        return ESP_FAIL;
+    }
+
+    esp_zb_uint48_t received = to_uint48(received_wh);
+    state = esp_zb_zcl_set_attribute_val(HA_DLMS_ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_METERING, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, METERING_ATTR_CURRENT_SUMMATION_RECEIVED_ID, &received, false);
+    if(state != ESP_ZB_ZCL_STATUS_SUCCESS)
+    {
+        ESP_LOGE(TAG, "Setting summation received attribute failed!");
+        return ESP_FAIL;
+    }
+
+    /* Only report values which changed, energy changes much slower than power */
+    bool delivered_changed = (delivered_wh != meter_snapshot.summation_delivered);
+    bool received_changed = (received_wh != meter_snapshot.summation_received);
+
+    /* Update snapshot */
+    meter_snapshot.summation_delivered = delivered_wh;
+    meter_snapshot.summation_received = received_wh;
+    snapshot_updated(SNAPSHOT_FIELD_ENERGY);
+
+    if(delivered_changed)
+    {
+        /* Request sending new summation delivered */
+        metering_cmd_req.attributeID = METERING_ATTR_CURRENT_SUMMATION_DELIVERED_ID;
+        state = report_attribute(&metering_cmd_req, ZB_SENT_MEASUREMENT);
+        if(state != ESP_ZB_ZCL_STATUS_SUCCESS)
+        {
+            ESP_LOGE(TAG, "Sending summation delivered attribute report command failed!");
+            return ESP_FAIL;
+        }
+        measure_first_report();
+    }
+
+    if(received_changed)
+    {
+        /* Request sending new summation received */
+        metering_cmd_req.attributeID = METERING_ATTR_CURRENT_SUMMATION_RECEIVED_ID;
+        state = report_attribute(&metering_cmd_req, ZB_SENT_MEASUREMENT);
+        if(state != ESP_ZB_ZCL_STATUS_SUCCESS)
+        {
+            ESP_LOGE(TAG, "Sending summation received attribute report command failed!");
+            return ESP_FAIL;
+        }
+        measure_first_report();
+    }
+
+    return ESP_OK;
+}
+
+void zb_update_complete()
+{
+    /* Measured values of a complete telegram replace all restored values */
+    if(updated_fields == SNAPSHOT_FIELDS_ALL)
+    {
+        if(data_stale)
+        {
+            data_stale = false;
+            esp_zb_zcl_set_attribute_val(HA_DLMS_ENDPOINT, ZB_MANUFACTURER_CLUSTER_ID, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, ZB_MANUFACTURER_ATTR_DATA_STALE_ID, &data_stale, false);
+        }
+
+        /* Persist for next boot, only values of one telegram are stored together */
+        zb_snapshot_store(&meter_snapshot);
+    }
+    updated_fields = 0;
+}
+
+esp_err_t zb_update_tier_summation(uint8_t tier, uint64_t delivered_wh, uint64_t received_wh)
+{
+    if(tier >= ZB_METERING_TIER_COUNT){ return ESP_ERR_INVALID_ARG; }
+
+    const uint16_t attribute_ids[2] = {METERING_ATTR_CURRENT_TIER1_SUMMATION_DELIVERED_ID + 2 * tier, METERING_ATTR_CURRENT_TIER1_SUMMATION_RECEIVED_ID + 2 * tier};
+    esp_zb_uint48_t values[2] = {to_uint48(delivered_wh), to_uint48(received_wh)};
+
+    for(int i = 0; i < 2; i++)
+    {
+        esp_zb_zcl_status_t state = esp_zb_zcl_set_attribute_val(HA_DLMS_ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_METERING, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, attribute_ids[i], &values[i], false);
+        if(state != ESP_ZB_ZCL_STATUS_SUCCESS)
+        {
+            ESP_LOGE(TAG, "Setting tier summation attribute 0x%04x failed!", attribute_ids[i]);
+            return ESP_FAIL;
+        }
+
+        metering_cmd_req.attributeID = attribute_ids[i];
+        if(report_attribute(&metering_cmd_req, ZB_SENT_OTHER) != ESP_ZB_ZCL_STATUS_SUCCESS)
+        {
+            ESP_LOGE(TAG, "Sending tier summation attribute report command failed!");
+            return ESP_FAIL;
+        }
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t zb_update_power_quality(uint16_t alarms, bool report)
+{
+    /* Write new alarms */
+    esp_zb_zcl_status_t state = esp_zb_zcl_set_attribute_val(HA_DLMS_ENDPOINT, ZB_MANUFACTURER_CLUSTER_ID, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, ZB_MANUFACTURER_ATTR_POWER_QUALITY_ID, &alarms, false);
+
+    /* Check for error */
+    if(state != ESP_ZB_ZCL_STATUS_SUCCESS) {
+        ESP_LOGE(TAG, "Setting power quality attribute failed!");
+        return ESP_FAIL;
+    }
+    if(!report){ return ESP_OK; }
+
+    /* Request sending new alarms, ahead of measurements of the same telegram */
+    esp_zb_zcl_report_attr_cmd_t cmd_req = {
+        .zcl_basic_cmd.src_endpoint = HA_DLMS_ENDPOINT,
+        .address_mode = ESP_ZB_APS_ADDR_MODE_DST_ADDR_ENDP_NOT_PRESENT,
+        .clusterID = ZB_MANUFACTURER_CLUSTER_ID,
+        .attributeID = ZB_MANUFACTURER_ATTR_POWER_QUALITY_ID,
+        .cluster_role = ESP_ZB_ZCL_CLUSTER_SERVER_ROLE
+    };
+    state = report_attribute(&cmd_req, ZB_SENT_OTHER);
+
+    /* Check for error */
+    if(state != ESP_ZB_ZCL_STATUS_SUCCESS) {
+        ESP_LOGE(TAG, "Sending power quality attribute report command failed!");
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t zb_update_reporting_mode(uint8_t mode)
+{
+    /* Write new mode */
+    esp_zb_zcl_status_t state = esp_zb_zcl_set_attribute_val(HA_DLMS_ENDPOINT, ZB_MANUFACTURER_CLUSTER_ID, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, ZB_MANUFACTURER_ATTR_REPORTING_MODE_ID, &mode, false);
+
+    /* Check for error */
+    if(state != ESP_ZB_ZCL_STATUS_SUCCESS) {
+        ESP_LOGE(TAG, "Setting reporting mode attribute failed!");
+        return ESP_FAIL;
+    }
+
+    /* Request sending new mode */
+    esp_zb_zcl_report_attr_cmd_t cmd_req = {
+        .zcl_basic_cmd.src_endpoint = HA_DLMS_ENDPOINT,
+        .address_mode = ESP_ZB_APS_ADDR_MODE_DST_ADDR_ENDP_NOT_PRESENT,
+        .clusterID = ZB_MANUFACTURER_CLUSTER_ID,
+        .attributeID = ZB_MANUFACTURER_ATTR_REPORTING_MODE_ID,
+        .cluster_role = ESP_ZB_ZCL_CLUSTER_SERVER_ROLE
+    };
+    state = report_attribute(&cmd_req, ZB_SENT_OTHER);
+
+    /* Check for error */
+    if(state != ESP_ZB_ZCL_STATUS_SUCCESS) {
+        ESP_LOGE(TAG, "Sending reporting mode attribute report command failed!");
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+#if LATENCY_TRACE_ENABLED
+esp_err_t zb_update_latency_histograms(const uint8_t *data, size_t size)
+{
+    /* Long octet string, first two bytes are the length */
+    static uint8_t value[2 + ZB_MANUFACTURER_LATENCY_MAX_SIZE];
+
+    if(size > ZB_MANUFACTURER_LATENCY_MAX_SIZE){ return ESP_ERR_INVALID_SIZE; }
+    value[0] = (uint8_t)(size & 0xFF);
+    value[1] = (uint8_t)(size >> 8);
+    memcpy(&value[2], data, size);
+
+    /* Read by coordinator on demand, no report */
+    esp_zb_zcl_status_t state = esp_zb_zcl_set_attribute_val(HA_DLMS_ENDPOINT, ZB_MANUFACTURER_CLUSTER_ID, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, ZB_MANUFACTURER_ATTR_LATENCY_ID, value, false);
+    if(state != ESP_ZB_ZCL_STATUS_SUCCESS) {
+        ESP_LOGE(TAG, "Setting latency attribute failed!");
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+#endif
+
+esp_err_t zb_update_system_status(const uint8_t *data, size_t size)
+{
+    /* Long octet string, first two bytes are the length */
+    static uint8_t value[2 + ZB_MANUFACTURER_SYSTEM_STATUS_MAX_SIZE];
+
+    if(size > ZB_MANUFACTURER_SYSTEM_STATUS_MAX_SIZE){ return ESP_ERR_INVALID_SIZE; }
+    value[0] = (uint8_t)(size & 0xFF);
+    value[1] = (uint8_t)(size >> 8);
+    memcpy(&value[2], data, size);
+
+    /* Read by coordinator on demand, no report */
+    esp_zb_zcl_status_t state = esp_zb_zcl_set_attribute_val(HA_DLMS_ENDPOINT, ZB_MANUFACTURER_CLUSTER_ID, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, ZB_MANUFACTURER_ATTR_SYSTEM_STATUS_ID, value, false);
+    if(state != ESP_ZB_ZCL_STATUS_SUCCESS) {
+        ESP_LOGE(TAG, "Setting system status attribute failed!");
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t zb_update_diagnostics(const zb_diagnostics_t *diagnostics)
+{
+    /* Values in attribute table */
+    static zb_diagnostics_t written = {0};
+
+    const struct {
+        uint16_t attribute_id;
+        const uint32_t *value;
+        uint32_t *written;
+    } counters[] = {
+        {DIAGNOSTICS_ATTR_TELEGRAMS_OK_ID, &diagnostics->telegrams_ok, &written.telegrams_ok},
+        {DIAGNOSTICS_ATTR_FIFO_OVERFLOWS_ID, &diagnostics->fifo_overflows, &written.fifo_overflows},
+        {DIAGNOSTICS_ATTR_BUFFER_FULL_ID, &diagnostics->buffer_full, &written.buffer_full},
+        {DIAGNOSTICS_ATTR_PARITY_ERRORS_ID, &diagnostics->parity_errors, &written.parity_errors},
+        {DIAGNOSTICS_ATTR_FRAME_ERRORS_ID, &diagnostics->frame_errors, &written.frame_errors},
+        {DIAGNOSTICS_ATTR_PARSE_FAILURES_ID, &diagnostics->parse_failures, &written.parse_failures},
+        {DIAGNOSTICS_ATTR_DECRYPT_FAILURES_ID, &diagnostics->decrypt_failures, &written.decrypt_failures},
+        {DIAGNOSTICS_ATTR_FRAME_POOL_PEAK_ID, &diagnostics->frame_pool_peak, &written.frame_pool_peak},
+        {DIAGNOSTICS_ATTR_FRAME_POOL_EMPTY_ID, &diagnostics->frame_pool_empty, &written.frame_pool_empty},
+        {DIAGNOSTICS_ATTR_REJOIN_TIME_ID, &diagnostics->rejoin_time_ms, &written.rejoin_time_ms},
+    };
+
+    esp_err_t err = ESP_OK;
+    for(size_t i = 0; i < sizeof(counters) / sizeof(counters[0]); i++)
+    {
+        if(*counters[i].value == *counters[i].written){ continue; }
+
+        uint32_t value = *counters[i].value;
+        if(esp_zb_zcl_set_attribute_val(HA_DLMS_ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_DIAGNOSTICS, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, counters[i].attribute_id, &value, false) != ESP_ZB_ZCL_STATUS_SUCCESS)
+        {
+            ESP_LOGE(TAG, "Setting diagnostics attribute 0x%04x failed!", counters[i].attribute_id);
+            err = ESP_FAIL;
+            continue;
+        }
+        *counters[i].written = value;
+    }
+
+    return err;
+}
+
+/* Send long octet string as command of manufacturer specific cluster, payload starts with two bytes reserved for the length */
+static esp_err_t send_manufacturer_cmd(uint8_t cmd_id, uint8_t *payload, size_t size, zb_sent_request_t kind)
+{
+    payload[0] = (uint8_t)(size & 0xFF);
+    payload[1] = (uint8_t)(size >> 8);
+
+    /* Send to bound devices, payloads larger than one frame are fragmented by the APS layer */
+    esp_zb_zcl_custom_cluster_cmd_req_t cmd_req = {
+        .zcl_basic_cmd.src_endpoint = HA_DLMS_ENDPOINT,
+        .address_mode = ESP_ZB_APS_ADDR_MODE_DST_ADDR_ENDP_NOT_PRESENT,
+        .profile_id = ESP_ZB_AF_HA_PROFILE_ID,
+        .cluster_id = ZB_MANUFACTURER_CLUSTER_ID,
+        .manuf_specific = 1,
+        .manuf_code = ZB_MANUFACTURER_CODE,
+        .direction = ESP_ZB_ZCL_CMD_DIRECTION_TO_CLI,
+        .dis_default_resp = 1,
+        .custom_cmd_id = cmd_id,
+        .data = {
+            .type = ESP_ZB_ZCL_ATTR_TYPE_LONG_OCTET_STRING,
+            .size = (uint16_t)(size + 2),
+            .value = &payload[0],
+        },
+    };
+
+    push_sent_request(kind);
+    if(esp_zb_zcl_custom_cluster_cmd_req(&cmd_req) != ESP_OK)
+    {
+        drop_sent_request();
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t zb_send_bulk_snapshot(const zb_bulk_snapshot_t *snapshot)
+{
+    /* Long octet string, first two bytes are the length */
+    static uint8_t payload[2 + ZB_BULK_MAX_PAYLOAD_SIZE];
+
+    size_t size = zb_bulk_encode(snapshot, &payload[2], ZB_BULK_MAX_PAYLOAD_SIZE);
+    if(size == 0)
+    {
+        ESP_LOGE(TAG, "Encoding bulk snapshot failed!");
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    if(send_manufacturer_cmd(ZB_MANUFACTURER_CMD_BULK_SNAPSHOT_ID, payload, size, ZB_SENT_OTHER) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Sending bulk snapshot failed!");
+        return ESP_FAIL;
+    }
 
+    ESP_LOGI(TAG, "Sent bulk snapshot with %d registers (%d bytes)", snapshot->register_count, (int)size);
     return ESP_OK;
 }
 
+esp_err_t zb_send_history_batch(const zb_history_entry_t *entries, uint8_t count)
+{
+    /* Long octet string, first two bytes are the length */
+    static uint8_t payload[2 + ZB_HISTORY_MAX_PAYLOAD_SIZE];
+
+    size_t size = zb_history_encode(entries, count, &payload[2], ZB_HISTORY_MAX_PAYLOAD_SIZE);
+    if(size == 0)
+    {
+        ESP_LOGE(TAG, "Encoding history batch failed!");
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    if(send_manufacturer_cmd(ZB_MANUFACTURER_CMD_HISTORY_BATCH_ID, payload, size, ZB_SENT_HISTORY) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Sending history batch failed!");
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG, "Sent history batch with %d entries (%d bytes)", count, (int)size);
+    return ESP_OK;
+}
+
+esp_err_t zb_send_aggregate_window(const zb_aggregate_window_t *window)
+{
+    /* Long octet string, first two bytes are the length */
+    static uint8_t payload[2 + ZB_AGGREGATE_PAYLOAD_SIZE];
+
+    size_t size = zb_aggregate_encode(window, &payload[2], ZB_AGGREGATE_PAYLOAD_SIZE);
+    if(size == 0)
+    {
+        ESP_LOGE(TAG, "Encoding aggregate window failed!");
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    if(send_manufacturer_cmd(ZB_MANUFACTURER_CMD_AGGREGATE_WINDOW_ID, payload, size, ZB_SENT_OTHER) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Sending aggregate window failed!");
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG, "Sent aggregate window of %d telegrams, demand %lu W", window->sample_count, (unsigned long)window->demand_delivered);
+    return ESP_OK;
+}
+
+esp_err_t zb_report_all_attributes()
+{
+    /* Attributes which are reported */
+    static const struct {
+        uint16_t cluster_id;
+        uint16_t attribute_id;
+    } report_list[] = {
+        {ESP_ZB_ZCL_CLUSTER_ID_ELECTRICAL_MEASUREMENT, ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_TOTAL_ACTIVE_POWER_ID},
+        {ESP_ZB_ZCL_CLUSTER_ID_ELECTRICAL_MEASUREMENT, ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_RMSVOLTAGE_ID},
+        {ESP_ZB_ZCL_CLUSTER_ID_ELECTRICAL_MEASUREMENT, ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_RMSVOLTAGE_PHB_ID},
+        {ESP_ZB_ZCL_CLUSTER_ID_ELECTRICAL_MEASUREMENT, ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_RMSVOLTAGE_PHC_ID},
+        {ESP_ZB_ZCL_CLUSTER_ID_ELECTRICAL_MEASUREMENT, ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_RMSCURRENT_ID},
+        {ESP_ZB_ZCL_CLUSTER_ID_ELECTRICAL_MEASUREMENT, ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_RMSCURRENT_PHB_ID},
+        {ESP_ZB_ZCL_CLUSTER_ID_ELECTRICAL_MEASUREMENT, ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_RMSCURRENT_PHC_ID},
+        {ESP_ZB_ZCL_CLUSTER_ID_METERING, METERING_ATTR_CURRENT_SUMMATION_DELIVERED_ID},
+        {ESP_ZB_ZCL_CLUSTER_ID_METERING, METERING_ATTR_CURRENT_SUMMATION_RECEIVED_ID},
+        {ZB_MANUFACTURER_CLUSTER_ID, ZB_MANUFACTURER_ATTR_DATA_STALE_ID},
+        {ZB_MANUFACTURER_CLUSTER_ID, ZB_MANUFACTURER_ATTR_REPORTING_MODE_ID},
+        {ZB_MANUFACTURER_CLUSTER_ID, ZB_MANUFACTURER_ATTR_POWER_QUALITY_ID},
+    };
+
+    esp_zb_zcl_report_attr_cmd_t cmd_req = {
+        .zcl_basic_cmd.src_endpoint = HA_DLMS_ENDPOINT,
+        .address_mode = ESP_ZB_APS_ADDR_MODE_DST_ADDR_ENDP_NOT_PRESENT,
+        .cluster_role = ESP_ZB_ZCL_CLUSTER_SERVER_ROLE
+    };
+
+    esp_err_t err = ESP_OK;
+    for(size_t i = 0; i < sizeof(report_list) / sizeof(report_list[0]); i++)
+    {
+        cmd_req.clusterID = report_list[i].cluster_id;
+        cmd_req.attributeID = report_list[i].attribute_id;
+
+        /* Request sending attribute, continue with others on error */
+        if(report_attribute(&cmd_req, ZB_SENT_OTHER) != ESP_ZB_ZCL_STATUS_SUCCESS)
+        {
+            ESP_LOGE(TAG, "Sending attribute 0x%04x of cluster 0x%04x failed!", cmd_req.attributeID, cmd_req.clusterID);
+            err = ESP_FAIL;
+        }
+    }
+
+    if(err == ESP_OK)
+    {
+        measure_first_report();
+    }
+
+    return err;
+}
+
+uint32_t zb_get_first_report_time_ms()
+{
+    return first_report_time_ms;
+}
+
+zb_sent_request_t zb_pop_sent_request()
+{
+    if(sent_requests.count == 0){ return ZB_SENT_UNKNOWN; }
+
+    zb_sent_request_t kind = sent_requests.kinds[sent_requests.head];
+    sent_requests.head = (sent_requests.head + 1) % ZB_SENT_REQUESTS_MAX;
+    sent_requests.count--;
+    return kind;
+}
+
 //TODO: Identify Callback
 /* ===== FUNCTION TO CREATE ENDPOINTS ===== */
 // Create endpoint for electricity meter
 void zb_electricity_meter_ep(esp_zb_ep_list_t *esp_zb_ep_list)
 {
+    /* Restore last measured values, attributes are flagged as stale until new values are measured */
+    data_stale = zb_snapshot_load(&meter_snapshot);
+
     /* ===== CREATE BASIC CLUSTER (REQUIRED) (0x0000) ===== */
     esp_zb_attribute_list_t *esp_zb_basic_cluster = esp_zb_zcl_attr_list_create(ESP_ZB_ZCL_CLUSTER_ID_BASIC);
 
@@ -209,38 +766,148 @@ void zb_electricity_meter_ep(esp_zb_ep_list_t *esp_zb_ep_list)
 
     /* == Attribute Set 0x03: AC (Non-phase Specific) Measurements (S. 303) == */
     /* Add attribute TotalActivePower (0x0304) */
-    int32_t total_active_power = 0;
+    int32_t total_active_power = meter_snapshot.total_active_power;
     ESP_ERROR_CHECK(esp_zb_electrical_meas_cluster_add_attr(esp_zb_electrical_measurement_cluster, ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_TOTAL_ACTIVE_POWER_ID, &total_active_power));
 
     /* == Attribute Set 0x05: AC (Single Phase or Phase A) Measurements (S. 306) == */
     /* Add attribute RMSVoltage Phase A (0x0505)*/
-    uint16_t rms_voltage_phase_a = ELECTRICAL_MEASUREMENT_RMS_VOLTAGE;
+    uint16_t rms_voltage_phase_a = meter_snapshot.rms_voltage[PhaseA];
     ESP_ERROR_CHECK(esp_zb_electrical_meas_cluster_add_attr(esp_zb_electrical_measurement_cluster, ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_RMSVOLTAGE_ID, &rms_voltage_phase_a));
 
     /* Add attribute RMSCurrent Phase A (0x0508) */
-    uint16_t rms_current_phase_a = ELECTRICAL_MEASUREMENT_RMS_CURRENT;
+    uint16_t rms_current_phase_a = meter_snapshot.rms_current[PhaseA];
     ESP_ERROR_CHECK(esp_zb_electrical_meas_cluster_add_attr(esp_zb_electrical_measurement_cluster, ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_RMSCURRENT_ID, &rms_current_phase_a));
 
     /* == Attribute Set 0x09: AC Phase B Measurements (S. 313) == */
     /* Add attribute RMSVoltage Phase B (0x0905)*/
-    uint16_t rms_voltage_phase_b = ELECTRICAL_MEASUREMENT_RMS_VOLTAGE;
+    uint16_t rms_voltage_phase_b = meter_snapshot.rms_voltage[PhaseB];
     ESP_ERROR_CHECK(esp_zb_electrical_meas_cluster_add_attr(esp_zb_electrical_measurement_cluster, ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_RMSVOLTAGE_PHB_ID, &rms_voltage_phase_b));
 
     /* Add attribute RMSCurrent Phase B (0x0908) */
-    uint16_t rms_current_phase_b = ELECTRICAL_MEASUREMENT_RMS_CURRENT;
+    uint16_t rms_current_phase_b = meter_snapshot.rms_current[PhaseB];
     ESP_ERROR_CHECK(esp_zb_electrical_meas_cluster_add_attr(esp_zb_electrical_measurement_cluster, ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_RMSCURRENT_PHB_ID, &rms_current_phase_b));
 
     /* == Attribute Set 0x0A: AC Phase C Measurements == */
     /* Add attribute RMSVoltage Phase C (0x0A05)*/
-    uint16_t rms_voltage_phase_c = ELECTRICAL_MEASUREMENT_RMS_VOLTAGE;
+    uint16_t rms_voltage_phase_c = meter_snapshot.rms_voltage[PhaseC];
     ESP_ERROR_CHECK(esp_zb_electrical_meas_cluster_add_attr(esp_zb_electrical_measurement_cluster, ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_RMSVOLTAGE_PHC_ID, &rms_voltage_phase_c));
 
     /* Add attribute RMSCurrent Phase C (0x0A08) */
-    uint16_t rms_current_phase_c = ELECTRICAL_MEASUREMENT_RMS_CURRENT;
+    uint16_t rms_current_phase_c = meter_snapshot.rms_current[PhaseC];
     ESP_ERROR_CHECK(esp_zb_electrical_meas_cluster_add_attr(esp_zb_electrical_measurement_cluster, ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_RMSCURRENT_PHC_ID, &rms_current_phase_c));
+
+    /* == Attribute Set 0x06: AC Formatting (S. 310) == */
+    /* Add attribute ACVoltageMultiplier (0x0600) */
+    uint16_t ac_voltage_multiplier = ELECTRICAL_MEASUREMENT_AC_VOLTAGE_MULTIPLIER;
+    ESP_ERROR_CHECK(esp_zb_electrical_meas_cluster_add_attr(esp_zb_electrical_measurement_cluster, ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_ACVOLTAGE_MULTIPLIER_ID, &ac_voltage_multiplier));
+
+    /* Add attribute ACVoltageDivisor (0x0601) */
+    uint16_t ac_voltage_divisor = ELECTRICAL_MEASUREMENT_AC_VOLTAGE_DIVISOR;
+    ESP_ERROR_CHECK(esp_zb_electrical_meas_cluster_add_attr(esp_zb_electrical_measurement_cluster, ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_ACVOLTAGE_DIVISOR_ID, &ac_voltage_divisor));
+
+    /* Add attribute ACCurrentMultiplier (0x0602) */
+    uint16_t ac_current_multiplier = ELECTRICAL_MEASUREMENT_AC_CURRENT_MULTIPLIER;
+    ESP_ERROR_CHECK(esp_zb_electrical_meas_cluster_add_attr(esp_zb_electrical_measurement_cluster, ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_ACCURRENT_MULTIPLIER_ID, &ac_current_multiplier));
+
+    /* Add attribute ACCurrentDivisor (0x0603) */
+    uint16_t ac_current_divisor = ELECTRICAL_MEASUREMENT_AC_CURRENT_DIVISOR;
+    ESP_ERROR_CHECK(esp_zb_electrical_meas_cluster_add_attr(esp_zb_electrical_measurement_cluster, ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_ACCURRENT_DIVISOR_ID, &ac_current_divisor));
+
+    /* Add attribute ACPowerMultiplier (0x0604) */
+    uint16_t ac_power_multiplier = ELECTRICAL_MEASUREMENT_AC_POWER_MULTIPLIER;
+    ESP_ERROR_CHECK(esp_zb_electrical_meas_cluster_add_attr(esp_zb_electrical_measurement_cluster, ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_ACPOWER_MULTIPLIER_ID, &ac_power_multiplier));
+
+    /* Add attribute ACPowerDivisor (0x0605) */
+    uint16_t ac_power_divisor = ELECTRICAL_MEASUREMENT_AC_POWER_DIVISOR;
+    ESP_ERROR_CHECK(esp_zb_electrical_meas_cluster_add_attr(esp_zb_electrical_measurement_cluster, ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_ACPOWER_DIVISOR_ID, &ac_power_divisor));
     
     /* === CREATE METERING CLUSTER (0x0702) === */
-    //TODO: Cluster still not implemented in ZigBee SDK: https://github.com/espressif/esp-zigbee-sdk/issues/36
+    /* Cluster still not implemented in ZigBee SDK: https://github.com/espressif/esp-zigbee-sdk/issues/36 */
+    /* Created as custom cluster with attributes of the specification (S. 592) */
+    esp_zb_attribute_list_t *esp_zb_metering_cluster = esp_zb_zcl_attr_list_create(ESP_ZB_ZCL_CLUSTER_ID_METERING);
+
+    /* == Attribute Set 0x00: Reading Information Set (S. 594) == */
+    /* Add attribute CurrentSummationDelivered (0x0000) */
+    esp_zb_uint48_t summation_delivered = to_uint48(meter_snapshot.summation_delivered);
+    ESP_ERROR_CHECK(esp_zb_custom_cluster_add_custom_attr(esp_zb_metering_cluster, METERING_ATTR_CURRENT_SUMMATION_DELIVERED_ID, ESP_ZB_ZCL_ATTR_TYPE_U48, ESP_ZB_ZCL_ATTR_ACCESS_READ_ONLY | ESP_ZB_ZCL_ATTR_ACCESS_REPORTING, &summation_delivered));
+
+    /* Add attribute CurrentSummationReceived (0x0001) */
+    esp_zb_uint48_t summation_received = to_uint48(meter_snapshot.summation_received);
+    ESP_ERROR_CHECK(esp_zb_custom_cluster_add_custom_attr(esp_zb_metering_cluster, METERING_ATTR_CURRENT_SUMMATION_RECEIVED_ID, ESP_ZB_ZCL_ATTR_TYPE_U48, ESP_ZB_ZCL_ATTR_ACCESS_READ_ONLY | ESP_ZB_ZCL_ATTR_ACCESS_REPORTING, &summation_received));
+
+    /* == Attribute Set 0x01: TOU Information Set == */
+    /* Add attributes CurrentTierNSummationDelivered and -Received (0x0100 - 0x0107), counted by aggregation of telegrams */
+    for(uint16_t tier = 0; tier < ZB_METERING_TIER_COUNT; tier++)
+    {
+        esp_zb_uint48_t tier_summation = to_uint48(0);
+        ESP_ERROR_CHECK(esp_zb_custom_cluster_add_custom_attr(esp_zb_metering_cluster, METERING_ATTR_CURRENT_TIER1_SUMMATION_DELIVERED_ID + 2 * tier, ESP_ZB_ZCL_ATTR_TYPE_U48, ESP_ZB_ZCL_ATTR_ACCESS_READ_ONLY | ESP_ZB_ZCL_ATTR_ACCESS_REPORTING, &tier_summation));
+        ESP_ERROR_CHECK(esp_zb_custom_cluster_add_custom_attr(esp_zb_metering_cluster, METERING_ATTR_CURRENT_TIER1_SUMMATION_RECEIVED_ID + 2 * tier, ESP_ZB_ZCL_ATTR_TYPE_U48, ESP_ZB_ZCL_ATTR_ACCESS_READ_ONLY | ESP_ZB_ZCL_ATTR_ACCESS_REPORTING, &tier_summation));
+    }
+
+    /* == Attribute Set 0x03: Formatting (S. 604) == */
+    /* Add attribute UnitofMeasure (0x0300) */
+    uint8_t unit_of_measure = METERING_UNIT_OF_MEASURE;
+    ESP_ERROR_CHECK(esp_zb_custom_cluster_add_custom_attr(esp_zb_metering_cluster, METERING_ATTR_UNIT_OF_MEASURE_ID, ESP_ZB_ZCL_ATTR_TYPE_8BIT_ENUM, ESP_ZB_ZCL_ATTR_ACCESS_READ_ONLY, &unit_of_measure));
+
+    /* Add attribute Multiplier (0x0301) */
+    esp_zb_uint24_t multiplier = {.low = METERING_MULTIPLIER, .high = 0};
+    ESP_ERROR_CHECK(esp_zb_custom_cluster_add_custom_attr(esp_zb_metering_cluster, METERING_ATTR_MULTIPLIER_ID, ESP_ZB_ZCL_ATTR_TYPE_U24, ESP_ZB_ZCL_ATTR_ACCESS_READ_ONLY, &multiplier));
+
+    /* Add attribute Divisor (0x0302) */
+    esp_zb_uint24_t divisor = {.low = METERING_DIVISOR, .high = 0};
+    ESP_ERROR_CHECK(esp_zb_custom_cluster_add_custom_attr(esp_zb_metering_cluster, METERING_ATTR_DIVISOR_ID, ESP_ZB_ZCL_ATTR_TYPE_U24, ESP_ZB_ZCL_ATTR_ACCESS_READ_ONLY, &divisor));
+
+    /* Add attribute SummationFormatting (0x0303) */
+    uint8_t summation_formatting = METERING_SUMMATION_FORMATTING;
+    ESP_ERROR_CHECK(esp_zb_custom_cluster_add_custom_attr(esp_zb_metering_cluster, METERING_ATTR_SUMMATION_FORMATTING_ID, ESP_ZB_ZCL_ATTR_TYPE_8BITMAP, ESP_ZB_ZCL_ATTR_ACCESS_READ_ONLY, &summation_formatting));
+
+    /* Add attribute MeteringDeviceType (0x0306) */
+    uint8_t metering_device_type = METERING_DEVICE_TYPE;
+    ESP_ERROR_CHECK(esp_zb_custom_cluster_add_custom_attr(esp_zb_metering_cluster, METERING_ATTR_METERING_DEVICE_TYPE_ID, ESP_ZB_ZCL_ATTR_TYPE_8BITMAP, ESP_ZB_ZCL_ATTR_ACCESS_READ_ONLY, &metering_device_type));
+
+    /* === CREATE DIAGNOSTICS CLUSTER (0x0B05) === */
+    /* Created as custom cluster, the counters of the meter link are not part of the specification */
+    esp_zb_attribute_list_t *esp_zb_diagnostics_cluster = esp_zb_zcl_attr_list_create(ESP_ZB_ZCL_CLUSTER_ID_DIAGNOSTICS);
+
+    /* Add attributes of meter link (0x4000 - 0x4008) and rejoin time (0x4009), zero at boot */
+    static const uint16_t diagnostics_attribute_ids[] = {
+        DIAGNOSTICS_ATTR_TELEGRAMS_OK_ID, DIAGNOSTICS_ATTR_FIFO_OVERFLOWS_ID, DIAGNOSTICS_ATTR_BUFFER_FULL_ID, DIAGNOSTICS_ATTR_PARITY_ERRORS_ID,
+        DIAGNOSTICS_ATTR_FRAME_ERRORS_ID, DIAGNOSTICS_ATTR_PARSE_FAILURES_ID, DIAGNOSTICS_ATTR_DECRYPT_FAILURES_ID,
+        DIAGNOSTICS_ATTR_FRAME_POOL_PEAK_ID, DIAGNOSTICS_ATTR_FRAME_POOL_EMPTY_ID, DIAGNOSTICS_ATTR_REJOIN_TIME_ID,
+    };
+    for(size_t i = 0; i < sizeof(diagnostics_attribute_ids) / sizeof(diagnostics_attribute_ids[0]); i++)
+    {
+        uint32_t counter = 0;
+        ESP_ERROR_CHECK(esp_zb_custom_cluster_add_custom_attr(esp_zb_diagnostics_cluster, diagnostics_attribute_ids[i], ESP_ZB_ZCL_ATTR_TYPE_U32, ESP_ZB_ZCL_ATTR_ACCESS_READ_ONLY, &counter));
+    }
+
+    /* === CREATE MANUFACTURER SPECIFIC CLUSTER (0xFC00) === */
+    esp_zb_attribute_list_t *esp_zb_manufacturer_cluster = esp_zb_zcl_attr_list_create(ZB_MANUFACTURER_CLUSTER_ID);
+
+    /* Add attribute DataStale (0x0000) */
+    ESP_ERROR_CHECK(esp_zb_custom_cluster_add_custom_attr(esp_zb_manufacturer_cluster, ZB_MANUFACTURER_ATTR_DATA_STALE_ID, ESP_ZB_ZCL_ATTR_TYPE_BOOL, ESP_ZB_ZCL_ATTR_ACCESS_READ_ONLY | ESP_ZB_ZCL_ATTR_ACCESS_REPORTING, &data_stale));
+
+    /* Add attribute BulkVersion (0x0001) */
+    uint8_t bulk_version = ZB_BULK_FORMAT_VERSION;
+    ESP_ERROR_CHECK(esp_zb_custom_cluster_add_custom_attr(esp_zb_manufacturer_cluster, ZB_MANUFACTURER_ATTR_BULK_VERSION_ID, ESP_ZB_ZCL_ATTR_TYPE_U8, ESP_ZB_ZCL_ATTR_ACCESS_READ_ONLY, &bulk_version));
+
+    /* Add attribute ReportingMode (0x0002) */
+    uint8_t reporting_mode = ZB_REPORTING_MODE_FULL;
+    ESP_ERROR_CHECK(esp_zb_custom_cluster_add_custom_attr(esp_zb_manufacturer_cluster, ZB_MANUFACTURER_ATTR_REPORTING_MODE_ID, ESP_ZB_ZCL_ATTR_TYPE_8BIT_ENUM, ESP_ZB_ZCL_ATTR_ACCESS_READ_ONLY | ESP_ZB_ZCL_ATTR_ACCESS_REPORTING, &reporting_mode));
+
+    /* Add attribute PowerQualityAlarms (0x0003) */
+    uint16_t power_quality_alarms = 0;
+    ESP_ERROR_CHECK(esp_zb_custom_cluster_add_custom_attr(esp_zb_manufacturer_cluster, ZB_MANUFACTURER_ATTR_POWER_QUALITY_ID, ESP_ZB_ZCL_ATTR_TYPE_16BITMAP, ESP_ZB_ZCL_ATTR_ACCESS_READ_ONLY | ESP_ZB_ZCL_ATTR_ACCESS_REPORTING, &power_quality_alarms));
+
+#if LATENCY_TRACE_ENABLED
+    /* Add attribute LatencyHistograms (0x0004), initial length reserves the maximum size, all zero (version 0) until first update */
+    static uint8_t latency_histograms[2 + ZB_MANUFACTURER_LATENCY_MAX_SIZE] = {ZB_MANUFACTURER_LATENCY_MAX_SIZE & 0xFF, ZB_MANUFACTURER_LATENCY_MAX_SIZE >> 8};
+    ESP_ERROR_CHECK(esp_zb_custom_cluster_add_custom_attr(esp_zb_manufacturer_cluster, ZB_MANUFACTURER_ATTR_LATENCY_ID, ESP_ZB_ZCL_ATTR_TYPE_LONG_OCTET_STRING, ESP_ZB_ZCL_ATTR_ACCESS_READ_ONLY, latency_histograms));
+#endif
+
+    /* Add attribute SystemStatus (0x0005), initial length reserves the maximum size */
+    static uint8_t system_status[2 + ZB_MANUFACTURER_SYSTEM_STATUS_MAX_SIZE] = {ZB_MANUFACTURER_SYSTEM_STATUS_MAX_SIZE & 0xFF, ZB_MANUFACTURER_SYSTEM_STATUS_MAX_SIZE >> 8};
+    ESP_ERROR_CHECK(esp_zb_custom_cluster_add_custom_attr(esp_zb_manufacturer_cluster, ZB_MANUFACTURER_ATTR_SYSTEM_STATUS_ID, ESP_ZB_ZCL_ATTR_TYPE_LONG_OCTET_STRING, ESP_ZB_ZCL_ATTR_ACCESS_READ_ONLY, system_status));
 
     /* === CREATE CLUSTER CLIENT ROLES === */
     esp_zb_attribute_list_t *esp_zb_identify_client_cluster = esp_zb_zcl_attr_list_create(ESP_ZB_ZCL_CLUSTER_ID_IDENTIFY);
@@ -252,6 +919,9 @@ void zb_electricity_meter_ep(esp_zb_ep_list_t *esp_zb_ep_list)
     ESP_ERROR_CHECK(esp_zb_cluster_list_add_basic_cluster(esp_zb_cluster_list, esp_zb_basic_cluster, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE));
     ESP_ERROR_CHECK(esp_zb_cluster_list_add_identify_cluster(esp_zb_cluster_list, esp_zb_identify_cluster, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE));
     ESP_ERROR_CHECK(esp_zb_cluster_list_add_electrical_meas_cluster(esp_zb_cluster_list, esp_zb_electrical_measurement_cluster, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE));
+    ESP_ERROR_CHECK(esp_zb_cluster_list_add_custom_cluster(esp_zb_cluster_list, esp_zb_metering_cluster, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE));
+    ESP_ERROR_CHECK(esp_zb_cluster_list_add_custom_cluster(esp_zb_cluster_list, esp_zb_diagnostics_cluster, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE));
+    ESP_ERROR_CHECK(esp_zb_cluster_list_add_custom_cluster(esp_zb_cluster_list, esp_zb_manufacturer_cluster, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE));
 
     /* Client clusters */
     ESP_ERROR_CHECK(esp_zb_cluster_list_add_identify_cluster(esp_zb_cluster_list, esp_zb_identify_client_cluster, ESP_ZB_ZCL_CLUSTER_CLIENT_ROLE));
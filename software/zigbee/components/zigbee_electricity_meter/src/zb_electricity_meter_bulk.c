@@ -0,0 +1,272 @@
+/**
+ * @file zb_electricity_meter_bulk.c
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <string.h>
+
+/* Header, encoding has no dependency on the zigbee stack and is also used by host tools */
+#include "zb_electricity_meter_bulk.h"
+#include "zb_varint.h"
+
+/* Common OBIS code of electricity registers, only C and D differ */
+static const uint8_t short_code_prefix[2] = {0x01, 0x00};
+static const uint8_t short_code_suffix[2] = {0x00, 0xFF};
+
+/* ===== HELPER FUNCTIONS ===== */
+static bool is_short_code(const uint8_t *obis_code)
+{
+    return (memcmp(&obis_code[0], short_code_prefix, 2) == 0) && (memcmp(&obis_code[4], short_code_suffix, 2) == 0);
+}
+
+static size_t put_le(uint32_t value, size_t size, uint8_t *buffer)
+{
+    for(size_t i = 0; i < size; i++)
+    {
+        buffer[i] = (uint8_t)(value >> (8 * i));
+    }
+    return size;
+}
+
+static uint32_t get_le(const uint8_t *buffer, size_t size)
+{
+    uint32_t value = 0;
+    for(size_t i = 0; i < size; i++)
+    {
+        value |= (uint32_t)buffer[i] << (8 * i);
+    }
+    return value;
+}
+
+/* Fields of history entry in order of encoding */
+static void history_fields(const zb_history_entry_t *entry, int64_t *fields)
+{
+    fields[0] = entry->time;
+    fields[1] = entry->summation_delivered;
+    fields[2] = entry->summation_received;
+    fields[3] = entry->total_active_power;
+    for(int i = 0; i < 3; i++)
+    {
+        fields[4 + i] = entry->rms_voltage[i];
+        fields[7 + i] = entry->rms_current[i];
+    }
+}
+
+/* ===== ENCODING ===== */
+size_t zb_bulk_encode(const zb_bulk_snapshot_t *snapshot, uint8_t *buffer, size_t buffer_size)
+{
+    size_t offset = 0;
+
+    /* Header */
+    size_t header_size = 2 + ZB_BULK_TIMESTAMP_LENGTH + 1 + snapshot->serial_number_length;
+    if(snapshot->register_count > ZB_BULK_MAX_REGISTERS || snapshot->serial_number_length > ZB_BULK_SERIAL_NUMBER_MAX_LENGTH || header_size > buffer_size)
+    {
+        return 0;
+    }
+    buffer[offset++] = ZB_BULK_FORMAT_VERSION;
+    buffer[offset++] = snapshot->register_count;
+    memcpy(&buffer[offset], snapshot->timestamp, ZB_BULK_TIMESTAMP_LENGTH);
+    offset += ZB_BULK_TIMESTAMP_LENGTH;
+    buffer[offset++] = snapshot->serial_number_length;
+    memcpy(&buffer[offset], snapshot->serial_number, snapshot->serial_number_length);
+    offset += snapshot->serial_number_length;
+
+    /* Registers */
+    for(uint8_t i = 0; i < snapshot->register_count; i++)
+    {
+        const zb_bulk_register_t *reg = &snapshot->registers[i];
+        bool short_code = is_short_code(reg->obis_code);
+        size_t code_size = short_code ? 2 : 6;
+
+        if(offset + 1 + code_size + 2 > buffer_size){ return 0; }
+
+        buffer[offset++] = short_code ? ZB_BULK_FLAG_SHORT_CODE : 0;
+        memcpy(&buffer[offset], short_code ? &reg->obis_code[2] : &reg->obis_code[0], code_size);
+        offset += code_size;
+        buffer[offset++] = (uint8_t)reg->scaler;
+        buffer[offset++] = reg->unit;
+
+        size_t value_size = zb_varint_put(reg->value, &buffer[offset], buffer_size - offset);
+        if(value_size == 0){ return 0; }
+        offset += value_size;
+    }
+
+    return offset;
+}
+
+esp_err_t zb_bulk_decode(const uint8_t *buffer, size_t buffer_size, zb_bulk_snapshot_t *snapshot)
+{
+    size_t offset = 0;
+
+    /* Header */
+    if(buffer_size < 2 + ZB_BULK_TIMESTAMP_LENGTH + 1){ return ESP_ERR_INVALID_SIZE; }
+    if(buffer[offset++] != ZB_BULK_FORMAT_VERSION){ return ESP_ERR_NOT_SUPPORTED; }
+
+    snapshot->register_count = buffer[offset++];
+    if(snapshot->register_count > ZB_BULK_MAX_REGISTERS){ return ESP_ERR_INVALID_SIZE; }
+
+    memcpy(snapshot->timestamp, &buffer[offset], ZB_BULK_TIMESTAMP_LENGTH);
+    offset += ZB_BULK_TIMESTAMP_LENGTH;
+
+    snapshot->serial_number_length = buffer[offset++];
+    if(snapshot->serial_number_length > ZB_BULK_SERIAL_NUMBER_MAX_LENGTH || offset + snapshot->serial_number_length > buffer_size)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(snapshot->serial_number, &buffer[offset], snapshot->serial_number_length);
+    offset += snapshot->serial_number_length;
+
+    /* Registers */
+    for(uint8_t i = 0; i < snapshot->register_count; i++)
+    {
+        zb_bulk_register_t *reg = &snapshot->registers[i];
+
+        if(offset >= buffer_size){ return ESP_ERR_INVALID_SIZE; }
+        bool short_code = (buffer[offset++] & ZB_BULK_FLAG_SHORT_CODE) != 0;
+        size_t code_size = short_code ? 2 : 6;
+
+        if(offset + code_size + 2 > buffer_size){ return ESP_ERR_INVALID_SIZE; }
+        if(short_code)
+        {
+            memcpy(&reg->obis_code[0], short_code_prefix, 2);
+            memcpy(&reg->obis_code[2], &buffer[offset], 2);
+            memcpy(&reg->obis_code[4], short_code_suffix, 2);
+        }
+        else
+        {
+            memcpy(&reg->obis_code[0], &buffer[offset], 6);
+        }
+        offset += code_size;
+        reg->scaler = (int8_t)buffer[offset++];
+        reg->unit = buffer[offset++];
+
+        size_t value_size = zb_varint_get(&buffer[offset], buffer_size - offset, &reg->value);
+        if(value_size == 0){ return ESP_ERR_INVALID_SIZE; }
+        offset += value_size;
+    }
+
+    return ESP_OK;
+}
+
+size_t zb_history_encode(const zb_history_entry_t *entries, uint8_t count, uint8_t *buffer, size_t buffer_size)
+{
+    int64_t previous[10] = {0};
+    int64_t fields[10];
+    size_t offset = 0;
+
+    if(count > ZB_HISTORY_MAX_ENTRIES || buffer_size < 2){ return 0; }
+    buffer[offset++] = ZB_HISTORY_FORMAT_VERSION;
+    buffer[offset++] = count;
+
+    /* Consecutive measurements differ little, differences mostly fit into one or two bytes */
+    for(uint8_t i = 0; i < count; i++)
+    {
+        history_fields(&entries[i], fields);
+        for(int j = 0; j < 10; j++)
+        {
+            size_t size = zb_varint_put(fields[j] - previous[j], &buffer[offset], buffer_size - offset);
+            if(size == 0){ return 0; }
+            offset += size;
+            previous[j] = fields[j];
+        }
+    }
+
+    return offset;
+}
+
+esp_err_t zb_history_decode(const uint8_t *buffer, size_t buffer_size, zb_history_entry_t *entries, uint8_t *count)
+{
+    int64_t fields[10] = {0};
+    size_t offset = 0;
+
+    if(buffer_size < 2){ return ESP_ERR_INVALID_SIZE; }
+    if(buffer[offset++] != ZB_HISTORY_FORMAT_VERSION){ return ESP_ERR_NOT_SUPPORTED; }
+
+    *count = buffer[offset++];
+    if(*count > ZB_HISTORY_MAX_ENTRIES){ return ESP_ERR_INVALID_SIZE; }
+
+    for(uint8_t i = 0; i < *count; i++)
+    {
+        for(int j = 0; j < 10; j++)
+        {
+            int64_t difference = 0;
+            size_t size = zb_varint_get(&buffer[offset], buffer_size - offset, &difference);
+            if(size == 0){ return ESP_ERR_INVALID_SIZE; }
+            offset += size;
+            fields[j] += difference;
+        }
+
+        zb_history_entry_t *entry = &entries[i];
+        entry->time = (uint32_t)fields[0];
+        entry->summation_delivered = (uint32_t)fields[1];
+        entry->summation_received = (uint32_t)fields[2];
+        entry->total_active_power = (int32_t)fields[3];
+        for(int j = 0; j < 3; j++)
+        {
+            entry->rms_voltage[j] = (uint16_t)fields[4 + j];
+            entry->rms_current[j] = (uint16_t)fields[7 + j];
+        }
+    }
+
+    return ESP_OK;
+}
+
+size_t zb_aggregate_encode(const zb_aggregate_window_t *window, uint8_t *buffer, size_t buffer_size)
+{
+    size_t offset = 0;
+    if(buffer_size < ZB_AGGREGATE_PAYLOAD_SIZE){ return 0; }
+
+    buffer[offset++] = ZB_AGGREGATE_FORMAT_VERSION;
+    offset += put_le(window->start_time, 4, &buffer[offset]);
+    offset += put_le(window->duration, 2, &buffer[offset]);
+    offset += put_le(window->sample_count, 2, &buffer[offset]);
+    buffer[offset++] = window->tariff;
+    offset += put_le(window->demand_delivered, 4, &buffer[offset]);
+    offset += put_le(window->demand_received, 4, &buffer[offset]);
+    offset += put_le((uint32_t)window->average_power, 4, &buffer[offset]);
+    for(int i = 0; i < 3; i++)
+    {
+        offset += put_le(window->voltage_min[i], 2, &buffer[offset]);
+        offset += put_le(window->voltage_mean[i], 2, &buffer[offset]);
+        offset += put_le(window->voltage_max[i], 2, &buffer[offset]);
+    }
+    for(int i = 0; i < 3; i++)
+    {
+        offset += put_le(window->current_min[i], 2, &buffer[offset]);
+        offset += put_le(window->current_mean[i], 2, &buffer[offset]);
+        offset += put_le(window->current_max[i], 2, &buffer[offset]);
+    }
+
+    return offset;
+}
+
+esp_err_t zb_aggregate_decode(const uint8_t *buffer, size_t buffer_size, zb_aggregate_window_t *window)
+{
+    size_t offset = 0;
+    if(buffer_size < ZB_AGGREGATE_PAYLOAD_SIZE){ return ESP_ERR_INVALID_SIZE; }
+    if(buffer[offset++] != ZB_AGGREGATE_FORMAT_VERSION){ return ESP_ERR_NOT_SUPPORTED; }
+
+    window->start_time = get_le(&buffer[offset], 4); offset += 4;
+    window->duration = (uint16_t)get_le(&buffer[offset], 2); offset += 2;
+    window->sample_count = (uint16_t)get_le(&buffer[offset], 2); offset += 2;
+    window->tariff = buffer[offset++];
+    window->demand_delivered = get_le(&buffer[offset], 4); offset += 4;
+    window->demand_received = get_le(&buffer[offset], 4); offset += 4;
+    window->average_power = (int32_t)get_le(&buffer[offset], 4); offset += 4;
+    for(int i = 0; i < 3; i++)
+    {
+        window->voltage_min[i] = (uint16_t)get_le(&buffer[offset], 2); offset += 2;
+        window->voltage_mean[i] = (uint16_t)get_le(&buffer[offset], 2); offset += 2;
+        window->voltage_max[i] = (uint16_t)get_le(&buffer[offset], 2); offset += 2;
+    }
+    for(int i = 0; i < 3; i++)
+    {
+        window->current_min[i] = (uint16_t)get_le(&buffer[offset], 2); offset += 2;
+        window->current_mean[i] = (uint16_t)get_le(&buffer[offset], 2); offset += 2;
+        window->current_max[i] = (uint16_t)get_le(&buffer[offset], 2); offset += 2;
+    }
+
+    return ESP_OK;
+}
@@ -0,0 +1,205 @@
+/**
+ * @file zb_electricity_meter_reporter.c
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+/* Setup logging */
+#include "esp_log.h"
+static const char* TAG = "zb_reporter";
+
+/* Header */
+#include "zb_electricity_meter_endpoint.h"
+#include "zb_electricity_meter_update.h"
+#include "zb_electricity_meter_reporter.h"
+
+/* Current reporting mode */
+static zb_reporting_mode_t reporting_mode = ZB_REPORTING_MODE_FULL;
+
+/* APS confirms of sent commands since last evaluation, and failed ones of them */
+static uint32_t link_confirms = 0;
+static uint32_t link_failures = 0;
+
+/* Consecutive good evaluations in reduced mode */
+static uint32_t good_intervals = 0;
+
+/* Periodic evaluation is running */
+static bool evaluation_started = false;
+
+/* Sums of measurements since last report in reduced mode */
+static struct {
+    int64_t total_active_power;
+    uint32_t rms_voltage[3];
+    uint32_t rms_current[3];
+    uint32_t count;
+} aggregate;
+
+/* Bulk snapshots submitted since last one sent in reduced mode */
+static uint32_t bulk_skipped = 0;
+
+/* ===== HELPER FUNCTIONS ===== */
+static bool get_parent_link(uint8_t *lqi, int8_t *rssi)
+{
+    esp_zb_nwk_info_iterator_t iterator = ESP_ZB_NWK_INFO_ITERATOR_INIT;
+    esp_zb_nwk_neighbor_info_t neighbor;
+    bool found = false;
+
+    /* Use parent, or best neighbor if parent is not in table anymore */
+    while(esp_zb_nwk_get_next_neighbor(&iterator, &neighbor) == ESP_OK)
+    {
+        if(neighbor.relationship == ESP_ZB_NWK_RELATIONSHIP_PARENT)
+        {
+            *lqi = neighbor.lqi;
+            *rssi = neighbor.rssi;
+            return true;
+        }
+        if(!found || neighbor.lqi > *lqi)
+        {
+            *lqi = neighbor.lqi;
+            *rssi = neighbor.rssi;
+            found = true;
+        }
+    }
+    return found;
+}
+
+static void set_mode(zb_reporting_mode_t mode)
+{
+    if(mode == reporting_mode){ return; }
+
+    reporting_mode = mode;
+    memset(&aggregate, 0, sizeof(aggregate));
+    bulk_skipped = 0;
+    ESP_LOGI(TAG, "Reporting mode: %s", mode == ZB_REPORTING_MODE_FULL ? "full" : "reduced");
+
+    /* Update and report attribute */
+    zb_update_reporting_mode((uint8_t)mode);
+}
+
+static void evaluate_link_cb(uint8_t param)
+{
+    uint8_t lqi = 0;
+    int8_t rssi = 0;
+    bool has_link = get_parent_link(&lqi, &rssi);
+
+    /* Read and reset confirm counters */
+    uint32_t confirms = link_confirms;
+    uint32_t failures = link_failures;
+    link_confirms = 0;
+    link_failures = 0;
+
+    /* Failure ratio only counts with enough confirms in the interval */
+    bool lossy = confirms >= LINK_MIN_CONFIRMS && failures * 100 >= confirms * LINK_DEGRADED_FAILURE_PERCENT;
+
+    bool degraded = !has_link || lqi <= LINK_DEGRADED_LQI || rssi <= LINK_DEGRADED_RSSI || lossy;
+    bool recovered = has_link && lqi > LINK_RECOVERED_LQI && rssi > LINK_RECOVERED_RSSI && failures == 0;
+
+    ESP_LOGD(TAG, "Link LQI: %d, RSSI: %d dBm, failed confirms: %lu/%lu", lqi, rssi, (unsigned long)failures, (unsigned long)confirms);
+
+    if(reporting_mode == ZB_REPORTING_MODE_FULL && degraded)
+    {
+        set_mode(ZB_REPORTING_MODE_REDUCED);
+        good_intervals = 0;
+    }
+    else if(reporting_mode == ZB_REPORTING_MODE_REDUCED)
+    {
+        /* Hysteresis, link must be good for several intervals */
+        good_intervals = recovered ? good_intervals + 1 : 0;
+        if(good_intervals >= LINK_RECOVERED_INTERVALS)
+        {
+            set_mode(ZB_REPORTING_MODE_FULL);
+        }
+    }
+
+    /* Evaluate again */
+    esp_zb_scheduler_alarm((esp_zb_callback_t)evaluate_link_cb, 0, LINK_EVALUATE_INTERVAL_MS);
+}
+
+static esp_err_t report(const zb_electricity_meter_snapshot_t *values)
+{
+    esp_err_t err = ESP_OK;
+
+    /* Send all values, delivery is counted by zb_reporter_send_status */
+    if(zb_update_total_active_power(values->total_active_power) != ESP_OK){ err = ESP_FAIL; }
+    for(phase_t phase = PhaseA; phase <= PhaseC; phase++)
+    {
+        if(zb_update_voltage(phase, values->rms_voltage[phase]) != ESP_OK){ err = ESP_FAIL; }
+        if(zb_update_current(phase, values->rms_current[phase]) != ESP_OK){ err = ESP_FAIL; }
+    }
+    if(zb_update_energy(values->summation_delivered, values->summation_received) != ESP_OK){ err = ESP_FAIL; }
+
+    /* All values of the telegram are in the attribute table */
+    zb_update_complete();
+    return err;
+}
+
+/* ===== REPORTER FUNCTIONS ===== */
+esp_err_t zb_reporter_submit(const zb_electricity_meter_snapshot_t *measurement)
+{
+    if(reporting_mode == ZB_REPORTING_MODE_FULL)
+    {
+        return report(measurement);
+    }
+
+    /* Reduced mode, sum up values */
+    aggregate.total_active_power += measurement->total_active_power;
+    for(int i = 0; i < 3; i++)
+    {
+        aggregate.rms_voltage[i] += measurement->rms_voltage[i];
+        aggregate.rms_current[i] += measurement->rms_current[i];
+    }
+    aggregate.count++;
+
+    if(aggregate.count < LINK_REDUCED_RATE_DIVISOR)
+    {
+        return ESP_OK;
+    }
+
+    /* Report averages, energy is a counter and latest value is used */
+    zb_electricity_meter_snapshot_t average = *measurement;
+    average.total_active_power = (int32_t)(aggregate.total_active_power / aggregate.count);
+    for(int i = 0; i < 3; i++)
+    {
+        average.rms_voltage[i] = (uint16_t)(aggregate.rms_voltage[i] / aggregate.count);
+        average.rms_current[i] = (uint16_t)(aggregate.rms_current[i] / aggregate.count);
+    }
+    memset(&aggregate, 0, sizeof(aggregate));
+
+    return report(&average);
+}
+
+esp_err_t zb_reporter_submit_bulk(const zb_bulk_snapshot_t *bulk)
+{
+    /* Fragmented command costs more than the reports, same rate as them */
+    if(reporting_mode == ZB_REPORTING_MODE_REDUCED && ++bulk_skipped < LINK_REDUCED_RATE_DIVISOR)
+    {
+        return ESP_OK;
+    }
+    bulk_skipped = 0;
+
+    return zb_send_bulk_snapshot(bulk);
+}
+
+void zb_reporter_start()
+{
+    /* Only one evaluation alarm may be scheduled */
+    if(evaluation_started){ return; }
+    evaluation_started = true;
+
+    esp_zb_scheduler_alarm((esp_zb_callback_t)evaluate_link_cb, 0, LINK_EVALUATE_INTERVAL_MS);
+}
+
+void zb_reporter_send_status(esp_err_t status)
+{
+    link_confirms++;
+    if(status != ESP_OK){ link_failures++; }
+}
+
+zb_reporting_mode_t zb_reporter_get_mode()
+{
+    return reporting_mode;
+}
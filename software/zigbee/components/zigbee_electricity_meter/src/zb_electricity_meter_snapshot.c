@@ -0,0 +1,121 @@
+/**
+ * @file zb_electricity_meter_snapshot.c
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+/* Setup logging */
+#include "esp_log.h"
+static const char* TAG = "zb_snapshot";
+
+/* Header */
+#include "zb_electricity_meter_snapshot.h"
+
+/* System libraries */
+#include "esp_timer.h"
+#include "nvs.h"
+
+/* Time of last write to flash, 0 if not written since boot */
+static int64_t last_store_time_us = 0;
+
+/* Last written snapshot, to skip writing unchanged values */
+static zb_electricity_meter_snapshot_t last_stored;
+
+/* Values recorded at last power fail */
+static zb_electricity_meter_snapshot_t restored;
+static bool has_restored = false;
+
+/* ===== HELPER FUNCTIONS ===== */
+static bool use_restored(zb_electricity_meter_snapshot_t *snapshot, const zb_electricity_meter_snapshot_t *stored)
+{
+    if(!has_restored){ return false; }
+
+    /* Energy counters only increase, record of an earlier power fail is older than the stored snapshot */
+    if(stored != NULL && (restored.summation_delivered < stored->summation_delivered || restored.summation_received < stored->summation_received))
+    {
+        ESP_LOGI(TAG, "Power fail record is older than stored snapshot");
+        return false;
+    }
+
+    *snapshot = restored;
+    ESP_LOGI(TAG, "Loaded power fail record");
+    return true;
+}
+
+/* ===== SNAPSHOT FUNCTIONS ===== */
+void zb_snapshot_restore(const zb_electricity_meter_snapshot_t *snapshot)
+{
+    restored = *snapshot;
+    has_restored = true;
+}
+
+bool zb_snapshot_load(zb_electricity_meter_snapshot_t *snapshot)
+{
+    nvs_handle_t handle;
+    if(nvs_open(SNAPSHOT_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK)
+    {
+        ESP_LOGI(TAG, "No stored snapshot");
+        return use_restored(snapshot, NULL);
+    }
+
+    /* Read into temporary, so snapshot stays unchanged on error */
+    zb_electricity_meter_snapshot_t stored;
+    size_t size = sizeof(zb_electricity_meter_snapshot_t);
+    esp_err_t err = nvs_get_blob(handle, SNAPSHOT_NVS_KEY, &stored, &size);
+    nvs_close(handle);
+
+    /* Size differs if structure changed with a firmware update */
+    if(err != ESP_OK || size != sizeof(zb_electricity_meter_snapshot_t))
+    {
+        ESP_LOGI(TAG, "No valid stored snapshot");
+        return use_restored(snapshot, NULL);
+    }
+
+    last_stored = stored;
+    if(use_restored(snapshot, &stored)){ return true; }
+
+    *snapshot = stored;
+    ESP_LOGI(TAG, "Loaded stored snapshot");
+    return true;
+}
+
+esp_err_t zb_snapshot_store(const zb_electricity_meter_snapshot_t *snapshot)
+{
+    /* Limit number of writes */
+    int64_t now = esp_timer_get_time();
+    if(last_store_time_us != 0 && (now - last_store_time_us) < (SNAPSHOT_STORE_INTERVAL_S * 1000000LL))
+    {
+        return ESP_OK;
+    }
+
+    /* Skip unchanged values */
+    if(memcmp(snapshot, &last_stored, sizeof(zb_electricity_meter_snapshot_t)) == 0)
+    {
+        return ESP_OK;
+    }
+
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(SNAPSHOT_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if(err != ESP_OK){ return err; }
+
+    err = nvs_set_blob(handle, SNAPSHOT_NVS_KEY, snapshot, sizeof(zb_electricity_meter_snapshot_t));
+    if(err == ESP_OK)
+    {
+        err = nvs_commit(handle);
+    }
+    nvs_close(handle);
+
+    if(err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Storing snapshot failed!");
+        return err;
+    }
+
+    last_store_time_us = now;
+    last_stored = *snapshot;
+    return ESP_OK;
+}
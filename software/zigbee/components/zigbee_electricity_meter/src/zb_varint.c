@@ -0,0 +1,48 @@
+/**
+ * @file zb_varint.c
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+/* Header */
+#include "zb_varint.h"
+
+/* ===== VARINT FUNCTIONS ===== */
+size_t zb_varint_put(int64_t value, uint8_t *buffer, size_t buffer_size)
+{
+    /* Zig-zag encoding, small negative values get small positive values */
+    uint64_t zigzag = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+
+    size_t size = 0;
+    do
+    {
+        if(size >= buffer_size){ return 0; }
+
+        /* 7 bits per byte, highest bit indicates following byte */
+        buffer[size] = (uint8_t)(zigzag & 0x7F);
+        zigzag >>= 7;
+        if(zigzag != 0)
+        {
+            buffer[size] |= 0x80;
+        }
+        size++;
+    } while(zigzag != 0);
+
+    return size;
+}
+
+size_t zb_varint_get(const uint8_t *buffer, size_t buffer_size, int64_t *value)
+{
+    uint64_t zigzag = 0;
+    for(size_t i = 0; i < buffer_size && i < ZB_VARINT_MAX_SIZE; i++)
+    {
+        zigzag |= (uint64_t)(buffer[i] & 0x7F) << (7 * i);
+        if((buffer[i] & 0x80) == 0)
+        {
+            *value = (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+            return i + 1;
+        }
+    }
+    return 0;
+}